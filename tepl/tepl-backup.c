@@ -0,0 +1,266 @@
+/* SPDX-FileCopyrightText: 2020 - Sébastien Wilmet <swilmet@gnome.org>
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "tepl-backup.h"
+#include <errno.h>
+#include <glib/gstdio.h>
+
+#if defined (__linux__)
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <linux/fs.h>
+#endif
+
+#if defined (__linux__) && defined (FICLONE)
+#define HAVE_REFLINK 1
+#else
+#define HAVE_REFLINK 0
+#endif
+
+/* Creation of the backup file when saving, with the cheapest strategy
+ * available:
+ *
+ * - Reflink: the backup is a copy-on-write clone of the original file
+ *   (FICLONE, on Btrfs or XFS for example). No data is written, and the
+ *   original file is then replaced or overwritten normally.
+ *
+ * - Rename: g_file_replace() creates the backup itself. For a local file
+ *   written to a temporary file, the original file becomes the backup with a
+ *   hard link or a rename, so no data is copied either. But when GLib needs to
+ *   overwrite the original file in place (for example if it has several hard
+ *   links), and for remote files, the backup is created by copying.
+ *
+ * - Copy: the original file is copied with g_file_copy() before being
+ *   replaced.
+ *
+ * The default strategy tries a reflink, and falls back to the rename strategy.
+ * The backup location is the same as with g_file_replace(), the filename
+ * followed by "~".
+ */
+
+static gchar *
+get_backup_path (const gchar *path)
+{
+	return g_strconcat (path, "~", NULL);
+}
+
+#if HAVE_REFLINK
+/* Returns %FALSE with G_IO_ERROR_NOT_SUPPORTED if the filesystem doesn't
+ * support reflinks.
+ */
+static gboolean
+create_reflink (const gchar  *path,
+		const gchar  *backup_path,
+		GError      **error)
+{
+	gint src_fd;
+	gint backup_fd;
+	struct stat src_stat;
+	gchar *tmp_path;
+	gint saved_errno;
+
+	src_fd = open (path, O_RDONLY | O_CLOEXEC);
+	if (src_fd == -1)
+	{
+		saved_errno = errno;
+
+		/* Nothing to backup. */
+		if (saved_errno == ENOENT)
+		{
+			return TRUE;
+		}
+
+		g_set_error_literal (error,
+				     G_IO_ERROR,
+				     g_io_error_from_errno (saved_errno),
+				     g_strerror (saved_errno));
+		return FALSE;
+	}
+
+	if (fstat (src_fd, &src_stat) != 0 ||
+	    !S_ISREG (src_stat.st_mode))
+	{
+		close (src_fd);
+		g_set_error_literal (error,
+				     G_IO_ERROR,
+				     G_IO_ERROR_NOT_SUPPORTED,
+				     "Not a regular file");
+		return FALSE;
+	}
+
+	/* The backup is replaced atomically, an existing backup is kept if the
+	 * reflink fails.
+	 */
+	tmp_path = g_strconcat (backup_path, ".XXXXXX", NULL);
+	backup_fd = g_mkstemp_full (tmp_path, O_WRONLY | O_CLOEXEC, src_stat.st_mode & 0777);
+	if (backup_fd == -1)
+	{
+		saved_errno = errno;
+		close (src_fd);
+		g_free (tmp_path);
+
+		g_set_error_literal (error,
+				     G_IO_ERROR,
+				     g_io_error_from_errno (saved_errno),
+				     g_strerror (saved_errno));
+		return FALSE;
+	}
+
+	if (ioctl (backup_fd, FICLONE, src_fd) != 0)
+	{
+		saved_errno = errno;
+		close (src_fd);
+		close (backup_fd);
+		g_unlink (tmp_path);
+		g_free (tmp_path);
+
+		/* EOPNOTSUPP, EXDEV, EINVAL, ENOTTY: not supported by the
+		 * filesystem.
+		 */
+		g_set_error_literal (error,
+				     G_IO_ERROR,
+				     G_IO_ERROR_NOT_SUPPORTED,
+				     g_strerror (saved_errno));
+		return FALSE;
+	}
+
+	close (src_fd);
+
+	if (close (backup_fd) != 0 ||
+	    g_rename (tmp_path, backup_path) != 0)
+	{
+		saved_errno = errno;
+		g_unlink (tmp_path);
+		g_free (tmp_path);
+
+		g_set_error_literal (error,
+				     G_IO_ERROR,
+				     g_io_error_from_errno (saved_errno),
+				     g_strerror (saved_errno));
+		return FALSE;
+	}
+
+	g_free (tmp_path);
+	return TRUE;
+}
+#endif /* HAVE_REFLINK */
+
+static gboolean
+create_copy (GFile         *location,
+	     const gchar   *backup_path,
+	     GCancellable  *cancellable,
+	     GError       **error)
+{
+	GFile *backup_location;
+	GError *my_error = NULL;
+
+	backup_location = g_file_new_for_path (backup_path);
+
+	g_file_copy (location,
+		     backup_location,
+		     G_FILE_COPY_OVERWRITE | G_FILE_COPY_ALL_METADATA,
+		     cancellable,
+		     NULL, NULL,
+		     &my_error);
+
+	g_object_unref (backup_location);
+
+	/* Nothing to backup. */
+	if (g_error_matches (my_error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+	{
+		g_clear_error (&my_error);
+	}
+
+	if (my_error != NULL)
+	{
+		g_propagate_error (error, my_error);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* Creates the backup of @location, before it is replaced. Runs in the saver
+ * worker thread.
+ *
+ * *@replace_makes_backup is set to whether the make_backup parameter of
+ * g_file_replace() must be %TRUE, in which case the backup is created by
+ * g_file_replace().
+ */
+gboolean
+_tepl_backup_prepare (GFile               *location,
+		      TeplBackupStrategy   strategy,
+		      gboolean            *replace_makes_backup,
+		      GCancellable        *cancellable,
+		      GError             **error)
+{
+	gchar *path;
+	gchar *backup_path;
+	gboolean ok = TRUE;
+
+	g_return_val_if_fail (G_IS_FILE (location), FALSE);
+	g_return_val_if_fail (replace_makes_backup != NULL, FALSE);
+
+	*replace_makes_backup = FALSE;
+
+	path = g_file_get_path (location);
+
+	if (path == NULL || strategy == TEPL_BACKUP_STRATEGY_RENAME)
+	{
+		if (strategy == TEPL_BACKUP_STRATEGY_REFLINK)
+		{
+			g_set_error_literal (error,
+					     G_IO_ERROR,
+					     G_IO_ERROR_NOT_SUPPORTED,
+					     "Reflinks are supported only for local files");
+			ok = FALSE;
+		}
+
+		*replace_makes_backup = TRUE;
+		g_free (path);
+		return ok;
+	}
+
+	backup_path = get_backup_path (path);
+
+	switch (strategy)
+	{
+		case TEPL_BACKUP_STRATEGY_AUTO:
+#if HAVE_REFLINK
+			if (!create_reflink (path, backup_path, NULL))
+			{
+				*replace_makes_backup = TRUE;
+			}
+#else
+			*replace_makes_backup = TRUE;
+#endif
+			break;
+
+		case TEPL_BACKUP_STRATEGY_REFLINK:
+#if HAVE_REFLINK
+			ok = create_reflink (path, backup_path, error);
+#else
+			g_set_error_literal (error,
+					     G_IO_ERROR,
+					     G_IO_ERROR_NOT_SUPPORTED,
+					     "Reflinks are not supported on this platform");
+			ok = FALSE;
+#endif
+			break;
+
+		case TEPL_BACKUP_STRATEGY_COPY:
+			ok = create_copy (location, backup_path, cancellable, error);
+			break;
+
+		case TEPL_BACKUP_STRATEGY_RENAME:
+		default:
+			g_assert_not_reached ();
+	}
+
+	g_free (path);
+	g_free (backup_path);
+	return ok;
+}
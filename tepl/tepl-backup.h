@@ -0,0 +1,35 @@
+/* SPDX-FileCopyrightText: 2020 - Sébastien Wilmet <swilmet@gnome.org>
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef TEPL_BACKUP_H
+#define TEPL_BACKUP_H
+
+#include <gio/gio.h>
+#include "tepl-file-saver.h"
+
+G_BEGIN_DECLS
+
+typedef enum _TeplBackupStrategy
+{
+	TEPL_BACKUP_STRATEGY_AUTO,
+	TEPL_BACKUP_STRATEGY_REFLINK,
+	TEPL_BACKUP_STRATEGY_RENAME,
+	TEPL_BACKUP_STRATEGY_COPY
+} TeplBackupStrategy;
+
+G_GNUC_INTERNAL
+gboolean	_tepl_backup_prepare			(GFile               *location,
+							 TeplBackupStrategy   strategy,
+							 gboolean            *replace_makes_backup,
+							 GCancellable        *cancellable,
+							 GError             **error);
+
+/* Defined in tepl-file-saver.c. */
+G_GNUC_INTERNAL
+void		_tepl_file_saver_set_backup_strategy	(TeplFileSaver      *saver,
+							 TeplBackupStrategy  strategy);
+
+G_END_DECLS
+
+#endif /* TEPL_BACKUP_H */
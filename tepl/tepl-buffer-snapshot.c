@@ -0,0 +1,374 @@
+/* SPDX-FileCopyrightText: 2020 - Sébastien Wilmet <swilmet@gnome.org>
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "tepl-buffer-snapshot.h"
+#include "tepl-rope.h"
+
+/**
+ * SECTION:buffer-snapshot
+ * @Title: TeplBufferSnapshot
+ * @Short_description: A read-only copy of the text of a TeplBuffer
+ *
+ * #GtkTextBuffer and #GtkTextIter can be used only on the main thread. A
+ * #TeplBufferSnapshot is a read-only copy of the text of a #TeplBuffer at one
+ * point in time, that can be read from any thread, for example to search, to
+ * count words or to lint the text in a worker thread while the user continues
+ * to edit the buffer.
+ *
+ * Taking a snapshot is cheap: the text is not copied. #TeplBuffer keeps its
+ * text in immutable chunks, and a snapshot shares them with the buffer. When
+ * the buffer is edited afterwards, only the edited chunks are replaced in the
+ * buffer, the snapshot keeps the previous ones.
+ *
+ * The text is in UTF-8. The pixbufs and child anchors are the U+FFFC
+ * character. The text can be read chunk by chunk with
+ * tepl_buffer_snapshot_get_n_chunks() and tepl_buffer_snapshot_get_chunk(),
+ * or by character offsets with tepl_buffer_snapshot_get_char() and
+ * tepl_buffer_snapshot_get_slice().
+ *
+ * A #TeplBufferSnapshot is immutable, so all its functions can be called from
+ * any thread, except tepl_buffer_snapshot_new() and
+ * tepl_buffer_snapshot_is_current() which need the #TeplBuffer.
+ */
+
+struct _TeplBufferSnapshot
+{
+	gint ref_count;
+	TeplRope *rope;
+
+	/* The character offsets of the start of each chunk, plus the number
+	 * of characters, to find a chunk by binary search. Computed on first
+	 * use, possibly in another thread.
+	 */
+	guint64 *chunk_starts;
+};
+
+G_DEFINE_BOXED_TYPE (TeplBufferSnapshot, tepl_buffer_snapshot,
+		     tepl_buffer_snapshot_ref,
+		     tepl_buffer_snapshot_unref)
+
+/**
+ * tepl_buffer_snapshot_new:
+ * @buffer: a #TeplBuffer.
+ *
+ * Must be called from the main thread.
+ *
+ * Returns: (transfer full): a new #TeplBufferSnapshot of the current text of
+ *   @buffer.
+ * Since: 6.0
+ */
+TeplBufferSnapshot *
+tepl_buffer_snapshot_new (TeplBuffer *buffer)
+{
+	TeplBufferSnapshot *snapshot;
+
+	g_return_val_if_fail (TEPL_IS_BUFFER (buffer), NULL);
+
+	snapshot = g_new0 (TeplBufferSnapshot, 1);
+	snapshot->ref_count = 1;
+	snapshot->rope = _tepl_rope_ref (_tepl_buffer_get_rope (buffer));
+
+	return snapshot;
+}
+
+/**
+ * tepl_buffer_snapshot_ref:
+ * @snapshot: a #TeplBufferSnapshot.
+ *
+ * Returns: (transfer full): @snapshot.
+ * Since: 6.0
+ */
+TeplBufferSnapshot *
+tepl_buffer_snapshot_ref (TeplBufferSnapshot *snapshot)
+{
+	g_return_val_if_fail (snapshot != NULL, NULL);
+
+	g_atomic_int_inc (&snapshot->ref_count);
+	return snapshot;
+}
+
+/**
+ * tepl_buffer_snapshot_unref:
+ * @snapshot: a #TeplBufferSnapshot.
+ *
+ * Since: 6.0
+ */
+void
+tepl_buffer_snapshot_unref (TeplBufferSnapshot *snapshot)
+{
+	g_return_if_fail (snapshot != NULL);
+
+	if (g_atomic_int_dec_and_test (&snapshot->ref_count))
+	{
+		_tepl_rope_unref (snapshot->rope);
+		g_free (snapshot->chunk_starts);
+		g_free (snapshot);
+	}
+}
+
+/**
+ * tepl_buffer_snapshot_is_current:
+ * @snapshot: a #TeplBufferSnapshot.
+ * @buffer: a #TeplBuffer.
+ *
+ * Must be called from the main thread, for example when a worker thread has
+ * finished to process @snapshot, to know if its result is still valid.
+ *
+ * Returns: whether @snapshot has been taken from @buffer and @buffer has not
+ *   been edited since then.
+ * Since: 6.0
+ */
+gboolean
+tepl_buffer_snapshot_is_current (TeplBufferSnapshot *snapshot,
+				 TeplBuffer         *buffer)
+{
+	g_return_val_if_fail (snapshot != NULL, FALSE);
+	g_return_val_if_fail (TEPL_IS_BUFFER (buffer), FALSE);
+
+	/* The rope of the buffer is copied at the next edit, since it is
+	 * shared with @snapshot.
+	 */
+	return _tepl_buffer_get_rope (buffer) == snapshot->rope;
+}
+
+/**
+ * tepl_buffer_snapshot_get_n_chars:
+ * @snapshot: a #TeplBufferSnapshot.
+ *
+ * Returns: the number of characters in @snapshot.
+ * Since: 6.0
+ */
+gint
+tepl_buffer_snapshot_get_n_chars (TeplBufferSnapshot *snapshot)
+{
+	g_return_val_if_fail (snapshot != NULL, 0);
+	return _tepl_rope_get_n_chars (snapshot->rope);
+}
+
+/**
+ * tepl_buffer_snapshot_get_n_bytes:
+ * @snapshot: a #TeplBufferSnapshot.
+ *
+ * Returns: the number of bytes in @snapshot.
+ * Since: 6.0
+ */
+goffset
+tepl_buffer_snapshot_get_n_bytes (TeplBufferSnapshot *snapshot)
+{
+	g_return_val_if_fail (snapshot != NULL, 0);
+	return _tepl_rope_get_n_bytes (snapshot->rope);
+}
+
+/**
+ * tepl_buffer_snapshot_get_n_chunks:
+ * @snapshot: a #TeplBufferSnapshot.
+ *
+ * Returns: the number of chunks of text in @snapshot.
+ * Since: 6.0
+ */
+guint
+tepl_buffer_snapshot_get_n_chunks (TeplBufferSnapshot *snapshot)
+{
+	g_return_val_if_fail (snapshot != NULL, 0);
+	return _tepl_rope_get_n_segments (snapshot->rope);
+}
+
+/**
+ * tepl_buffer_snapshot_get_chunk:
+ * @snapshot: a #TeplBufferSnapshot.
+ * @chunk_num: the chunk number, between 0 and
+ *   tepl_buffer_snapshot_get_n_chunks() - 1.
+ *
+ * The chunks are not empty, and they are cut at character boundaries, but a
+ * line can be split between two chunks, even between a "\r" and a "\n". The
+ * concatenation of all the chunks is the text.
+ *
+ * Returns: (transfer none): the bytes of the chunk, in UTF-8. They are not
+ *   nul-terminated.
+ * Since: 6.0
+ */
+GBytes *
+tepl_buffer_snapshot_get_chunk (TeplBufferSnapshot *snapshot,
+				guint               chunk_num)
+{
+	g_return_val_if_fail (snapshot != NULL, NULL);
+	g_return_val_if_fail (chunk_num < _tepl_rope_get_n_segments (snapshot->rope), NULL);
+
+	return _tepl_rope_get_segment (snapshot->rope, chunk_num, NULL);
+}
+
+static const guint64 *
+get_chunk_starts (TeplBufferSnapshot *snapshot)
+{
+	if (g_once_init_enter (&snapshot->chunk_starts))
+	{
+		guint n_chunks = _tepl_rope_get_n_segments (snapshot->rope);
+		guint64 *chunk_starts;
+		guint64 char_offset = 0;
+		guint chunk_num;
+
+		chunk_starts = g_new (guint64, n_chunks + 1);
+
+		for (chunk_num = 0; chunk_num < n_chunks; chunk_num++)
+		{
+			guint n_chars;
+
+			_tepl_rope_get_segment (snapshot->rope, chunk_num, &n_chars);
+			chunk_starts[chunk_num] = char_offset;
+			char_offset += n_chars;
+		}
+
+		chunk_starts[n_chunks] = char_offset;
+
+		g_once_init_leave (&snapshot->chunk_starts, chunk_starts);
+	}
+
+	return snapshot->chunk_starts;
+}
+
+/* Finds the chunk containing @char_offset, which must be less than the number
+ * of characters, in O(log n).
+ *
+ * Returns: a pointer to the character in the chunk data.
+ */
+static const gchar *
+find_char (TeplBufferSnapshot *snapshot,
+	   guint64             char_offset,
+	   guint              *chunk_num)
+{
+	const guint64 *chunk_starts = get_chunk_starts (snapshot);
+	guint low = 0;
+	guint high = _tepl_rope_get_n_segments (snapshot->rope);
+	GBytes *chunk;
+	const gchar *chunk_data;
+
+	/* The last chunk starting before or at @char_offset. */
+	while (high - low > 1)
+	{
+		guint middle = low + (high - low) / 2;
+
+		if (chunk_starts[middle] <= char_offset)
+		{
+			low = middle;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+
+	*chunk_num = low;
+
+	chunk = _tepl_rope_get_segment (snapshot->rope, low, NULL);
+	chunk_data = g_bytes_get_data (chunk, NULL);
+
+	return g_utf8_offset_to_pointer (chunk_data, char_offset - chunk_starts[low]);
+}
+
+/**
+ * tepl_buffer_snapshot_get_char:
+ * @snapshot: a #TeplBufferSnapshot.
+ * @char_offset: a character offset, between 0 and
+ *   tepl_buffer_snapshot_get_n_chars() - 1.
+ *
+ * The chunk containing @char_offset is found in O(log n), where n is the
+ * number of chunks, and then the chunk is read up to @char_offset. To read
+ * all the text, the chunks are faster.
+ *
+ * Returns: the character at @char_offset.
+ * Since: 6.0
+ */
+gunichar
+tepl_buffer_snapshot_get_char (TeplBufferSnapshot *snapshot,
+			       gint                char_offset)
+{
+	guint chunk_num;
+
+	g_return_val_if_fail (snapshot != NULL, 0);
+	g_return_val_if_fail (char_offset >= 0, 0);
+	g_return_val_if_fail ((guint64) char_offset < _tepl_rope_get_n_chars (snapshot->rope), 0);
+
+	return g_utf8_get_char (find_char (snapshot, char_offset, &chunk_num));
+}
+
+/**
+ * tepl_buffer_snapshot_get_slice:
+ * @snapshot: a #TeplBufferSnapshot.
+ * @start_char_offset: the character offset of the start of the slice.
+ * @end_char_offset: the character offset of the end of the slice, or -1 for
+ *   the end of @snapshot.
+ *
+ * Returns: (transfer full): the text between @start_char_offset and
+ *   @end_char_offset, nul-terminated. Free with g_free().
+ * Since: 6.0
+ */
+gchar *
+tepl_buffer_snapshot_get_slice (TeplBufferSnapshot *snapshot,
+				gint                start_char_offset,
+				gint                end_char_offset)
+{
+	guint64 n_chars;
+	GString *slice;
+	const gchar *pos;
+	const gchar *end_pos = NULL;
+	guint chunk_num;
+	guint end_chunk_num;
+
+	g_return_val_if_fail (snapshot != NULL, NULL);
+
+	n_chars = _tepl_rope_get_n_chars (snapshot->rope);
+
+	if (end_char_offset < 0)
+	{
+		end_char_offset = n_chars;
+	}
+
+	g_return_val_if_fail (0 <= start_char_offset && start_char_offset <= end_char_offset, NULL);
+	g_return_val_if_fail ((guint64) end_char_offset <= n_chars, NULL);
+
+	slice = g_string_new (NULL);
+
+	if (start_char_offset == end_char_offset)
+	{
+		return g_string_free (slice, FALSE);
+	}
+
+	pos = find_char (snapshot, start_char_offset, &chunk_num);
+
+	/* Otherwise the slice goes to the end of the last chunk. */
+	end_chunk_num = _tepl_rope_get_n_segments (snapshot->rope) - 1;
+	if ((guint64) end_char_offset < n_chars)
+	{
+		end_pos = find_char (snapshot, end_char_offset, &end_chunk_num);
+	}
+
+	while (TRUE)
+	{
+		GBytes *chunk = _tepl_rope_get_segment (snapshot->rope, chunk_num, NULL);
+		const gchar *chunk_data;
+		gsize chunk_size;
+		const gchar *chunk_end;
+
+		chunk_data = g_bytes_get_data (chunk, &chunk_size);
+		chunk_end = chunk_data + chunk_size;
+
+		if (pos == NULL)
+		{
+			pos = chunk_data;
+		}
+
+		if (chunk_num == end_chunk_num)
+		{
+			g_string_append_len (slice, pos, (end_pos != NULL ? end_pos : chunk_end) - pos);
+			break;
+		}
+
+		g_string_append_len (slice, pos, chunk_end - pos);
+
+		chunk_num++;
+		pos = NULL;
+	}
+
+	return g_string_free (slice, FALSE);
+}
@@ -0,0 +1,60 @@
+/* SPDX-FileCopyrightText: 2020 - Sébastien Wilmet <swilmet@gnome.org>
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef TEPL_BUFFER_SNAPSHOT_H
+#define TEPL_BUFFER_SNAPSHOT_H
+
+#if !defined (TEPL_H_INSIDE) && !defined (TEPL_COMPILATION)
+#error "Only <tepl/tepl.h> can be included directly."
+#endif
+
+#include <tepl/tepl-buffer.h>
+
+G_BEGIN_DECLS
+
+#define TEPL_TYPE_BUFFER_SNAPSHOT (tepl_buffer_snapshot_get_type ())
+
+typedef struct _TeplBufferSnapshot TeplBufferSnapshot;
+
+_TEPL_EXTERN
+GType			tepl_buffer_snapshot_get_type		(void);
+
+_TEPL_EXTERN
+TeplBufferSnapshot *	tepl_buffer_snapshot_new		(TeplBuffer *buffer);
+
+_TEPL_EXTERN
+TeplBufferSnapshot *	tepl_buffer_snapshot_ref		(TeplBufferSnapshot *snapshot);
+
+_TEPL_EXTERN
+void			tepl_buffer_snapshot_unref		(TeplBufferSnapshot *snapshot);
+
+_TEPL_EXTERN
+gboolean		tepl_buffer_snapshot_is_current		(TeplBufferSnapshot *snapshot,
+								 TeplBuffer         *buffer);
+
+_TEPL_EXTERN
+gint			tepl_buffer_snapshot_get_n_chars	(TeplBufferSnapshot *snapshot);
+
+_TEPL_EXTERN
+goffset			tepl_buffer_snapshot_get_n_bytes	(TeplBufferSnapshot *snapshot);
+
+_TEPL_EXTERN
+guint			tepl_buffer_snapshot_get_n_chunks	(TeplBufferSnapshot *snapshot);
+
+_TEPL_EXTERN
+GBytes *		tepl_buffer_snapshot_get_chunk		(TeplBufferSnapshot *snapshot,
+								 guint               chunk_num);
+
+_TEPL_EXTERN
+gunichar		tepl_buffer_snapshot_get_char		(TeplBufferSnapshot *snapshot,
+								 gint                char_offset);
+
+_TEPL_EXTERN
+gchar *			tepl_buffer_snapshot_get_slice		(TeplBufferSnapshot *snapshot,
+								 gint                start_char_offset,
+								 gint                end_char_offset);
+
+G_END_DECLS
+
+#endif /* TEPL_BUFFER_SNAPSHOT_H */
@@ -3,8 +3,12 @@
  */
 
 #include "tepl-buffer.h"
+#include <string.h>
 #include "tepl-abstract-factory.h"
+#include "tepl-line-index.h"
 #include "tepl-metadata-manager.h"
+#include "tepl-rope.h"
+#include "tepl-undo-manager.h"
 #include "tepl-utils.h"
 
 /**
@@ -19,11 +23,17 @@
  * tepl_buffer_get_file(). The association cannot change. The same for
  * #TeplMetadata with tepl_buffer_get_metadata().
  *
+ * A #TeplBuffer uses a #TeplUndoManager, which limits the memory used by the
+ * undo/redo history.
+ *
  * The properties and signals have the tepl namespace, to avoid potential
  * conflicts in the future if the property or signal is moved to
  * #GtkSourceBuffer.
  */
 
+/* U+FFFC, for pixbufs and child anchors. */
+#define OBJECT_REPLACEMENT_CHAR "\xEF\xBF\xBC"
+
 typedef struct _TeplBufferPrivate TeplBufferPrivate;
 
 struct _TeplBufferPrivate
@@ -31,10 +41,52 @@ struct _TeplBufferPrivate
 	TeplFile *file;
 	TeplMetadata *metadata;
 
+	/* The escaped invalid bytes of the loaded file. @n_invalid_chars is the
+	 * number of characters that have the tag, maintained at each edit and
+	 * each application or removal of the tag, so that the buffer doesn't
+	 * need to be scanned to know if there are invalid chars.
+	 */
 	GtkTextTag *invalid_char_tag;
+	gint n_invalid_chars;
+
+	/* The newlines inserted by the TeplFileLoader to split very long lines.
+	 * Each one is tagged, and preceded by a mark with a right gravity, so
+	 * that the mark stays before the newline when text is inserted at the
+	 * end of the split line.
+	 */
+	GtkTextTag *line_split_tag;
+	GPtrArray *line_split_marks;
+
+	/* A copy of the text, that can be read from other threads. It is
+	 * created by the first _tepl_buffer_get_rope() call, for a snapshot, a
+	 * save or the edit journal, and then updated at each edit. Until then,
+	 * editing the buffer doesn't pay for it. Incremented at each insertion
+	 * or deletion, @revision permits to know if the text has changed since
+	 * a snapshot was taken.
+	 */
+	TeplRope *rope;
+	guint64 revision;
+
+	/* The lengths of the lines, in characters and in bytes. */
+	TeplLineIndex *line_index;
+
+	/* The fingerprint of the content when the file was last loaded or
+	 * saved, see _tepl_buffer_is_unchanged_since_save(). Without the rope,
+	 * only the revision is known.
+	 */
+	guint64 saved_content_revision;
+	guint64 saved_content_hash;
+	guint64 saved_content_n_bytes;
+	guint saved_content_known : 1;
+	guint saved_content_hash_known : 1;
 
 	guint n_nested_user_actions;
 	guint idle_cursor_moved_id;
+
+	/* Whether the buffer contains only a part of the file, see
+	 * TeplFileViewer.
+	 */
+	guint partial_content : 1;
 };
 
 enum
@@ -129,6 +181,23 @@ tepl_buffer_set_property (GObject      *object,
 	}
 }
 
+static void
+tepl_buffer_constructed (GObject *object)
+{
+	TeplBuffer *buffer = TEPL_BUFFER (object);
+	TeplUndoManager *undo_manager;
+
+	G_OBJECT_CLASS (tepl_buffer_parent_class)->constructed (object);
+
+	/* Not in tepl_buffer_init(), the GtkSourceBuffer:undo-manager construct
+	 * property would replace it by the default undo manager.
+	 */
+	undo_manager = tepl_undo_manager_new (buffer);
+	gtk_source_buffer_set_undo_manager (GTK_SOURCE_BUFFER (buffer),
+					    GTK_SOURCE_UNDO_MANAGER (undo_manager));
+	g_object_unref (undo_manager);
+}
+
 static void
 tepl_buffer_dispose (GObject *object)
 {
@@ -146,6 +215,18 @@ tepl_buffer_dispose (GObject *object)
 	G_OBJECT_CLASS (tepl_buffer_parent_class)->dispose (object);
 }
 
+static void
+tepl_buffer_finalize (GObject *object)
+{
+	TeplBufferPrivate *priv = tepl_buffer_get_instance_private (TEPL_BUFFER (object));
+
+	g_ptr_array_unref (priv->line_split_marks);
+	g_clear_pointer (&priv->rope, _tepl_rope_unref);
+	_tepl_line_index_free (priv->line_index);
+
+	G_OBJECT_CLASS (tepl_buffer_parent_class)->finalize (object);
+}
+
 static gboolean
 idle_cursor_moved_cb (gpointer user_data)
 {
@@ -257,6 +338,250 @@ tepl_buffer_modified_changed (GtkTextBuffer *buffer)
 	g_object_notify_by_pspec (G_OBJECT (buffer), properties[PROP_TEPL_FULL_TITLE]);
 }
 
+/* Returns: the number of characters between @start and @end that have @tag. */
+static gint
+count_tagged_chars (GtkTextTag        *tag,
+		    const GtkTextIter *start,
+		    const GtkTextIter *end)
+{
+	GtkTextIter iter = *start;
+	gint n_chars = 0;
+
+	while (gtk_text_iter_compare (&iter, end) < 0)
+	{
+		gboolean tagged = gtk_text_iter_has_tag (&iter, tag);
+		GtkTextIter next = iter;
+
+		if (!gtk_text_iter_forward_to_tag_toggle (&next, tag) ||
+		    gtk_text_iter_compare (&next, end) > 0)
+		{
+			next = *end;
+		}
+
+		if (tagged)
+		{
+			n_chars += gtk_text_iter_get_offset (&next) - gtk_text_iter_get_offset (&iter);
+		}
+
+		iter = next;
+	}
+
+	return n_chars;
+}
+
+/* A position in the buffer, taken before an edit because the iters are
+ * revalidated by the edit.
+ */
+typedef struct _Position Position;
+struct _Position
+{
+	gint offset;
+	gint line;
+	gint line_offset;
+	gint line_index;
+};
+
+/* The offset and the line are in O(log n) in the GtkTextBTree, the position in
+ * the line in characters is deduced from the line index. Only the position in
+ * the line in bytes needs to go through the line segments.
+ */
+static void
+get_position (TeplBuffer        *buffer,
+	      const GtkTextIter *iter,
+	      Position          *pos)
+{
+	TeplBufferPrivate *priv = tepl_buffer_get_instance_private (buffer);
+	TeplLineInfo info;
+
+	pos->offset = gtk_text_iter_get_offset (iter);
+	pos->line = gtk_text_iter_get_line (iter);
+	pos->line_index = gtk_text_iter_get_line_index (iter);
+
+	_tepl_line_index_get_line_info (priv->line_index, pos->line, &info);
+	pos->line_offset = pos->offset - info.char_offset;
+}
+
+static void
+text_inserted (TeplBuffer     *buffer,
+	       const Position *pos,
+	       const gchar    *text,
+	       gsize           length)
+{
+	TeplBufferPrivate *priv = tepl_buffer_get_instance_private (buffer);
+
+	if (priv->rope != NULL)
+	{
+		_tepl_rope_insert (&priv->rope, pos->offset, text, length);
+	}
+
+	_tepl_line_index_insert (priv->line_index,
+				 pos->line,
+				 pos->line_offset,
+				 pos->line_index,
+				 text,
+				 length);
+	priv->revision++;
+}
+
+static void
+tepl_buffer_insert_text (GtkTextBuffer *buffer,
+			 GtkTextIter   *location,
+			 const gchar   *text,
+			 gint           length)
+{
+	TeplBufferPrivate *priv = tepl_buffer_get_instance_private (TEPL_BUFFER (buffer));
+	Position pos;
+
+	get_position (TEPL_BUFFER (buffer), location, &pos);
+
+	if (GTK_TEXT_BUFFER_CLASS (tepl_buffer_parent_class)->insert_text != NULL)
+	{
+		GTK_TEXT_BUFFER_CLASS (tepl_buffer_parent_class)->insert_text (buffer, location, text, length);
+	}
+
+	text_inserted (TEPL_BUFFER (buffer), &pos, text, length);
+
+	/* Text inserted inside a tagged range has the tag too. */
+	if (priv->n_invalid_chars > 0)
+	{
+		GtkTextIter start;
+
+		gtk_text_buffer_get_iter_at_offset (buffer, &start, pos.offset);
+		priv->n_invalid_chars += count_tagged_chars (priv->invalid_char_tag, &start, location);
+	}
+}
+
+static void
+tepl_buffer_insert_pixbuf (GtkTextBuffer *buffer,
+			   GtkTextIter   *location,
+			   GdkPixbuf     *pixbuf)
+{
+	Position pos;
+
+	get_position (TEPL_BUFFER (buffer), location, &pos);
+
+	if (GTK_TEXT_BUFFER_CLASS (tepl_buffer_parent_class)->insert_pixbuf != NULL)
+	{
+		GTK_TEXT_BUFFER_CLASS (tepl_buffer_parent_class)->insert_pixbuf (buffer, location, pixbuf);
+	}
+
+	/* Pixbufs and child anchors are a U+FFFC character in the text. */
+	text_inserted (TEPL_BUFFER (buffer), &pos, OBJECT_REPLACEMENT_CHAR, strlen (OBJECT_REPLACEMENT_CHAR));
+}
+
+static void
+tepl_buffer_insert_child_anchor (GtkTextBuffer      *buffer,
+				 GtkTextIter        *location,
+				 GtkTextChildAnchor *anchor)
+{
+	Position pos;
+
+	get_position (TEPL_BUFFER (buffer), location, &pos);
+
+	if (GTK_TEXT_BUFFER_CLASS (tepl_buffer_parent_class)->insert_child_anchor != NULL)
+	{
+		GTK_TEXT_BUFFER_CLASS (tepl_buffer_parent_class)->insert_child_anchor (buffer, location, anchor);
+	}
+
+	text_inserted (TEPL_BUFFER (buffer), &pos, OBJECT_REPLACEMENT_CHAR, strlen (OBJECT_REPLACEMENT_CHAR));
+}
+
+static void
+tepl_buffer_delete_range (GtkTextBuffer *buffer,
+			  GtkTextIter   *start,
+			  GtkTextIter   *end)
+{
+	TeplBufferPrivate *priv = tepl_buffer_get_instance_private (TEPL_BUFFER (buffer));
+	Position start_pos;
+	Position end_pos;
+
+	/* The iters can be in any order. */
+	if (gtk_text_iter_compare (start, end) <= 0)
+	{
+		get_position (TEPL_BUFFER (buffer), start, &start_pos);
+		get_position (TEPL_BUFFER (buffer), end, &end_pos);
+
+		if (priv->n_invalid_chars > 0)
+		{
+			priv->n_invalid_chars -= count_tagged_chars (priv->invalid_char_tag, start, end);
+		}
+	}
+	else
+	{
+		get_position (TEPL_BUFFER (buffer), end, &start_pos);
+		get_position (TEPL_BUFFER (buffer), start, &end_pos);
+
+		if (priv->n_invalid_chars > 0)
+		{
+			priv->n_invalid_chars -= count_tagged_chars (priv->invalid_char_tag, end, start);
+		}
+	}
+
+	if (GTK_TEXT_BUFFER_CLASS (tepl_buffer_parent_class)->delete_range != NULL)
+	{
+		GTK_TEXT_BUFFER_CLASS (tepl_buffer_parent_class)->delete_range (buffer, start, end);
+	}
+
+	if (priv->rope != NULL)
+	{
+		_tepl_rope_delete (&priv->rope,
+				   start_pos.offset,
+				   end_pos.offset - start_pos.offset);
+	}
+
+	_tepl_line_index_delete (priv->line_index,
+				 start_pos.line,
+				 start_pos.line_offset,
+				 start_pos.line_index,
+				 end_pos.line,
+				 end_pos.line_offset,
+				 end_pos.line_index);
+	priv->revision++;
+}
+
+static void
+tepl_buffer_apply_tag (GtkTextBuffer     *buffer,
+		       GtkTextTag        *tag,
+		       const GtkTextIter *start,
+		       const GtkTextIter *end)
+{
+	TeplBufferPrivate *priv = tepl_buffer_get_instance_private (TEPL_BUFFER (buffer));
+	gboolean is_invalid_char_tag = tag == priv->invalid_char_tag;
+
+	/* The iters are invalidated by the application of the tag, but the
+	 * whole range has the tag afterwards.
+	 */
+	if (is_invalid_char_tag)
+	{
+		priv->n_invalid_chars += (gtk_text_iter_get_offset (end) - gtk_text_iter_get_offset (start) -
+					  count_tagged_chars (tag, start, end));
+	}
+
+	if (GTK_TEXT_BUFFER_CLASS (tepl_buffer_parent_class)->apply_tag != NULL)
+	{
+		GTK_TEXT_BUFFER_CLASS (tepl_buffer_parent_class)->apply_tag (buffer, tag, start, end);
+	}
+}
+
+static void
+tepl_buffer_remove_tag (GtkTextBuffer     *buffer,
+			GtkTextTag        *tag,
+			const GtkTextIter *start,
+			const GtkTextIter *end)
+{
+	TeplBufferPrivate *priv = tepl_buffer_get_instance_private (TEPL_BUFFER (buffer));
+
+	if (tag == priv->invalid_char_tag)
+	{
+		priv->n_invalid_chars -= count_tagged_chars (tag, start, end);
+	}
+
+	if (GTK_TEXT_BUFFER_CLASS (tepl_buffer_parent_class)->remove_tag != NULL)
+	{
+		GTK_TEXT_BUFFER_CLASS (tepl_buffer_parent_class)->remove_tag (buffer, tag, start, end);
+	}
+}
+
 static void
 tepl_buffer_class_init (TeplBufferClass *klass)
 {
@@ -265,13 +590,21 @@ tepl_buffer_class_init (TeplBufferClass *klass)
 
 	object_class->get_property = tepl_buffer_get_property;
 	object_class->set_property = tepl_buffer_set_property;
+	object_class->constructed = tepl_buffer_constructed;
 	object_class->dispose = tepl_buffer_dispose;
+	object_class->finalize = tepl_buffer_finalize;
 
 	text_buffer_class->begin_user_action = tepl_buffer_begin_user_action;
 	text_buffer_class->end_user_action = tepl_buffer_end_user_action;
 	text_buffer_class->mark_set = tepl_buffer_mark_set;
 	text_buffer_class->changed = tepl_buffer_changed;
 	text_buffer_class->modified_changed = tepl_buffer_modified_changed;
+	text_buffer_class->insert_text = tepl_buffer_insert_text;
+	text_buffer_class->insert_pixbuf = tepl_buffer_insert_pixbuf;
+	text_buffer_class->insert_child_anchor = tepl_buffer_insert_child_anchor;
+	text_buffer_class->delete_range = tepl_buffer_delete_range;
+	text_buffer_class->apply_tag = tepl_buffer_apply_tag;
+	text_buffer_class->remove_tag = tepl_buffer_remove_tag;
 
 	/**
 	 * TeplBuffer:tepl-short-title:
@@ -376,6 +709,8 @@ tepl_buffer_init (TeplBuffer *buffer)
 	priv->file = tepl_abstract_factory_create_file (factory);
 
 	priv->metadata = tepl_metadata_new ();
+	priv->line_split_marks = g_ptr_array_new_with_free_func (g_object_unref);
+	priv->line_index = _tepl_line_index_new ();
 
 	g_signal_connect_object (priv->file,
 				 "notify::short-name",
@@ -717,74 +1052,915 @@ tepl_buffer_get_selection_type (TeplBuffer *buffer)
 	return TEPL_SELECTION_TYPE_MULTIPLE_LINES;
 }
 
-static void
-text_tag_set_highest_priority (GtkTextTag    *tag,
-			       GtkTextBuffer *buffer)
+/**
+ * tepl_buffer_get_line_char_offset:
+ * @buffer: a #TeplBuffer.
+ * @line: a line number, counting from 0.
+ *
+ * Like gtk_text_buffer_get_iter_at_line() followed by
+ * gtk_text_iter_get_offset(). If @line is greater than or equal to the number
+ * of lines, the number of characters in @buffer is returned.
+ *
+ * The lengths of the lines are indexed by #TeplBuffer, so the functions to
+ * convert between lines, character offsets and byte offsets run in O(log n),
+ * where n is the number of lines.
+ *
+ * Returns: the character offset of the start of @line.
+ * Since: 6.0
+ */
+gint
+tepl_buffer_get_line_char_offset (TeplBuffer *buffer,
+				  gint        line)
 {
-	GtkTextTagTable *table;
-	gint n;
+	TeplBufferPrivate *priv;
+	TeplLineInfo info;
+
+	g_return_val_if_fail (TEPL_IS_BUFFER (buffer), 0);
+	g_return_val_if_fail (line >= 0, 0);
+
+	priv = tepl_buffer_get_instance_private (buffer);
 
-	table = gtk_text_buffer_get_tag_table (buffer);
-	n = gtk_text_tag_table_get_size (table);
-	gtk_text_tag_set_priority (tag, n - 1);
+	if (line >= _tepl_line_index_get_n_lines (priv->line_index))
+	{
+		return _tepl_line_index_get_n_chars (priv->line_index);
+	}
+
+	_tepl_line_index_get_line_info (priv->line_index, line, &info);
+	return info.char_offset;
 }
 
-void
-_tepl_buffer_set_as_invalid_character (TeplBuffer        *buffer,
-				       const GtkTextIter *start,
-				       const GtkTextIter *end)
+/**
+ * tepl_buffer_get_line_byte_offset:
+ * @buffer: a #TeplBuffer.
+ * @line: a line number, counting from 0.
+ *
+ * Like tepl_buffer_get_line_char_offset(), but in bytes. If @line is greater
+ * than or equal to the number of lines, the number of bytes in @buffer is
+ * returned.
+ *
+ * The bytes are counted in the UTF-8 text, with the pixbufs and child anchors
+ * counted as the 3 bytes of the U+FFFC character.
+ *
+ * Returns: the byte offset of the start of @line.
+ * Since: 6.0
+ */
+goffset
+tepl_buffer_get_line_byte_offset (TeplBuffer *buffer,
+				  gint        line)
 {
 	TeplBufferPrivate *priv;
+	TeplLineInfo info;
 
-	g_return_if_fail (TEPL_IS_BUFFER (buffer));
-	g_return_if_fail (start != NULL);
-	g_return_if_fail (end != NULL);
+	g_return_val_if_fail (TEPL_IS_BUFFER (buffer), 0);
+	g_return_val_if_fail (line >= 0, 0);
 
 	priv = tepl_buffer_get_instance_private (buffer);
 
-	if (priv->invalid_char_tag == NULL)
+	if (line >= _tepl_line_index_get_n_lines (priv->line_index))
 	{
-		priv->invalid_char_tag = gtk_text_buffer_create_tag (GTK_TEXT_BUFFER (buffer),
-								     NULL,
-								     NULL);
+		return _tepl_line_index_get_n_bytes (priv->line_index);
+	}
 
-		update_invalid_char_tag_style (buffer);
+	_tepl_line_index_get_line_info (priv->line_index, line, &info);
+	return info.byte_offset;
+}
+
+/**
+ * tepl_buffer_get_line_at_char_offset:
+ * @buffer: a #TeplBuffer.
+ * @char_offset: a character offset, counting from 0, or -1 for the end of
+ *   @buffer.
+ *
+ * Like gtk_text_buffer_get_iter_at_offset() followed by
+ * gtk_text_iter_get_line(), in O(log n).
+ *
+ * Returns: the line containing @char_offset.
+ * Since: 6.0
+ */
+gint
+tepl_buffer_get_line_at_char_offset (TeplBuffer *buffer,
+				     gint        char_offset)
+{
+	TeplBufferPrivate *priv;
+	TeplLineInfo info;
+
+	g_return_val_if_fail (TEPL_IS_BUFFER (buffer), 0);
+
+	priv = tepl_buffer_get_instance_private (buffer);
+
+	if (char_offset < 0)
+	{
+		char_offset = _tepl_line_index_get_n_chars (priv->line_index);
 	}
 
-	/* Make sure the 'error' tag has the priority over
-	 * syntax highlighting tags.
-	 */
-	text_tag_set_highest_priority (priv->invalid_char_tag,
-	                               GTK_TEXT_BUFFER (buffer));
+	_tepl_line_index_get_line_info_at_char_offset (priv->line_index, char_offset, &info);
+	return info.line;
+}
+
+/**
+ * tepl_buffer_get_line_at_byte_offset:
+ * @buffer: a #TeplBuffer.
+ * @byte_offset: a byte offset, counting from 0, or -1 for the end of @buffer.
+ *
+ * Like tepl_buffer_get_line_at_char_offset(), but with a byte offset.
+ *
+ * Returns: the line containing @byte_offset.
+ * Since: 6.0
+ */
+gint
+tepl_buffer_get_line_at_byte_offset (TeplBuffer *buffer,
+				     goffset     byte_offset)
+{
+	TeplBufferPrivate *priv;
+	TeplLineInfo info;
+
+	g_return_val_if_fail (TEPL_IS_BUFFER (buffer), 0);
+
+	priv = tepl_buffer_get_instance_private (buffer);
+
+	if (byte_offset < 0)
+	{
+		byte_offset = _tepl_line_index_get_n_bytes (priv->line_index);
+	}
+
+	_tepl_line_index_get_line_info_at_byte_offset (priv->line_index, byte_offset, &info);
+	return info.line;
+}
 
-	gtk_text_buffer_apply_tag (GTK_TEXT_BUFFER (buffer),
-	                           priv->invalid_char_tag,
-	                           start,
-	                           end);
+/**
+ * tepl_buffer_char_offset_to_byte_offset:
+ * @buffer: a #TeplBuffer.
+ * @char_offset: a character offset, counting from 0, or -1 for the end of
+ *   @buffer.
+ *
+ * Converts a character offset to a byte offset in the UTF-8 text of @buffer,
+ * for example to communicate with an external tool. The line is found in
+ * O(log n), and only the line containing @char_offset is read, when it
+ * contains non-ASCII characters.
+ *
+ * Returns: the byte offset corresponding to @char_offset.
+ * Since: 6.0
+ */
+goffset
+tepl_buffer_char_offset_to_byte_offset (TeplBuffer *buffer,
+					gint        char_offset)
+{
+	TeplBufferPrivate *priv;
+	TeplLineInfo info;
+	GtkTextIter iter;
+
+	g_return_val_if_fail (TEPL_IS_BUFFER (buffer), 0);
+
+	priv = tepl_buffer_get_instance_private (buffer);
+
+	if (char_offset < 0 ||
+	    char_offset >= _tepl_line_index_get_n_chars (priv->line_index))
+	{
+		return _tepl_line_index_get_n_bytes (priv->line_index);
+	}
+
+	_tepl_line_index_get_line_info_at_char_offset (priv->line_index, char_offset, &info);
+
+	/* Only ASCII characters. */
+	if (info.n_chars == info.n_bytes)
+	{
+		return info.byte_offset + (char_offset - info.char_offset);
+	}
+
+	gtk_text_buffer_get_iter_at_line_offset (GTK_TEXT_BUFFER (buffer),
+						 &iter,
+						 info.line,
+						 char_offset - info.char_offset);
+
+	return info.byte_offset + gtk_text_iter_get_line_index (&iter);
+}
+
+/**
+ * tepl_buffer_byte_offset_to_char_offset:
+ * @buffer: a #TeplBuffer.
+ * @byte_offset: a byte offset, counting from 0, or -1 for the end of @buffer.
+ *   It must be at a character boundary.
+ *
+ * The inverse of tepl_buffer_char_offset_to_byte_offset().
+ *
+ * Returns: the character offset corresponding to @byte_offset.
+ * Since: 6.0
+ */
+gint
+tepl_buffer_byte_offset_to_char_offset (TeplBuffer *buffer,
+					goffset     byte_offset)
+{
+	TeplBufferPrivate *priv;
+	TeplLineInfo info;
+	GtkTextIter iter;
+
+	g_return_val_if_fail (TEPL_IS_BUFFER (buffer), 0);
+
+	priv = tepl_buffer_get_instance_private (buffer);
+
+	if (byte_offset < 0 ||
+	    byte_offset >= _tepl_line_index_get_n_bytes (priv->line_index))
+	{
+		return _tepl_line_index_get_n_chars (priv->line_index);
+	}
+
+	_tepl_line_index_get_line_info_at_byte_offset (priv->line_index, byte_offset, &info);
+
+	/* Only ASCII characters. */
+	if (info.n_chars == info.n_bytes)
+	{
+		return info.char_offset + (byte_offset - info.byte_offset);
+	}
+
+	gtk_text_buffer_get_iter_at_line_index (GTK_TEXT_BUFFER (buffer),
+						&iter,
+						info.line,
+						byte_offset - info.byte_offset);
+
+	return info.char_offset + gtk_text_iter_get_line_offset (&iter);
 }
 
+/* Like gtk_text_buffer_get_iter_at_line(), but the start of @line is found in
+ * the index of the lines. If @line doesn't exist, @iter is at the start of the
+ * last line, like with GtkTextBuffer.
+ *
+ * Returns: whether @line exists.
+ */
 gboolean
-_tepl_buffer_has_invalid_chars (TeplBuffer *buffer)
+_tepl_buffer_get_iter_at_line (TeplBuffer  *buffer,
+			       GtkTextIter *iter,
+			       gint         line)
 {
 	TeplBufferPrivate *priv;
-	GtkTextIter start;
+	TeplLineInfo info;
+	gint n_lines;
+	gboolean line_exists;
 
 	g_return_val_if_fail (TEPL_IS_BUFFER (buffer), FALSE);
+	g_return_val_if_fail (iter != NULL, FALSE);
 
 	priv = tepl_buffer_get_instance_private (buffer);
 
-	if (priv->invalid_char_tag == NULL)
+	n_lines = _tepl_line_index_get_n_lines (priv->line_index);
+	line_exists = 0 <= line && line < n_lines;
+
+	_tepl_line_index_get_line_info (priv->line_index,
+					line_exists ? line : n_lines - 1,
+					&info);
+	gtk_text_buffer_get_iter_at_offset (GTK_TEXT_BUFFER (buffer), iter, info.char_offset);
+
+	return line_exists;
+}
+
+/* Sets @iter at the end of @line, before its line terminator, like
+ * gtk_text_iter_forward_to_line_end() but without walking through the line.
+ * If @line doesn't exist, the last line is taken.
+ */
+void
+_tepl_buffer_get_iter_at_line_end (TeplBuffer  *buffer,
+				   GtkTextIter *iter,
+				   gint         line)
+{
+	TeplBufferPrivate *priv;
+	TeplLineInfo info;
+	gint n_lines;
+
+	g_return_if_fail (TEPL_IS_BUFFER (buffer));
+	g_return_if_fail (iter != NULL);
+
+	priv = tepl_buffer_get_instance_private (buffer);
+
+	n_lines = _tepl_line_index_get_n_lines (priv->line_index);
+	if (line < 0 || line >= n_lines)
 	{
-		return FALSE;
+		line = n_lines - 1;
 	}
 
-	gtk_text_buffer_get_start_iter (GTK_TEXT_BUFFER (buffer), &start);
+	_tepl_line_index_get_line_info (priv->line_index, line, &info);
+	gtk_text_buffer_get_iter_at_offset (GTK_TEXT_BUFFER (buffer),
+					    iter,
+					    info.char_offset + info.n_chars);
 
-	if (gtk_text_iter_starts_tag (&start, priv->invalid_char_tag) ||
-	    gtk_text_iter_forward_to_tag_toggle (&start, priv->invalid_char_tag))
+	/* The last line has no line terminator. */
+	if (line == n_lines - 1)
 	{
-		return TRUE;
+		return;
 	}
 
-	return FALSE;
+	/* The line terminator is one character, except "\r\n". */
+	gtk_text_iter_backward_char (iter);
+
+	if (info.n_chars >= 2 && gtk_text_iter_get_char (iter) == '\n')
+	{
+		GtkTextIter prev = *iter;
+
+		gtk_text_iter_backward_char (&prev);
+		if (gtk_text_iter_get_char (&prev) == '\r')
+		{
+			*iter = prev;
+		}
+	}
+}
+
+static gboolean
+edits_are_valid (TeplBuffer           *buffer,
+		 const TeplBufferEdit *edits,
+		 guint                 n_edits)
+{
+	gint n_chars = gtk_text_buffer_get_char_count (GTK_TEXT_BUFFER (buffer));
+	gint prev_end_offset = 0;
+	guint i;
+
+	for (i = 0; i < n_edits; i++)
+	{
+		const TeplBufferEdit *edit = &edits[i];
+
+		if (edit->start_offset < prev_end_offset ||
+		    edit->end_offset < edit->start_offset ||
+		    edit->end_offset > n_chars)
+		{
+			return FALSE;
+		}
+
+		prev_end_offset = edit->end_offset;
+	}
+
+	return TRUE;
+}
+
+/**
+ * tepl_buffer_apply_edits:
+ * @buffer: a #TeplBuffer.
+ * @edits: (array length=n_edits): the edits, sorted by position and not
+ *   overlapping. Their offsets are in the content before the edits.
+ * @n_edits: the number of @edits.
+ *
+ * Replaces several ranges of @buffer in one go, for example for a replace-all,
+ * or to apply the changes computed by a code formatter.
+ *
+ * The edits are applied from the last one to the first one, so that the
+ * offsets of the remaining edits stay valid, and inside one user action. So
+ * it is one undo step, and the #TeplBuffer::tepl-cursor-moved signal is
+ * emitted once, after all the edits.
+ *
+ * Since: 6.0
+ */
+void
+tepl_buffer_apply_edits (TeplBuffer           *buffer,
+			 const TeplBufferEdit *edits,
+			 guint                 n_edits)
+{
+	GtkTextBuffer *text_buffer;
+	guint i;
+
+	g_return_if_fail (TEPL_IS_BUFFER (buffer));
+	g_return_if_fail (edits != NULL || n_edits == 0);
+	g_return_if_fail (edits_are_valid (buffer, edits, n_edits));
+
+	if (n_edits == 0)
+	{
+		return;
+	}
+
+	text_buffer = GTK_TEXT_BUFFER (buffer);
+	gtk_text_buffer_begin_user_action (text_buffer);
+
+	for (i = n_edits; i > 0; i--)
+	{
+		const TeplBufferEdit *edit = &edits[i - 1];
+		GtkTextIter start;
+
+		gtk_text_buffer_get_iter_at_offset (text_buffer, &start, edit->start_offset);
+
+		if (edit->end_offset > edit->start_offset)
+		{
+			GtkTextIter end;
+
+			gtk_text_buffer_get_iter_at_offset (text_buffer, &end, edit->end_offset);
+
+			/* @start is revalidated at the place of the deleted
+			 * text.
+			 */
+			gtk_text_buffer_delete (text_buffer, &start, &end);
+		}
+
+		if (edit->text != NULL && edit->text[0] != '\0')
+		{
+			gtk_text_buffer_insert (text_buffer, &start, edit->text, -1);
+		}
+	}
+
+	gtk_text_buffer_end_user_action (text_buffer);
+}
+
+/*
+ * _tepl_buffer_set_as_invalid_chars:
+ * @buffer: a #TeplBuffer.
+ * @offsets: a #GArray of #gint: the start and end character offsets of each
+ *   range, two by two.
+ *
+ * Tags the ranges of escaped invalid bytes, in one go for all the invalid bytes
+ * inserted by a batch.
+ */
+void
+_tepl_buffer_set_as_invalid_chars (TeplBuffer   *buffer,
+				   const GArray *offsets)
+{
+	TeplBufferPrivate *priv;
+	GtkTextBuffer *text_buffer;
+	GtkTextTagTable *table;
+	gint highest_priority;
+	guint i;
+
+	g_return_if_fail (TEPL_IS_BUFFER (buffer));
+	g_return_if_fail (offsets != NULL);
+	g_return_if_fail (offsets->len % 2 == 0);
+
+	priv = tepl_buffer_get_instance_private (buffer);
+	text_buffer = GTK_TEXT_BUFFER (buffer);
+
+	if (offsets->len == 0)
+	{
+		return;
+	}
+
+	if (priv->invalid_char_tag == NULL)
+	{
+		priv->invalid_char_tag = gtk_text_buffer_create_tag (text_buffer, NULL, NULL);
+		update_invalid_char_tag_style (buffer);
+	}
+
+	/* Make sure the 'error' tag has the priority over
+	 * syntax highlighting tags.
+	 */
+	table = gtk_text_buffer_get_tag_table (text_buffer);
+	highest_priority = gtk_text_tag_table_get_size (table) - 1;
+	if (gtk_text_tag_get_priority (priv->invalid_char_tag) != highest_priority)
+	{
+		gtk_text_tag_set_priority (priv->invalid_char_tag, highest_priority);
+	}
+
+	for (i = 0; i < offsets->len; i += 2)
+	{
+		GtkTextIter start;
+		GtkTextIter end;
+
+		gtk_text_buffer_get_iter_at_offset (text_buffer, &start, g_array_index (offsets, gint, i));
+		gtk_text_buffer_get_iter_at_offset (text_buffer, &end, g_array_index (offsets, gint, i + 1));
+		gtk_text_buffer_apply_tag (text_buffer, priv->invalid_char_tag, &start, &end);
+	}
+}
+
+/* Returns: whether the buffer contains escaped invalid bytes, in O(1). */
+gboolean
+_tepl_buffer_has_invalid_chars (TeplBuffer *buffer)
+{
+	TeplBufferPrivate *priv;
+
+	g_return_val_if_fail (TEPL_IS_BUFFER (buffer), FALSE);
+
+	priv = tepl_buffer_get_instance_private (buffer);
+	return priv->n_invalid_chars > 0;
+}
+
+/* @newline: the position of a "\n" inserted to split a very long line. */
+void
+_tepl_buffer_add_line_split (TeplBuffer        *buffer,
+			     const GtkTextIter *newline)
+{
+	TeplBufferPrivate *priv;
+	GtkTextBuffer *text_buffer;
+	GtkTextIter newline_end;
+	GtkTextMark *mark;
+
+	g_return_if_fail (TEPL_IS_BUFFER (buffer));
+	g_return_if_fail (newline != NULL);
+	g_return_if_fail (gtk_text_iter_get_char (newline) == '\n');
+
+	priv = tepl_buffer_get_instance_private (buffer);
+	text_buffer = GTK_TEXT_BUFFER (buffer);
+
+	if (priv->line_split_tag == NULL)
+	{
+		priv->line_split_tag = gtk_text_buffer_create_tag (text_buffer, NULL, NULL);
+	}
+
+	newline_end = *newline;
+	gtk_text_iter_forward_char (&newline_end);
+	gtk_text_buffer_apply_tag (text_buffer, priv->line_split_tag, newline, &newline_end);
+
+	mark = gtk_text_buffer_create_mark (text_buffer, NULL, newline, FALSE);
+	g_ptr_array_add (priv->line_split_marks, g_object_ref (mark));
+}
+
+void
+_tepl_buffer_clear_line_splits (TeplBuffer *buffer)
+{
+	TeplBufferPrivate *priv;
+	GtkTextBuffer *text_buffer;
+	GtkTextIter start;
+	GtkTextIter end;
+	guint i;
+
+	g_return_if_fail (TEPL_IS_BUFFER (buffer));
+
+	priv = tepl_buffer_get_instance_private (buffer);
+	text_buffer = GTK_TEXT_BUFFER (buffer);
+
+	for (i = 0; i < priv->line_split_marks->len; i++)
+	{
+		GtkTextMark *mark = g_ptr_array_index (priv->line_split_marks, i);
+
+		if (!gtk_text_mark_get_deleted (mark))
+		{
+			gtk_text_buffer_delete_mark (text_buffer, mark);
+		}
+	}
+
+	g_ptr_array_set_size (priv->line_split_marks, 0);
+
+	if (priv->line_split_tag != NULL)
+	{
+		gtk_text_buffer_get_bounds (text_buffer, &start, &end);
+		gtk_text_buffer_remove_tag (text_buffer, priv->line_split_tag, &start, &end);
+	}
+}
+
+/* A line split is intact if the newline inserted by the file loader is still
+ * there, just after the mark.
+ */
+static gboolean
+get_intact_line_split (TeplBuffer  *buffer,
+		       GtkTextMark *mark,
+		       GtkTextIter *newline)
+{
+	TeplBufferPrivate *priv = tepl_buffer_get_instance_private (buffer);
+
+	gtk_text_buffer_get_iter_at_mark (GTK_TEXT_BUFFER (buffer), newline, mark);
+
+	return (gtk_text_iter_get_char (newline) == '\n' &&
+		gtk_text_iter_has_tag (newline, priv->line_split_tag));
+}
+
+/* Returns: whether a newline inserted to split a very long line has been
+ * deleted or replaced.
+ */
+gboolean
+_tepl_buffer_has_edited_line_splits (TeplBuffer *buffer)
+{
+	TeplBufferPrivate *priv;
+	guint i;
+
+	g_return_val_if_fail (TEPL_IS_BUFFER (buffer), FALSE);
+
+	priv = tepl_buffer_get_instance_private (buffer);
+
+	for (i = 0; i < priv->line_split_marks->len; i++)
+	{
+		GtkTextMark *mark = g_ptr_array_index (priv->line_split_marks, i);
+		GtkTextIter newline;
+
+		if (!get_intact_line_split (buffer, mark, &newline))
+		{
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+/* Returns: (transfer full) (element-type guint64): the sorted character
+ * offsets of the newlines of the intact line splits.
+ */
+GArray *
+_tepl_buffer_get_line_split_offsets (TeplBuffer *buffer)
+{
+	TeplBufferPrivate *priv;
+	GArray *offsets;
+	guint i;
+
+	g_return_val_if_fail (TEPL_IS_BUFFER (buffer), NULL);
+
+	priv = tepl_buffer_get_instance_private (buffer);
+	offsets = g_array_sized_new (FALSE, FALSE, sizeof (guint64), priv->line_split_marks->len);
+
+	/* The marks stay in the same order when the text is edited. */
+	for (i = 0; i < priv->line_split_marks->len; i++)
+	{
+		GtkTextMark *mark = g_ptr_array_index (priv->line_split_marks, i);
+		GtkTextIter newline;
+		guint64 offset;
+
+		if (!get_intact_line_split (buffer, mark, &newline))
+		{
+			continue;
+		}
+
+		/* Several marks can end up at the same place when the text
+		 * between them is deleted.
+		 */
+		offset = gtk_text_iter_get_offset (&newline);
+		if (offsets->len > 0 &&
+		    g_array_index (offsets, guint64, offsets->len - 1) >= offset)
+		{
+			continue;
+		}
+
+		g_array_append_val (offsets, offset);
+	}
+
+	return offsets;
+}
+
+/* Returns: (transfer none): the copy of the text, that can be read from other
+ * threads. Take a ref to keep a snapshot of the current text, the rope is
+ * copied on write. The first call copies the whole text, in O(n); the rope is
+ * then kept up to date at each edit.
+ */
+TeplRope *
+_tepl_buffer_get_rope (TeplBuffer *buffer)
+{
+	TeplBufferPrivate *priv;
+
+	g_return_val_if_fail (TEPL_IS_BUFFER (buffer), NULL);
+
+	priv = tepl_buffer_get_instance_private (buffer);
+
+	if (priv->rope == NULL)
+	{
+		GtkTextIter start;
+		GtkTextIter end;
+		gchar *text;
+
+		/* With the U+FFFC characters of the pixbufs and child
+		 * anchors, like the edits.
+		 */
+		gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (buffer), &start, &end);
+		text = gtk_text_buffer_get_slice (GTK_TEXT_BUFFER (buffer), &start, &end, TRUE);
+
+		priv->rope = _tepl_rope_new ();
+		_tepl_rope_insert (&priv->rope, 0, text, strlen (text));
+		g_free (text);
+
+		if (priv->saved_content_known &&
+		    !priv->saved_content_hash_known &&
+		    priv->saved_content_revision == priv->revision)
+		{
+			_tepl_buffer_set_saved_content (buffer, priv->rope);
+			priv->saved_content_revision = priv->revision;
+		}
+	}
+
+	return priv->rope;
+}
+
+/* Returns: a number that changes at each insertion or deletion. */
+guint64
+_tepl_buffer_get_revision (TeplBuffer *buffer)
+{
+	TeplBufferPrivate *priv;
+
+	g_return_val_if_fail (TEPL_IS_BUFFER (buffer), 0);
+
+	priv = tepl_buffer_get_instance_private (buffer);
+	return priv->revision;
+}
+
+/* Records @rope, a snapshot of the buffer content, as the content that is on
+ * disk. @rope can be older than the current buffer content, for example when
+ * the buffer has been edited during a save operation. %NULL if the content on
+ * disk is not a snapshot of the buffer content.
+ */
+void
+_tepl_buffer_set_saved_content (TeplBuffer *buffer,
+				TeplRope   *rope)
+{
+	TeplBufferPrivate *priv;
+
+	g_return_if_fail (TEPL_IS_BUFFER (buffer));
+
+	priv = tepl_buffer_get_instance_private (buffer);
+
+	if (rope == NULL)
+	{
+		priv->saved_content_known = FALSE;
+		priv->saved_content_hash_known = FALSE;
+		return;
+	}
+
+	/* The revision of @rope is not known. */
+	priv->saved_content_revision = G_MAXUINT64;
+	priv->saved_content_hash = _tepl_rope_get_hash (rope);
+	priv->saved_content_n_bytes = _tepl_rope_get_n_bytes (rope);
+	priv->saved_content_known = TRUE;
+	priv->saved_content_hash_known = TRUE;
+}
+
+/* Records the current content as the content that is on disk, without creating
+ * the rope. If the rope doesn't exist yet, only the revision is recorded, until
+ * the rope is created.
+ */
+void
+_tepl_buffer_set_current_content_as_saved (TeplBuffer *buffer)
+{
+	TeplBufferPrivate *priv;
+
+	g_return_if_fail (TEPL_IS_BUFFER (buffer));
+
+	priv = tepl_buffer_get_instance_private (buffer);
+
+	if (priv->rope != NULL)
+	{
+		_tepl_buffer_set_saved_content (buffer, priv->rope);
+	}
+	else
+	{
+		priv->saved_content_known = TRUE;
+		priv->saved_content_hash_known = FALSE;
+	}
+
+	priv->saved_content_revision = priv->revision;
+}
+
+/* Returns: whether the buffer content is the same as when the file was last
+ * loaded or saved, even if gtk_text_buffer_get_modified() returns %TRUE, for
+ * example when a character has been typed and then deleted. It compares the
+ * hashes of the contents, which are maintained at each edit, so it doesn't
+ * read the text. If the rope didn't exist when the content was saved, only an
+ * unedited buffer is known to be unchanged.
+ */
+gboolean
+_tepl_buffer_is_unchanged_since_save (TeplBuffer *buffer)
+{
+	TeplBufferPrivate *priv;
+
+	g_return_val_if_fail (TEPL_IS_BUFFER (buffer), FALSE);
+
+	priv = tepl_buffer_get_instance_private (buffer);
+
+	if (!priv->saved_content_known)
+	{
+		return FALSE;
+	}
+
+	if (priv->saved_content_revision == priv->revision)
+	{
+		return TRUE;
+	}
+
+	return (priv->saved_content_hash_known &&
+		priv->rope != NULL &&
+		_tepl_rope_get_n_bytes (priv->rope) == priv->saved_content_n_bytes &&
+		_tepl_rope_get_hash (priv->rope) == priv->saved_content_hash);
+}
+
+void
+_tepl_buffer_set_partial_content (TeplBuffer *buffer,
+				  gboolean    partial_content)
+{
+	TeplBufferPrivate *priv;
+
+	g_return_if_fail (TEPL_IS_BUFFER (buffer));
+
+	priv = tepl_buffer_get_instance_private (buffer);
+	priv->partial_content = partial_content != FALSE;
+}
+
+gboolean
+_tepl_buffer_has_partial_content (TeplBuffer *buffer)
+{
+	TeplBufferPrivate *priv;
+
+	g_return_val_if_fail (TEPL_IS_BUFFER (buffer), FALSE);
+
+	priv = tepl_buffer_get_instance_private (buffer);
+	return priv->partial_content;
+}
+
+static void
+copy_undo_memory_budget (TeplBuffer *buffer,
+			 TeplBuffer *sibling)
+{
+	GtkSourceUndoManager *undo_manager;
+	GtkSourceUndoManager *sibling_undo_manager;
+
+	undo_manager = gtk_source_buffer_get_undo_manager (GTK_SOURCE_BUFFER (buffer));
+	sibling_undo_manager = gtk_source_buffer_get_undo_manager (GTK_SOURCE_BUFFER (sibling));
+
+	if (TEPL_IS_UNDO_MANAGER (undo_manager) &&
+	    TEPL_IS_UNDO_MANAGER (sibling_undo_manager))
+	{
+		tepl_undo_manager_set_memory_budget (TEPL_UNDO_MANAGER (sibling_undo_manager),
+						     tepl_undo_manager_get_memory_budget (TEPL_UNDO_MANAGER (undo_manager)));
+	}
+}
+
+/* Creates @sibling with the construct properties of @buffer that are added by a
+ * subclass of TeplBuffer, so that a subclass can require some of them. The
+ * construct properties of the parent classes, like the tag table or the undo
+ * manager, must not be shared, the settings are copied afterwards.
+ */
+static TeplBuffer *
+new_buffer_with_subclass_construct_properties (TeplBuffer *buffer)
+{
+	GObjectClass *klass;
+	GParamSpec **pspecs;
+	guint n_pspecs;
+	const gchar **names;
+	GValue *values;
+	guint n_properties = 0;
+	TeplBuffer *sibling;
+	guint i;
+
+	klass = G_OBJECT_GET_CLASS (buffer);
+	pspecs = g_object_class_list_properties (klass, &n_pspecs);
+	names = g_new0 (const gchar *, n_pspecs);
+	values = g_new0 (GValue, n_pspecs);
+
+	for (i = 0; i < n_pspecs; i++)
+	{
+		GParamSpec *pspec = pspecs[i];
+
+		if ((pspec->flags & (G_PARAM_CONSTRUCT | G_PARAM_CONSTRUCT_ONLY)) == 0 ||
+		    (pspec->flags & G_PARAM_READWRITE) != G_PARAM_READWRITE ||
+		    pspec->owner_type == TEPL_TYPE_BUFFER ||
+		    !g_type_is_a (pspec->owner_type, TEPL_TYPE_BUFFER))
+		{
+			continue;
+		}
+
+		names[n_properties] = pspec->name;
+		g_value_init (&values[n_properties], pspec->value_type);
+		g_object_get_property (G_OBJECT (buffer), pspec->name, &values[n_properties]);
+		n_properties++;
+	}
+
+	sibling = TEPL_BUFFER (g_object_new_with_properties (G_OBJECT_TYPE (buffer),
+							     n_properties,
+							     names,
+							     values));
+
+	for (i = 0; i < n_properties; i++)
+	{
+		g_value_unset (&values[i]);
+	}
+
+	g_free (values);
+	g_free (names);
+	g_free (pspecs);
+
+	return sibling;
+}
+
+/* Creates an empty buffer of the same type as @buffer, with the same settings,
+ * and sharing its TeplFile and TeplMetadata. A file can be loaded into it
+ * while it is not attached to a view, and it can then replace @buffer in the
+ * view with gtk_text_view_set_buffer().
+ */
+TeplBuffer *
+_tepl_buffer_new_sibling (TeplBuffer *buffer)
+{
+	TeplBufferPrivate *priv;
+	TeplBuffer *sibling;
+	TeplBufferPrivate *sibling_priv;
+	GtkSourceBuffer *gsv_buffer;
+	GtkSourceBuffer *gsv_sibling;
+
+	g_return_val_if_fail (TEPL_IS_BUFFER (buffer), NULL);
+
+	priv = tepl_buffer_get_instance_private (buffer);
+
+	sibling = new_buffer_with_subclass_construct_properties (buffer);
+	sibling_priv = tepl_buffer_get_instance_private (sibling);
+
+	g_signal_handlers_disconnect_by_func (sibling_priv->file,
+					      file_short_name_notify_cb,
+					      sibling);
+	g_set_object (&sibling_priv->file, priv->file);
+	g_set_object (&sibling_priv->metadata, priv->metadata);
+
+	g_signal_connect_object (sibling_priv->file,
+				 "notify::short-name",
+				 G_CALLBACK (file_short_name_notify_cb),
+				 sibling,
+				 0);
+
+	gsv_buffer = GTK_SOURCE_BUFFER (buffer);
+	gsv_sibling = GTK_SOURCE_BUFFER (sibling);
+
+	gtk_source_buffer_set_language (gsv_sibling,
+					gtk_source_buffer_get_language (gsv_buffer));
+	gtk_source_buffer_set_style_scheme (gsv_sibling,
+					    gtk_source_buffer_get_style_scheme (gsv_buffer));
+	gtk_source_buffer_set_highlight_syntax (gsv_sibling,
+						gtk_source_buffer_get_highlight_syntax (gsv_buffer));
+	gtk_source_buffer_set_highlight_matching_brackets (gsv_sibling,
+							   gtk_source_buffer_get_highlight_matching_brackets (gsv_buffer));
+	gtk_source_buffer_set_max_undo_levels (gsv_sibling,
+					       gtk_source_buffer_get_max_undo_levels (gsv_buffer));
+	copy_undo_memory_budget (buffer, sibling);
+	gtk_source_buffer_set_implicit_trailing_newline (gsv_sibling,
+							 gtk_source_buffer_get_implicit_trailing_newline (gsv_buffer));
+
+	return sibling;
 }
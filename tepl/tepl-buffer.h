@@ -47,6 +47,25 @@ typedef enum _TeplSelectionType
 	TEPL_SELECTION_TYPE_MULTIPLE_LINES
 } TeplSelectionType;
 
+/**
+ * TeplBufferEdit:
+ * @start_offset: the character offset of the start of the range to replace.
+ * @end_offset: the character offset of the end of the range to replace.
+ * @text: (nullable): the replacement text, in UTF-8. %NULL or the empty string
+ *   to only delete the range.
+ *
+ * A replacement of a range of a #TeplBuffer, see tepl_buffer_apply_edits().
+ *
+ * Since: 6.0
+ */
+typedef struct _TeplBufferEdit TeplBufferEdit;
+struct _TeplBufferEdit
+{
+	gint start_offset;
+	gint end_offset;
+	const gchar *text;
+};
+
 _TEPL_EXTERN
 TeplBuffer *		tepl_buffer_new				(void);
 
@@ -83,14 +102,84 @@ void			tepl_buffer_set_style_scheme_id		(TeplBuffer  *buffer,
 _TEPL_EXTERN
 TeplSelectionType	tepl_buffer_get_selection_type		(TeplBuffer *buffer);
 
+_TEPL_EXTERN
+gint			tepl_buffer_get_line_char_offset	(TeplBuffer *buffer,
+								 gint        line);
+
+_TEPL_EXTERN
+goffset			tepl_buffer_get_line_byte_offset	(TeplBuffer *buffer,
+								 gint        line);
+
+_TEPL_EXTERN
+gint			tepl_buffer_get_line_at_char_offset	(TeplBuffer *buffer,
+								 gint        char_offset);
+
+_TEPL_EXTERN
+gint			tepl_buffer_get_line_at_byte_offset	(TeplBuffer *buffer,
+								 goffset     byte_offset);
+
+_TEPL_EXTERN
+goffset			tepl_buffer_char_offset_to_byte_offset	(TeplBuffer *buffer,
+								 gint        char_offset);
+
+_TEPL_EXTERN
+gint			tepl_buffer_byte_offset_to_char_offset	(TeplBuffer *buffer,
+								 goffset     byte_offset);
+
+_TEPL_EXTERN
+void			tepl_buffer_apply_edits			(TeplBuffer           *buffer,
+								 const TeplBufferEdit *edits,
+								 guint                 n_edits);
+
 G_GNUC_INTERNAL
-void			_tepl_buffer_set_as_invalid_character	(TeplBuffer        *buffer,
-								 const GtkTextIter *start,
-								 const GtkTextIter *end);
+void			_tepl_buffer_set_as_invalid_chars	(TeplBuffer   *buffer,
+								 const GArray *offsets);
 
 G_GNUC_INTERNAL
 gboolean		_tepl_buffer_has_invalid_chars		(TeplBuffer *buffer);
 
+G_GNUC_INTERNAL
+void			_tepl_buffer_add_line_split		(TeplBuffer        *buffer,
+								 const GtkTextIter *newline);
+
+G_GNUC_INTERNAL
+void			_tepl_buffer_clear_line_splits		(TeplBuffer *buffer);
+
+G_GNUC_INTERNAL
+gboolean		_tepl_buffer_has_edited_line_splits	(TeplBuffer *buffer);
+
+G_GNUC_INTERNAL
+GArray *		_tepl_buffer_get_line_split_offsets	(TeplBuffer *buffer);
+
+G_GNUC_INTERNAL
+void			_tepl_buffer_set_partial_content	(TeplBuffer *buffer,
+								 gboolean    partial_content);
+
+G_GNUC_INTERNAL
+gboolean		_tepl_buffer_has_partial_content	(TeplBuffer *buffer);
+
+G_GNUC_INTERNAL
+TeplBuffer *		_tepl_buffer_new_sibling		(TeplBuffer *buffer);
+
+G_GNUC_INTERNAL
+guint64			_tepl_buffer_get_revision		(TeplBuffer *buffer);
+
+G_GNUC_INTERNAL
+void			_tepl_buffer_set_current_content_as_saved (TeplBuffer *buffer);
+
+G_GNUC_INTERNAL
+gboolean		_tepl_buffer_is_unchanged_since_save	(TeplBuffer *buffer);
+
+G_GNUC_INTERNAL
+gboolean		_tepl_buffer_get_iter_at_line		(TeplBuffer  *buffer,
+								 GtkTextIter *iter,
+								 gint         line);
+
+G_GNUC_INTERNAL
+void			_tepl_buffer_get_iter_at_line_end	(TeplBuffer  *buffer,
+								 GtkTextIter *iter,
+								 gint         line);
+
 G_END_DECLS
 
 #endif /* TEPL_BUFFER_H */
@@ -0,0 +1,267 @@
+/* SPDX-FileCopyrightText: 2020 - Sébastien Wilmet <swilmet@gnome.org>
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "config.h"
+#include "tepl-charset-converter.h"
+#include <glib/gi18n-lib.h>
+#include "tepl-icu.h"
+
+/* A streaming character encoding converter, built on ICU.
+ *
+ * The input is given chunk by chunk, and a character can be split between two
+ * chunks (ICU keeps the state between two calls). The conversion goes through
+ * a small UTF-16 pivot buffer with ucnv_convertEx(), so the whole content is
+ * never materialized in UTF-16.
+ *
+ * A TeplCharsetConverter is not thread-safe, but it can be used by different
+ * threads one after the other, for example by a chain of GTask's running in
+ * a thread.
+ */
+
+#define PIVOT_BUFFER_SIZE (1024)
+
+/* The buffer size needed by ucnv_getInvalidChars(). */
+#define INVALID_CHARS_BUFFER_SIZE (32)
+
+struct _TeplCharsetConverter
+{
+	UConverter *from_converter;
+	UConverter *to_converter;
+
+	gchar *from_charset;
+	gchar *to_charset;
+
+	/* The content of the pivot buffer must be kept between two calls to
+	 * ucnv_convertEx().
+	 */
+	UChar pivot_buffer[PIVOT_BUFFER_SIZE];
+	UChar *pivot_source;
+	UChar *pivot_target;
+
+	/* The number of input bytes converted so far, to report the position of
+	 * invalid data.
+	 */
+	goffset n_converted_bytes;
+};
+
+/*
+ * _tepl_charset_converter_new:
+ * @from_charset: the character encoding of the input.
+ * @to_charset: the character encoding of the output.
+ * @error: location to a %NULL #GError, or %NULL.
+ *
+ * The charsets are ICU converter names or aliases, for example "UTF-8",
+ * "ISO-8859-15" or "UTF-16". With "UTF-16" or "UTF-32" as @from_charset, the
+ * byte order is detected from the BOM, and the BOM is removed.
+ *
+ * Returns: (transfer full) (nullable): a new #TeplCharsetConverter, or %NULL
+ * if one of the charsets is not supported. Free with
+ * _tepl_charset_converter_free().
+ */
+TeplCharsetConverter *
+_tepl_charset_converter_new (const gchar  *from_charset,
+			     const gchar  *to_charset,
+			     GError      **error)
+{
+	TeplCharsetConverter *converter;
+	UErrorCode from_error_code = U_ZERO_ERROR;
+	UErrorCode to_error_code = U_ZERO_ERROR;
+
+	g_return_val_if_fail (from_charset != NULL, NULL);
+	g_return_val_if_fail (to_charset != NULL, NULL);
+	g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+	converter = g_new0 (TeplCharsetConverter, 1);
+	converter->from_converter = _tepl_icu_ucnv_open_strict (from_charset, &from_error_code);
+	converter->to_converter = _tepl_icu_ucnv_open_strict (to_charset, &to_error_code);
+
+	if (U_FAILURE (from_error_code) || U_FAILURE (to_error_code))
+	{
+		g_set_error (error,
+			     G_IO_ERROR,
+			     G_IO_ERROR_NOT_SUPPORTED,
+			     _("Conversion from character encoding “%s” to “%s” is not supported."),
+			     from_charset,
+			     to_charset);
+
+		_tepl_charset_converter_free (converter);
+		return NULL;
+	}
+
+	converter->from_charset = g_strdup (from_charset);
+	converter->to_charset = g_strdup (to_charset);
+	converter->pivot_source = converter->pivot_buffer;
+	converter->pivot_target = converter->pivot_buffer;
+
+	return converter;
+}
+
+void
+_tepl_charset_converter_free (TeplCharsetConverter *converter)
+{
+	if (converter == NULL)
+	{
+		return;
+	}
+
+	if (converter->from_converter != NULL)
+	{
+		ucnv_close (converter->from_converter);
+	}
+
+	if (converter->to_converter != NULL)
+	{
+		ucnv_close (converter->to_converter);
+	}
+
+	g_free (converter->from_charset);
+	g_free (converter->to_charset);
+	g_free (converter);
+}
+
+/* @n_consumed_bytes: the number of bytes of the current input that ICU has
+ * consumed when the error occurred.
+ */
+static void
+set_conversion_error (TeplCharsetConverter  *converter,
+		      UErrorCode             error_code,
+		      gsize                  n_consumed_bytes,
+		      GError               **error)
+{
+	char invalid_chars[INVALID_CHARS_BUFFER_SIZE];
+	int8_t invalid_chars_length = sizeof (invalid_chars);
+	UErrorCode my_error_code = U_ZERO_ERROR;
+	goffset offset;
+	gchar *offset_str;
+
+	ucnv_getInvalidChars (converter->from_converter,
+			      invalid_chars,
+			      &invalid_chars_length,
+			      &my_error_code);
+
+	if (U_FAILURE (my_error_code))
+	{
+		invalid_chars_length = 0;
+	}
+
+	if (invalid_chars_length == 0 && error_code != U_TRUNCATED_CHAR_FOUND)
+	{
+		/* The input is valid, but a character doesn't exist in the
+		 * output charset.
+		 */
+		g_set_error (error,
+			     G_IO_ERROR,
+			     G_IO_ERROR_INVALID_DATA,
+			     _("Some characters cannot be converted to the character encoding “%s”."),
+			     converter->to_charset);
+		return;
+	}
+
+	/* The invalid bytes have already been consumed. */
+	offset = converter->n_converted_bytes + n_consumed_bytes - invalid_chars_length;
+	offset = MAX (offset, 0);
+	offset_str = g_strdup_printf ("%" G_GOFFSET_FORMAT, offset);
+
+	/* Translators: the first %s is a character encoding name, for example
+	 * "ISO-8859-15". The second %s is a position in the file, in bytes.
+	 */
+	g_set_error (error,
+		     G_IO_ERROR,
+		     G_IO_ERROR_INVALID_DATA,
+		     _("The content is not valid in the “%s” character encoding. "
+		       "Invalid data found at byte %s."),
+		     converter->from_charset,
+		     offset_str);
+
+	g_free (offset_str);
+}
+
+/*
+ * _tepl_charset_converter_convert:
+ * @converter: a #TeplCharsetConverter.
+ * @input: the next chunk of the input.
+ * @input_length: the length of @input, in bytes.
+ * @flush: %TRUE for the last chunk. @input can be empty.
+ * @error: location to a %NULL #GError, or %NULL.
+ *
+ * Converts the next chunk. If the chunk ends with an incomplete character, its
+ * first bytes are kept in @converter and the character is converted with the
+ * next chunk.
+ *
+ * Returns: (transfer full) (nullable): the converted chunk, or %NULL on error.
+ */
+GBytes *
+_tepl_charset_converter_convert (TeplCharsetConverter  *converter,
+				 const gchar           *input,
+				 gsize                  input_length,
+				 gboolean               flush,
+				 GError               **error)
+{
+	const char *source = input;
+	gchar *output;
+	gsize output_capacity;
+	gsize output_length = 0;
+
+	g_return_val_if_fail (converter != NULL, NULL);
+	g_return_val_if_fail (input != NULL || input_length == 0, NULL);
+	g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+	/* Enough for most conversions. Otherwise the buffer is grown. */
+	output_capacity = input_length + input_length / 2 + 16;
+	output = g_malloc (output_capacity);
+
+	while (TRUE)
+	{
+		char *target = output + output_length;
+		UErrorCode error_code = U_ZERO_ERROR;
+
+		ucnv_convertEx (converter->to_converter,
+				converter->from_converter,
+				&target,
+				output + output_capacity,
+				&source,
+				input + input_length,
+				converter->pivot_buffer,
+				&converter->pivot_source,
+				&converter->pivot_target,
+				converter->pivot_buffer + PIVOT_BUFFER_SIZE,
+				FALSE,
+				flush,
+				&error_code);
+
+		output_length = target - output;
+
+		if (error_code == U_BUFFER_OVERFLOW_ERROR)
+		{
+			output_capacity *= 2;
+			output = g_realloc (output, output_capacity);
+			continue;
+		}
+
+		if (U_FAILURE (error_code))
+		{
+			set_conversion_error (converter, error_code, source - input, error);
+			g_free (output);
+			return NULL;
+		}
+
+		break;
+	}
+
+	converter->n_converted_bytes += input_length;
+
+	output = g_realloc (output, output_length);
+	return g_bytes_new_take (output, output_length);
+}
+
+/* Returns: whether @charset is UTF-8, ignoring the case and the punctuation as
+ * for ICU converter names. For example "utf8" is also UTF-8.
+ */
+gboolean
+_tepl_charset_is_utf8 (const gchar *charset)
+{
+	g_return_val_if_fail (charset != NULL, FALSE);
+
+	return ucnv_compareNames (charset, "UTF-8") == 0;
+}
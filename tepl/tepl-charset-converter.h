@@ -0,0 +1,34 @@
+/* SPDX-FileCopyrightText: 2020 - Sébastien Wilmet <swilmet@gnome.org>
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef TEPL_CHARSET_CONVERTER_H
+#define TEPL_CHARSET_CONVERTER_H
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+typedef struct _TeplCharsetConverter TeplCharsetConverter;
+
+G_GNUC_INTERNAL
+TeplCharsetConverter *	_tepl_charset_converter_new		(const gchar  *from_charset,
+								 const gchar  *to_charset,
+								 GError      **error);
+
+G_GNUC_INTERNAL
+void			_tepl_charset_converter_free		(TeplCharsetConverter *converter);
+
+G_GNUC_INTERNAL
+GBytes *		_tepl_charset_converter_convert		(TeplCharsetConverter  *converter,
+								 const gchar           *input,
+								 gsize                  input_length,
+								 gboolean               flush,
+								 GError               **error);
+
+G_GNUC_INTERNAL
+gboolean		_tepl_charset_is_utf8			(const gchar *charset);
+
+G_END_DECLS
+
+#endif /* TEPL_CHARSET_CONVERTER_H */
@@ -0,0 +1,443 @@
+/* SPDX-FileCopyrightText: 2020 - Sébastien Wilmet <swilmet@gnome.org>
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "tepl-charset-detector.h"
+#include <string.h>
+#include <unicode/ucsdet.h>
+#include "tepl-utf8.h"
+
+/* Character encoding auto-detection.
+ *
+ * The whole file is never read: only a prefix, plus a few samples taken at
+ * regular intervals in the rest of the file (if the input stream is seekable).
+ * So the time needed doesn't depend on the file size.
+ *
+ * The samples are first checked for a BOM and for UTF-8, the most common case,
+ * with the fast UTF-8 validator. Otherwise the ICU charset detector (ucsdet)
+ * is used.
+ *
+ * The confidence is a number between 0 and 100, like for ucsdet.
+ */
+
+#define PREFIX_SIZE (64 * 1024)
+#define SAMPLE_SIZE (4 * 1024)
+#define N_SAMPLES (8)
+
+/* The ucsdet confidence for UTF-8 without BOM. The samples can be valid UTF-8
+ * while the rest of the file is not.
+ */
+#define UTF8_CONFIDENCE (80)
+
+typedef struct
+{
+	const gchar *bom;
+	gsize bom_length;
+	const gchar *charset;
+} BomInfo;
+
+/* The UTF-32 BOMs must be checked before the UTF-16 ones. The "UTF-16" and
+ * "UTF-32" ICU converters detect the byte order from the BOM.
+ */
+static const BomInfo boms[] =
+{
+	{ "\xEF\xBB\xBF", 3, "UTF-8" },
+	{ "\x00\x00\xFE\xFF", 4, "UTF-32" },
+	{ "\xFF\xFE\x00\x00", 4, "UTF-32" },
+	{ "\xFE\xFF", 2, "UTF-16" },
+	{ "\xFF\xFE", 2, "UTF-16" },
+};
+
+/* Returns: the charset corresponding to the byte order mark (BOM) at the start
+ * of @data, or %NULL if there is no BOM.
+ */
+const gchar *
+_tepl_charset_detect_bom (const gchar *data,
+			  gsize        length)
+{
+	gsize i;
+
+	g_return_val_if_fail (data != NULL || length == 0, NULL);
+
+	for (i = 0; i < G_N_ELEMENTS (boms); i++)
+	{
+		if (length >= boms[i].bom_length &&
+		    memcmp (data, boms[i].bom, boms[i].bom_length) == 0)
+		{
+			return boms[i].charset;
+		}
+	}
+
+	return NULL;
+}
+
+static const gchar *
+detect_bom (GBytes *first_sample)
+{
+	const gchar *data;
+	gsize length;
+
+	data = g_bytes_get_data (first_sample, &length);
+	return _tepl_charset_detect_bom (data, length);
+}
+
+/* A sample taken in the middle of the file can start and end in the middle of
+ * a UTF-8 character.
+ */
+static gboolean
+sample_is_valid_utf8 (GBytes   *sample,
+		      gboolean  is_start,
+		      gboolean  is_end)
+{
+	const gchar *data;
+	gsize length;
+	gsize valid_length;
+
+	data = g_bytes_get_data (sample, &length);
+
+	if (!is_start)
+	{
+		gsize n_skipped_bytes = 0;
+
+		while (n_skipped_bytes < length &&
+		       n_skipped_bytes < TEPL_UTF8_CHAR_MAX_LENGTH - 1 &&
+		       (((guchar) data[n_skipped_bytes]) & 0xC0) == 0x80)
+		{
+			n_skipped_bytes++;
+		}
+
+		data += n_skipped_bytes;
+		length -= n_skipped_bytes;
+	}
+
+	if (_tepl_utf8_validate (data, length, &valid_length))
+	{
+		return TRUE;
+	}
+
+	return (!is_end &&
+		_tepl_utf8_is_incomplete_char (data + valid_length, length - valid_length));
+}
+
+/* ucsdet can return names that are not converter names, for the visual and
+ * logical variants of some charsets.
+ */
+static gchar *
+get_converter_name (const gchar *ucsdet_name)
+{
+	if (g_str_has_suffix (ucsdet_name, "_rtl") ||
+	    g_str_has_suffix (ucsdet_name, "_ltr"))
+	{
+		return g_strndup (ucsdet_name, strlen (ucsdet_name) - strlen ("_rtl"));
+	}
+
+	return g_strdup (ucsdet_name);
+}
+
+static gchar *
+detect_with_ucsdet (GPtrArray *samples,
+		    gint      *confidence)
+{
+	GByteArray *text;
+	UCharsetDetector *detector;
+	const UCharsetMatch *match;
+	gchar *charset = NULL;
+	UErrorCode error_code = U_ZERO_ERROR;
+	guint i;
+
+	text = g_byte_array_new ();
+
+	for (i = 0; i < samples->len; i++)
+	{
+		GBytes *sample = g_ptr_array_index (samples, i);
+		gconstpointer data;
+		gsize length;
+
+		data = g_bytes_get_data (sample, &length);
+		g_byte_array_append (text, data, length);
+	}
+
+	detector = ucsdet_open (&error_code);
+	ucsdet_setText (detector, (const char *) text->data, text->len, &error_code);
+	match = ucsdet_detect (detector, &error_code);
+
+	if (U_SUCCESS (error_code) && match != NULL)
+	{
+		const char *name;
+
+		name = ucsdet_getName (match, &error_code);
+		*confidence = ucsdet_getConfidence (match, &error_code);
+
+		if (U_SUCCESS (error_code) && name != NULL)
+		{
+			charset = get_converter_name (name);
+		}
+	}
+
+	ucsdet_close (detector);
+	g_byte_array_unref (text);
+
+	return charset;
+}
+
+/*
+ * _tepl_charset_detect:
+ * @samples: (element-type GBytes): the samples of the content. The first one
+ *   must be at the beginning of the content.
+ * @last_sample_is_end: whether the last sample is at the end of the content.
+ * @confidence: (out): the detection confidence, between 0 and 100.
+ *
+ * Returns: (transfer full) (nullable): the detected charset, as an ICU
+ * converter name, or %NULL if it cannot be detected. Free with g_free().
+ */
+gchar *
+_tepl_charset_detect (GPtrArray *samples,
+		      gboolean   last_sample_is_end,
+		      gint      *confidence)
+{
+	const gchar *bom_charset;
+	gboolean valid_utf8 = TRUE;
+	guint i;
+
+	g_return_val_if_fail (samples != NULL, NULL);
+	g_return_val_if_fail (confidence != NULL, NULL);
+
+	*confidence = 0;
+
+	if (samples->len == 0)
+	{
+		return NULL;
+	}
+
+	bom_charset = detect_bom (g_ptr_array_index (samples, 0));
+	if (bom_charset != NULL)
+	{
+		*confidence = 100;
+		return g_strdup (bom_charset);
+	}
+
+	for (i = 0; i < samples->len && valid_utf8; i++)
+	{
+		gboolean is_start = i == 0;
+		gboolean is_end = i == samples->len - 1 && last_sample_is_end;
+
+		valid_utf8 = sample_is_valid_utf8 (g_ptr_array_index (samples, i), is_start, is_end);
+	}
+
+	if (valid_utf8)
+	{
+		*confidence = UTF8_CONFIDENCE;
+		return g_strdup ("UTF-8");
+	}
+
+	return detect_with_ucsdet (samples, confidence);
+}
+
+static GBytes *
+read_sample (GInputStream  *input_stream,
+	     gsize          size,
+	     GCancellable  *cancellable,
+	     GError       **error)
+{
+	gchar *buffer;
+	gsize n_bytes_read = 0;
+
+	buffer = g_malloc (size);
+
+	if (!g_input_stream_read_all (input_stream, buffer, size, &n_bytes_read, cancellable, error))
+	{
+		g_free (buffer);
+		return NULL;
+	}
+
+	buffer = g_realloc (buffer, n_bytes_read);
+	return g_bytes_new_take (buffer, n_bytes_read);
+}
+
+typedef struct
+{
+	gchar *charset;
+	gint confidence;
+} DetectionResult;
+
+static void
+detection_result_free (DetectionResult *result)
+{
+	if (result != NULL)
+	{
+		g_free (result->charset);
+		g_free (result);
+	}
+}
+
+/* Reads the samples of the file. Returns whether the last sample is at the end
+ * of the file.
+ */
+static gboolean
+read_samples (GFileInputStream  *file_input_stream,
+	      GPtrArray         *samples,
+	      GCancellable      *cancellable,
+	      GError           **error)
+{
+	GInputStream *input_stream = G_INPUT_STREAM (file_input_stream);
+	GSeekable *seekable = G_SEEKABLE (file_input_stream);
+	GBytes *prefix;
+	GFileInfo *info;
+	goffset file_size;
+	goffset prev_sample_end;
+	gint sample_num;
+
+	prefix = read_sample (input_stream, PREFIX_SIZE, cancellable, error);
+	if (prefix == NULL)
+	{
+		return FALSE;
+	}
+
+	g_ptr_array_add (samples, prefix);
+
+	if (g_bytes_get_size (prefix) < PREFIX_SIZE ||
+	    !g_seekable_can_seek (seekable))
+	{
+		return g_bytes_get_size (prefix) < PREFIX_SIZE;
+	}
+
+	info = g_file_input_stream_query_info (file_input_stream,
+					       G_FILE_ATTRIBUTE_STANDARD_SIZE,
+					       cancellable,
+					       NULL);
+	if (info == NULL)
+	{
+		return FALSE;
+	}
+
+	file_size = g_file_info_get_size (info);
+	g_object_unref (info);
+
+	prev_sample_end = PREFIX_SIZE;
+
+	for (sample_num = 1; sample_num <= N_SAMPLES; sample_num++)
+	{
+		goffset offset;
+		GBytes *sample;
+
+		/* Aligned, to not break UTF-16 and UTF-32 code units. */
+		offset = (file_size * sample_num / (N_SAMPLES + 1)) & ~((goffset) 3);
+		if (offset < prev_sample_end)
+		{
+			continue;
+		}
+
+		if (!g_seekable_seek (seekable, offset, G_SEEK_SET, cancellable, error))
+		{
+			return FALSE;
+		}
+
+		sample = read_sample (input_stream, SAMPLE_SIZE, cancellable, error);
+		if (sample == NULL)
+		{
+			return FALSE;
+		}
+
+		prev_sample_end = offset + g_bytes_get_size (sample);
+		g_ptr_array_add (samples, sample);
+	}
+
+	return prev_sample_end >= file_size;
+}
+
+static void
+detect_file_thread (GTask        *task,
+		    gpointer      source_object,
+		    gpointer      task_data,
+		    GCancellable *cancellable)
+{
+	GFile *location = G_FILE (source_object);
+	GFileInputStream *file_input_stream;
+	GPtrArray *samples;
+	gboolean last_sample_is_end;
+	DetectionResult *result;
+	GError *error = NULL;
+
+	file_input_stream = g_file_read (location, cancellable, &error);
+	if (error != NULL)
+	{
+		g_task_return_error (task, error);
+		return;
+	}
+
+	samples = g_ptr_array_new_with_free_func ((GDestroyNotify)g_bytes_unref);
+	last_sample_is_end = read_samples (file_input_stream, samples, cancellable, &error);
+	g_object_unref (file_input_stream);
+
+	if (error != NULL)
+	{
+		g_task_return_error (task, error);
+		g_ptr_array_unref (samples);
+		return;
+	}
+
+	result = g_new0 (DetectionResult, 1);
+	result->charset = _tepl_charset_detect (samples, last_sample_is_end, &result->confidence);
+	g_ptr_array_unref (samples);
+
+	g_task_return_pointer (task, result, (GDestroyNotify)detection_result_free);
+}
+
+/*
+ * _tepl_charset_detect_file_async:
+ *
+ * Detects the charset of @location, in a worker thread.
+ */
+void
+_tepl_charset_detect_file_async (GFile               *location,
+				 gint                 io_priority,
+				 GCancellable        *cancellable,
+				 GAsyncReadyCallback  callback,
+				 gpointer             user_data)
+{
+	GTask *task;
+
+	g_return_if_fail (G_IS_FILE (location));
+	g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+
+	task = g_task_new (location, cancellable, callback, user_data);
+	g_task_set_priority (task, io_priority);
+	g_task_run_in_thread (task, detect_file_thread);
+	g_object_unref (task);
+}
+
+/*
+ * _tepl_charset_detect_file_finish:
+ * @result: a #GAsyncResult.
+ * @confidence: (out): the detection confidence, between 0 and 100.
+ * @error: location to a %NULL #GError, or %NULL.
+ *
+ * Returns: (transfer full) (nullable): the detected charset, or %NULL if it
+ * cannot be detected or if an error occurred. Free with g_free().
+ */
+gchar *
+_tepl_charset_detect_file_finish (GAsyncResult  *result,
+				  gint          *confidence,
+				  GError       **error)
+{
+	DetectionResult *detection_result;
+	gchar *charset;
+
+	g_return_val_if_fail (G_IS_TASK (result), NULL);
+	g_return_val_if_fail (confidence != NULL, NULL);
+	g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+	*confidence = 0;
+
+	detection_result = g_task_propagate_pointer (G_TASK (result), error);
+	if (detection_result == NULL)
+	{
+		return NULL;
+	}
+
+	charset = g_steal_pointer (&detection_result->charset);
+	*confidence = detection_result->confidence;
+	detection_result_free (detection_result);
+
+	return charset;
+}
@@ -0,0 +1,35 @@
+/* SPDX-FileCopyrightText: 2020 - Sébastien Wilmet <swilmet@gnome.org>
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef TEPL_CHARSET_DETECTOR_H
+#define TEPL_CHARSET_DETECTOR_H
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+G_GNUC_INTERNAL
+const gchar *	_tepl_charset_detect_bom			(const gchar *data,
+								 gsize        length);
+
+G_GNUC_INTERNAL
+gchar *		_tepl_charset_detect				(GPtrArray *samples,
+								 gboolean   last_sample_is_end,
+								 gint      *confidence);
+
+G_GNUC_INTERNAL
+void		_tepl_charset_detect_file_async			(GFile               *location,
+								 gint                 io_priority,
+								 GCancellable        *cancellable,
+								 GAsyncReadyCallback  callback,
+								 gpointer             user_data);
+
+G_GNUC_INTERNAL
+gchar *		_tepl_charset_detect_file_finish		(GAsyncResult  *result,
+								 gint          *confidence,
+								 GError       **error);
+
+G_END_DECLS
+
+#endif /* TEPL_CHARSET_DETECTOR_H */
@@ -0,0 +1,306 @@
+/* SPDX-FileCopyrightText: 2020 - Sébastien Wilmet <swilmet@gnome.org>
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "config.h"
+#include "tepl-charset-encoder.h"
+#include <glib/gi18n-lib.h>
+#include "tepl-icu.h"
+
+/* A streaming encoder from UTF-8 to another character encoding, built on
+ * ICU, for saving files.
+ *
+ * The UTF-8 text is converted to UTF-16 in chunks of bounded size, and each
+ * chunk is then encoded with ucnv_fromUnicode(). So the memory needed doesn't
+ * depend on the length of the text.
+ *
+ * The characters that don't exist in the target charset are replaced by the
+ * substitution character of the charset, and their positions are reported.
+ *
+ * A TeplCharsetEncoder is not thread-safe, but it can be used by different
+ * threads one after the other.
+ */
+
+/* In UTF-16 code units. A chunk of UTF16_BUFFER_SIZE bytes of UTF-8 always
+ * fits.
+ */
+#define UTF16_BUFFER_SIZE (8 * 1024)
+
+struct _TeplCharsetEncoder
+{
+	UConverter *converter;
+
+	/* The chunk being encoded, for the callback. */
+	const UChar *chunk;
+
+	/* The number of characters of the current text before @chunk. */
+	gsize n_chars_before_chunk;
+
+	/* Where the callback appends the positions of the unconvertible
+	 * characters.
+	 */
+	GArray *unconvertible_chars;
+
+	UChar utf16_buffer[UTF16_BUFFER_SIZE];
+};
+
+/* Records the position of the unconvertible character, and writes the
+ * substitution character instead.
+ */
+static void
+from_unicode_callback (const void                *context,
+		       UConverterFromUnicodeArgs *args,
+		       const UChar               *code_units,
+		       int32_t                    length,
+		       UChar32                    code_point,
+		       UConverterCallbackReason   reason,
+		       UErrorCode                *error_code)
+{
+	TeplCharsetEncoder *encoder = (TeplCharsetEncoder *) context;
+	gint32 utf16_index;
+	gsize char_index;
+
+	if (reason != UCNV_UNASSIGNED &&
+	    reason != UCNV_ILLEGAL &&
+	    reason != UCNV_IRREGULAR)
+	{
+		/* UCNV_RESET, UCNV_CLOSE or UCNV_CLONE. */
+		return;
+	}
+
+	/* The code units have already been consumed. */
+	utf16_index = (args->source - encoder->chunk) - length;
+	utf16_index = MAX (utf16_index, 0);
+
+	char_index = encoder->n_chars_before_chunk + u_countChar32 (encoder->chunk, utf16_index);
+	g_array_append_val (encoder->unconvertible_chars, char_index);
+
+	UCNV_FROM_U_CALLBACK_SUBSTITUTE (NULL, args, code_units, length, code_point, reason, error_code);
+}
+
+/*
+ * _tepl_charset_encoder_new:
+ * @charset: the character encoding of the output, as an ICU converter name or
+ *   alias.
+ * @error: location to a %NULL #GError, or %NULL.
+ *
+ * With "UTF-16" or "UTF-32", a byte order mark (BOM) is written at the start.
+ *
+ * Returns: (transfer full) (nullable): a new #TeplCharsetEncoder, or %NULL if
+ * @charset is not supported. Free with _tepl_charset_encoder_free().
+ */
+TeplCharsetEncoder *
+_tepl_charset_encoder_new (const gchar  *charset,
+			   GError      **error)
+{
+	TeplCharsetEncoder *encoder;
+	UErrorCode error_code = U_ZERO_ERROR;
+
+	g_return_val_if_fail (charset != NULL, NULL);
+	g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+	encoder = g_new0 (TeplCharsetEncoder, 1);
+	encoder->converter = _tepl_icu_ucnv_open_strict (charset, &error_code);
+
+	if (U_SUCCESS (error_code))
+	{
+		ucnv_setFromUCallBack (encoder->converter,
+				       from_unicode_callback,
+				       encoder,
+				       NULL,
+				       NULL,
+				       &error_code);
+	}
+
+	if (U_FAILURE (error_code))
+	{
+		g_set_error (error,
+			     G_IO_ERROR,
+			     G_IO_ERROR_NOT_SUPPORTED,
+			     _("Conversion from character encoding “%s” to “%s” is not supported."),
+			     "UTF-8",
+			     charset);
+
+		_tepl_charset_encoder_free (encoder);
+		return NULL;
+	}
+
+	return encoder;
+}
+
+void
+_tepl_charset_encoder_free (TeplCharsetEncoder *encoder)
+{
+	if (encoder == NULL)
+	{
+		return;
+	}
+
+	if (encoder->converter != NULL)
+	{
+		ucnv_close (encoder->converter);
+	}
+
+	g_free (encoder);
+}
+
+/* Returns the end of the next chunk, on a character boundary. */
+static const gchar *
+get_chunk_end (const gchar *pos,
+	       const gchar *end)
+{
+	const gchar *chunk_end;
+
+	if ((gsize) (end - pos) <= UTF16_BUFFER_SIZE)
+	{
+		return end;
+	}
+
+	chunk_end = pos + UTF16_BUFFER_SIZE;
+
+	/* Not on a continuation byte. */
+	while (chunk_end > pos && (*chunk_end & 0xC0) == 0x80)
+	{
+		chunk_end--;
+	}
+
+	return chunk_end;
+}
+
+static gboolean
+encode_chunk (TeplCharsetEncoder  *encoder,
+	      int32_t              chunk_length,
+	      gboolean             flush,
+	      GByteArray          *output,
+	      GError             **error)
+{
+	const UChar *source = encoder->utf16_buffer;
+	const UChar *source_limit = encoder->utf16_buffer + chunk_length;
+
+	encoder->chunk = encoder->utf16_buffer;
+
+	while (TRUE)
+	{
+		guint prev_length = output->len;
+		int32_t capacity;
+		char *target;
+		UErrorCode error_code = U_ZERO_ERROR;
+
+		capacity = UCNV_GET_MAX_BYTES_FOR_STRING (source_limit - source,
+							  ucnv_getMaxCharSize (encoder->converter));
+		g_byte_array_set_size (output, prev_length + capacity);
+		target = (char *) output->data + prev_length;
+
+		ucnv_fromUnicode (encoder->converter,
+				  &target,
+				  target + capacity,
+				  &source,
+				  source_limit,
+				  NULL,
+				  flush,
+				  &error_code);
+
+		g_byte_array_set_size (output, (guint8 *) target - output->data);
+
+		/* Normally not possible with the maximum size, but the
+		 * substitution characters are not taken into account.
+		 */
+		if (error_code == U_BUFFER_OVERFLOW_ERROR)
+		{
+			continue;
+		}
+
+		if (U_FAILURE (error_code))
+		{
+			g_set_error (error,
+				     G_IO_ERROR,
+				     G_IO_ERROR_FAILED,
+				     _("Error during character encoding conversion: %s"),
+				     u_errorName (error_code));
+			return FALSE;
+		}
+
+		return TRUE;
+	}
+}
+
+/*
+ * _tepl_charset_encoder_encode:
+ * @encoder: a #TeplCharsetEncoder.
+ * @text: the next part of the text, in valid UTF-8. It must not end in the
+ *   middle of a character.
+ * @length: the length of @text, in bytes.
+ * @flush: %TRUE for the last part. @text can be empty.
+ * @output: where to append the encoded text.
+ * @unconvertible_chars: a #GArray of #gsize, where to append the character
+ *   indexes in @text of the characters that don't exist in the charset.
+ * @error: location to a %NULL #GError, or %NULL.
+ *
+ * The unconvertible characters are replaced by the substitution character of
+ * the charset, so it is not an error.
+ *
+ * Returns: %TRUE on success.
+ */
+gboolean
+_tepl_charset_encoder_encode (TeplCharsetEncoder  *encoder,
+			      const gchar         *text,
+			      gsize                length,
+			      gboolean             flush,
+			      GByteArray          *output,
+			      GArray              *unconvertible_chars,
+			      GError             **error)
+{
+	const gchar *pos = text;
+	const gchar *end = text + length;
+	gboolean ok = TRUE;
+
+	g_return_val_if_fail (encoder != NULL, FALSE);
+	g_return_val_if_fail (text != NULL || length == 0, FALSE);
+	g_return_val_if_fail (output != NULL, FALSE);
+	g_return_val_if_fail (unconvertible_chars != NULL, FALSE);
+	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+	encoder->n_chars_before_chunk = 0;
+	encoder->unconvertible_chars = unconvertible_chars;
+
+	do
+	{
+		const gchar *chunk_end;
+		int32_t chunk_length = 0;
+		UErrorCode error_code = U_ZERO_ERROR;
+
+		chunk_end = get_chunk_end (pos, end);
+
+		u_strFromUTF8 (encoder->utf16_buffer,
+			       UTF16_BUFFER_SIZE,
+			       &chunk_length,
+			       pos,
+			       chunk_end - pos,
+			       &error_code);
+
+		if (U_FAILURE (error_code))
+		{
+			g_set_error (error,
+				     G_IO_ERROR,
+				     G_IO_ERROR_INVALID_DATA,
+				     _("Error during character encoding conversion: %s"),
+				     u_errorName (error_code));
+			ok = FALSE;
+			break;
+		}
+
+		if (!encode_chunk (encoder, chunk_length, flush && chunk_end == end, output, error))
+		{
+			ok = FALSE;
+			break;
+		}
+
+		encoder->n_chars_before_chunk += u_countChar32 (encoder->utf16_buffer, chunk_length);
+		pos = chunk_end;
+	}
+	while (pos < end);
+
+	encoder->chunk = NULL;
+	encoder->unconvertible_chars = NULL;
+	return ok;
+}
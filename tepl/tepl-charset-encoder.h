@@ -0,0 +1,32 @@
+/* SPDX-FileCopyrightText: 2020 - Sébastien Wilmet <swilmet@gnome.org>
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef TEPL_CHARSET_ENCODER_H
+#define TEPL_CHARSET_ENCODER_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _TeplCharsetEncoder TeplCharsetEncoder;
+
+G_GNUC_INTERNAL
+TeplCharsetEncoder *	_tepl_charset_encoder_new		(const gchar  *charset,
+								 GError      **error);
+
+G_GNUC_INTERNAL
+void			_tepl_charset_encoder_free		(TeplCharsetEncoder *encoder);
+
+G_GNUC_INTERNAL
+gboolean		_tepl_charset_encoder_encode		(TeplCharsetEncoder  *encoder,
+								 const gchar         *text,
+								 gsize                length,
+								 gboolean             flush,
+								 GByteArray          *output,
+								 GArray              *unconvertible_chars,
+								 GError             **error);
+
+G_END_DECLS
+
+#endif /* TEPL_CHARSET_ENCODER_H */
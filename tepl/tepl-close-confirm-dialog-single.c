@@ -167,8 +167,12 @@ _tepl_close_confirm_dialog_single_async (TeplTab             *tab,
 
 	task = g_task_new (tab, NULL, callback, user_data);
 
+	/* The buffer can be modified but with the same content as the file,
+	 * for example when a character has been typed and then deleted.
+	 */
 	buffer = tepl_tab_get_buffer (tab);
-	if (!gtk_text_buffer_get_modified (GTK_TEXT_BUFFER (buffer)))
+	if (!gtk_text_buffer_get_modified (GTK_TEXT_BUFFER (buffer)) ||
+	    _tepl_buffer_is_unchanged_since_save (buffer))
 	{
 		g_task_return_boolean (task, CAN_CLOSE);
 		g_object_unref (task);
@@ -0,0 +1,166 @@
+/* SPDX-FileCopyrightText: 2020 - Sébastien Wilmet <swilmet@gnome.org>
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "tepl-content-analyzer.h"
+
+/* Collects information about a UTF-8 text given piece by piece, in a single
+ * pass over the bytes: the line terminators and the line lengths.
+ *
+ * Lines are terminated by "\n", "\r" or "\r\n". Like GtkTextBuffer, there is
+ * always one more line than the number of line terminators. A "\r\n" can be
+ * split between two pieces.
+ */
+
+void
+_tepl_content_analyzer_init (TeplContentAnalyzer *analyzer)
+{
+	g_return_if_fail (analyzer != NULL);
+
+	*analyzer = (TeplContentAnalyzer) { 0 };
+}
+
+static inline void
+end_line (TeplContentAnalyzer *analyzer)
+{
+	analyzer->total_lines_length += analyzer->cur_line_length;
+	analyzer->max_line_length = MAX (analyzer->max_line_length, analyzer->cur_line_length);
+	analyzer->cur_line_length = 0;
+}
+
+/* @text must be valid UTF-8, but it can start or end in the middle of a
+ * character.
+ */
+void
+_tepl_content_analyzer_feed (TeplContentAnalyzer *analyzer,
+			     const gchar         *text,
+			     gsize                length)
+{
+	const guchar *p = (const guchar *) text;
+	const guchar *end = p + length;
+
+	g_return_if_fail (analyzer != NULL);
+	g_return_if_fail (text != NULL || length == 0);
+
+	for (; p < end; p++)
+	{
+		guchar byte = *p;
+
+		if (byte == '\n')
+		{
+			if (analyzer->prev_char_is_cr)
+			{
+				/* The line has already been ended by the '\r'. */
+				analyzer->n_cr--;
+				analyzer->n_cr_lf++;
+			}
+			else
+			{
+				analyzer->n_lf++;
+				end_line (analyzer);
+			}
+
+			analyzer->prev_char_is_cr = FALSE;
+		}
+		else if (byte == '\r')
+		{
+			analyzer->n_cr++;
+			end_line (analyzer);
+			analyzer->prev_char_is_cr = TRUE;
+		}
+		else
+		{
+			/* Count the characters, not the continuation bytes. */
+			if ((byte & 0xC0) != 0x80)
+			{
+				analyzer->cur_line_length++;
+			}
+
+			analyzer->prev_char_is_cr = FALSE;
+		}
+	}
+}
+
+/* Returns: the most frequent line terminator, or %TEPL_NEWLINE_TYPE_DEFAULT if
+ * there is none.
+ */
+TeplNewlineType
+_tepl_content_analyzer_get_newline_type (const TeplContentAnalyzer *analyzer)
+{
+	g_return_val_if_fail (analyzer != NULL, TEPL_NEWLINE_TYPE_DEFAULT);
+
+	if (analyzer->n_lf == 0 &&
+	    analyzer->n_cr == 0 &&
+	    analyzer->n_cr_lf == 0)
+	{
+		return TEPL_NEWLINE_TYPE_DEFAULT;
+	}
+
+	if (analyzer->n_lf >= analyzer->n_cr &&
+	    analyzer->n_lf >= analyzer->n_cr_lf)
+	{
+		return TEPL_NEWLINE_TYPE_LF;
+	}
+
+	if (analyzer->n_cr_lf >= analyzer->n_cr)
+	{
+		return TEPL_NEWLINE_TYPE_CR_LF;
+	}
+
+	return TEPL_NEWLINE_TYPE_CR;
+}
+
+/* Returns: whether the content contains more than one kind of line
+ * terminators.
+ */
+gboolean
+_tepl_content_analyzer_has_mixed_newlines (const TeplContentAnalyzer *analyzer)
+{
+	guint n_kinds = 0;
+
+	g_return_val_if_fail (analyzer != NULL, FALSE);
+
+	if (analyzer->n_lf > 0)
+	{
+		n_kinds++;
+	}
+	if (analyzer->n_cr > 0)
+	{
+		n_kinds++;
+	}
+	if (analyzer->n_cr_lf > 0)
+	{
+		n_kinds++;
+	}
+
+	return n_kinds > 1;
+}
+
+guint64
+_tepl_content_analyzer_get_n_lines (const TeplContentAnalyzer *analyzer)
+{
+	g_return_val_if_fail (analyzer != NULL, 0);
+
+	return analyzer->n_lf + analyzer->n_cr + analyzer->n_cr_lf + 1;
+}
+
+guint64
+_tepl_content_analyzer_get_max_line_length (const TeplContentAnalyzer *analyzer)
+{
+	g_return_val_if_fail (analyzer != NULL, 0);
+
+	/* The last line has no line terminator. */
+	return MAX (analyzer->max_line_length, analyzer->cur_line_length);
+}
+
+gdouble
+_tepl_content_analyzer_get_mean_line_length (const TeplContentAnalyzer *analyzer)
+{
+	guint64 total_lines_length;
+
+	g_return_val_if_fail (analyzer != NULL, 0.0);
+
+	total_lines_length = analyzer->total_lines_length + analyzer->cur_line_length;
+
+	return (gdouble) total_lines_length / _tepl_content_analyzer_get_n_lines (analyzer);
+}
@@ -0,0 +1,55 @@
+/* SPDX-FileCopyrightText: 2020 - Sébastien Wilmet <swilmet@gnome.org>
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef TEPL_CONTENT_ANALYZER_H
+#define TEPL_CONTENT_ANALYZER_H
+
+#include <glib.h>
+#include "tepl-file.h"
+
+G_BEGIN_DECLS
+
+typedef struct _TeplContentAnalyzer TeplContentAnalyzer;
+
+/* The fields are private, use the functions. */
+struct _TeplContentAnalyzer
+{
+	guint64 n_lf;
+	guint64 n_cr;
+	guint64 n_cr_lf;
+
+	/* Line lengths are in characters, without the line terminator. */
+	guint64 total_lines_length;
+	guint64 max_line_length;
+	guint64 cur_line_length;
+
+	guint prev_char_is_cr : 1;
+};
+
+G_GNUC_INTERNAL
+void		_tepl_content_analyzer_init			(TeplContentAnalyzer *analyzer);
+
+G_GNUC_INTERNAL
+void		_tepl_content_analyzer_feed			(TeplContentAnalyzer *analyzer,
+								 const gchar         *text,
+								 gsize                length);
+
+G_GNUC_INTERNAL
+TeplNewlineType	_tepl_content_analyzer_get_newline_type		(const TeplContentAnalyzer *analyzer);
+
+G_GNUC_INTERNAL
+gboolean	_tepl_content_analyzer_has_mixed_newlines	(const TeplContentAnalyzer *analyzer);
+
+G_GNUC_INTERNAL
+guint64		_tepl_content_analyzer_get_n_lines		(const TeplContentAnalyzer *analyzer);
+
+G_GNUC_INTERNAL
+guint64		_tepl_content_analyzer_get_max_line_length	(const TeplContentAnalyzer *analyzer);
+
+G_GNUC_INTERNAL
+gdouble		_tepl_content_analyzer_get_mean_line_length	(const TeplContentAnalyzer *analyzer);
+
+G_END_DECLS
+
+#endif /* TEPL_CONTENT_ANALYZER_H */
@@ -0,0 +1,1078 @@
+/* SPDX-FileCopyrightText: 2020 - Sébastien Wilmet <swilmet@gnome.org>
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "config.h"
+#include "tepl-edit-journal.h"
+#include <string.h>
+#include <glib/gi18n-lib.h>
+#include "tepl-rope.h"
+#include "tepl-utils.h"
+
+/**
+ * SECTION:edit-journal
+ * @Title: TeplEditJournal
+ * @Short_description: Crash recovery journal of the edits
+ * @See_also: #TeplFileSaver
+ *
+ * A #TeplEditJournal records the insertions and deletions done in a
+ * #TeplBuffer into a recovery file, so that the edits are not lost if the
+ * application crashes. Unlike an autosave of the whole buffer, the cost of the
+ * recovery file depends on the volume of the edits, not on the size of the
+ * document.
+ *
+ * The edits are appended to the recovery file by batches, from a worker
+ * thread, and each batch is flushed to the disk with fsync(). When the journal becomes bigger than the document, it is compacted:
+ * it is replaced by a copy of the whole buffer content, taken from a snapshot.
+ *
+ * Typical usage:
+ * - After loading a file, create a #TeplEditJournal for the buffer. If the
+ *   buffer is already modified, the journal starts with a copy of the buffer
+ *   content.
+ * - After each successful save, call tepl_edit_journal_reset(). If the buffer
+ *   has been edited during the save, the journal restarts with a copy of the
+ *   buffer content.
+ * - When the document is closed normally, unref the journal and delete the
+ *   recovery file.
+ * - After a crash, if the recovery file exists, load the original file in a
+ *   #TeplBuffer (with the same #TeplFileLoader settings, since the journal
+ *   contains character offsets) and call tepl_edit_journal_replay().
+ */
+
+/* The file format. The integers are in little endian.
+ * - The header: JOURNAL_MAGIC.
+ * - The records, each one starts with a byte for its type:
+ *   - 'I': insertion. guint64 character offset, guint32 length in bytes, text.
+ *   - 'D': deletion. guint64 character offset, guint64 number of characters.
+ *   - 'T': the whole text. guint64 length in bytes, text.
+ *
+ * A truncated record at the end of the file, if the application crashed while
+ * it was being written, is ignored.
+ */
+#define JOURNAL_MAGIC "TEPLJRN1"
+#define JOURNAL_MAGIC_LENGTH (8)
+
+#define RECORD_INSERT 'I'
+#define RECORD_DELETE 'D'
+#define RECORD_TEXT 'T'
+
+/* The records are sent to the worker thread when there are at least
+ * BATCH_SIZE bytes, or after FLUSH_DELAY_MS.
+ */
+#define BATCH_SIZE (64 * 1024)
+#define FLUSH_DELAY_MS (500)
+
+/* The journal is compacted when it is bigger than twice the document, and at
+ * least COMPACT_MIN_SIZE.
+ */
+#define COMPACT_MIN_SIZE (1024 * 1024)
+
+/* U+FFFC, for pixbufs and child anchors. */
+#define OBJECT_REPLACEMENT_CHAR "\xEF\xBF\xBC"
+
+/* Used only by the worker thread. */
+typedef struct _Writer Writer;
+struct _Writer
+{
+	GFile *location;
+
+	/* Appends to the recovery file. */
+	GOutputStream *output_stream;
+};
+
+typedef enum _JobType
+{
+	JOB_APPEND,
+	JOB_REPLACE,
+	JOB_SYNC
+} JobType;
+
+typedef struct _SyncPoint SyncPoint;
+struct _SyncPoint
+{
+	GMutex mutex;
+	GCond cond;
+	gboolean reached;
+};
+
+typedef struct _Job Job;
+struct _Job
+{
+	JobType type;
+
+	/* For JOB_APPEND. */
+	GBytes *records;
+
+	/* For JOB_REPLACE. NULL to only write the header. */
+	TeplRope *rope;
+
+	/* For JOB_SYNC. */
+	SyncPoint *sync_point;
+};
+
+struct _TeplEditJournalPrivate
+{
+	/* Weak ref. */
+	TeplBuffer *buffer;
+
+	GFile *location;
+
+	/* With a single thread, the jobs are run in order. */
+	GThreadPool *thread_pool;
+	Writer *writer;
+
+	/* The records not yet sent to the worker thread. */
+	GByteArray *pending_records;
+	guint flush_timeout_id;
+
+	/* The size of the journal since the last compaction. */
+	guint64 journal_size;
+};
+
+enum
+{
+	PROP_0,
+	PROP_BUFFER,
+	PROP_LOCATION,
+	N_PROPERTIES
+};
+
+static GParamSpec *properties[N_PROPERTIES];
+
+G_DEFINE_TYPE_WITH_PRIVATE (TeplEditJournal, tepl_edit_journal, G_TYPE_OBJECT)
+
+G_DEFINE_QUARK (tepl-edit-journal-error, tepl_edit_journal_error)
+
+static void
+job_free (Job *job)
+{
+	if (job != NULL)
+	{
+		g_clear_pointer (&job->records, g_bytes_unref);
+		g_clear_pointer (&job->rope, _tepl_rope_unref);
+		g_free (job);
+	}
+}
+
+static void
+writer_free (Writer *writer)
+{
+	if (writer != NULL)
+	{
+		g_clear_object (&writer->location);
+
+		if (writer->output_stream != NULL)
+		{
+			g_output_stream_close (writer->output_stream, NULL, NULL);
+			g_object_unref (writer->output_stream);
+		}
+
+		g_free (writer);
+	}
+}
+
+static void
+warn_error (const GError *error)
+{
+	g_warning ("Failed to write the edit journal: %s", error->message);
+}
+
+/* Writes a new recovery file, containing the header and the whole text of
+ * @rope. The file is replaced atomically, then it is opened for appending.
+ */
+static void
+writer_replace (Writer   *writer,
+		TeplRope *rope)
+{
+	GFileOutputStream *replace_stream;
+	GOutputStream *output_stream;
+	GError *error = NULL;
+
+	if (writer->output_stream != NULL)
+	{
+		g_output_stream_close (writer->output_stream, NULL, NULL);
+		g_clear_object (&writer->output_stream);
+	}
+
+	replace_stream = g_file_replace (writer->location, NULL, FALSE, G_FILE_CREATE_NONE, NULL, &error);
+	if (error != NULL)
+	{
+		goto out;
+	}
+
+	output_stream = G_OUTPUT_STREAM (replace_stream);
+
+	if (!g_output_stream_write_all (output_stream, JOURNAL_MAGIC, JOURNAL_MAGIC_LENGTH, NULL, NULL, &error))
+	{
+		goto out;
+	}
+
+	if (rope != NULL)
+	{
+		guint8 record_header[1 + sizeof (guint64)];
+		guint64 length;
+		guint n_segments;
+		guint i;
+
+		record_header[0] = RECORD_TEXT;
+		length = GUINT64_TO_LE (_tepl_rope_get_n_bytes (rope));
+		memcpy (record_header + 1, &length, sizeof (guint64));
+
+		if (!g_output_stream_write_all (output_stream, record_header, sizeof (record_header), NULL, NULL, &error))
+		{
+			goto out;
+		}
+
+		n_segments = _tepl_rope_get_n_segments (rope);
+		for (i = 0; i < n_segments; i++)
+		{
+			GBytes *segment = _tepl_rope_get_segment (rope, i, NULL);
+			gconstpointer data;
+			gsize size;
+
+			data = g_bytes_get_data (segment, &size);
+
+			if (!g_output_stream_write_all (output_stream, data, size, NULL, NULL, &error))
+			{
+				goto out;
+			}
+		}
+	}
+
+	if (!g_output_stream_close (output_stream, NULL, &error) ||
+	    !_tepl_utils_sync_file (writer->location, TRUE, &error))
+	{
+		goto out;
+	}
+
+	writer->output_stream = G_OUTPUT_STREAM (g_file_append_to (writer->location,
+								   G_FILE_CREATE_NONE,
+								   NULL,
+								   &error));
+
+out:
+	if (error != NULL)
+	{
+		warn_error (error);
+		g_clear_error (&error);
+	}
+
+	g_clear_object (&replace_stream);
+}
+
+static void
+writer_append (Writer *writer,
+	       GBytes *records)
+{
+	gconstpointer data;
+	gsize size;
+	GError *error = NULL;
+
+	if (writer->output_stream == NULL)
+	{
+		/* A previous error. */
+		return;
+	}
+
+	data = g_bytes_get_data (records, &size);
+
+	if (!g_output_stream_write_all (writer->output_stream, data, size, NULL, NULL, &error) ||
+	    !_tepl_utils_sync_file (writer->location, FALSE, &error))
+	{
+		warn_error (error);
+		g_clear_error (&error);
+	}
+}
+
+/* Runs in the worker thread. */
+static void
+run_job (gpointer data,
+	 gpointer user_data)
+{
+	Job *job = data;
+	Writer *writer = user_data;
+
+	switch (job->type)
+	{
+		case JOB_APPEND:
+			writer_append (writer, job->records);
+			break;
+
+		case JOB_REPLACE:
+			writer_replace (writer, job->rope);
+			break;
+
+		case JOB_SYNC:
+			g_mutex_lock (&job->sync_point->mutex);
+			job->sync_point->reached = TRUE;
+			g_cond_signal (&job->sync_point->cond);
+			g_mutex_unlock (&job->sync_point->mutex);
+			break;
+
+		default:
+			g_assert_not_reached ();
+	}
+
+	job_free (job);
+}
+
+static void
+push_job (TeplEditJournal *journal,
+	  Job             *job)
+{
+	GError *error = NULL;
+
+	g_thread_pool_push (journal->priv->thread_pool, job, &error);
+
+	if (error != NULL)
+	{
+		warn_error (error);
+		g_clear_error (&error);
+		job_free (job);
+	}
+}
+
+/* Starts a new journal file. @rope can be NULL. */
+static void
+push_replace_job (TeplEditJournal *journal,
+		  TeplRope        *rope)
+{
+	Job *job;
+
+	job = g_new0 (Job, 1);
+	job->type = JOB_REPLACE;
+	job->rope = rope != NULL ? _tepl_rope_ref (rope) : NULL;
+	push_job (journal, job);
+
+	journal->priv->journal_size = JOURNAL_MAGIC_LENGTH;
+	if (rope != NULL)
+	{
+		journal->priv->journal_size += _tepl_rope_get_n_bytes (rope);
+	}
+}
+
+static void
+push_pending_records (TeplEditJournal *journal)
+{
+	TeplEditJournalPrivate *priv = journal->priv;
+	Job *job;
+
+	if (priv->pending_records->len == 0)
+	{
+		return;
+	}
+
+	priv->journal_size += priv->pending_records->len;
+
+	job = g_new0 (Job, 1);
+	job->type = JOB_APPEND;
+	job->records = g_byte_array_free_to_bytes (priv->pending_records);
+	priv->pending_records = g_byte_array_new ();
+
+	push_job (journal, job);
+}
+
+static void
+compact_if_needed (TeplEditJournal *journal)
+{
+	TeplEditJournalPrivate *priv = journal->priv;
+	TeplRope *rope;
+	guint64 threshold;
+
+	if (priv->buffer == NULL)
+	{
+		return;
+	}
+
+	rope = _tepl_buffer_get_rope (priv->buffer);
+	threshold = MAX (COMPACT_MIN_SIZE, 2 * _tepl_rope_get_n_bytes (rope));
+
+	if (priv->journal_size > threshold)
+	{
+		push_replace_job (journal, rope);
+	}
+}
+
+/* Not called during a signal emission of the buffer, so the rope contains
+ * all the recorded edits, for the compaction.
+ */
+static void
+flush (TeplEditJournal *journal)
+{
+	TeplEditJournalPrivate *priv = journal->priv;
+
+	if (priv->flush_timeout_id != 0)
+	{
+		g_source_remove (priv->flush_timeout_id);
+		priv->flush_timeout_id = 0;
+	}
+
+	push_pending_records (journal);
+	compact_if_needed (journal);
+}
+
+static gboolean
+flush_timeout_cb (gpointer user_data)
+{
+	TeplEditJournal *journal = TEPL_EDIT_JOURNAL (user_data);
+
+	journal->priv->flush_timeout_id = 0;
+	flush (journal);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+add_record (TeplEditJournal *journal,
+	    const guint8    *record,
+	    gsize            record_length,
+	    const gchar     *text,
+	    gsize            text_length)
+{
+	TeplEditJournalPrivate *priv = journal->priv;
+
+	g_byte_array_append (priv->pending_records, record, record_length);
+	if (text_length > 0)
+	{
+		g_byte_array_append (priv->pending_records, (const guint8 *) text, text_length);
+	}
+
+	if (priv->pending_records->len >= BATCH_SIZE)
+	{
+		push_pending_records (journal);
+	}
+	else if (priv->flush_timeout_id == 0)
+	{
+		priv->flush_timeout_id = g_timeout_add (FLUSH_DELAY_MS, flush_timeout_cb, journal);
+	}
+}
+
+static void
+add_insert_record (TeplEditJournal *journal,
+		   gint             offset,
+		   const gchar     *text,
+		   gsize            length)
+{
+	guint8 record[1 + sizeof (guint64) + sizeof (guint32)];
+	guint64 offset_le = GUINT64_TO_LE ((guint64) offset);
+	guint32 length_le = GUINT32_TO_LE ((guint32) length);
+
+	record[0] = RECORD_INSERT;
+	memcpy (record + 1, &offset_le, sizeof (guint64));
+	memcpy (record + 1 + sizeof (guint64), &length_le, sizeof (guint32));
+
+	add_record (journal, record, sizeof (record), text, length);
+}
+
+static void
+insert_text_cb (GtkTextBuffer   *buffer,
+		GtkTextIter     *location,
+		const gchar     *text,
+		gint             length,
+		TeplEditJournal *journal)
+{
+	if (length < 0)
+	{
+		length = strlen (text);
+	}
+
+	add_insert_record (journal, gtk_text_iter_get_offset (location), text, length);
+}
+
+static void
+insert_object_cb (GtkTextBuffer   *buffer,
+		  GtkTextIter     *location,
+		  gpointer         object,
+		  TeplEditJournal *journal)
+{
+	add_insert_record (journal,
+			   gtk_text_iter_get_offset (location),
+			   OBJECT_REPLACEMENT_CHAR,
+			   strlen (OBJECT_REPLACEMENT_CHAR));
+}
+
+static void
+delete_range_cb (GtkTextBuffer   *buffer,
+		 GtkTextIter     *start,
+		 GtkTextIter     *end,
+		 TeplEditJournal *journal)
+{
+	guint8 record[1 + 2 * sizeof (guint64)];
+	gint start_offset = gtk_text_iter_get_offset (start);
+	gint end_offset = gtk_text_iter_get_offset (end);
+	guint64 offset_le;
+	guint64 n_chars_le;
+
+	if (start_offset == end_offset)
+	{
+		return;
+	}
+
+	offset_le = GUINT64_TO_LE ((guint64) MIN (start_offset, end_offset));
+	n_chars_le = GUINT64_TO_LE ((guint64) ABS (end_offset - start_offset));
+
+	record[0] = RECORD_DELETE;
+	memcpy (record + 1, &offset_le, sizeof (guint64));
+	memcpy (record + 1 + sizeof (guint64), &n_chars_le, sizeof (guint64));
+
+	add_record (journal, record, sizeof (record), NULL, 0);
+}
+
+static void
+tepl_edit_journal_get_property (GObject    *object,
+				guint       prop_id,
+				GValue     *value,
+				GParamSpec *pspec)
+{
+	TeplEditJournal *journal = TEPL_EDIT_JOURNAL (object);
+
+	switch (prop_id)
+	{
+		case PROP_BUFFER:
+			g_value_set_object (value, tepl_edit_journal_get_buffer (journal));
+			break;
+
+		case PROP_LOCATION:
+			g_value_set_object (value, tepl_edit_journal_get_location (journal));
+			break;
+
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+			break;
+	}
+}
+
+static void
+tepl_edit_journal_set_property (GObject      *object,
+				guint         prop_id,
+				const GValue *value,
+				GParamSpec   *pspec)
+{
+	TeplEditJournal *journal = TEPL_EDIT_JOURNAL (object);
+
+	switch (prop_id)
+	{
+		case PROP_BUFFER:
+			g_assert (journal->priv->buffer == NULL);
+			g_set_weak_pointer (&journal->priv->buffer, g_value_get_object (value));
+			break;
+
+		case PROP_LOCATION:
+			g_assert (journal->priv->location == NULL);
+			journal->priv->location = g_value_dup_object (value);
+			break;
+
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+			break;
+	}
+}
+
+static void
+tepl_edit_journal_constructed (GObject *object)
+{
+	TeplEditJournal *journal = TEPL_EDIT_JOURNAL (object);
+	TeplEditJournalPrivate *priv = journal->priv;
+	GtkTextBuffer *text_buffer;
+
+	G_OBJECT_CLASS (tepl_edit_journal_parent_class)->constructed (object);
+
+	priv->writer = g_new0 (Writer, 1);
+	priv->writer->location = g_object_ref (priv->location);
+	priv->thread_pool = g_thread_pool_new (run_job, priv->writer, 1, FALSE, NULL);
+
+	if (priv->buffer == NULL)
+	{
+		return;
+	}
+
+	text_buffer = GTK_TEXT_BUFFER (priv->buffer);
+
+	/* The recorded edits apply to the current buffer content. */
+	push_replace_job (journal,
+			  gtk_text_buffer_get_modified (text_buffer) ?
+			  _tepl_buffer_get_rope (priv->buffer) :
+			  NULL);
+
+	/* Before the default handlers, the iters are still valid. */
+	g_signal_connect (text_buffer,
+			  "insert-text",
+			  G_CALLBACK (insert_text_cb),
+			  journal);
+
+	g_signal_connect (text_buffer,
+			  "insert-pixbuf",
+			  G_CALLBACK (insert_object_cb),
+			  journal);
+
+	g_signal_connect (text_buffer,
+			  "insert-child-anchor",
+			  G_CALLBACK (insert_object_cb),
+			  journal);
+
+	g_signal_connect (text_buffer,
+			  "delete-range",
+			  G_CALLBACK (delete_range_cb),
+			  journal);
+}
+
+static void
+tepl_edit_journal_dispose (GObject *object)
+{
+	TeplEditJournal *journal = TEPL_EDIT_JOURNAL (object);
+	TeplEditJournalPrivate *priv = journal->priv;
+
+	if (priv->buffer != NULL)
+	{
+		g_signal_handlers_disconnect_by_data (priv->buffer, journal);
+		g_clear_weak_pointer (&priv->buffer);
+	}
+
+	if (priv->thread_pool != NULL)
+	{
+		flush (journal);
+
+		/* Waits for the pending jobs. */
+		g_thread_pool_free (priv->thread_pool, FALSE, TRUE);
+		priv->thread_pool = NULL;
+	}
+
+	if (priv->flush_timeout_id != 0)
+	{
+		g_source_remove (priv->flush_timeout_id);
+		priv->flush_timeout_id = 0;
+	}
+
+	g_clear_pointer (&priv->writer, writer_free);
+	g_clear_object (&priv->location);
+
+	G_OBJECT_CLASS (tepl_edit_journal_parent_class)->dispose (object);
+}
+
+static void
+tepl_edit_journal_finalize (GObject *object)
+{
+	TeplEditJournal *journal = TEPL_EDIT_JOURNAL (object);
+
+	g_byte_array_unref (journal->priv->pending_records);
+
+	G_OBJECT_CLASS (tepl_edit_journal_parent_class)->finalize (object);
+}
+
+static void
+tepl_edit_journal_class_init (TeplEditJournalClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+	object_class->get_property = tepl_edit_journal_get_property;
+	object_class->set_property = tepl_edit_journal_set_property;
+	object_class->constructed = tepl_edit_journal_constructed;
+	object_class->dispose = tepl_edit_journal_dispose;
+	object_class->finalize = tepl_edit_journal_finalize;
+
+	/**
+	 * TeplEditJournal:buffer:
+	 *
+	 * The #TeplBuffer whose edits are recorded.
+	 *
+	 * Since: 6.0
+	 */
+	properties[PROP_BUFFER] =
+		g_param_spec_object ("buffer",
+				     "Buffer",
+				     "",
+				     TEPL_TYPE_BUFFER,
+				     G_PARAM_READWRITE |
+				     G_PARAM_CONSTRUCT_ONLY |
+				     G_PARAM_STATIC_STRINGS);
+
+	/**
+	 * TeplEditJournal:location:
+	 *
+	 * The #GFile where the edits are recorded.
+	 *
+	 * Since: 6.0
+	 */
+	properties[PROP_LOCATION] =
+		g_param_spec_object ("location",
+				     "Location",
+				     "",
+				     G_TYPE_FILE,
+				     G_PARAM_READWRITE |
+				     G_PARAM_CONSTRUCT_ONLY |
+				     G_PARAM_STATIC_STRINGS);
+
+	g_object_class_install_properties (object_class, N_PROPERTIES, properties);
+}
+
+static void
+tepl_edit_journal_init (TeplEditJournal *journal)
+{
+	journal->priv = tepl_edit_journal_get_instance_private (journal);
+	journal->priv->pending_records = g_byte_array_new ();
+}
+
+/**
+ * tepl_edit_journal_new:
+ * @buffer: a #TeplBuffer.
+ * @location: the #GFile where to record the edits.
+ *
+ * Creates a new #TeplEditJournal. The file at @location is replaced. If
+ * @buffer is not modified, the recorded edits apply to the current buffer
+ * content, which should be the content of the file on disk. If @buffer is
+ * modified, the journal starts with a copy of the buffer content.
+ *
+ * Returns: a new #TeplEditJournal object.
+ * Since: 6.0
+ */
+TeplEditJournal *
+tepl_edit_journal_new (TeplBuffer *buffer,
+		       GFile      *location)
+{
+	g_return_val_if_fail (TEPL_IS_BUFFER (buffer), NULL);
+	g_return_val_if_fail (G_IS_FILE (location), NULL);
+
+	return g_object_new (TEPL_TYPE_EDIT_JOURNAL,
+			     "buffer", buffer,
+			     "location", location,
+			     NULL);
+}
+
+/**
+ * tepl_edit_journal_get_buffer:
+ * @journal: a #TeplEditJournal.
+ *
+ * Returns: (transfer none) (nullable): the #TeplEditJournal:buffer.
+ * Since: 6.0
+ */
+TeplBuffer *
+tepl_edit_journal_get_buffer (TeplEditJournal *journal)
+{
+	g_return_val_if_fail (TEPL_IS_EDIT_JOURNAL (journal), NULL);
+
+	return journal->priv->buffer;
+}
+
+/**
+ * tepl_edit_journal_get_location:
+ * @journal: a #TeplEditJournal.
+ *
+ * Returns: (transfer none): the #TeplEditJournal:location.
+ * Since: 6.0
+ */
+GFile *
+tepl_edit_journal_get_location (TeplEditJournal *journal)
+{
+	g_return_val_if_fail (TEPL_IS_EDIT_JOURNAL (journal), NULL);
+
+	return journal->priv->location;
+}
+
+/**
+ * tepl_edit_journal_reset:
+ * @journal: a #TeplEditJournal.
+ *
+ * Restarts the journal. To call after the buffer content has been successfully
+ * saved with a #TeplFileSaver, the next recorded edits apply to the saved file.
+ *
+ * The saved file is the snapshot of the buffer taken when the save started. If
+ * the buffer content is still the same, the journal is emptied. Otherwise, for
+ * example when the buffer has been edited during the save, or when its content
+ * has been converted while saving it, the journal starts with a copy of the
+ * current buffer content, as for a modified buffer in tepl_edit_journal_new().
+ *
+ * Since: 6.0
+ */
+void
+tepl_edit_journal_reset (TeplEditJournal *journal)
+{
+	TeplEditJournalPrivate *priv;
+
+	g_return_if_fail (TEPL_IS_EDIT_JOURNAL (journal));
+
+	priv = journal->priv;
+
+	if (priv->flush_timeout_id != 0)
+	{
+		g_source_remove (priv->flush_timeout_id);
+		priv->flush_timeout_id = 0;
+	}
+
+	/* Included in the copy of the buffer content, if any. */
+	g_byte_array_set_size (priv->pending_records, 0);
+
+	if (priv->thread_pool == NULL || priv->buffer == NULL)
+	{
+		return;
+	}
+
+	push_replace_job (journal,
+			  _tepl_buffer_is_unchanged_since_save (priv->buffer) ?
+			  NULL :
+			  _tepl_buffer_get_rope (priv->buffer));
+}
+
+/**
+ * tepl_edit_journal_sync:
+ * @journal: a #TeplEditJournal.
+ *
+ * Writes the edits that are not yet written to the file, and waits until it is
+ * done. Normally the edits are written by batches, a short time after they
+ * have been done in the buffer.
+ *
+ * Since: 6.0
+ */
+void
+tepl_edit_journal_sync (TeplEditJournal *journal)
+{
+	SyncPoint sync_point;
+	Job *job;
+
+	g_return_if_fail (TEPL_IS_EDIT_JOURNAL (journal));
+
+	if (journal->priv->thread_pool == NULL)
+	{
+		return;
+	}
+
+	flush (journal);
+
+	g_mutex_init (&sync_point.mutex);
+	g_cond_init (&sync_point.cond);
+	sync_point.reached = FALSE;
+
+	job = g_new0 (Job, 1);
+	job->type = JOB_SYNC;
+	job->sync_point = &sync_point;
+	push_job (journal, job);
+
+	g_mutex_lock (&sync_point.mutex);
+	while (!sync_point.reached)
+	{
+		g_cond_wait (&sync_point.cond, &sync_point.mutex);
+	}
+	g_mutex_unlock (&sync_point.mutex);
+
+	g_mutex_clear (&sync_point.mutex);
+	g_cond_clear (&sync_point.cond);
+}
+
+static gboolean
+read_guint64 (const gchar **pos,
+	      const gchar  *end,
+	      guint64      *value)
+{
+	if ((gsize) (end - *pos) < sizeof (guint64))
+	{
+		return FALSE;
+	}
+
+	memcpy (value, *pos, sizeof (guint64));
+	*value = GUINT64_FROM_LE (*value);
+	*pos += sizeof (guint64);
+	return TRUE;
+}
+
+static gboolean
+read_guint32 (const gchar **pos,
+	      const gchar  *end,
+	      guint32      *value)
+{
+	if ((gsize) (end - *pos) < sizeof (guint32))
+	{
+		return FALSE;
+	}
+
+	memcpy (value, *pos, sizeof (guint32));
+	*value = GUINT32_FROM_LE (*value);
+	*pos += sizeof (guint32);
+	return TRUE;
+}
+
+static gboolean
+read_text (const gchar **pos,
+	   const gchar  *end,
+	   guint64       length,
+	   const gchar **text)
+{
+	if ((guint64) (end - *pos) < length)
+	{
+		return FALSE;
+	}
+
+	*text = *pos;
+	*pos += length;
+	return TRUE;
+}
+
+static void
+set_invalid_error (GError **error)
+{
+	g_set_error_literal (error,
+			     TEPL_EDIT_JOURNAL_ERROR,
+			     TEPL_EDIT_JOURNAL_ERROR_INVALID,
+			     _("The edit journal is invalid, or it doesn’t match the document."));
+}
+
+/* Returns: whether the record is valid. *@complete is set to %FALSE if the
+ * record is truncated.
+ */
+static gboolean
+replay_record (GtkTextBuffer  *buffer,
+	       const gchar   **pos,
+	       const gchar    *end,
+	       gboolean       *complete)
+{
+	gchar record_type = **pos;
+	const gchar *text;
+	guint64 offset;
+	guint64 n_chars;
+	guint64 length;
+	guint32 length32;
+	GtkTextIter start;
+	GtkTextIter stop;
+
+	*complete = FALSE;
+	(*pos)++;
+
+	switch (record_type)
+	{
+		case RECORD_INSERT:
+			if (!read_guint64 (pos, end, &offset) ||
+			    !read_guint32 (pos, end, &length32) ||
+			    !read_text (pos, end, length32, &text))
+			{
+				return TRUE;
+			}
+
+			*complete = TRUE;
+
+			if (offset > (guint64) gtk_text_buffer_get_char_count (buffer) ||
+			    !g_utf8_validate (text, length32, NULL))
+			{
+				return FALSE;
+			}
+
+			gtk_text_buffer_get_iter_at_offset (buffer, &start, offset);
+			gtk_text_buffer_insert (buffer, &start, text, length32);
+			return TRUE;
+
+		case RECORD_DELETE:
+			if (!read_guint64 (pos, end, &offset) ||
+			    !read_guint64 (pos, end, &n_chars))
+			{
+				return TRUE;
+			}
+
+			*complete = TRUE;
+
+			if (offset + n_chars > (guint64) gtk_text_buffer_get_char_count (buffer))
+			{
+				return FALSE;
+			}
+
+			gtk_text_buffer_get_iter_at_offset (buffer, &start, offset);
+			gtk_text_buffer_get_iter_at_offset (buffer, &stop, offset + n_chars);
+			gtk_text_buffer_delete (buffer, &start, &stop);
+			return TRUE;
+
+		case RECORD_TEXT:
+			if (!read_guint64 (pos, end, &length) ||
+			    !read_text (pos, end, length, &text))
+			{
+				return TRUE;
+			}
+
+			*complete = TRUE;
+
+			if (length > G_MAXINT || !g_utf8_validate (text, length, NULL))
+			{
+				return FALSE;
+			}
+
+			gtk_text_buffer_set_text (buffer, text, length);
+			return TRUE;
+
+		default:
+			break;
+	}
+
+	*complete = TRUE;
+	return FALSE;
+}
+
+/**
+ * tepl_edit_journal_replay:
+ * @buffer: a #TeplBuffer.
+ * @location: the #GFile of a journal written by a #TeplEditJournal.
+ * @error: a #GError, or %NULL.
+ *
+ * Applies to @buffer the edits recorded in the journal at @location, to
+ * recover them after a crash. The content of @buffer must be the one that the
+ * journal was started with, typically the original file loaded with the same
+ * #TeplFileLoader settings.
+ *
+ * The edits are applied inside one user action. If the journal is invalid,
+ * the edits already applied are kept.
+ *
+ * Returns: whether the journal has been successfully applied.
+ * Since: 6.0
+ */
+gboolean
+tepl_edit_journal_replay (TeplBuffer  *buffer,
+			  GFile       *location,
+			  GError     **error)
+{
+	GtkTextBuffer *text_buffer;
+	gchar *contents;
+	gsize length;
+	const gchar *pos;
+	const gchar *end;
+	gboolean ok = TRUE;
+
+	g_return_val_if_fail (TEPL_IS_BUFFER (buffer), FALSE);
+	g_return_val_if_fail (G_IS_FILE (location), FALSE);
+	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+	if (!g_file_load_contents (location, NULL, &contents, &length, NULL, error))
+	{
+		return FALSE;
+	}
+
+	if (length < JOURNAL_MAGIC_LENGTH ||
+	    memcmp (contents, JOURNAL_MAGIC, JOURNAL_MAGIC_LENGTH) != 0)
+	{
+		set_invalid_error (error);
+		g_free (contents);
+		return FALSE;
+	}
+
+	text_buffer = GTK_TEXT_BUFFER (buffer);
+	pos = contents + JOURNAL_MAGIC_LENGTH;
+	end = contents + length;
+
+	gtk_text_buffer_begin_user_action (text_buffer);
+
+	while (pos < end)
+	{
+		gboolean complete;
+
+		if (!replay_record (text_buffer, &pos, end, &complete))
+		{
+			set_invalid_error (error);
+			ok = FALSE;
+			break;
+		}
+
+		/* Truncated by a crash. */
+		if (!complete)
+		{
+			break;
+		}
+	}
+
+	gtk_text_buffer_end_user_action (text_buffer);
+
+	g_free (contents);
+	return ok;
+}
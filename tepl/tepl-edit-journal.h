@@ -0,0 +1,87 @@
+/* SPDX-FileCopyrightText: 2020 - Sébastien Wilmet <swilmet@gnome.org>
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef TEPL_EDIT_JOURNAL_H
+#define TEPL_EDIT_JOURNAL_H
+
+#if !defined (TEPL_H_INSIDE) && !defined (TEPL_COMPILATION)
+#error "Only <tepl/tepl.h> can be included directly."
+#endif
+
+#include <gio/gio.h>
+#include <tepl/tepl-buffer.h>
+
+G_BEGIN_DECLS
+
+#define TEPL_TYPE_EDIT_JOURNAL             (tepl_edit_journal_get_type ())
+#define TEPL_EDIT_JOURNAL(obj)             (G_TYPE_CHECK_INSTANCE_CAST ((obj), TEPL_TYPE_EDIT_JOURNAL, TeplEditJournal))
+#define TEPL_EDIT_JOURNAL_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST ((klass), TEPL_TYPE_EDIT_JOURNAL, TeplEditJournalClass))
+#define TEPL_IS_EDIT_JOURNAL(obj)          (G_TYPE_CHECK_INSTANCE_TYPE ((obj), TEPL_TYPE_EDIT_JOURNAL))
+#define TEPL_IS_EDIT_JOURNAL_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE ((klass), TEPL_TYPE_EDIT_JOURNAL))
+#define TEPL_EDIT_JOURNAL_GET_CLASS(obj)   (G_TYPE_INSTANCE_GET_CLASS ((obj), TEPL_TYPE_EDIT_JOURNAL, TeplEditJournalClass))
+
+typedef struct _TeplEditJournal         TeplEditJournal;
+typedef struct _TeplEditJournalClass    TeplEditJournalClass;
+typedef struct _TeplEditJournalPrivate  TeplEditJournalPrivate;
+
+#define TEPL_EDIT_JOURNAL_ERROR tepl_edit_journal_error_quark ()
+
+/**
+ * TeplEditJournalError:
+ * @TEPL_EDIT_JOURNAL_ERROR_INVALID: The file is not an edit journal, or the
+ *   edits don't match the buffer content.
+ *
+ * An error code used with the %TEPL_EDIT_JOURNAL_ERROR domain.
+ *
+ * Since: 6.0
+ */
+typedef enum _TeplEditJournalError
+{
+	TEPL_EDIT_JOURNAL_ERROR_INVALID
+} TeplEditJournalError;
+
+struct _TeplEditJournal
+{
+	GObject parent;
+
+	TeplEditJournalPrivate *priv;
+};
+
+struct _TeplEditJournalClass
+{
+	GObjectClass parent_class;
+
+	gpointer padding[12];
+};
+
+_TEPL_EXTERN
+GType			tepl_edit_journal_get_type		(void);
+
+_TEPL_EXTERN
+GQuark			tepl_edit_journal_error_quark		(void);
+
+_TEPL_EXTERN
+TeplEditJournal *	tepl_edit_journal_new			(TeplBuffer *buffer,
+								 GFile      *location);
+
+_TEPL_EXTERN
+TeplBuffer *		tepl_edit_journal_get_buffer		(TeplEditJournal *journal);
+
+_TEPL_EXTERN
+GFile *			tepl_edit_journal_get_location		(TeplEditJournal *journal);
+
+_TEPL_EXTERN
+void			tepl_edit_journal_reset			(TeplEditJournal *journal);
+
+_TEPL_EXTERN
+void			tepl_edit_journal_sync			(TeplEditJournal *journal);
+
+_TEPL_EXTERN
+gboolean		tepl_edit_journal_replay		(TeplBuffer  *buffer,
+								 GFile       *location,
+								 GError     **error);
+
+G_END_DECLS
+
+#endif /* TEPL_EDIT_JOURNAL_H */
@@ -4,7 +4,20 @@
 
 #include "config.h"
 #include "tepl-file-loader.h"
+#include "tepl-charset-converter.h"
+#include "tepl-charset-detector.h"
+#include "tepl-content-analyzer.h"
+#include "tepl-metadata-manager.h"
+#include "tepl-rope.h"
+#include "tepl-utf8.h"
+#include <string.h>
 #include <glib/gi18n-lib.h>
+#include <glib/gstdio.h>
+
+#ifdef G_OS_UNIX
+#include <setjmp.h>
+#include <signal.h>
+#endif
 
 /**
  * SECTION:file-loader
@@ -27,6 +40,59 @@
  * After a file loading, the buffer is reset to the content provided by the
  * #GFile, so the buffer is set as “unmodified”, that is,
  * gtk_text_buffer_set_modified() is called with %FALSE.
+ *
+ * The content is read and inserted into the buffer chunk by chunk, so the
+ * memory needed in addition to the #GtkTextBuffer content is bounded by the
+ * chunk size, regardless of the file size. If an error occurs, the buffer is
+ * emptied.
+ *
+ * By default the character encoding is auto-detected, from a bounded number of
+ * samples of the file, so the detection time doesn't depend on the file size.
+ * The detected charset is stored in the #TeplMetadataManager, under the
+ * `"tepl-character-encoding"` key, so when the same file is loaded again, the
+ * detection is skipped. The stored charset is not trusted blindly: if the
+ * content cannot be converted from it, or if it is UTF-8 but the first chunk
+ * has invalid bytes, the file has probably been modified by another program, so
+ * the loading restarts with the detection, and the stored charset is replaced
+ * if the detected one is different. Invalid bytes found after the first chunk
+ * are inserted as escape sequences, and the stored charset is kept. The
+ * #TeplFileLoader:charset property permits to choose the charset instead.
+ *
+ * If the content is not encoded in UTF-8, it is converted to UTF-8 with ICU,
+ * chunk by chunk, in a worker thread.
+ *
+ * A local regular file in UTF-8 is mapped into memory with #GMappedFile,
+ * instead of being read with system calls. The mapped content is copied and
+ * validated by windows in a worker thread. If the file is truncated by
+ * another process in the meantime, the loading restarts with a #GInputStream.
+ * Remote files and special files are read with a #GInputStream.
+ *
+ * While the content is inserted, it is analyzed in the same pass: on success,
+ * the #TeplFile:newline-type is set to the most frequent line terminator, and
+ * the line count, the line lengths and the byte order mark presence are
+ * available with the #TeplFileLoader getters. The application can thus choose
+ * a strategy adapted to big files or to very long lines without walking
+ * through the #GtkTextBuffer afterwards.
+ *
+ * GtkTextView is slow with very long lines, for example with minified JSON or
+ * JavaScript code on a single line. The #TeplFileLoader:line-split-length
+ * property permits to split them, by inserting newlines that #TeplFileSaver
+ * removes when saving the file.
+ *
+ * Invalid bytes, for example in a file that is not really encoded in UTF-8, are
+ * not an error. Each invalid byte is inserted as an escape sequence like
+ * “\FF”, marked with the same tag as the invalid characters detected by
+ * #TeplBuffer. The invalid ranges are available with
+ * tepl_file_loader_get_n_invalid_ranges() and
+ * tepl_file_loader_get_invalid_range(). The original bytes are not restored
+ * when saving the file, so #TeplFileSaver reports the
+ * %TEPL_FILE_SAVER_ERROR_INVALID_CHARS error as long as the buffer contains
+ * such escape sequences, to not corrupt the file silently.
+ *
+ * With the #TeplFileLoader:max-file-size property, the file size is queried
+ * before reading the content, and a file that is too big is not loaded: the
+ * %TEPL_FILE_LOADER_ERROR_TOO_BIG error is reported instead. Such a file can
+ * be inspected with a #TeplFileViewer.
  */
 
 /* To simulate for example loading a big remote file with a slow network
@@ -34,6 +100,29 @@
  */
 #define SIMULATE_LONG_FILE_LOADING FALSE
 
+/* The maximum number of bytes read at once from the GInputStream. It bounds
+ * the amount of memory needed in addition to the GtkTextBuffer content.
+ */
+#define READ_CHUNK_SIZE (64 * 1024)
+
+/* When this amount of content is waiting to be converted or inserted into the
+ * buffer, reading is paused until the conversion and insertion catch up.
+ */
+#define MAX_QUEUED_TEXT_LENGTH (4 * READ_CHUNK_SIZE)
+
+/* The number of bytes of a mapped file validated at once in a worker thread. */
+#define MAPPED_WINDOW_SIZE (4 * READ_CHUNK_SIZE)
+
+/* The maximum number of bytes inserted at once into the buffer, so that the
+ * time budget is not exceeded by too much.
+ */
+#define INSERTION_PIECE_LENGTH (8 * 1024)
+
+/* In microseconds. */
+#define DEFAULT_INSERTION_TIME_BUDGET (5000)
+
+#define CHARSET_METADATA_KEY "tepl-character-encoding"
+
 struct _TeplFileLoaderPrivate
 {
 	/* Weak ref to the TeplBuffer. A strong ref could create a reference
@@ -50,7 +139,152 @@ struct _TeplFileLoaderPrivate
 
 	GFile *location;
 
+	gchar *charset;
+
+	/* In microseconds. */
+	guint insertion_time_budget;
+
+	/* In bytes, 0 for no limit. */
+	guint64 max_file_size;
+
+	/* In characters, 0 to not split the lines. */
+	guint line_split_length;
+	guint n_line_splits;
+
+	/* -1 if the charset has not been auto-detected. */
+	gint detected_charset_confidence;
+
+	/* Information about the content, collected during the last load
+	 * operation.
+	 */
+	TeplContentAnalyzer analyzer;
+	GArray *invalid_ranges;
+
+	guint has_bom : 1;
 	guint is_loading : 1;
+	guint use_mapped_file : 1;
+};
+
+typedef struct _InvalidRange InvalidRange;
+struct _InvalidRange
+{
+	goffset start;
+	goffset length;
+};
+
+typedef struct _QueuedText QueuedText;
+struct _QueuedText
+{
+	GBytes *text;
+
+	/* Whether @text is the escaped form of invalid bytes. */
+	guint invalid : 1;
+};
+
+typedef struct _TaskData TaskData;
+struct _TaskData
+{
+	GInputStream *input_stream;
+
+	/* The charset used for this load operation. */
+	gchar *charset;
+
+	/* The charset stored in the metadata, or NULL. */
+	gchar *metadata_charset;
+
+	/* The entity tag of the file, or NULL if unknown. */
+	gchar *etag;
+
+	/* To convert the content to UTF-8, or NULL if it is already in UTF-8.
+	 * The chunks are converted one after the other in a worker thread.
+	 */
+	TeplCharsetConverter *converter;
+
+	/* For a local regular file, the whole content mapped into memory,
+	 * used instead of the input stream. The content before @mapped_pos has
+	 * been validated.
+	 */
+	GBytes *mapped_content;
+	gsize mapped_pos;
+
+	/* Chunks read from the input stream waiting to be converted, as a
+	 * queue of GBytes.
+	 */
+	GQueue conversion_queue;
+	gsize conversion_queue_length;
+
+	/* The number of bytes of UTF-8 content handled so far. Without charset
+	 * conversion, it is the position in the file.
+	 */
+	goffset n_handled_bytes;
+
+	/* Validated text waiting to be inserted into the buffer, as a queue of
+	 * QueuedText. The first @head_offset bytes of the head have already
+	 * been inserted.
+	 */
+	GQueue text_queue;
+	gsize text_queue_length;
+	gsize head_offset;
+
+	/* The escaped invalid bytes inserted by the current insertion batch, as
+	 * a #GArray of #gint: the start and end character offsets of each
+	 * range. They are tagged at the end of the batch, in one go.
+	 */
+	GArray *invalid_char_offsets;
+
+	guint insertion_idle_id;
+
+	/* The length, in characters, of the last line inserted into the
+	 * buffer, to split the very long lines.
+	 */
+	guint64 inserted_line_length;
+
+	/* A UTF-8 character can be split between two chunks. The first bytes
+	 * of such a character, at the end of the previous chunk, are kept here
+	 * until the next chunk is read.
+	 */
+	gchar incomplete_char[TEPL_UTF8_CHAR_MAX_LENGTH];
+	gsize incomplete_char_length;
+
+	/* Whether an asynchronous operation on the input stream is running,
+	 * or a window of the mapped content is being validated.
+	 */
+	guint reading : 1;
+
+	/* Whether all the content has been read and the input stream closed. */
+	guint end_of_stream : 1;
+
+	/* Whether a chunk is being converted in a worker thread. */
+	guint converting : 1;
+
+	/* Whether the last conversion, to flush the converter, has started. */
+	guint converter_flushed : 1;
+
+	/* Whether the charset has been auto-detected. */
+	guint charset_detected : 1;
+
+	/* Whether the charset comes from the metadata. If the content doesn't
+	 * match it, the loading is restarted with the charset detection.
+	 */
+	guint charset_from_metadata : 1;
+
+	/* Whether the first chunk has been checked against the charset that
+	 * comes from the metadata, see check_charset_from_metadata().
+	 */
+	guint charset_from_metadata_checked : 1;
+
+	/* Whether the loading must be restarted with the charset detection,
+	 * once the pending read or conversion is finished.
+	 */
+	guint restart_pending : 1;
+
+	/* Whether the start of the file has been checked for a BOM. */
+	guint bom_checked : 1;
+
+	/* Whether the GTask has already returned. Pending asynchronous
+	 * operations have then nothing more to do.
+	 */
+	guint returned : 1;
 };
 
 enum
@@ -59,6 +293,10 @@ enum
 	PROP_BUFFER,
 	PROP_FILE,
 	PROP_LOCATION,
+	PROP_CHARSET,
+	PROP_INSERTION_TIME_BUDGET,
+	PROP_LINE_SPLIT_LENGTH,
+	PROP_MAX_FILE_SIZE,
 	N_PROPERTIES
 };
 
@@ -66,6 +304,64 @@ static GParamSpec *properties[N_PROPERTIES];
 
 G_DEFINE_TYPE_WITH_PRIVATE (TeplFileLoader, tepl_file_loader, G_TYPE_OBJECT)
 
+G_DEFINE_QUARK (tepl-file-loader-error, tepl_file_loader_error)
+
+static void
+queued_text_free (QueuedText *queued_text)
+{
+	if (queued_text != NULL)
+	{
+		g_bytes_unref (queued_text->text);
+		g_free (queued_text);
+	}
+}
+
+static TaskData *
+task_data_new (void)
+{
+	TaskData *data;
+
+	data = g_new0 (TaskData, 1);
+	g_queue_init (&data->conversion_queue);
+	g_queue_init (&data->text_queue);
+	data->invalid_char_offsets = g_array_new (FALSE, FALSE, sizeof (gint));
+
+	return data;
+}
+
+static void
+task_data_clear_queues (TaskData *data)
+{
+	g_queue_clear_full (&data->conversion_queue, (GDestroyNotify)g_bytes_unref);
+	data->conversion_queue_length = 0;
+
+	g_queue_clear_full (&data->text_queue, (GDestroyNotify)queued_text_free);
+	data->text_queue_length = 0;
+	data->head_offset = 0;
+
+	g_array_set_size (data->invalid_char_offsets, 0);
+}
+
+static void
+task_data_free (TaskData *data)
+{
+	if (data != NULL)
+	{
+		/* The idle source has a reference to the GTask. */
+		g_assert (data->insertion_idle_id == 0);
+
+		g_clear_object (&data->input_stream);
+		g_clear_pointer (&data->mapped_content, g_bytes_unref);
+		g_free (data->charset);
+		g_free (data->metadata_charset);
+		g_free (data->etag);
+		_tepl_charset_converter_free (data->converter);
+		task_data_clear_queues (data);
+		g_array_unref (data->invalid_char_offsets);
+		g_free (data);
+	}
+}
+
 static void
 tepl_file_loader_get_property (GObject    *object,
 			       guint       prop_id,
@@ -88,6 +384,22 @@ tepl_file_loader_get_property (GObject    *object,
 			g_value_set_object (value, tepl_file_loader_get_location (loader));
 			break;
 
+		case PROP_CHARSET:
+			g_value_set_string (value, tepl_file_loader_get_charset (loader));
+			break;
+
+		case PROP_INSERTION_TIME_BUDGET:
+			g_value_set_uint (value, tepl_file_loader_get_insertion_time_budget (loader));
+			break;
+
+		case PROP_LINE_SPLIT_LENGTH:
+			g_value_set_uint (value, tepl_file_loader_get_line_split_length (loader));
+			break;
+
+		case PROP_MAX_FILE_SIZE:
+			g_value_set_uint64 (value, tepl_file_loader_get_max_file_size (loader));
+			break;
+
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 			break;
@@ -119,6 +431,22 @@ tepl_file_loader_set_property (GObject      *object,
 			loader->priv->location = g_value_dup_object (value);
 			break;
 
+		case PROP_CHARSET:
+			tepl_file_loader_set_charset (loader, g_value_get_string (value));
+			break;
+
+		case PROP_INSERTION_TIME_BUDGET:
+			tepl_file_loader_set_insertion_time_budget (loader, g_value_get_uint (value));
+			break;
+
+		case PROP_LINE_SPLIT_LENGTH:
+			tepl_file_loader_set_line_split_length (loader, g_value_get_uint (value));
+			break;
+
+		case PROP_MAX_FILE_SIZE:
+			tepl_file_loader_set_max_file_size (loader, g_value_get_uint64 (value));
+			break;
+
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 			break;
@@ -161,6 +489,17 @@ tepl_file_loader_dispose (GObject *object)
 	G_OBJECT_CLASS (tepl_file_loader_parent_class)->dispose (object);
 }
 
+static void
+tepl_file_loader_finalize (GObject *object)
+{
+	TeplFileLoader *loader = TEPL_FILE_LOADER (object);
+
+	g_free (loader->priv->charset);
+	g_array_unref (loader->priv->invalid_ranges);
+
+	G_OBJECT_CLASS (tepl_file_loader_parent_class)->finalize (object);
+}
+
 static void
 tepl_file_loader_class_init (TeplFileLoaderClass *klass)
 {
@@ -170,6 +509,7 @@ tepl_file_loader_class_init (TeplFileLoaderClass *klass)
 	object_class->set_property = tepl_file_loader_set_property;
 	object_class->constructed = tepl_file_loader_constructed;
 	object_class->dispose = tepl_file_loader_dispose;
+	object_class->finalize = tepl_file_loader_finalize;
 
 	/**
 	 * TeplFileLoader:buffer:
@@ -222,6 +562,99 @@ tepl_file_loader_class_init (TeplFileLoaderClass *klass)
 				     G_PARAM_CONSTRUCT_ONLY |
 				     G_PARAM_STATIC_STRINGS);
 
+	/**
+	 * TeplFileLoader:charset:
+	 *
+	 * The character encoding of the content, as an ICU converter name or
+	 * alias, for example "UTF-8", "ISO-8859-15" or "UTF-16". %NULL to
+	 * auto-detect it.
+	 *
+	 * With "UTF-16" or "UTF-32", the byte order is detected from the byte
+	 * order mark (BOM). On success, the #TeplFile:charset property is
+	 * updated.
+	 *
+	 * Since: 6.0
+	 */
+	properties[PROP_CHARSET] =
+		g_param_spec_string ("charset",
+				     "charset",
+				     "",
+				     NULL,
+				     G_PARAM_READWRITE |
+				     G_PARAM_STATIC_STRINGS);
+
+	/**
+	 * TeplFileLoader:insertion-time-budget:
+	 *
+	 * The maximum amount of time, in microseconds, spent to insert text
+	 * into the #TeplBuffer during one main loop iteration.
+	 *
+	 * The content is inserted in batches from an idle callback that has a
+	 * lower priority than redrawing the widgets. Between two batches, the
+	 * main loop can thus process user input, redraw the #GtkTextView and
+	 * let other tabs work. A smaller value makes the UI more responsive,
+	 * while a larger value makes the file loading finish sooner.
+	 *
+	 * Since: 6.0
+	 */
+	properties[PROP_INSERTION_TIME_BUDGET] =
+		g_param_spec_uint ("insertion-time-budget",
+				   "insertion-time-budget",
+				   "",
+				   1, G_MAXUINT,
+				   DEFAULT_INSERTION_TIME_BUDGET,
+				   G_PARAM_READWRITE |
+				   G_PARAM_CONSTRUCT |
+				   G_PARAM_STATIC_STRINGS);
+
+	/**
+	 * TeplFileLoader:line-split-length:
+	 *
+	 * The maximum length of a line, in characters, after which the line
+	 * is split by inserting a newline. 0 to not split the lines.
+	 *
+	 * The lines are split between two characters, not before a combining
+	 * mark. The content analysis, see for example
+	 * tepl_file_loader_get_max_line_length(), is about the original
+	 * content.
+	 *
+	 * The inserted newlines are recorded in the #TeplBuffer, and are
+	 * removed by #TeplFileSaver to save the original lines. If some of
+	 * them are deleted or replaced, the lines cannot be exactly restored,
+	 * and #TeplFileSaver reports the
+	 * %TEPL_FILE_SAVER_ERROR_EDITED_LINE_SPLITS error.
+	 *
+	 * Since: 6.0
+	 */
+	properties[PROP_LINE_SPLIT_LENGTH] =
+		g_param_spec_uint ("line-split-length",
+				   "line-split-length",
+				   "",
+				   0, G_MAXUINT,
+				   0,
+				   G_PARAM_READWRITE |
+				   G_PARAM_CONSTRUCT |
+				   G_PARAM_STATIC_STRINGS);
+
+	/**
+	 * TeplFileLoader:max-file-size:
+	 *
+	 * The maximum size of the file, in bytes, or 0 for no limit. The size
+	 * of a bigger file is detected before reading its content, and the
+	 * %TEPL_FILE_LOADER_ERROR_TOO_BIG error is reported.
+	 *
+	 * Since: 6.0
+	 */
+	properties[PROP_MAX_FILE_SIZE] =
+		g_param_spec_uint64 ("max-file-size",
+				     "max-file-size",
+				     "",
+				     0, G_MAXUINT64,
+				     0,
+				     G_PARAM_READWRITE |
+				     G_PARAM_CONSTRUCT |
+				     G_PARAM_STATIC_STRINGS);
+
 	g_object_class_install_properties (object_class, N_PROPERTIES, properties);
 }
 
@@ -229,6 +662,11 @@ static void
 tepl_file_loader_init (TeplFileLoader *loader)
 {
 	loader->priv = tepl_file_loader_get_instance_private (loader);
+	loader->priv->insertion_time_budget = DEFAULT_INSERTION_TIME_BUDGET;
+	loader->priv->detected_charset_confidence = -1;
+	loader->priv->use_mapped_file = TRUE;
+	loader->priv->invalid_ranges = g_array_new (FALSE, FALSE, sizeof (InvalidRange));
+	_tepl_content_analyzer_init (&loader->priv->analyzer);
 }
 
 /**
@@ -307,129 +745,2171 @@ tepl_file_loader_get_location (TeplFileLoader *loader)
 	return loader->priv->location;
 }
 
-static void
-load_contents_cb (GObject      *source_object,
-		  GAsyncResult *result,
-		  gpointer      user_data)
+/**
+ * tepl_file_loader_set_charset:
+ * @loader: a #TeplFileLoader.
+ * @charset: (nullable): the new value.
+ *
+ * Sets the #TeplFileLoader:charset property. It must not be called during a
+ * load operation.
+ *
+ * Since: 6.0
+ */
+void
+tepl_file_loader_set_charset (TeplFileLoader *loader,
+			      const gchar    *charset)
 {
-	GFile *location = G_FILE (source_object);
-	GTask *task = G_TASK (user_data);
-	TeplFileLoader *loader = g_task_get_source_object (task);
-	gchar *content = NULL;
-	gsize content_length = 0;
-	GError *error = NULL;
-
-	g_file_load_contents_finish (location,
-				     result,
-				     &content,
-				     &content_length,
-				     NULL,
-				     &error);
-
-	if (error != NULL)
-	{
-		g_task_return_error (task, error);
-		g_object_unref (task);
-		goto out;
-	}
-
-	if (!g_utf8_validate_len (content, content_length, NULL))
-	{
-		g_task_return_new_error (task,
-					 G_IO_ERROR,
-					 G_IO_ERROR_INVALID_DATA,
-					 _("The content must be encoded with the UTF-8 character encoding."));
-		g_object_unref (task);
-		goto out;
-	}
+	g_return_if_fail (TEPL_IS_FILE_LOADER (loader));
+	g_return_if_fail (!loader->priv->is_loading);
 
-	if (loader->priv->buffer != NULL)
+	if (g_strcmp0 (loader->priv->charset, charset) != 0)
 	{
-		GtkTextBuffer *text_buffer = GTK_TEXT_BUFFER (loader->priv->buffer);
-		GtkTextIter start;
-
-		gtk_text_buffer_set_text (text_buffer, content, content_length);
-
-		gtk_text_buffer_get_start_iter (text_buffer, &start);
-		gtk_text_buffer_place_cursor (text_buffer, &start);
+		g_free (loader->priv->charset);
+		loader->priv->charset = g_strdup (charset);
+		g_object_notify_by_pspec (G_OBJECT (loader), properties[PROP_CHARSET]);
 	}
+}
 
-	g_task_return_boolean (task, TRUE);
-	g_object_unref (task);
+/**
+ * tepl_file_loader_get_charset:
+ * @loader: a #TeplFileLoader.
+ *
+ * Returns: (nullable): the value of the #TeplFileLoader:charset property.
+ * Since: 6.0
+ */
+const gchar *
+tepl_file_loader_get_charset (TeplFileLoader *loader)
+{
+	g_return_val_if_fail (TEPL_IS_FILE_LOADER (loader), NULL);
 
-out:
-	g_free (content);
+	return loader->priv->charset;
 }
 
-static void
-start_load_contents (GTask *task)
+/**
+ * tepl_file_loader_get_detected_charset_confidence:
+ * @loader: a #TeplFileLoader.
+ *
+ * After a load operation, gets the confidence of the charset auto-detection,
+ * between 0 and 100. The detected charset is available with
+ * tepl_file_get_charset().
+ *
+ * A low confidence can be shown to the user, to propose to choose the charset
+ * with the #TeplFileLoader:charset property and to load the file again.
+ *
+ * Returns: the confidence, or -1 if the charset has not been auto-detected
+ *   (because the #TeplFileLoader:charset property is set, or because the
+ *   charset was already known from the #TeplMetadataManager).
+ * Since: 6.0
+ */
+gint
+tepl_file_loader_get_detected_charset_confidence (TeplFileLoader *loader)
 {
-	TeplFileLoader *loader = g_task_get_source_object (task);
+	g_return_val_if_fail (TEPL_IS_FILE_LOADER (loader), -1);
 
-	g_file_load_contents_async (loader->priv->location,
-				    g_task_get_cancellable (task),
-				    load_contents_cb,
-				    task);
+	return loader->priv->detected_charset_confidence;
 }
 
-#if SIMULATE_LONG_FILE_LOADING
-static gboolean
-simulate_long_file_loading_timeout_cb (gpointer user_data)
+/**
+ * tepl_file_loader_set_insertion_time_budget:
+ * @loader: a #TeplFileLoader.
+ * @time_budget: the new value, in microseconds. Must be greater than 0.
+ *
+ * Sets the #TeplFileLoader:insertion-time-budget property.
+ *
+ * Since: 6.0
+ */
+void
+tepl_file_loader_set_insertion_time_budget (TeplFileLoader *loader,
+					    guint           time_budget)
 {
-	GTask *task = G_TASK (user_data);
+	g_return_if_fail (TEPL_IS_FILE_LOADER (loader));
+	g_return_if_fail (time_budget > 0);
 
-	g_message ("%s()", G_STRFUNC);
+	if (loader->priv->insertion_time_budget != time_budget)
+	{
+		loader->priv->insertion_time_budget = time_budget;
+		g_object_notify_by_pspec (G_OBJECT (loader), properties[PROP_INSERTION_TIME_BUDGET]);
+	}
+}
 
-	start_load_contents (task);
+/**
+ * tepl_file_loader_get_insertion_time_budget:
+ * @loader: a #TeplFileLoader.
+ *
+ * Returns: the value of the #TeplFileLoader:insertion-time-budget property, in
+ *   microseconds.
+ * Since: 6.0
+ */
+guint
+tepl_file_loader_get_insertion_time_budget (TeplFileLoader *loader)
+{
+	g_return_val_if_fail (TEPL_IS_FILE_LOADER (loader), DEFAULT_INSERTION_TIME_BUDGET);
 
-	return G_SOURCE_REMOVE;
+	return loader->priv->insertion_time_budget;
 }
-#endif
 
 /**
- * tepl_file_loader_load_async:
+ * tepl_file_loader_set_line_split_length:
  * @loader: a #TeplFileLoader.
- * @io_priority: the I/O priority of the request. E.g. %G_PRIORITY_LOW,
- *   %G_PRIORITY_DEFAULT or %G_PRIORITY_HIGH.
- * @cancellable: (nullable): optional #GCancellable object, %NULL to ignore.
- * @callback: (scope async): a #GAsyncReadyCallback to call when the request is
- *   satisfied.
- * @user_data: user data to pass to @callback.
+ * @line_split_length: the new value, in characters.
  *
- * Loads asynchronously the file content into the #TeplBuffer.
- *
- * See the #GAsyncResult documentation to know how to use this function.
+ * Sets the #TeplFileLoader:line-split-length property. It must not be called
+ * during a load operation.
  *
- * Since: 5.0
+ * Since: 6.0
  */
 void
-tepl_file_loader_load_async (TeplFileLoader      *loader,
-			     gint                 io_priority,
-			     GCancellable        *cancellable,
-			     GAsyncReadyCallback  callback,
-			     gpointer             user_data)
+tepl_file_loader_set_line_split_length (TeplFileLoader *loader,
+					guint           line_split_length)
 {
-	GTask *task;
-
 	g_return_if_fail (TEPL_IS_FILE_LOADER (loader));
-	g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
 	g_return_if_fail (!loader->priv->is_loading);
 
-	loader->priv->is_loading = TRUE;
-
-	task = g_task_new (loader, cancellable, callback, user_data);
-	g_task_set_priority (task, io_priority);
-
-	if (loader->priv->buffer == NULL ||
-	    loader->priv->file == NULL ||
-	    loader->priv->location == NULL)
+	if (loader->priv->line_split_length != line_split_length)
 	{
-		g_task_return_boolean (task, FALSE);
-		g_object_unref (task);
-		return;
+		loader->priv->line_split_length = line_split_length;
+		g_object_notify_by_pspec (G_OBJECT (loader), properties[PROP_LINE_SPLIT_LENGTH]);
+	}
+}
+
+/**
+ * tepl_file_loader_get_line_split_length:
+ * @loader: a #TeplFileLoader.
+ *
+ * Returns: the value of the #TeplFileLoader:line-split-length property.
+ * Since: 6.0
+ */
+guint
+tepl_file_loader_get_line_split_length (TeplFileLoader *loader)
+{
+	g_return_val_if_fail (TEPL_IS_FILE_LOADER (loader), 0);
+
+	return loader->priv->line_split_length;
+}
+
+/**
+ * tepl_file_loader_set_max_file_size:
+ * @loader: a #TeplFileLoader.
+ * @max_file_size: the new value, in bytes.
+ *
+ * Sets the #TeplFileLoader:max-file-size property. It must not be called during
+ * a load operation.
+ *
+ * Since: 6.0
+ */
+void
+tepl_file_loader_set_max_file_size (TeplFileLoader *loader,
+				    guint64         max_file_size)
+{
+	g_return_if_fail (TEPL_IS_FILE_LOADER (loader));
+	g_return_if_fail (!loader->priv->is_loading);
+
+	if (loader->priv->max_file_size != max_file_size)
+	{
+		loader->priv->max_file_size = max_file_size;
+		g_object_notify_by_pspec (G_OBJECT (loader), properties[PROP_MAX_FILE_SIZE]);
+	}
+}
+
+/**
+ * tepl_file_loader_get_max_file_size:
+ * @loader: a #TeplFileLoader.
+ *
+ * Returns: the value of the #TeplFileLoader:max-file-size property.
+ * Since: 6.0
+ */
+guint64
+tepl_file_loader_get_max_file_size (TeplFileLoader *loader)
+{
+	g_return_val_if_fail (TEPL_IS_FILE_LOADER (loader), 0);
+
+	return loader->priv->max_file_size;
+}
+
+/**
+ * tepl_file_loader_get_n_line_splits:
+ * @loader: a #TeplFileLoader.
+ *
+ * After a successful load operation, gets the number of newlines inserted to
+ * split the very long lines. See the #TeplFileLoader:line-split-length
+ * property.
+ *
+ * Returns: the number of line splits.
+ * Since: 6.0
+ */
+guint
+tepl_file_loader_get_n_line_splits (TeplFileLoader *loader)
+{
+	g_return_val_if_fail (TEPL_IS_FILE_LOADER (loader), 0);
+
+	return loader->priv->n_line_splits;
+}
+
+/**
+ * tepl_file_loader_has_bom:
+ * @loader: a #TeplFileLoader.
+ *
+ * After a successful load operation, returns whether the file starts with a
+ * UTF-8, UTF-16 or UTF-32 byte order mark (BOM).
+ *
+ * Returns: whether the file starts with a BOM.
+ * Since: 6.0
+ */
+gboolean
+tepl_file_loader_has_bom (TeplFileLoader *loader)
+{
+	g_return_val_if_fail (TEPL_IS_FILE_LOADER (loader), FALSE);
+
+	return loader->priv->has_bom;
+}
+
+/**
+ * tepl_file_loader_get_n_lines:
+ * @loader: a #TeplFileLoader.
+ *
+ * After a successful load operation, gets the number of lines of the content.
+ * The line terminators are "\n", "\r" and "\r\n". Like
+ * gtk_text_buffer_get_line_count(), an empty content has one line.
+ *
+ * Returns: the number of lines.
+ * Since: 6.0
+ */
+guint64
+tepl_file_loader_get_n_lines (TeplFileLoader *loader)
+{
+	g_return_val_if_fail (TEPL_IS_FILE_LOADER (loader), 0);
+
+	return _tepl_content_analyzer_get_n_lines (&loader->priv->analyzer);
+}
+
+/**
+ * tepl_file_loader_get_max_line_length:
+ * @loader: a #TeplFileLoader.
+ *
+ * After a successful load operation, gets the length of the longest line, in
+ * characters, without the line terminator.
+ *
+ * Returns: the maximum line length.
+ * Since: 6.0
+ */
+guint64
+tepl_file_loader_get_max_line_length (TeplFileLoader *loader)
+{
+	g_return_val_if_fail (TEPL_IS_FILE_LOADER (loader), 0);
+
+	return _tepl_content_analyzer_get_max_line_length (&loader->priv->analyzer);
+}
+
+/**
+ * tepl_file_loader_get_mean_line_length:
+ * @loader: a #TeplFileLoader.
+ *
+ * After a successful load operation, gets the mean line length, in characters,
+ * without the line terminators.
+ *
+ * Returns: the mean line length.
+ * Since: 6.0
+ */
+gdouble
+tepl_file_loader_get_mean_line_length (TeplFileLoader *loader)
+{
+	g_return_val_if_fail (TEPL_IS_FILE_LOADER (loader), 0.0);
+
+	return _tepl_content_analyzer_get_mean_line_length (&loader->priv->analyzer);
+}
+
+/**
+ * tepl_file_loader_get_n_invalid_ranges:
+ * @loader: a #TeplFileLoader.
+ *
+ * After a successful load operation, gets the number of ranges of invalid
+ * bytes. See tepl_file_loader_get_invalid_range().
+ *
+ * Returns: the number of invalid ranges.
+ * Since: 6.0
+ */
+guint
+tepl_file_loader_get_n_invalid_ranges (TeplFileLoader *loader)
+{
+	g_return_val_if_fail (TEPL_IS_FILE_LOADER (loader), 0);
+
+	return loader->priv->invalid_ranges->len;
+}
+
+/**
+ * tepl_file_loader_get_invalid_range:
+ * @loader: a #TeplFileLoader.
+ * @range_num: the index of the range, between 0 and
+ *   tepl_file_loader_get_n_invalid_ranges() - 1.
+ * @start: (out) (optional): return location for the position of the first
+ *   invalid byte.
+ * @length: (out) (optional): return location for the number of invalid bytes.
+ *
+ * Gets a range of consecutive invalid bytes. The ranges are sorted and don't
+ * touch each other.
+ *
+ * The positions are in bytes, in the content once converted to UTF-8. Without
+ * charset conversion, they are thus the positions in the file. When the
+ * content is converted from another charset, the only invalid bytes can be NUL
+ * bytes.
+ *
+ * Since: 6.0
+ */
+void
+tepl_file_loader_get_invalid_range (TeplFileLoader *loader,
+				    guint           range_num,
+				    goffset        *start,
+				    goffset        *length)
+{
+	InvalidRange *range;
+
+	g_return_if_fail (TEPL_IS_FILE_LOADER (loader));
+	g_return_if_fail (range_num < loader->priv->invalid_ranges->len);
+
+	range = &g_array_index (loader->priv->invalid_ranges, InvalidRange, range_num);
+
+	if (start != NULL)
+	{
+		*start = range->start;
+	}
+
+	if (length != NULL)
+	{
+		*length = range->length;
+	}
+}
+
+/* @invalid: whether @text is the escaped form of invalid bytes. */
+static void
+insert_text (GTask       *task,
+	     const gchar *text,
+	     gsize        length,
+	     gboolean     invalid)
+{
+	TeplFileLoader *loader = g_task_get_source_object (task);
+	TaskData *task_data = g_task_get_task_data (task);
+	GtkTextBuffer *text_buffer;
+	GtkTextIter end;
+	gint start_offset;
+	gboolean was_empty;
+
+	if (loader->priv->buffer == NULL || length == 0)
+	{
+		return;
+	}
+
+	text_buffer = GTK_TEXT_BUFFER (loader->priv->buffer);
+	start_offset = gtk_text_buffer_get_char_count (text_buffer);
+	was_empty = start_offset == 0;
+
+	gtk_text_buffer_get_end_iter (text_buffer, &end);
+	gtk_text_buffer_insert (text_buffer, &end, text, length);
+
+	if (invalid)
+	{
+		GArray *offsets = task_data->invalid_char_offsets;
+		gint end_offset = gtk_text_iter_get_offset (&end);
+
+		/* Extends the previous range if possible. */
+		if (offsets->len > 0 &&
+		    g_array_index (offsets, gint, offsets->len - 1) == start_offset)
+		{
+			g_array_index (offsets, gint, offsets->len - 1) = end_offset;
+		}
+		else
+		{
+			g_array_append_val (offsets, start_offset);
+			g_array_append_val (offsets, end_offset);
+		}
+	}
+
+	/* The insert mark has a right gravity, so it has been moved at the end
+	 * if the buffer was empty.
+	 */
+	if (was_empty)
+	{
+		GtkTextIter start;
+
+		gtk_text_buffer_get_start_iter (text_buffer, &start);
+		gtk_text_buffer_place_cursor (text_buffer, &start);
+	}
+}
+
+/* Tags the escaped invalid bytes inserted since the last call. */
+static void
+tag_invalid_chars (GTask *task)
+{
+	TeplFileLoader *loader = g_task_get_source_object (task);
+	TaskData *task_data = g_task_get_task_data (task);
+
+	if (loader->priv->buffer != NULL)
+	{
+		_tepl_buffer_set_as_invalid_chars (loader->priv->buffer, task_data->invalid_char_offsets);
+	}
+
+	g_array_set_size (task_data->invalid_char_offsets, 0);
+}
+
+static void
+insert_line_split (TeplFileLoader *loader)
+{
+	GtkTextBuffer *text_buffer;
+	GtkTextIter iter;
+
+	if (loader->priv->buffer == NULL)
+	{
+		return;
+	}
+
+	text_buffer = GTK_TEXT_BUFFER (loader->priv->buffer);
+
+	gtk_text_buffer_get_end_iter (text_buffer, &iter);
+	gtk_text_buffer_insert (text_buffer, &iter, "\n", 1);
+	gtk_text_iter_backward_char (&iter);
+
+	_tepl_buffer_add_line_split (loader->priv->buffer, &iter);
+	loader->priv->n_line_splits++;
+}
+
+/* @text must contain only complete UTF-8 characters. When @invalid is %TRUE,
+ * @text contains escape sequences like “\FF”, that are not split: a line is
+ * split only before a backslash, so it can be up to two characters longer than
+ * the line split length.
+ */
+static void
+insert_text_splitting_long_lines (GTask       *task,
+				  const gchar *text,
+				  gsize        length,
+				  gboolean     invalid)
+{
+	TeplFileLoader *loader = g_task_get_source_object (task);
+	TaskData *task_data = g_task_get_task_data (task);
+	const gchar *end = text + length;
+	const gchar *segment_start = text;
+	const gchar *p;
+
+	for (p = text; p < end; p = g_utf8_next_char (p))
+	{
+		if (*p == '\n' || *p == '\r')
+		{
+			task_data->inserted_line_length = 0;
+			continue;
+		}
+
+		if (task_data->inserted_line_length >= loader->priv->line_split_length &&
+		    (invalid ? *p == '\\' : !g_unichar_ismark (g_utf8_get_char (p))))
+		{
+			insert_text (task, segment_start, p - segment_start, invalid);
+			insert_line_split (loader);
+
+			segment_start = p;
+			task_data->inserted_line_length = 0;
+		}
+
+		task_data->inserted_line_length++;
+	}
+
+	insert_text (task, segment_start, end - segment_start, invalid);
+}
+
+static QueuedText *
+queued_text_new (GBytes   *text,
+		 gboolean  invalid)
+{
+	QueuedText *queued_text;
+
+	queued_text = g_new0 (QueuedText, 1);
+	queued_text->text = text;
+	queued_text->invalid = invalid != FALSE;
+
+	return queued_text;
+}
+
+/* Text produced from some content, to be appended to the text queue. The text
+ * is analyzed when it is added to the batch, in the content order.
+ *
+ * The TextBatch functions don't access the TeplFileLoader or the GTask, so
+ * they can be called from a worker thread.
+ */
+typedef struct _TextBatch TextBatch;
+struct _TextBatch
+{
+	/* Owned by the TeplFileLoader. Only one batch at a time is filled. */
+	TeplContentAnalyzer *analyzer;
+
+	/* Of QueuedText. */
+	GQueue queued_texts;
+
+	/* Of InvalidRange. */
+	GArray *invalid_ranges;
+};
+
+static void
+text_batch_init (TextBatch           *batch,
+		 TeplContentAnalyzer *analyzer)
+{
+	batch->analyzer = analyzer;
+	g_queue_init (&batch->queued_texts);
+	batch->invalid_ranges = g_array_new (FALSE, FALSE, sizeof (InvalidRange));
+}
+
+static void
+text_batch_clear (TextBatch *batch)
+{
+	g_queue_clear_full (&batch->queued_texts, (GDestroyNotify)queued_text_free);
+	g_clear_pointer (&batch->invalid_ranges, g_array_unref);
+}
+
+static void
+add_invalid_range (GArray  *ranges,
+		   goffset  start,
+		   goffset  length)
+{
+	InvalidRange new_range;
+
+	if (ranges->len > 0)
+	{
+		InvalidRange *last_range = &g_array_index (ranges, InvalidRange, ranges->len - 1);
+
+		if (last_range->start + last_range->length == start)
+		{
+			last_range->length += length;
+			return;
+		}
+	}
+
+	new_range.start = start;
+	new_range.length = length;
+	g_array_append_val (ranges, new_range);
+}
+
+static void
+text_batch_add_valid_text (TextBatch *batch,
+			   GBytes    *text)
+{
+	const gchar *data;
+	gsize length;
+
+	data = g_bytes_get_data (text, &length);
+	if (length == 0)
+	{
+		g_bytes_unref (text);
+		return;
+	}
+
+	_tepl_content_analyzer_feed (batch->analyzer, data, length);
+	g_queue_push_tail (&batch->queued_texts, queued_text_new (text, FALSE));
+}
+
+/* @offset: the position, in bytes, of the invalid bytes in the content. */
+static void
+text_batch_add_invalid_bytes (TextBatch   *batch,
+			      const gchar *bytes,
+			      gsize        n_bytes,
+			      goffset      offset)
+{
+	GString *escaped;
+	gsize i;
+
+	if (n_bytes == 0)
+	{
+		return;
+	}
+
+	add_invalid_range (batch->invalid_ranges, offset, n_bytes);
+
+	escaped = g_string_sized_new (n_bytes * 3);
+
+	for (i = 0; i < n_bytes; i++)
+	{
+		g_string_append_printf (escaped, "\\%02X", (guchar) bytes[i]);
+	}
+
+	_tepl_content_analyzer_feed (batch->analyzer, escaped->str, escaped->len);
+	g_queue_push_tail (&batch->queued_texts,
+			   queued_text_new (g_string_free_to_bytes (escaped), TRUE));
+}
+
+/* Returns: the number of consecutive invalid bytes at the start of @text. */
+static gsize
+count_invalid_bytes (const gchar *text,
+		     gsize        length)
+{
+	gsize n_invalid_bytes = 1;
+
+	while (n_invalid_bytes < length)
+	{
+		const gchar *next = text + n_invalid_bytes;
+		gsize remaining_length = length - n_invalid_bytes;
+		gsize valid_length;
+
+		_tepl_utf8_validate (next,
+				     MIN (remaining_length, TEPL_UTF8_CHAR_MAX_LENGTH),
+				     &valid_length);
+
+		if (valid_length > 0 ||
+		    _tepl_utf8_is_incomplete_char (next, remaining_length))
+		{
+			break;
+		}
+
+		n_invalid_bytes++;
+	}
+
+	return n_invalid_bytes;
+}
+
+/* Adds the bytes of @content between @start and @end. The valid text is added
+ * as slices of @content, without copy. @content_offset is the position of
+ * @content in the UTF-8 content.
+ *
+ * If @is_end is %FALSE, a character can continue after @end.
+ *
+ * Returns: the position of the character that continues after @end, or @end.
+ */
+static gsize
+text_batch_add_content (TextBatch *batch,
+			GBytes    *content,
+			gsize      start,
+			gsize      end,
+			gboolean   is_end,
+			goffset    content_offset)
+{
+	const gchar *data;
+	gsize pos = start;
+
+	data = g_bytes_get_data (content, NULL);
+
+	while (pos < end)
+	{
+		gsize valid_length;
+		gsize remaining_length;
+		gsize n_invalid_bytes;
+
+		_tepl_utf8_validate (data + pos, end - pos, &valid_length);
+		text_batch_add_valid_text (batch, g_bytes_new_from_bytes (content, pos, valid_length));
+		pos += valid_length;
+
+		remaining_length = end - pos;
+		if (remaining_length == 0)
+		{
+			break;
+		}
+
+		if (!is_end &&
+		    _tepl_utf8_is_incomplete_char (data + pos, remaining_length))
+		{
+			return pos;
+		}
+
+		n_invalid_bytes = count_invalid_bytes (data + pos, remaining_length);
+		text_batch_add_invalid_bytes (batch,
+					      data + pos,
+					      n_invalid_bytes,
+					      content_offset + pos);
+		pos += n_invalid_bytes;
+	}
+
+	return end;
+}
+
+/* Must be called in the main thread. */
+static void
+push_text_batch (GTask     *task,
+		 TextBatch *batch)
+{
+	TeplFileLoader *loader = g_task_get_source_object (task);
+	TaskData *task_data = g_task_get_task_data (task);
+	QueuedText *queued_text;
+	guint i;
+
+	while ((queued_text = g_queue_pop_head (&batch->queued_texts)) != NULL)
+	{
+		g_queue_push_tail (&task_data->text_queue, queued_text);
+		task_data->text_queue_length += g_bytes_get_size (queued_text->text);
+	}
+
+	for (i = 0; i < batch->invalid_ranges->len; i++)
+	{
+		InvalidRange *range = &g_array_index (batch->invalid_ranges, InvalidRange, i);
+
+		add_invalid_range (loader->priv->invalid_ranges, range->start, range->length);
+	}
+
+	g_array_set_size (batch->invalid_ranges, 0);
+}
+
+/* When the content ends in the middle of a character, its first bytes are
+ * invalid.
+ */
+static void
+enqueue_incomplete_char_as_invalid (GTask *task)
+{
+	TeplFileLoader *loader = g_task_get_source_object (task);
+	TaskData *task_data = g_task_get_task_data (task);
+	TextBatch batch;
+
+	text_batch_init (&batch, &loader->priv->analyzer);
+	text_batch_add_invalid_bytes (&batch,
+				      task_data->incomplete_char,
+				      task_data->incomplete_char_length,
+				      task_data->n_handled_bytes - task_data->incomplete_char_length);
+	push_text_batch (task, &batch);
+	text_batch_clear (&batch);
+
+	task_data->incomplete_char_length = 0;
+}
+
+/* Completes the character split across the chunk boundary, if any.
+ *
+ * Returns: the number of bytes of @chunk that have been consumed.
+ */
+static gsize
+complete_incomplete_char (GTask       *task,
+			  TextBatch   *batch,
+			  const gchar *chunk,
+			  gsize        chunk_length)
+{
+	TaskData *task_data = g_task_get_task_data (task);
+	gsize prev_length;
+	gsize char_length;
+	gsize n_bytes;
+	gsize new_length;
+
+	prev_length = task_data->incomplete_char_length;
+	if (prev_length == 0)
+	{
+		return 0;
+	}
+
+	char_length = _tepl_utf8_get_char_length ((guchar) task_data->incomplete_char[0]);
+	g_assert_cmpuint (char_length, >, prev_length);
+
+	n_bytes = MIN (char_length - prev_length, chunk_length);
+	memcpy (task_data->incomplete_char + prev_length, chunk, n_bytes);
+	new_length = prev_length + n_bytes;
+
+	if (new_length < char_length &&
+	    _tepl_utf8_is_incomplete_char (task_data->incomplete_char, new_length))
+	{
+		/* The chunk is very small, the character continues in the next
+		 * chunk.
+		 */
+		task_data->incomplete_char_length = new_length;
+		return n_bytes;
+	}
+
+	if (new_length == char_length &&
+	    _tepl_utf8_validate (task_data->incomplete_char, char_length, NULL))
+	{
+		text_batch_add_valid_text (batch, g_bytes_new (task_data->incomplete_char, char_length));
+		task_data->incomplete_char_length = 0;
+		return n_bytes;
+	}
+
+	/* The bytes kept from the previous chunks are invalid. The current
+	 * chunk is handled from its start.
+	 */
+	text_batch_add_invalid_bytes (batch,
+				      task_data->incomplete_char,
+				      prev_length,
+				      task_data->n_handled_bytes - prev_length);
+	task_data->incomplete_char_length = 0;
+	return 0;
+}
+
+static void
+handle_chunk (GTask  *task,
+	      GBytes *chunk)
+{
+	TeplFileLoader *loader = g_task_get_source_object (task);
+	TaskData *task_data = g_task_get_task_data (task);
+	TextBatch batch;
+	const gchar *chunk_data;
+	gsize chunk_length;
+	gsize start;
+	gsize end;
+
+	chunk_data = g_bytes_get_data (chunk, &chunk_length);
+	text_batch_init (&batch, &loader->priv->analyzer);
+
+	start = complete_incomplete_char (task, &batch, chunk_data, chunk_length);
+	end = text_batch_add_content (&batch,
+				      chunk,
+				      start,
+				      chunk_length,
+				      FALSE,
+				      task_data->n_handled_bytes);
+
+	if (end < chunk_length)
+	{
+		g_assert_cmpuint (task_data->incomplete_char_length, ==, 0);
+
+		memcpy (task_data->incomplete_char, chunk_data + end, chunk_length - end);
+		task_data->incomplete_char_length = chunk_length - end;
+	}
+
+	push_text_batch (task, &batch);
+	text_batch_clear (&batch);
+
+	task_data->n_handled_bytes += chunk_length;
+}
+
+static void restart_with_charset_detection (GTask *task);
+
+static void
+return_error (GTask  *task,
+	      GError *error)
+{
+	TeplFileLoader *loader = g_task_get_source_object (task);
+	TaskData *task_data = g_task_get_task_data (task);
+
+	if (task_data->returned)
+	{
+		g_error_free (error);
+		return;
+	}
+
+	/* The charset stored in the metadata is unknown or doesn't match the
+	 * content.
+	 */
+	if (task_data->charset_from_metadata &&
+	    (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA) ||
+	     g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED)))
+	{
+		g_error_free (error);
+		restart_with_charset_detection (task);
+		return;
+	}
+
+	task_data->returned = TRUE;
+
+	if (task_data->insertion_idle_id != 0)
+	{
+		g_source_remove (task_data->insertion_idle_id);
+		task_data->insertion_idle_id = 0;
+	}
+
+	task_data_clear_queues (task_data);
+
+	/* Don't keep a partially loaded content. */
+	if (loader->priv->buffer != NULL)
+	{
+		_tepl_buffer_clear_line_splits (loader->priv->buffer);
+		gtk_text_buffer_set_text (GTK_TEXT_BUFFER (loader->priv->buffer), "", -1);
+	}
+
+	g_task_return_error (task, error);
+	g_object_unref (task);
+}
+
+static gchar *
+get_charset_from_metadata (TeplFileLoader *loader)
+{
+	TeplMetadataManager *manager;
+	TeplMetadata *metadata;
+	gchar *charset;
+
+	manager = tepl_metadata_manager_get_singleton ();
+	metadata = tepl_metadata_new ();
+
+	tepl_metadata_manager_copy_from (manager, loader->priv->location, metadata);
+	charset = tepl_metadata_get (metadata, CHARSET_METADATA_KEY);
+
+	g_object_unref (metadata);
+	return charset;
+}
+
+static void
+store_charset_in_metadata (TeplFileLoader *loader,
+			   const gchar    *charset)
+{
+	TeplMetadataManager *manager;
+	TeplMetadata *metadata;
+
+	manager = tepl_metadata_manager_get_singleton ();
+	metadata = tepl_metadata_new ();
+
+	tepl_metadata_set (metadata, CHARSET_METADATA_KEY, charset);
+	tepl_metadata_manager_merge_into (manager, loader->priv->location, metadata);
+	g_object_unref (metadata);
+
+	if (loader->priv->buffer != NULL)
+	{
+		metadata = tepl_buffer_get_metadata (loader->priv->buffer);
+		tepl_metadata_set (metadata, CHARSET_METADATA_KEY, charset);
+	}
+}
+
+/* The charset stored in the metadata is checked on the first chunk only: if
+ * the first chunk has invalid bytes, the file has probably been modified by
+ * another program, and the loading restarts with the charset detection while
+ * nearly nothing has been loaded. Afterwards the stored charset is kept, and
+ * the invalid bytes are inserted as escape sequences, like with a charset that
+ * doesn't come from the metadata. Must be called after the first chunk has
+ * been pushed, before it is inserted.
+ *
+ * Returns: whether the loading restarts.
+ */
+static gboolean
+check_charset_from_metadata (GTask *task)
+{
+	TeplFileLoader *loader = g_task_get_source_object (task);
+	TaskData *task_data = g_task_get_task_data (task);
+
+	if (!task_data->charset_from_metadata ||
+	    task_data->charset_from_metadata_checked)
+	{
+		return FALSE;
+	}
+
+	task_data->charset_from_metadata_checked = TRUE;
+
+	if (loader->priv->invalid_ranges->len > 0)
+	{
+		restart_with_charset_detection (task);
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+static void
+return_success_if_finished (GTask *task)
+{
+	TeplFileLoader *loader = g_task_get_source_object (task);
+	TaskData *task_data = g_task_get_task_data (task);
+
+	if (task_data->returned ||
+	    !task_data->end_of_stream ||
+	    task_data->converting ||
+	    (task_data->converter != NULL && !task_data->converter_flushed) ||
+	    !g_queue_is_empty (&task_data->text_queue))
+	{
+		return;
+	}
+
+	g_assert (task_data->insertion_idle_id == 0);
+	g_assert (g_queue_is_empty (&task_data->conversion_queue));
+
+	if (loader->priv->file != NULL)
+	{
+		_tepl_file_set_charset (loader->priv->file, task_data->charset);
+		_tepl_file_set_etag (loader->priv->file, task_data->etag);
+	}
+
+	if (task_data->charset_detected &&
+	    g_strcmp0 (task_data->charset, task_data->metadata_charset) != 0)
+	{
+		store_charset_in_metadata (loader, task_data->charset);
+	}
+
+	if (loader->priv->file != NULL)
+	{
+		TeplNewlineType newline_type;
+
+		newline_type = _tepl_content_analyzer_get_newline_type (&loader->priv->analyzer);
+		_tepl_file_set_newline_type (loader->priv->file, newline_type);
+	}
+
+	task_data->returned = TRUE;
+	g_task_return_boolean (task, TRUE);
+	g_object_unref (task);
+}
+
+/* Inserts at most INSERTION_PIECE_LENGTH bytes from the text queue. */
+static void
+insert_next_text_piece (GTask *task)
+{
+	TeplFileLoader *loader = g_task_get_source_object (task);
+	TaskData *task_data = g_task_get_task_data (task);
+	QueuedText *head;
+	const gchar *head_data;
+	gsize head_length;
+	const gchar *piece;
+	gsize piece_length;
+
+	head = g_queue_peek_head (&task_data->text_queue);
+	g_assert (head != NULL);
+
+	head_data = g_bytes_get_data (head->text, &head_length);
+	piece = head_data + task_data->head_offset;
+	piece_length = head_length - task_data->head_offset;
+
+	if (piece_length > INSERTION_PIECE_LENGTH)
+	{
+		piece_length = INSERTION_PIECE_LENGTH;
+
+		/* Don't split a UTF-8 character. The escaped invalid bytes
+		 * are ASCII.
+		 */
+		while ((((guchar) piece[piece_length]) & 0xC0) == 0x80)
+		{
+			piece_length--;
+		}
+	}
+
+	if (loader->priv->line_split_length > 0)
+	{
+		insert_text_splitting_long_lines (task, piece, piece_length, head->invalid);
+	}
+	else
+	{
+		insert_text (task, piece, piece_length, head->invalid);
+	}
+
+	task_data->head_offset += piece_length;
+	task_data->text_queue_length -= piece_length;
+
+	if (task_data->head_offset == head_length)
+	{
+		queued_text_free (g_queue_pop_head (&task_data->text_queue));
+		task_data->head_offset = 0;
+	}
+}
+
+static void read_next_chunk (GTask *task);
+
+/* Whether reading can continue. Reading is paused while too much content waits
+ * to be converted or inserted.
+ */
+static gboolean
+can_read_next_chunk (TaskData *task_data)
+{
+	return (!task_data->reading &&
+		!task_data->end_of_stream &&
+		task_data->conversion_queue_length + task_data->text_queue_length < MAX_QUEUED_TEXT_LENGTH);
+}
+
+static gboolean
+insertion_idle_cb (gpointer user_data)
+{
+	GTask *task = G_TASK (user_data);
+	TeplFileLoader *loader = g_task_get_source_object (task);
+	TaskData *task_data = g_task_get_task_data (task);
+	GError *error = NULL;
+	gint64 deadline;
+
+	/* Stop cleanly between two batches. */
+	if (g_cancellable_set_error_if_cancelled (g_task_get_cancellable (task), &error))
+	{
+		task_data->insertion_idle_id = 0;
+		return_error (task, error);
+		return G_SOURCE_REMOVE;
+	}
+
+	deadline = g_get_monotonic_time () + loader->priv->insertion_time_budget;
+
+	do
+	{
+		insert_next_text_piece (task);
+	}
+	while (!g_queue_is_empty (&task_data->text_queue) &&
+	       g_get_monotonic_time () < deadline);
+
+	tag_invalid_chars (task);
+
+	if (can_read_next_chunk (task_data))
+	{
+		read_next_chunk (task);
+	}
+
+	if (g_queue_is_empty (&task_data->text_queue))
+	{
+		task_data->insertion_idle_id = 0;
+		return_success_if_finished (task);
+		return G_SOURCE_REMOVE;
+	}
+
+	return G_SOURCE_CONTINUE;
+}
+
+static void
+install_insertion_idle (GTask *task)
+{
+	TaskData *task_data = g_task_get_task_data (task);
+
+	if (task_data->insertion_idle_id != 0 ||
+	    g_queue_is_empty (&task_data->text_queue))
+	{
+		return;
+	}
+
+	/* G_PRIORITY_DEFAULT_IDLE is lower than GDK_PRIORITY_REDRAW, so the
+	 * GtkTextView is redrawn between two batches.
+	 */
+	task_data->insertion_idle_id = g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
+							insertion_idle_cb,
+							g_object_ref (task),
+							g_object_unref);
+}
+
+typedef struct _ConversionData ConversionData;
+struct _ConversionData
+{
+	/* Owned by the TaskData of the main GTask. */
+	TeplCharsetConverter *converter;
+
+	/* NULL to flush the converter. */
+	GBytes *input;
+};
+
+static void
+conversion_data_free (ConversionData *data)
+{
+	if (data != NULL)
+	{
+		if (data->input != NULL)
+		{
+			g_bytes_unref (data->input);
+		}
+
+		g_free (data);
+	}
+}
+
+/* Runs in a worker thread. */
+static void
+convert_chunk_thread (GTask        *subtask,
+		      gpointer      source_object,
+		      gpointer      subtask_data,
+		      GCancellable *cancellable)
+{
+	ConversionData *data = subtask_data;
+	const gchar *input = NULL;
+	gsize input_length = 0;
+	GBytes *output;
+	GError *error = NULL;
+
+	if (data->input != NULL)
+	{
+		input = g_bytes_get_data (data->input, &input_length);
+	}
+
+	output = _tepl_charset_converter_convert (data->converter,
+						  input,
+						  input_length,
+						  data->input == NULL,
+						  &error);
+
+	if (error != NULL)
+	{
+		g_task_return_error (subtask, error);
+	}
+	else
+	{
+		g_task_return_pointer (subtask, output, (GDestroyNotify)g_bytes_unref);
+	}
+}
+
+static void convert_next_chunk (GTask *task);
+
+static void
+convert_chunk_cb (GObject      *source_object,
+		  GAsyncResult *result,
+		  gpointer      user_data)
+{
+	GTask *task = G_TASK (user_data);
+	TaskData *task_data = g_task_get_task_data (task);
+	GBytes *output;
+	GError *error = NULL;
+
+	task_data->converting = FALSE;
+	output = g_task_propagate_pointer (G_TASK (result), &error);
+
+	if (task_data->restart_pending)
+	{
+		g_clear_error (&error);
+		restart_with_charset_detection (task);
+		goto out;
+	}
+
+	if (error != NULL)
+	{
+		return_error (task, error);
+		goto out;
+	}
+
+	if (task_data->returned)
+	{
+		goto out;
+	}
+
+	handle_chunk (task, output);
+
+	if (check_charset_from_metadata (task))
+	{
+		goto out;
+	}
+
+	/* It was the last conversion. */
+	if (task_data->converter_flushed)
+	{
+		enqueue_incomplete_char_as_invalid (task);
+	}
+
+	install_insertion_idle (task);
+	convert_next_chunk (task);
+
+	if (can_read_next_chunk (task_data))
+	{
+		read_next_chunk (task);
+	}
+
+	return_success_if_finished (task);
+
+out:
+	if (output != NULL)
+	{
+		g_bytes_unref (output);
+	}
+
+	g_object_unref (task);
+}
+
+/* The converter keeps a state between two chunks, so only one chunk at a time
+ * is converted. In the meantime, the next chunks can be read.
+ */
+static void
+convert_next_chunk (GTask *task)
+{
+	TaskData *task_data = g_task_get_task_data (task);
+	ConversionData *data;
+	GTask *subtask;
+
+	if (task_data->converter == NULL ||
+	    task_data->converting ||
+	    task_data->converter_flushed ||
+	    task_data->returned)
+	{
+		return;
+	}
+
+	if (g_queue_is_empty (&task_data->conversion_queue) &&
+	    !task_data->end_of_stream)
+	{
+		return;
+	}
+
+	data = g_new0 (ConversionData, 1);
+	data->converter = task_data->converter;
+
+	if (g_queue_is_empty (&task_data->conversion_queue))
+	{
+		task_data->converter_flushed = TRUE;
+	}
+	else
+	{
+		data->input = g_queue_pop_head (&task_data->conversion_queue);
+		task_data->conversion_queue_length -= g_bytes_get_size (data->input);
+	}
+
+	task_data->converting = TRUE;
+
+	/* The subtask has a reference to the main task until its callback is
+	 * called, so the converter is not freed while it is used by the
+	 * thread.
+	 */
+	subtask = g_task_new (NULL,
+			      g_task_get_cancellable (task),
+			      convert_chunk_cb,
+			      g_object_ref (task));
+	g_task_set_priority (subtask, g_task_get_priority (task));
+	g_task_set_task_data (subtask, data, (GDestroyNotify)conversion_data_free);
+	g_task_run_in_thread (subtask, convert_chunk_thread);
+	g_object_unref (subtask);
+}
+
+static void
+close_input_stream_cb (GObject      *source_object,
+		       GAsyncResult *result,
+		       gpointer      user_data)
+{
+	GInputStream *input_stream = G_INPUT_STREAM (source_object);
+	GTask *task = G_TASK (user_data);
+	TaskData *task_data = g_task_get_task_data (task);
+	GError *error = NULL;
+
+	task_data->reading = FALSE;
+	g_input_stream_close_finish (input_stream, result, &error);
+
+	if (task_data->restart_pending)
+	{
+		g_clear_error (&error);
+		restart_with_charset_detection (task);
+	}
+	else if (error != NULL)
+	{
+		return_error (task, error);
+	}
+	else
+	{
+		task_data->end_of_stream = TRUE;
+		convert_next_chunk (task);
+		return_success_if_finished (task);
+	}
+
+	g_object_unref (task);
+}
+
+static void
+read_chunk_cb (GObject      *source_object,
+	       GAsyncResult *result,
+	       gpointer      user_data)
+{
+	GInputStream *input_stream = G_INPUT_STREAM (source_object);
+	GTask *task = G_TASK (user_data);
+	TeplFileLoader *loader = g_task_get_source_object (task);
+	TaskData *task_data = g_task_get_task_data (task);
+	GBytes *chunk;
+	GError *error = NULL;
+
+	task_data->reading = FALSE;
+	chunk = g_input_stream_read_bytes_finish (input_stream, result, &error);
+
+	if (task_data->restart_pending)
+	{
+		g_clear_error (&error);
+		restart_with_charset_detection (task);
+		goto out;
+	}
+
+	if (error != NULL)
+	{
+		return_error (task, error);
+		goto out;
+	}
+
+	if (task_data->returned)
+	{
+		goto out;
+	}
+
+	/* End of file. */
+	if (g_bytes_get_size (chunk) == 0)
+	{
+		if (task_data->converter == NULL)
+		{
+			enqueue_incomplete_char_as_invalid (task);
+			install_insertion_idle (task);
+		}
+
+		task_data->reading = TRUE;
+		g_input_stream_close_async (input_stream,
+					    g_task_get_priority (task),
+					    g_task_get_cancellable (task),
+					    close_input_stream_cb,
+					    g_object_ref (task));
+		goto out;
+	}
+
+	if (!task_data->bom_checked)
+	{
+		const gchar *data;
+		gsize length;
+
+		data = g_bytes_get_data (chunk, &length);
+		loader->priv->has_bom = _tepl_charset_detect_bom (data, length) != NULL;
+		task_data->bom_checked = TRUE;
+	}
+
+	if (task_data->converter != NULL)
+	{
+		g_queue_push_tail (&task_data->conversion_queue, g_bytes_ref (chunk));
+		task_data->conversion_queue_length += g_bytes_get_size (chunk);
+		convert_next_chunk (task);
+	}
+	else
+	{
+		handle_chunk (task, chunk);
+
+		if (check_charset_from_metadata (task))
+		{
+			goto out;
+		}
+
+		install_insertion_idle (task);
+	}
+
+	/* Otherwise reading is resumed by the insertion idle callback or when a
+	 * chunk has been converted.
+	 */
+	if (can_read_next_chunk (task_data))
+	{
+		read_next_chunk (task);
+	}
+
+out:
+	if (chunk != NULL)
+	{
+		g_bytes_unref (chunk);
+	}
+
+	g_object_unref (task);
+}
+
+typedef struct _WindowData WindowData;
+struct _WindowData
+{
+	GBytes *content;
+	gchar *path;
+	gsize start;
+	gsize end;
+	gboolean is_end;
+
+	TextBatch batch;
+
+	/* Set by the worker thread: where the next window starts. */
+	gsize next_start;
+
+	/* Set by the worker thread, for the first window. */
+	gboolean has_bom;
+
+	/* Set by the worker thread: whether the file has been truncated since
+	 * it has been mapped.
+	 */
+	gboolean truncated;
+};
+
+static void
+window_data_free (WindowData *data)
+{
+	if (data != NULL)
+	{
+		g_bytes_unref (data->content);
+		g_free (data->path);
+		text_batch_clear (&data->batch);
+		g_free (data);
+	}
+}
+
+#ifdef G_OS_UNIX
+/* Accessing the pages of a mapped file after its end raises SIGBUS, when the
+ * file has been truncated. The mapped content is accessed only by
+ * copy_mapped_window(), which catches the signal: the handler jumps back to
+ * the sigjmp_buf of the current thread, if any.
+ */
+static GPrivate sigbus_env;
+static struct sigaction previous_sigbus_action;
+
+static void
+sigbus_handler (gint       signum,
+		siginfo_t *info,
+		gpointer   context)
+{
+	sigjmp_buf *env = g_private_get (&sigbus_env);
+
+	if (env != NULL)
+	{
+		siglongjmp (*env, 1);
+	}
+
+	/* Not raised by copy_mapped_window(). */
+	if ((previous_sigbus_action.sa_flags & SA_SIGINFO) != 0)
+	{
+		previous_sigbus_action.sa_sigaction (signum, info, context);
+	}
+	else if (previous_sigbus_action.sa_handler != SIG_DFL &&
+		 previous_sigbus_action.sa_handler != SIG_IGN)
+	{
+		previous_sigbus_action.sa_handler (signum);
+	}
+	else
+	{
+		/* The faulting instruction is run again, with the default
+		 * action.
+		 */
+		signal (SIGBUS, SIG_DFL);
+	}
+}
+
+static void
+install_sigbus_handler (void)
+{
+	static gsize initialized = 0;
+
+	if (g_once_init_enter (&initialized))
+	{
+		struct sigaction action;
+
+		memset (&action, 0, sizeof (action));
+		action.sa_sigaction = sigbus_handler;
+		action.sa_flags = SA_SIGINFO;
+		sigemptyset (&action.sa_mask);
+
+		sigaction (SIGBUS, &action, &previous_sigbus_action);
+
+		g_once_init_leave (&initialized, 1);
+	}
+}
+
+/* Runs in a worker thread. Returns: a copy of @data, or %NULL if the file has
+ * been truncated.
+ */
+static GBytes *
+copy_mapped_window (const gchar *data,
+		    gsize        length)
+{
+	sigjmp_buf env;
+	gchar *copy;
+
+	install_sigbus_handler ();
+	copy = g_malloc (length);
+
+	if (sigsetjmp (env, 1) != 0)
+	{
+		g_private_set (&sigbus_env, NULL);
+		g_free (copy);
+		return NULL;
+	}
+
+	g_private_set (&sigbus_env, &env);
+	memcpy (copy, data, length);
+	g_private_set (&sigbus_env, NULL);
+
+	return g_bytes_new_take (copy, length);
+}
+#else
+/* A mapped file can't be truncated on Windows. */
+static GBytes *
+copy_mapped_window (const gchar *data,
+		    gsize        length)
+{
+	return g_bytes_new (data, length);
+}
+#endif
+
+/* Runs in a worker thread. The window is copied, so that the main thread never
+ * accesses the mapped content.
+ */
+static void
+validate_window_thread (GTask        *subtask,
+			gpointer      source_object,
+			gpointer      subtask_data,
+			GCancellable *cancellable)
+{
+	WindowData *data = subtask_data;
+	const gchar *mapped_data;
+	GBytes *window;
+	const gchar *window_data;
+	gsize window_length;
+	GStatBuf statbuf;
+
+	if (g_task_return_error_if_cancelled (subtask))
+	{
+		return;
+	}
+
+	mapped_data = g_bytes_get_data (data->content, NULL);
+	window = copy_mapped_window (mapped_data + data->start, data->end - data->start);
+
+	/* When the file is truncated in the middle of the last page, reading
+	 * the rest of the page doesn't raise SIGBUS, it contains zeros.
+	 */
+	if (window == NULL ||
+	    (g_stat (data->path, &statbuf) == 0 && (guint64) statbuf.st_size < data->end))
+	{
+		data->truncated = TRUE;
+		g_clear_pointer (&window, g_bytes_unref);
+		g_task_return_boolean (subtask, TRUE);
+		return;
+	}
+
+	window_data = g_bytes_get_data (window, &window_length);
+
+	if (data->start == 0)
+	{
+		data->has_bom = _tepl_charset_detect_bom (window_data, window_length) != NULL;
+	}
+
+	/* Without charset conversion, the positions in the UTF-8 content are
+	 * the positions in the file.
+	 */
+	data->next_start = data->start + text_batch_add_content (&data->batch,
+								 window,
+								 0,
+								 window_length,
+								 data->is_end,
+								 data->start);
+
+	g_bytes_unref (window);
+	g_task_return_boolean (subtask, TRUE);
+}
+
+static void restart_with_input_stream (GTask *task);
+
+static void
+validate_window_cb (GObject      *source_object,
+		    GAsyncResult *result,
+		    gpointer      user_data)
+{
+	GTask *task = G_TASK (user_data);
+	TeplFileLoader *loader = g_task_get_source_object (task);
+	TaskData *task_data = g_task_get_task_data (task);
+	WindowData *data = g_task_get_task_data (G_TASK (result));
+	GError *error = NULL;
+
+	task_data->reading = FALSE;
+
+	if (task_data->restart_pending)
+	{
+		g_task_propagate_boolean (G_TASK (result), NULL);
+		restart_with_charset_detection (task);
+		goto out;
+	}
+
+	if (!g_task_propagate_boolean (G_TASK (result), &error))
+	{
+		return_error (task, error);
+		goto out;
+	}
+
+	if (task_data->returned)
+	{
+		goto out;
+	}
+
+	if (data->truncated)
+	{
+		restart_with_input_stream (task);
+		goto out;
+	}
+
+	if (data->start == 0)
+	{
+		loader->priv->has_bom = data->has_bom;
+		task_data->bom_checked = TRUE;
+	}
+
+	push_text_batch (task, &data->batch);
+
+	if (check_charset_from_metadata (task))
+	{
+		goto out;
+	}
+
+	task_data->mapped_pos = data->next_start;
+	task_data->end_of_stream = data->is_end;
+
+	install_insertion_idle (task);
+
+	if (can_read_next_chunk (task_data))
+	{
+		read_next_chunk (task);
+	}
+
+	return_success_if_finished (task);
+
+out:
+	g_object_unref (task);
+}
+
+/* Only one window at a time is validated, since the content analyzer keeps a
+ * state between two windows. In the meantime, the previous windows are
+ * inserted into the buffer.
+ */
+static void
+validate_next_window (GTask *task)
+{
+	TeplFileLoader *loader = g_task_get_source_object (task);
+	TaskData *task_data = g_task_get_task_data (task);
+	gsize content_length;
+	WindowData *data;
+	GTask *subtask;
+
+	content_length = g_bytes_get_size (task_data->mapped_content);
+
+	data = g_new0 (WindowData, 1);
+	data->content = g_bytes_ref (task_data->mapped_content);
+	data->path = g_file_get_path (loader->priv->location);
+	data->start = task_data->mapped_pos;
+	data->end = data->start + MIN (content_length - data->start, MAPPED_WINDOW_SIZE);
+	data->is_end = data->end == content_length;
+	text_batch_init (&data->batch, &loader->priv->analyzer);
+
+	/* The subtask has a reference to the main task until its callback is
+	 * called, so the analyzer is not freed while it is used by the
+	 * thread.
+	 */
+	subtask = g_task_new (NULL,
+			      g_task_get_cancellable (task),
+			      validate_window_cb,
+			      g_object_ref (task));
+	g_task_set_priority (subtask, g_task_get_priority (task));
+	g_task_set_task_data (subtask, data, (GDestroyNotify)window_data_free);
+	g_task_run_in_thread (subtask, validate_window_thread);
+	g_object_unref (subtask);
+}
+
+static void
+read_next_chunk (GTask *task)
+{
+	TaskData *task_data = g_task_get_task_data (task);
+
+	g_assert (!task_data->reading);
+	task_data->reading = TRUE;
+
+	if (task_data->mapped_content != NULL)
+	{
+		validate_next_window (task);
+		return;
+	}
+
+	g_input_stream_read_bytes_async (task_data->input_stream,
+					 READ_CHUNK_SIZE,
+					 g_task_get_priority (task),
+					 g_task_get_cancellable (task),
+					 read_chunk_cb,
+					 g_object_ref (task));
+}
+
+static void
+open_file_cb (GObject      *source_object,
+	      GAsyncResult *result,
+	      gpointer      user_data)
+{
+	GFile *location = G_FILE (source_object);
+	GTask *task = G_TASK (user_data);
+	TaskData *task_data = g_task_get_task_data (task);
+	GFileInputStream *file_input_stream;
+	GError *error = NULL;
+
+	file_input_stream = g_file_read_finish (location, result, &error);
+
+	if (error != NULL)
+	{
+		return_error (task, error);
+		return;
+	}
+
+	task_data->input_stream = G_INPUT_STREAM (file_input_stream);
+	read_next_chunk (task);
+}
+
+static void
+open_input_stream (GTask *task)
+{
+	TeplFileLoader *loader = g_task_get_source_object (task);
+
+	g_file_read_async (loader->priv->location,
+			   g_task_get_priority (task),
+			   g_task_get_cancellable (task),
+			   open_file_cb,
+			   task);
+}
+
+/* Runs in a worker thread. */
+static void
+map_file_thread (GTask        *subtask,
+		 gpointer      source_object,
+		 gpointer      subtask_data,
+		 GCancellable *cancellable)
+{
+	GFile *location = G_FILE (source_object);
+	gchar *path;
+	GMappedFile *mapped_file = NULL;
+	GBytes *content = NULL;
+
+	path = g_file_get_path (location);
+
+	/* Special files, like the /proc files or named pipes, must be read
+	 * with an input stream.
+	 */
+	if (path != NULL &&
+	    g_file_test (path, G_FILE_TEST_IS_REGULAR))
+	{
+		mapped_file = g_mapped_file_new (path, FALSE, NULL);
+	}
+
+	if (mapped_file != NULL)
+	{
+		content = g_mapped_file_get_bytes (mapped_file);
+		g_mapped_file_unref (mapped_file);
+	}
+
+	g_free (path);
+	g_task_return_pointer (subtask, content, (GDestroyNotify)g_bytes_unref);
+}
+
+static void
+map_file_cb (GObject      *source_object,
+	     GAsyncResult *result,
+	     gpointer      user_data)
+{
+	GTask *task = G_TASK (user_data);
+	TaskData *task_data = g_task_get_task_data (task);
+	GBytes *content;
+
+	content = g_task_propagate_pointer (G_TASK (result), NULL);
+
+	/* The input stream reports the error, if any. */
+	if (content == NULL)
+	{
+		open_input_stream (task);
+		return;
+	}
+
+	/* The BOM is checked with the first window. */
+	task_data->mapped_content = content;
+	read_next_chunk (task);
+}
+
+static void
+map_file (GTask *task)
+{
+	TeplFileLoader *loader = g_task_get_source_object (task);
+	GTask *subtask;
+
+	subtask = g_task_new (loader->priv->location,
+			      g_task_get_cancellable (task),
+			      map_file_cb,
+			      task);
+	g_task_set_priority (subtask, g_task_get_priority (task));
+	g_task_run_in_thread (subtask, map_file_thread);
+	g_object_unref (subtask);
+}
+
+static void
+open_file (GTask *task)
+{
+	TeplFileLoader *loader = g_task_get_source_object (task);
+	TaskData *task_data = g_task_get_task_data (task);
+
+	if (!_tepl_charset_is_utf8 (task_data->charset))
+	{
+		GError *error = NULL;
+
+		task_data->converter = _tepl_charset_converter_new (task_data->charset, "UTF-8", &error);
+		if (error != NULL)
+		{
+			return_error (task, error);
+			return;
+		}
+	}
+
+	/* The converter needs a copy anyway, so mapping the file is useful
+	 * only for UTF-8 content.
+	 */
+	if (task_data->converter == NULL &&
+	    loader->priv->use_mapped_file &&
+	    g_file_is_native (loader->priv->location))
+	{
+		map_file (task);
+		return;
+	}
+
+	open_input_stream (task);
+}
+
+static void
+detect_charset_cb (GObject      *source_object,
+		   GAsyncResult *result,
+		   gpointer      user_data)
+{
+	GTask *task = G_TASK (user_data);
+	TeplFileLoader *loader = g_task_get_source_object (task);
+	TaskData *task_data = g_task_get_task_data (task);
+	GError *error = NULL;
+
+	task_data->charset = _tepl_charset_detect_file_finish (result,
+								&loader->priv->detected_charset_confidence,
+								&error);
+
+	if (error != NULL)
+	{
+		return_error (task, error);
+		return;
+	}
+
+	/* If nothing matches, the content is probably invalid UTF-8 or binary,
+	 * and loading it as UTF-8 shows where the invalid bytes are.
+	 */
+	if (task_data->charset == NULL)
+	{
+		task_data->charset = g_strdup ("UTF-8");
+	}
+
+	task_data->charset_detected = TRUE;
+	open_file (task);
+}
+
+static void
+detect_charset (GTask *task)
+{
+	TeplFileLoader *loader = g_task_get_source_object (task);
+
+	_tepl_charset_detect_file_async (loader->priv->location,
+					 g_task_get_priority (task),
+					 g_task_get_cancellable (task),
+					 detect_charset_cb,
+					 task);
+}
+
+/* Discards what has been loaded so far. No read or conversion must be
+ * running.
+ */
+static void
+discard_loaded_content (GTask *task)
+{
+	TeplFileLoader *loader = g_task_get_source_object (task);
+	TaskData *task_data = g_task_get_task_data (task);
+
+	g_assert (!task_data->reading);
+	g_assert (!task_data->converting);
+
+	if (task_data->insertion_idle_id != 0)
+	{
+		g_source_remove (task_data->insertion_idle_id);
+		task_data->insertion_idle_id = 0;
+	}
+
+	task_data_clear_queues (task_data);
+	g_clear_object (&task_data->input_stream);
+	g_clear_pointer (&task_data->mapped_content, g_bytes_unref);
+	task_data->mapped_pos = 0;
+	task_data->n_handled_bytes = 0;
+	task_data->inserted_line_length = 0;
+	task_data->incomplete_char_length = 0;
+	task_data->end_of_stream = FALSE;
+	task_data->converter_flushed = FALSE;
+	task_data->bom_checked = FALSE;
+
+	loader->priv->has_bom = FALSE;
+	loader->priv->n_line_splits = 0;
+	g_array_set_size (loader->priv->invalid_ranges, 0);
+	_tepl_content_analyzer_init (&loader->priv->analyzer);
+
+	if (loader->priv->buffer != NULL)
+	{
+		_tepl_buffer_clear_line_splits (loader->priv->buffer);
+		gtk_text_buffer_set_text (GTK_TEXT_BUFFER (loader->priv->buffer), "", -1);
+	}
+}
+
+/* Discards what has been loaded with the charset stored in the metadata, and
+ * loads the file again from the start, with the charset detection. If a read
+ * or a conversion is running, it is done when it is finished.
+ */
+static void
+restart_with_charset_detection (GTask *task)
+{
+	TaskData *task_data = g_task_get_task_data (task);
+
+	/* The pending asynchronous operations have nothing more to do. */
+	task_data->returned = TRUE;
+
+	if (task_data->insertion_idle_id != 0)
+	{
+		g_source_remove (task_data->insertion_idle_id);
+		task_data->insertion_idle_id = 0;
+	}
+
+	if (task_data->reading || task_data->converting)
+	{
+		task_data->restart_pending = TRUE;
+		return;
+	}
+
+	discard_loaded_content (task);
+
+	g_clear_pointer (&task_data->charset, g_free);
+	g_clear_pointer (&task_data->converter, _tepl_charset_converter_free);
+	task_data->charset_from_metadata = FALSE;
+	task_data->restart_pending = FALSE;
+	task_data->returned = FALSE;
+
+	detect_charset (task);
+}
+
+/* The mapped file has been truncated while it was being read. Discards what
+ * has been loaded, and loads the file again from the start with an input
+ * stream, with the same charset.
+ */
+static void
+restart_with_input_stream (GTask *task)
+{
+	TaskData *task_data = g_task_get_task_data (task);
+
+	discard_loaded_content (task);
+
+	/* The content has changed, so the first chunk is checked again. */
+	task_data->charset_from_metadata_checked = FALSE;
+
+	open_input_stream (task);
+}
+
+static void
+choose_charset (GTask *task)
+{
+	TeplFileLoader *loader = g_task_get_source_object (task);
+	TaskData *task_data = g_task_get_task_data (task);
+
+	if (loader->priv->charset != NULL)
+	{
+		task_data->charset = g_strdup (loader->priv->charset);
+	}
+	else
+	{
+		task_data->metadata_charset = get_charset_from_metadata (loader);
+		task_data->charset = g_strdup (task_data->metadata_charset);
+		task_data->charset_from_metadata = task_data->charset != NULL;
+	}
+
+	if (task_data->charset != NULL)
+	{
+		open_file (task);
+		return;
+	}
+
+	detect_charset (task);
+}
+
+static void
+query_file_size_cb (GObject      *source_object,
+		    GAsyncResult *result,
+		    gpointer      user_data)
+{
+	GFile *location = G_FILE (source_object);
+	GTask *task = G_TASK (user_data);
+	TeplFileLoader *loader = g_task_get_source_object (task);
+	TaskData *task_data = g_task_get_task_data (task);
+	GFileInfo *info;
+	GError *error = NULL;
+
+	info = g_file_query_info_finish (location, result, &error);
+
+	if (error != NULL)
+	{
+		return_error (task, error);
+		return;
+	}
+
+	task_data->etag = g_strdup (g_file_info_get_etag (info));
+
+	/* The size is not always known, for example for some remote files. */
+	if (loader->priv->max_file_size > 0 &&
+	    g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_STANDARD_SIZE))
+	{
+		goffset size = g_file_info_get_size (info);
+
+		if (size > 0 && (guint64) size > loader->priv->max_file_size)
+		{
+			gchar *size_str;
+			gchar *max_size_str;
+
+			size_str = g_format_size (size);
+			max_size_str = g_format_size (loader->priv->max_file_size);
+
+			error = g_error_new (TEPL_FILE_LOADER_ERROR,
+					     TEPL_FILE_LOADER_ERROR_TOO_BIG,
+					     _("The file is too big (%s). The maximum size is %s."),
+					     size_str,
+					     max_size_str);
+
+			g_free (size_str);
+			g_free (max_size_str);
+		}
+	}
+
+	g_object_unref (info);
+
+	if (error != NULL)
+	{
+		return_error (task, error);
+		return;
+	}
+
+	choose_charset (task);
+}
+
+static void
+start_load_contents (GTask *task)
+{
+	TeplFileLoader *loader = g_task_get_source_object (task);
+
+	/* The etag permits to know later if the file has been modified by
+	 * another program, see TeplFileSaver.
+	 */
+	g_file_query_info_async (loader->priv->location,
+				 G_FILE_ATTRIBUTE_STANDARD_SIZE ","
+				 G_FILE_ATTRIBUTE_ETAG_VALUE,
+				 G_FILE_QUERY_INFO_NONE,
+				 g_task_get_priority (task),
+				 g_task_get_cancellable (task),
+				 query_file_size_cb,
+				 task);
+}
+
+#if SIMULATE_LONG_FILE_LOADING
+static gboolean
+simulate_long_file_loading_timeout_cb (gpointer user_data)
+{
+	GTask *task = G_TASK (user_data);
+
+	g_message ("%s()", G_STRFUNC);
+
+	start_load_contents (task);
+
+	return G_SOURCE_REMOVE;
+}
+#endif
+
+/**
+ * tepl_file_loader_load_async:
+ * @loader: a #TeplFileLoader.
+ * @io_priority: the I/O priority of the request. E.g. %G_PRIORITY_LOW,
+ *   %G_PRIORITY_DEFAULT or %G_PRIORITY_HIGH.
+ * @cancellable: (nullable): optional #GCancellable object, %NULL to ignore.
+ * @callback: (scope async): a #GAsyncReadyCallback to call when the request is
+ *   satisfied.
+ * @user_data: user data to pass to @callback.
+ *
+ * Loads asynchronously the file content into the #TeplBuffer.
+ *
+ * The content is inserted in batches, see the
+ * #TeplFileLoader:insertion-time-budget property. If @cancellable is
+ * cancelled, the operation stops cleanly between two batches.
+ *
+ * See the #GAsyncResult documentation to know how to use this function.
+ *
+ * Since: 5.0
+ */
+void
+tepl_file_loader_load_async (TeplFileLoader      *loader,
+			     gint                 io_priority,
+			     GCancellable        *cancellable,
+			     GAsyncReadyCallback  callback,
+			     gpointer             user_data)
+{
+	GTask *task;
+
+	g_return_if_fail (TEPL_IS_FILE_LOADER (loader));
+	g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+	g_return_if_fail (!loader->priv->is_loading);
+
+	loader->priv->is_loading = TRUE;
+	loader->priv->detected_charset_confidence = -1;
+	loader->priv->has_bom = FALSE;
+	loader->priv->n_line_splits = 0;
+	g_array_set_size (loader->priv->invalid_ranges, 0);
+	_tepl_content_analyzer_init (&loader->priv->analyzer);
+
+	task = g_task_new (loader, cancellable, callback, user_data);
+	g_task_set_priority (task, io_priority);
+	g_task_set_task_data (task, task_data_new (), (GDestroyNotify)task_data_free);
+
+	if (loader->priv->buffer == NULL ||
+	    loader->priv->file == NULL ||
+	    loader->priv->location == NULL)
+	{
+		g_task_return_boolean (task, FALSE);
+		g_object_unref (task);
+		return;
 	}
 
 	gtk_source_buffer_begin_not_undoable_action (GTK_SOURCE_BUFFER (loader->priv->buffer));
+	_tepl_buffer_clear_line_splits (loader->priv->buffer);
+	_tepl_buffer_set_partial_content (loader->priv->buffer, FALSE);
 	gtk_text_buffer_set_text (GTK_TEXT_BUFFER (loader->priv->buffer), "", -1);
 	gtk_text_buffer_set_modified (GTK_TEXT_BUFFER (loader->priv->buffer), FALSE);
 
@@ -458,16 +2938,44 @@ tepl_file_loader_load_finish (TeplFileLoader  *loader,
 			      GAsyncResult    *result,
 			      GError         **error)
 {
+	gboolean ok;
+
 	g_return_val_if_fail (TEPL_IS_FILE_LOADER (loader), FALSE);
 	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
 	g_return_val_if_fail (g_task_is_valid (result, loader), FALSE);
 
+	ok = g_task_propagate_boolean (G_TASK (result), error);
+
 	if (loader->priv->buffer != NULL)
 	{
 		gtk_source_buffer_end_not_undoable_action (GTK_SOURCE_BUFFER (loader->priv->buffer));
 		gtk_text_buffer_set_modified (GTK_TEXT_BUFFER (loader->priv->buffer), FALSE);
+
+		/* With mixed line terminators, the file differs from what
+		 * the saver writes, which uses only one kind, so an unchanged
+		 * buffer must still be saved to normalize the file.
+		 */
+		if (ok &&
+		    !_tepl_content_analyzer_has_mixed_newlines (&loader->priv->analyzer))
+		{
+			_tepl_buffer_set_current_content_as_saved (loader->priv->buffer);
+		}
+		else
+		{
+			_tepl_buffer_set_saved_content (loader->priv->buffer, NULL);
+		}
 	}
 
 	loader->priv->is_loading = FALSE;
-	return g_task_propagate_boolean (G_TASK (result), error);
+	return ok;
+}
+
+/* For the unit tests, to test the input stream code path with local files. */
+void
+_tepl_file_loader_set_use_mapped_file (TeplFileLoader *loader,
+				       gboolean        use_mapped_file)
+{
+	g_return_if_fail (TEPL_IS_FILE_LOADER (loader));
+
+	loader->priv->use_mapped_file = use_mapped_file != FALSE;
 }
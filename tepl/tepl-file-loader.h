@@ -26,6 +26,22 @@ typedef struct _TeplFileLoader         TeplFileLoader;
 typedef struct _TeplFileLoaderClass    TeplFileLoaderClass;
 typedef struct _TeplFileLoaderPrivate  TeplFileLoaderPrivate;
 
+#define TEPL_FILE_LOADER_ERROR tepl_file_loader_error_quark ()
+
+/**
+ * TeplFileLoaderError:
+ * @TEPL_FILE_LOADER_ERROR_TOO_BIG: The file is bigger than the
+ *   #TeplFileLoader:max-file-size.
+ *
+ * An error code used with the %TEPL_FILE_LOADER_ERROR domain.
+ *
+ * Since: 6.0
+ */
+typedef enum _TeplFileLoaderError
+{
+	TEPL_FILE_LOADER_ERROR_TOO_BIG
+} TeplFileLoaderError;
+
 struct _TeplFileLoader
 {
 	GObject parent;
@@ -43,6 +59,9 @@ struct _TeplFileLoaderClass
 _TEPL_EXTERN
 GType			tepl_file_loader_get_type		(void);
 
+_TEPL_EXTERN
+GQuark			tepl_file_loader_error_quark		(void);
+
 _TEPL_EXTERN
 TeplFileLoader *	tepl_file_loader_new			(TeplBuffer *buffer,
 								 TeplFile   *file);
@@ -56,6 +75,61 @@ TeplFile *		tepl_file_loader_get_file		(TeplFileLoader *loader);
 _TEPL_EXTERN
 GFile *			tepl_file_loader_get_location		(TeplFileLoader *loader);
 
+_TEPL_EXTERN
+void			tepl_file_loader_set_charset		(TeplFileLoader *loader,
+								 const gchar    *charset);
+
+_TEPL_EXTERN
+const gchar *		tepl_file_loader_get_charset		(TeplFileLoader *loader);
+
+_TEPL_EXTERN
+gint			tepl_file_loader_get_detected_charset_confidence (TeplFileLoader *loader);
+
+_TEPL_EXTERN
+void			tepl_file_loader_set_insertion_time_budget (TeplFileLoader *loader,
+								    guint           time_budget);
+
+_TEPL_EXTERN
+guint			tepl_file_loader_get_insertion_time_budget (TeplFileLoader *loader);
+
+_TEPL_EXTERN
+void			tepl_file_loader_set_line_split_length	(TeplFileLoader *loader,
+								 guint           line_split_length);
+
+_TEPL_EXTERN
+guint			tepl_file_loader_get_line_split_length	(TeplFileLoader *loader);
+
+_TEPL_EXTERN
+void			tepl_file_loader_set_max_file_size	(TeplFileLoader *loader,
+								 guint64         max_file_size);
+
+_TEPL_EXTERN
+guint64			tepl_file_loader_get_max_file_size	(TeplFileLoader *loader);
+
+_TEPL_EXTERN
+guint			tepl_file_loader_get_n_line_splits	(TeplFileLoader *loader);
+
+_TEPL_EXTERN
+gboolean		tepl_file_loader_has_bom		(TeplFileLoader *loader);
+
+_TEPL_EXTERN
+guint64			tepl_file_loader_get_n_lines		(TeplFileLoader *loader);
+
+_TEPL_EXTERN
+guint64			tepl_file_loader_get_max_line_length	(TeplFileLoader *loader);
+
+_TEPL_EXTERN
+gdouble			tepl_file_loader_get_mean_line_length	(TeplFileLoader *loader);
+
+_TEPL_EXTERN
+guint			tepl_file_loader_get_n_invalid_ranges	(TeplFileLoader *loader);
+
+_TEPL_EXTERN
+void			tepl_file_loader_get_invalid_range	(TeplFileLoader *loader,
+								 guint           range_num,
+								 goffset        *start,
+								 goffset        *length);
+
 _TEPL_EXTERN
 void			tepl_file_loader_load_async		(TeplFileLoader      *loader,
 								 gint                 io_priority,
@@ -68,6 +142,10 @@ gboolean		tepl_file_loader_load_finish		(TeplFileLoader  *loader,
 								 GAsyncResult    *result,
 								 GError         **error);
 
+G_GNUC_INTERNAL
+void			_tepl_file_loader_set_use_mapped_file	(TeplFileLoader *loader,
+								 gboolean        use_mapped_file);
+
 G_END_DECLS
 
 #endif /* TEPL_FILE_LOADER_H */
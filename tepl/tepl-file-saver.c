@@ -5,9 +5,21 @@
  * SPDX-License-Identifier: LGPL-3.0-or-later
  */
 
+#include "config.h"
 #include "tepl-file-saver.h"
 #include <string.h>
+#include <glib/gi18n-lib.h>
+#include "tepl-backup.h"
+#include "tepl-charset-converter.h"
+#include "tepl-charset-encoder.h"
 #include "tepl-enum-types.h"
+#include "tepl-newline-converter.h"
+#include "tepl-rope.h"
+#include "tepl-utils.h"
+
+#ifdef G_OS_UNIX
+#include <unistd.h>
+#endif
 
 /**
  * SECTION:file-saver
@@ -21,18 +33,56 @@
  * handling. If an error occurs, you can reconfigure the saver and relaunch the
  * operation with tepl_file_saver_save_async().
  *
- * # Things that need to be done at a higher level
+ * # Editing during the save operation
+ *
+ * The buffer can be edited during the save operation. A snapshot of the buffer
+ * content is taken when the save operation starts, and it is written to the
+ * file in a worker thread. gtk_text_buffer_set_modified() must be called (with
+ * a %FALSE value) only when the file has been successfully saved, so it is
+ * called by tepl_file_saver_save_finish(), and only if the buffer has not been
+ * modified since the snapshot was taken.
+ *
+ * If the very long lines have been split by #TeplFileLoader, see the
+ * #TeplFileLoader:line-split-length property, the lines are joined back in the
+ * saved file.
+ *
+ * The line terminators of the buffer are converted to the
+ * #TeplFileSaver:newline-type. With the
+ * %TEPL_FILE_SAVER_FLAGS_STRIP_TRAILING_WHITESPACE and
+ * %TEPL_FILE_SAVER_FLAGS_ENSURE_TRAILING_NEWLINE flags, the trailing whitespace
+ * is removed and a trailing newline is added in the same pass, in the saved
+ * file only: the buffer is not modified. Then the content is encoded in the
+ * #TeplFileSaver:charset. The charset conversion is done chunk by chunk in the
+ * worker thread too. If some characters don't exist in the charset, the
+ * %TEPL_FILE_SAVER_ERROR_UNCONVERTIBLE_CHARS error is reported, unless the
+ * %TEPL_FILE_SAVER_FLAGS_IGNORE_UNCONVERTIBLE_CHARS flag is set. In both cases,
+ * the positions of the characters are available with
+ * tepl_file_saver_get_unconvertible_char_offset().
  *
- * Make the #GtkTextView non-editable during the save operation. See
- * gtk_text_view_set_editable(). Because the save operation is asynchronous, and
- * gtk_text_buffer_set_modified() must be called (with a %FALSE value) only when
- * the file has been successfully saved. So that's why
- * gtk_text_buffer_set_modified() is called by tepl_file_saver_save_finish(),
- * not at the beginning of the save operation. If the view/buffer is editable
- * during the save operation, gtk_text_buffer_set_modified() may be called at
- * the wrong place in the undo/redo history.
+ * Taking the snapshot doesn't copy the buffer content: #TeplBuffer keeps a
+ * copy of its text in refcounted segments, and the segments are shared with
+ * the snapshot. The snapshot is written chunk by chunk to the
+ * #GFileOutputStream returned by g_file_replace(), so the memory needed is
+ * bounded by the chunk size. The file is replaced only when all the content
+ * has been written successfully.
+ *
+ * With the %TEPL_FILE_SAVER_FLAGS_CREATE_BACKUP flag, the backup is created
+ * without copying the file content when possible: as a copy-on-write clone
+ * (reflink) on the filesystems that support it, or else by keeping the original
+ * file as the backup when the new content is written to a temporary file.
+ *
+ * If the buffer has not been edited since the file was last loaded or saved, or
+ * if its content is the same as when the file was last saved (for example if a
+ * character has been typed and then deleted), and if the file has not been
+ * modified by another program since then, the file is not rewritten. The save operation is successful, but no backup is created.
  */
 
+/* The approximate number of bytes written at once. */
+#define WRITE_CHUNK_SIZE (64 * 1024)
+
+/* The maximum number of unconvertible characters whose positions are kept. */
+#define MAX_UNCONVERTIBLE_CHARS (1000)
+
 enum
 {
 	PROP_0,
@@ -40,7 +90,9 @@ enum
 	PROP_FILE,
 	PROP_LOCATION,
 	PROP_NEWLINE_TYPE,
+	PROP_CHARSET,
 	PROP_FLAGS,
+	PROP_DURABILITY,
 	N_PROPERTIES
 };
 
@@ -61,21 +113,80 @@ struct _TeplFileSaverPrivate
 	GFile *location;
 
 	TeplNewlineType newline_type;
+	gchar *charset;
 	TeplFileSaverFlags flags;
+	TeplFileSaverDurability durability;
+	TeplBackupStrategy backup_strategy;
+
+	/* The buffer offsets (gint) of the unconvertible characters, from the
+	 * last save operation.
+	 */
+	GArray *unconvertible_char_offsets;
 
 	guint is_saving : 1;
 };
 
+/* Set in the main thread, then used only by the worker thread until the end
+ * of the task.
+ */
 typedef struct _TaskData TaskData;
 struct _TaskData
 {
-	gchar *buffer_content;
+	/* The snapshot of the buffer content, and its revision. */
+	TeplRope *rope;
+	guint64 revision;
+
+	/* The character offsets of the newlines to skip, to join back the
+	 * very long lines split by the TeplFileLoader.
+	 */
+	GArray *line_split_offsets;
+	guint line_split_index;
+
+	GFile *location;
+	TeplFileSaverDurability durability;
+	TeplBackupStrategy backup_strategy;
+	guint make_backup : 1;
+
+	/* If not NULL, the content to save is the same as the content on
+	 * disk, and the file has this entity tag if it has not been modified by
+	 * another program.
+	 */
+	gchar *unchanged_file_etag;
+
+	/* The entity tag of the saved file. */
+	gchar *new_etag;
+
+	TeplNewlineConverter newline_converter;
+
+	/* NULL for UTF-8, the buffer content is already in UTF-8. */
+	gchar *charset;
+	TeplCharsetEncoder *encoder;
+	guint ignore_unconvertible_chars : 1;
+
+	/* The character indexes reported by the encoder for the current text
+	 * (gsize), and the buffer offsets of all the unconvertible characters
+	 * found so far (gint).
+	 */
+	GArray *unconvertible_char_indexes;
+	GArray *unconvertible_char_offsets;
+
+	/* For TEPL_FILE_SAVER_DURABILITY_FAST, the temporary file where
+	 * @output_stream writes, renamed to @location when the content is
+	 * written. NULL when g_file_replace() is used.
+	 */
+	GFile *tmp_location;
+	GOutputStream *output_stream;
+
+	/* The converted content not yet written. */
+	GByteArray *pending;
 };
 
 static GParamSpec *properties[N_PROPERTIES];
 
 G_DEFINE_TYPE_WITH_PRIVATE (TeplFileSaver, tepl_file_saver, G_TYPE_OBJECT)
 
+G_DEFINE_QUARK (tepl-file-saver-error, tepl_file_saver_error)
+
 static TaskData *
 task_data_new (void)
 {
@@ -87,7 +198,19 @@ task_data_free (TaskData *data)
 {
 	if (data != NULL)
 	{
-		g_free (data->buffer_content);
+		g_clear_pointer (&data->rope, _tepl_rope_unref);
+		g_clear_pointer (&data->line_split_offsets, g_array_unref);
+		g_clear_object (&data->location);
+		g_free (data->unchanged_file_etag);
+		g_free (data->new_etag);
+		_tepl_newline_converter_clear (&data->newline_converter);
+		g_free (data->charset);
+		_tepl_charset_encoder_free (data->encoder);
+		g_clear_pointer (&data->unconvertible_char_indexes, g_array_unref);
+		g_clear_pointer (&data->unconvertible_char_offsets, g_array_unref);
+		g_clear_object (&data->output_stream);
+		g_clear_object (&data->tmp_location);
+		g_clear_pointer (&data->pending, g_byte_array_unref);
 		g_free (data);
 	}
 }
@@ -121,10 +244,18 @@ tepl_file_saver_set_property (GObject      *object,
 			tepl_file_saver_set_newline_type (saver, g_value_get_enum (value));
 			break;
 
+		case PROP_CHARSET:
+			tepl_file_saver_set_charset (saver, g_value_get_string (value));
+			break;
+
 		case PROP_FLAGS:
 			tepl_file_saver_set_flags (saver, g_value_get_flags (value));
 			break;
 
+		case PROP_DURABILITY:
+			tepl_file_saver_set_durability (saver, g_value_get_enum (value));
+			break;
+
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 			break;
@@ -157,10 +288,18 @@ tepl_file_saver_get_property (GObject    *object,
 			g_value_set_enum (value, saver->priv->newline_type);
 			break;
 
+		case PROP_CHARSET:
+			g_value_set_string (value, saver->priv->charset);
+			break;
+
 		case PROP_FLAGS:
 			g_value_set_flags (value, saver->priv->flags);
 			break;
 
+		case PROP_DURABILITY:
+			g_value_set_enum (value, saver->priv->durability);
+			break;
+
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 			break;
@@ -178,6 +317,7 @@ tepl_file_saver_constructed (GObject *object)
 
 		newline_type = tepl_file_get_newline_type (saver->priv->file);
 		tepl_file_saver_set_newline_type (saver, newline_type);
+		tepl_file_saver_set_charset (saver, tepl_file_get_charset (saver->priv->file));
 
 		if (saver->priv->location == NULL)
 		{
@@ -210,6 +350,17 @@ tepl_file_saver_dispose (GObject *object)
 	G_OBJECT_CLASS (tepl_file_saver_parent_class)->dispose (object);
 }
 
+static void
+tepl_file_saver_finalize (GObject *object)
+{
+	TeplFileSaver *saver = TEPL_FILE_SAVER (object);
+
+	g_free (saver->priv->charset);
+	g_array_unref (saver->priv->unconvertible_char_offsets);
+
+	G_OBJECT_CLASS (tepl_file_saver_parent_class)->finalize (object);
+}
+
 static void
 tepl_file_saver_class_init (TeplFileSaverClass *klass)
 {
@@ -219,6 +370,7 @@ tepl_file_saver_class_init (TeplFileSaverClass *klass)
 	object_class->get_property = tepl_file_saver_get_property;
 	object_class->constructed = tepl_file_saver_constructed;
 	object_class->dispose = tepl_file_saver_dispose;
+	object_class->finalize = tepl_file_saver_finalize;
 
 	/**
 	 * TeplFileSaver:buffer:
@@ -288,6 +440,27 @@ tepl_file_saver_class_init (TeplFileSaverClass *klass)
 				   G_PARAM_CONSTRUCT |
 				   G_PARAM_STATIC_STRINGS);
 
+	/**
+	 * TeplFileSaver:charset:
+	 *
+	 * The character encoding, as an ICU converter name or alias, for
+	 * example "UTF-8", "ISO-8859-15" or "UTF-16". By default the charset is
+	 * taken from the #TeplFile at construction time.
+	 *
+	 * With "UTF-16" or "UTF-32", a byte order mark (BOM) is written at the
+	 * start of the file.
+	 *
+	 * Since: 6.0
+	 */
+	properties[PROP_CHARSET] =
+		g_param_spec_string ("charset",
+				     "charset",
+				     "",
+				     "UTF-8",
+				     G_PARAM_READWRITE |
+				     G_PARAM_CONSTRUCT |
+				     G_PARAM_STATIC_STRINGS);
+
 	/**
 	 * TeplFileSaver:flags:
 	 *
@@ -305,6 +478,23 @@ tepl_file_saver_class_init (TeplFileSaverClass *klass)
 				    G_PARAM_CONSTRUCT |
 				    G_PARAM_STATIC_STRINGS);
 
+	/**
+	 * TeplFileSaver:durability:
+	 *
+	 * The durability policy, see #TeplFileSaverDurability.
+	 *
+	 * Since: 6.0
+	 */
+	properties[PROP_DURABILITY] =
+		g_param_spec_enum ("durability",
+				   "durability",
+				   "",
+				   TEPL_TYPE_FILE_SAVER_DURABILITY,
+				   TEPL_FILE_SAVER_DURABILITY_DEFAULT,
+				   G_PARAM_READWRITE |
+				   G_PARAM_CONSTRUCT |
+				   G_PARAM_STATIC_STRINGS);
+
 	g_object_class_install_properties (object_class, N_PROPERTIES, properties);
 }
 
@@ -315,6 +505,8 @@ tepl_file_saver_init (TeplFileSaver *saver)
 
 	saver->priv->newline_type = TEPL_NEWLINE_TYPE_DEFAULT;
 	saver->priv->flags = TEPL_FILE_SAVER_FLAGS_NONE;
+	saver->priv->durability = TEPL_FILE_SAVER_DURABILITY_DEFAULT;
+	saver->priv->unconvertible_char_offsets = g_array_new (FALSE, FALSE, sizeof (gint));
 }
 
 /**
@@ -461,6 +653,46 @@ tepl_file_saver_get_newline_type (TeplFileSaver *saver)
 	return saver->priv->newline_type;
 }
 
+/**
+ * tepl_file_saver_set_charset:
+ * @saver: a #TeplFileSaver.
+ * @charset: the new charset.
+ *
+ * Sets the #TeplFileSaver:charset property.
+ *
+ * Since: 6.0
+ */
+void
+tepl_file_saver_set_charset (TeplFileSaver *saver,
+			     const gchar   *charset)
+{
+	g_return_if_fail (TEPL_IS_FILE_SAVER (saver));
+	g_return_if_fail (charset != NULL);
+	g_return_if_fail (!saver->priv->is_saving);
+
+	if (g_strcmp0 (saver->priv->charset, charset) != 0)
+	{
+		g_free (saver->priv->charset);
+		saver->priv->charset = g_strdup (charset);
+		g_object_notify_by_pspec (G_OBJECT (saver), properties[PROP_CHARSET]);
+	}
+}
+
+/**
+ * tepl_file_saver_get_charset:
+ * @saver: a #TeplFileSaver.
+ *
+ * Returns: the value of the #TeplFileSaver:charset property.
+ * Since: 6.0
+ */
+const gchar *
+tepl_file_saver_get_charset (TeplFileSaver *saver)
+{
+	g_return_val_if_fail (TEPL_IS_FILE_SAVER (saver), NULL);
+
+	return saver->priv->charset;
+}
+
 /**
  * tepl_file_saver_set_flags:
  * @saver: a #TeplFileSaver.
@@ -497,63 +729,839 @@ tepl_file_saver_get_flags (TeplFileSaver *saver)
 	return saver->priv->flags;
 }
 
+/**
+ * tepl_file_saver_set_durability:
+ * @saver: a #TeplFileSaver.
+ * @durability: the new durability policy.
+ *
+ * Sets the #TeplFileSaver:durability property.
+ *
+ * Since: 6.0
+ */
+void
+tepl_file_saver_set_durability (TeplFileSaver           *saver,
+				TeplFileSaverDurability  durability)
+{
+	g_return_if_fail (TEPL_IS_FILE_SAVER (saver));
+	g_return_if_fail (!saver->priv->is_saving);
+
+	if (saver->priv->durability != durability)
+	{
+		saver->priv->durability = durability;
+		g_object_notify_by_pspec (G_OBJECT (saver), properties[PROP_DURABILITY]);
+	}
+}
+
+/**
+ * tepl_file_saver_get_durability:
+ * @saver: a #TeplFileSaver.
+ *
+ * Returns: the value of the #TeplFileSaver:durability property.
+ * Since: 6.0
+ */
+TeplFileSaverDurability
+tepl_file_saver_get_durability (TeplFileSaver *saver)
+{
+	g_return_val_if_fail (TEPL_IS_FILE_SAVER (saver), TEPL_FILE_SAVER_DURABILITY_DEFAULT);
+
+	return saver->priv->durability;
+}
+
+static gboolean
+flush_pending (TaskData      *task_data,
+	       GCancellable  *cancellable,
+	       GError       **error)
+{
+	gboolean ok;
+
+	if (task_data->pending->len == 0)
+	{
+		return TRUE;
+	}
+
+	ok = g_output_stream_write_all (task_data->output_stream,
+					task_data->pending->data,
+					task_data->pending->len,
+					NULL,
+					cancellable,
+					error);
+
+	g_byte_array_set_size (task_data->pending, 0);
+	return ok;
+}
+
 static void
-get_all_buffer_content (GTask *task)
+set_unconvertible_chars_error (TaskData  *task_data,
+			       GError   **error)
 {
-	TeplFileSaver *saver = g_task_get_source_object (task);
-	TaskData *task_data = g_task_get_task_data (task);
-	GtkTextIter start;
-	GtkTextIter end;
+	g_set_error (error,
+		     TEPL_FILE_SAVER_ERROR,
+		     TEPL_FILE_SAVER_ERROR_UNCONVERTIBLE_CHARS,
+		     _("Some characters cannot be represented in the character encoding “%s”."),
+		     task_data->charset);
+}
+
+/* The characters that the TeplNewlineConverter can add or remove. */
+static inline gboolean
+is_newline_or_blank_char (gchar c)
+{
+	return c == '\n' || c == '\r' || c == ' ' || c == '\t';
+}
+
+/* Converts the character indexes in @converted_text reported by the encoder to
+ * buffer offsets. The newline conversion changes only the line terminators and
+ * the trailing whitespace, and an unconvertible character is never one of
+ * them. So the Nth character that is not a newline or blank char is the same
+ * in @text and in @converted_text.
+ */
+static void
+add_unconvertible_char_offsets (TaskData    *task_data,
+				const gchar *text,
+				gsize        length,
+				guint64      char_offset,
+				const gchar *converted_text)
+{
+	GArray *indexes = task_data->unconvertible_char_indexes;
+	const gchar *pos = text;
+	const gchar *end = text + length;
+	gsize pos_index = 0;
+	const gchar *converted_pos = converted_text;
+	gsize converted_pos_index = 0;
+	guint i;
+
+	for (i = 0; i < indexes->len; i++)
+	{
+		gsize converted_index = g_array_index (indexes, gsize, i);
+		gint offset;
+
+		if (task_data->unconvertible_char_offsets->len >= MAX_UNCONVERTIBLE_CHARS)
+		{
+			break;
+		}
+
+		if (converted_text != NULL)
+		{
+			for (; converted_pos_index < converted_index; converted_pos_index++)
+			{
+				if (!is_newline_or_blank_char (*converted_pos))
+				{
+					while (pos < end && is_newline_or_blank_char (*pos))
+					{
+						pos++;
+						pos_index++;
+					}
+
+					pos = g_utf8_next_char (pos);
+					pos_index++;
+				}
+
+				converted_pos = g_utf8_next_char (converted_pos);
+			}
+
+			while (pos < end && is_newline_or_blank_char (*pos))
+			{
+				pos++;
+				pos_index++;
+			}
+
+			converted_index = pos_index;
+		}
+
+		offset = (gint) (char_offset + converted_index);
+		g_array_append_val (task_data->unconvertible_char_offsets, offset);
+	}
+
+	g_array_set_size (indexes, 0);
+}
+
+/* Appends @output, in UTF-8, to the pending content. */
+static gboolean
+append_output (TaskData     *task_data,
+	       const gchar  *output,
+	       gsize         output_length,
+	       gboolean      flush,
+	       GError      **error)
+{
+	if (task_data->encoder == NULL)
+	{
+		g_byte_array_append (task_data->pending, (const guint8 *) output, output_length);
+		return TRUE;
+	}
+
+	return _tepl_charset_encoder_encode (task_data->encoder,
+					     output,
+					     output_length,
+					     flush,
+					     task_data->pending,
+					     task_data->unconvertible_char_indexes,
+					     error);
+}
+
+/* @char_offset: the buffer offset of @text. */
+static gboolean
+write_text (TaskData      *task_data,
+	    const gchar   *text,
+	    gsize          length,
+	    guint64        char_offset,
+	    GCancellable  *cancellable,
+	    GError       **error)
+{
+	gchar *converted_text = NULL;
+	gsize converted_length = 0;
+	gboolean converted;
+	gboolean ok;
+
+	converted = _tepl_newline_converter_convert (&task_data->newline_converter,
+						     text,
+						     length,
+						     &converted_text,
+						     &converted_length);
+
+	ok = append_output (task_data,
+			    converted ? converted_text : text,
+			    converted ? converted_length : length,
+			    FALSE,
+			    error);
+
+	if (ok && task_data->unconvertible_char_indexes->len > 0)
+	{
+		add_unconvertible_char_offsets (task_data, text, length, char_offset,
+						converted ? converted_text : NULL);
+	}
+
+	g_free (converted_text);
+
+	if (!ok)
+	{
+		return FALSE;
+	}
+
+	if (task_data->unconvertible_char_offsets->len > 0 &&
+	    !task_data->ignore_unconvertible_chars)
+	{
+		/* The save operation will fail. The rest of the content is
+		 * still encoded, to find the positions of the other
+		 * unconvertible characters, but not written.
+		 */
+		g_byte_array_set_size (task_data->pending, 0);
+
+		if (task_data->unconvertible_char_offsets->len >= MAX_UNCONVERTIBLE_CHARS)
+		{
+			set_unconvertible_chars_error (task_data, error);
+			return FALSE;
+		}
+
+		return TRUE;
+	}
+
+	if (task_data->pending->len >= WRITE_CHUNK_SIZE)
+	{
+		return flush_pending (task_data, cancellable, error);
+	}
+
+	return TRUE;
+}
+
+/* Writes a segment of the snapshot, without the newlines of the line splits. */
+static gboolean
+write_segment (TaskData      *task_data,
+	       const gchar   *data,
+	       gsize          size,
+	       guint64        segment_char_offset,
+	       guint          segment_n_chars,
+	       GCancellable  *cancellable,
+	       GError       **error)
+{
+	const gchar *pos = data;
+	guint64 pos_char_offset = segment_char_offset;
+	guint64 segment_end_char_offset = segment_char_offset + segment_n_chars;
+
+	while (task_data->line_split_index < task_data->line_split_offsets->len)
+	{
+		guint64 newline_offset;
+		const gchar *newline;
+
+		newline_offset = g_array_index (task_data->line_split_offsets,
+						guint64,
+						task_data->line_split_index);
+
+		if (newline_offset >= segment_end_char_offset)
+		{
+			break;
+		}
+
+		newline = g_utf8_offset_to_pointer (pos, newline_offset - pos_char_offset);
+
+		if (!write_text (task_data, pos, newline - pos, pos_char_offset, cancellable, error))
+		{
+			return FALSE;
+		}
+
+		/* Skip the "\n". */
+		pos = newline + 1;
+		pos_char_offset = newline_offset + 1;
+		task_data->line_split_index++;
+	}
+
+	return write_text (task_data, pos, data + size - pos, pos_char_offset, cancellable, error);
+}
+
+static gboolean
+write_snapshot (TaskData      *task_data,
+		GCancellable  *cancellable,
+		GError       **error)
+{
+	guint n_segments;
+	guint64 char_offset = 0;
+	gchar *end_text;
+	gsize end_length;
+	gboolean ok;
+	guint i;
+
+	n_segments = _tepl_rope_get_n_segments (task_data->rope);
+
+	for (i = 0; i < n_segments; i++)
+	{
+		GBytes *segment;
+		guint n_chars;
+		const gchar *data;
+		gsize size;
+
+		segment = _tepl_rope_get_segment (task_data->rope, i, &n_chars);
+		data = g_bytes_get_data (segment, &size);
+
+		if (!write_segment (task_data, data, size, char_offset, n_chars, cancellable, error))
+		{
+			return FALSE;
+		}
+
+		char_offset += n_chars;
+	}
 
-	gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (saver->priv->buffer), &start, &end);
+	/* The end of the output: the trailing newline, and the end of the
+	 * stateful charsets. A newline is never an unconvertible character.
+	 */
+	if (!_tepl_newline_converter_finish (&task_data->newline_converter, &end_text, &end_length))
+	{
+		end_text = NULL;
+		end_length = 0;
+	}
 
-	g_free (task_data->buffer_content);
-	task_data->buffer_content = gtk_text_buffer_get_text (GTK_TEXT_BUFFER (saver->priv->buffer),
-							      &start,
-							      &end,
-							      TRUE);
+	ok = append_output (task_data, end_text != NULL ? end_text : "", end_length, TRUE, error);
+	g_free (end_text);
+
+	if (!ok)
+	{
+		return FALSE;
+	}
+
+	if (task_data->unconvertible_char_offsets->len > 0 &&
+	    !task_data->ignore_unconvertible_chars)
+	{
+		set_unconvertible_chars_error (task_data, error);
+		return FALSE;
+	}
+
+	return flush_pending (task_data, cancellable, error);
 }
 
+/* Closes the output stream with a cancelled GCancellable, so that the file is
+ * not replaced by a partial content.
+ */
 static void
-save_all_buffer_content_cb (GObject      *source_object,
-			    GAsyncResult *result,
-			    gpointer      user_data)
+abort_save (TaskData *task_data)
 {
-	GFile *location = G_FILE (source_object);
-	GTask *task = G_TASK (user_data);
+	GCancellable *cancellable;
+
+	cancellable = g_cancellable_new ();
+	g_cancellable_cancel (cancellable);
+	g_output_stream_close (task_data->output_stream, cancellable, NULL);
+	g_object_unref (cancellable);
+
+	if (task_data->tmp_location != NULL)
+	{
+		g_file_delete (task_data->tmp_location, NULL, NULL);
+	}
+}
+
+/* Runs in a worker thread. */
+static gboolean
+file_has_etag (GFile        *location,
+	       const gchar  *etag,
+	       GCancellable *cancellable)
+{
+	GFileInfo *info;
+	gboolean same_etag;
+
+	info = g_file_query_info (location,
+				  G_FILE_ATTRIBUTE_ETAG_VALUE,
+				  G_FILE_QUERY_INFO_NONE,
+				  cancellable,
+				  NULL);
+
+	if (info == NULL)
+	{
+		return FALSE;
+	}
+
+	same_etag = g_strcmp0 (g_file_info_get_etag (info), etag) == 0;
+
+	g_object_unref (info);
+	return same_etag;
+}
+
+/* Runs in a worker thread. */
+static gboolean
+open_replace (TaskData      *task_data,
+	      GCancellable  *cancellable,
+	      GError       **error)
+{
+	gboolean replace_makes_backup = FALSE;
+	GFileOutputStream *output_stream;
+
+	if (task_data->make_backup &&
+	    !_tepl_backup_prepare (task_data->location,
+				   task_data->backup_strategy,
+				   &replace_makes_backup,
+				   cancellable,
+				   error))
+	{
+		return FALSE;
+	}
+
+	output_stream = g_file_replace (task_data->location,
+					NULL,
+					replace_makes_backup,
+					G_FILE_CREATE_NONE,
+					cancellable,
+					error);
+
+	if (output_stream == NULL)
+	{
+		return FALSE;
+	}
+
+	task_data->output_stream = G_OUTPUT_STREAM (output_stream);
+	return TRUE;
+}
+
+/* Runs in a worker thread. Creates a new file next to @location. */
+static GFileOutputStream *
+create_tmp_file (GFile         *location,
+		 GFile        **tmp_location,
+		 GCancellable  *cancellable,
+		 GError       **error)
+{
+	GFile *parent;
+	gchar *basename;
+	gint n_tries;
+
+	parent = g_file_get_parent (location);
+	basename = g_file_get_basename (location);
+
+	for (n_tries = 0; ; n_tries++)
+	{
+		GFileOutputStream *output_stream;
+		gchar *tmp_basename;
+		GError *my_error = NULL;
+
+		tmp_basename = g_strdup_printf (".%s.%08x", basename, g_random_int ());
+		*tmp_location = g_file_get_child (parent, tmp_basename);
+		g_free (tmp_basename);
+
+		output_stream = g_file_create (*tmp_location,
+					       G_FILE_CREATE_NONE,
+					       cancellable,
+					       &my_error);
+
+		if (output_stream != NULL)
+		{
+			g_object_unref (parent);
+			g_free (basename);
+			return output_stream;
+		}
+
+		g_clear_object (tmp_location);
+
+		if (!g_error_matches (my_error, G_IO_ERROR, G_IO_ERROR_EXISTS) || n_tries >= 10)
+		{
+			g_propagate_error (error, my_error);
+			g_object_unref (parent);
+			g_free (basename);
+			return NULL;
+		}
+
+		g_clear_error (&my_error);
+	}
+}
+
+/* Whether the file can be replaced by a new file with a rename, without
+ * changing what other paths see or who owns it.
+ */
+static gboolean
+can_rename_over (GFileInfo *info)
+{
+	/* For a symlink or a special file, the rename would replace it. */
+	if (g_file_info_get_file_type (info) != G_FILE_TYPE_REGULAR)
+	{
+		return FALSE;
+	}
+
+	/* The other hard links would keep the old content. */
+	if (g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_UNIX_NLINK) &&
+	    g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_NLINK) > 1)
+	{
+		return FALSE;
+	}
+
+#ifdef G_OS_UNIX
+	/* The new file would belong to the current user. */
+	if (g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_UNIX_UID) &&
+	    g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_UID) != geteuid ())
+	{
+		return FALSE;
+	}
+#endif
+
+	return TRUE;
+}
+
+/* Runs in a worker thread. Best effort, like g_file_replace(): the
+ * permissions, the group, the extended attributes, the ACL and the SELinux
+ * context of the file are set on the temporary file, before it is renamed.
+ */
+static void
+copy_attributes_to_tmp_file (TaskData     *task_data,
+			     GCancellable *cancellable)
+{
+	GFileInfo *info;
+
+	/* The attributes copied with the file content: the unix mode, the
+	 * user extended attributes and the SELinux context.
+	 */
+	g_file_copy_attributes (task_data->location,
+				task_data->tmp_location,
+				G_FILE_COPY_NOFOLLOW_SYMLINKS,
+				cancellable,
+				NULL);
+
+	/* Not the time attributes, which are part of the etag. The ACL is
+	 * stored in the system extended attributes.
+	 */
+	info = g_file_query_info (task_data->location,
+				  G_FILE_ATTRIBUTE_UNIX_GID ","
+				  "xattr-sys::*",
+				  G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+				  cancellable,
+				  NULL);
+
+	if (info != NULL)
+	{
+		g_file_set_attributes_from_info (task_data->tmp_location,
+						 info,
+						 G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+						 cancellable,
+						 NULL);
+		g_object_unref (info);
+	}
+}
+
+/* Runs in a worker thread. For TEPL_FILE_SAVER_DURABILITY_FAST, with a local
+ * file. Like g_file_replace(), the new content is written to a temporary file
+ * that is then renamed, but it is never flushed to the disk. See
+ * close_stream().
+ */
+static gboolean
+open_fast (TaskData      *task_data,
+	   GCancellable  *cancellable,
+	   GError       **error)
+{
+	GFileInfo *info;
+	GFileOutputStream *output_stream;
+	GError *my_error = NULL;
+
+	info = g_file_query_info (task_data->location,
+				  G_FILE_ATTRIBUTE_STANDARD_TYPE ","
+				  G_FILE_ATTRIBUTE_UNIX_NLINK ","
+				  G_FILE_ATTRIBUTE_UNIX_UID,
+				  G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+				  cancellable,
+				  &my_error);
+
+	/* For a new file, g_file_replace() doesn't flush anything. For the
+	 * files that can't be renamed over, g_file_replace() writes in place
+	 * when needed.
+	 */
+	if (g_error_matches (my_error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND) ||
+	    (info != NULL && !can_rename_over (info)))
+	{
+		g_clear_error (&my_error);
+		g_clear_object (&info);
+		return open_replace (task_data, cancellable, error);
+	}
+
+	if (my_error != NULL)
+	{
+		g_propagate_error (error, my_error);
+		return FALSE;
+	}
+
+	g_object_unref (info);
+
+	output_stream = create_tmp_file (task_data->location,
+					 &task_data->tmp_location,
+					 cancellable,
+					 &my_error);
+
+	/* For example when the directory is not writable, g_file_replace()
+	 * can still overwrite the file.
+	 */
+	if (g_error_matches (my_error, G_IO_ERROR, G_IO_ERROR_PERMISSION_DENIED))
+	{
+		g_clear_error (&my_error);
+		return open_replace (task_data, cancellable, error);
+	}
+
+	if (output_stream == NULL)
+	{
+		g_propagate_error (error, my_error);
+		return FALSE;
+	}
+
+	task_data->output_stream = G_OUTPUT_STREAM (output_stream);
+
+	copy_attributes_to_tmp_file (task_data, cancellable);
+
+	if (task_data->make_backup)
+	{
+		gboolean replace_makes_backup = FALSE;
+
+		/* The file is renamed over, not replaced by GIO, so the backup
+		 * that g_file_replace() would make is a copy.
+		 */
+		if (!_tepl_backup_prepare (task_data->location,
+					   task_data->backup_strategy,
+					   &replace_makes_backup,
+					   cancellable,
+					   error) ||
+		    (replace_makes_backup &&
+		     !_tepl_backup_prepare (task_data->location,
+					    TEPL_BACKUP_STRATEGY_COPY,
+					    &replace_makes_backup,
+					    cancellable,
+					    error)))
+		{
+			abort_save (task_data);
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+/* Runs in a worker thread. */
+static gboolean
+close_stream (TaskData      *task_data,
+	      GCancellable  *cancellable,
+	      GError       **error)
+{
+	GFileInfo *info;
+
+	if (task_data->tmp_location == NULL)
+	{
+		if (!g_output_stream_close (task_data->output_stream, cancellable, error))
+		{
+			return FALSE;
+		}
+
+		task_data->new_etag = g_strdup (g_file_output_stream_get_etag (G_FILE_OUTPUT_STREAM (task_data->output_stream)));
+		return TRUE;
+	}
+
+	/* The rename is atomic, so the file contains either the old or the new
+	 * content. Without fsync(), after a system crash it can be empty.
+	 */
+	if (!g_output_stream_close (task_data->output_stream, cancellable, error) ||
+	    !g_file_move (task_data->tmp_location,
+			  task_data->location,
+			  G_FILE_COPY_OVERWRITE | G_FILE_COPY_NOFOLLOW_SYMLINKS,
+			  cancellable,
+			  NULL, NULL,
+			  error))
+	{
+		g_file_delete (task_data->tmp_location, NULL, NULL);
+		return FALSE;
+	}
+
+	info = g_file_query_info (task_data->location,
+				  G_FILE_ATTRIBUTE_ETAG_VALUE,
+				  G_FILE_QUERY_INFO_NONE,
+				  cancellable,
+				  NULL);
+
+	if (info != NULL)
+	{
+		task_data->new_etag = g_strdup (g_file_info_get_etag (info));
+		g_object_unref (info);
+	}
+
+	return TRUE;
+}
+
+/* Runs in a worker thread. */
+static void
+save_thread (GTask        *task,
+	     gpointer      source_object,
+	     gpointer      task_data_pointer,
+	     GCancellable *cancellable)
+{
+	TaskData *task_data = task_data_pointer;
+	gboolean ok;
 	GError *error = NULL;
 
-	g_file_replace_contents_finish (location, result, NULL, &error);
+	if (task_data->unchanged_file_etag != NULL &&
+	    file_has_etag (task_data->location, task_data->unchanged_file_etag, cancellable))
+	{
+		/* Nothing to write. */
+		task_data->new_etag = g_strdup (task_data->unchanged_file_etag);
+		g_task_return_boolean (task, TRUE);
+		return;
+	}
+
+	if (task_data->charset != NULL)
+	{
+		task_data->encoder = _tepl_charset_encoder_new (task_data->charset, &error);
+
+		if (task_data->encoder == NULL)
+		{
+			g_task_return_error (task, error);
+			return;
+		}
+	}
+
+	if (task_data->durability == TEPL_FILE_SAVER_DURABILITY_FAST &&
+	    g_file_is_native (task_data->location))
+	{
+		ok = open_fast (task_data, cancellable, &error);
+	}
+	else
+	{
+		ok = open_replace (task_data, cancellable, &error);
+	}
 
-	if (error != NULL)
+	if (!ok)
+	{
+		g_task_return_error (task, error);
+		return;
+	}
+
+	task_data->pending = g_byte_array_sized_new (2 * WRITE_CHUNK_SIZE);
+
+	if (!write_snapshot (task_data, cancellable, &error))
+	{
+		abort_save (task_data);
+		g_task_return_error (task, error);
+		return;
+	}
+
+	if (!close_stream (task_data, cancellable, &error))
+	{
+		g_task_return_error (task, error);
+		return;
+	}
+
+	if (task_data->durability == TEPL_FILE_SAVER_DURABILITY_DURABLE &&
+	    !_tepl_utils_sync_file (task_data->location, TRUE, &error))
 	{
 		g_task_return_error (task, error);
-		g_object_unref (task);
 		return;
 	}
 
 	g_task_return_boolean (task, TRUE);
-	g_object_unref (task);
 }
 
+/* Whether the content on disk is already the content to save, with the same
+ * settings. In that case, the file is not rewritten if its etag shows that it
+ * has not been modified by another program.
+ */
+static gboolean
+can_skip_write (TeplFileSaver *saver,
+		TaskData      *task_data)
+{
+	TeplFile *file = saver->priv->file;
+	GFile *file_location;
+	const gchar *file_charset;
+
+	if (_tepl_file_get_etag (file) == NULL ||
+	    !_tepl_buffer_is_unchanged_since_save (saver->priv->buffer))
+	{
+		return FALSE;
+	}
+
+	file_location = tepl_file_get_location (file);
+	if (file_location == NULL ||
+	    !g_file_equal (file_location, saver->priv->location))
+	{
+		return FALSE;
+	}
+
+	file_charset = tepl_file_get_charset (file);
+	if (file_charset == NULL ||
+	    g_ascii_strcasecmp (file_charset, saver->priv->charset) != 0 ||
+	    tepl_file_get_newline_type (file) != saver->priv->newline_type)
+	{
+		return FALSE;
+	}
+
+	/* The whitespace to strip is not known without reading the content. */
+	if ((saver->priv->flags & (TEPL_FILE_SAVER_FLAGS_STRIP_TRAILING_WHITESPACE |
+				   TEPL_FILE_SAVER_FLAGS_ENSURE_TRAILING_NEWLINE)) != 0)
+	{
+		return FALSE;
+	}
+
+	/* The file contains the lines joined back, it is simpler to not
+	 * compare in that case.
+	 */
+	return (task_data->line_split_offsets->len == 0 &&
+		!_tepl_buffer_has_edited_line_splits (saver->priv->buffer));
+}
+
+/* Takes the snapshot, in the main thread. */
 static void
-save_all_buffer_content (GTask *task)
+launch_save_thread (GTask *task)
 {
 	TeplFileSaver *saver = g_task_get_source_object (task);
 	TaskData *task_data = g_task_get_task_data (task);
-	gboolean make_backup;
 
-	make_backup = (saver->priv->flags & TEPL_FILE_SAVER_FLAGS_CREATE_BACKUP) != 0;
+	task_data->rope = _tepl_rope_ref (_tepl_buffer_get_rope (saver->priv->buffer));
+	task_data->revision = _tepl_buffer_get_revision (saver->priv->buffer);
+	task_data->line_split_offsets = _tepl_buffer_get_line_split_offsets (saver->priv->buffer);
+	task_data->location = g_object_ref (saver->priv->location);
+	task_data->make_backup = (saver->priv->flags & TEPL_FILE_SAVER_FLAGS_CREATE_BACKUP) != 0;
+	task_data->durability = saver->priv->durability;
+	task_data->backup_strategy = saver->priv->backup_strategy;
+	_tepl_newline_converter_init (&task_data->newline_converter, saver->priv->newline_type);
+	_tepl_newline_converter_set_strip_trailing_whitespace (&task_data->newline_converter,
+							       (saver->priv->flags & TEPL_FILE_SAVER_FLAGS_STRIP_TRAILING_WHITESPACE) != 0);
+	_tepl_newline_converter_set_ensure_trailing_newline (&task_data->newline_converter,
+							     (saver->priv->flags & TEPL_FILE_SAVER_FLAGS_ENSURE_TRAILING_NEWLINE) != 0);
+	task_data->ignore_unconvertible_chars = (saver->priv->flags & TEPL_FILE_SAVER_FLAGS_IGNORE_UNCONVERTIBLE_CHARS) != 0;
+	task_data->unconvertible_char_indexes = g_array_new (FALSE, FALSE, sizeof (gsize));
+	task_data->unconvertible_char_offsets = g_array_new (FALSE, FALSE, sizeof (gint));
+
+	if (!_tepl_charset_is_utf8 (saver->priv->charset))
+	{
+		task_data->charset = g_strdup (saver->priv->charset);
+	}
+
+	if (can_skip_write (saver, task_data))
+	{
+		task_data->unchanged_file_etag = g_strdup (_tepl_file_get_etag (saver->priv->file));
+	}
 
-	g_file_replace_contents_async (saver->priv->location,
-				       task_data->buffer_content,
-				       strlen (task_data->buffer_content),
-				       NULL,
-				       make_backup,
-				       G_FILE_CREATE_NONE,
-				       g_task_get_cancellable (task),
-				       save_all_buffer_content_cb,
-				       task);
+	g_task_run_in_thread (task, save_thread);
+	g_object_unref (task);
 }
 
 /**
@@ -569,6 +1577,15 @@ save_all_buffer_content (GTask *task)
  * Saves asynchronously the buffer into the file. See the #GAsyncResult
  * documentation to know how to use this function.
  *
+ * The %TEPL_FILE_SAVER_ERROR_EDITED_LINE_SPLITS error can be reported, unless
+ * the %TEPL_FILE_SAVER_FLAGS_IGNORE_EDITED_LINE_SPLITS flag is set. The
+ * %TEPL_FILE_SAVER_ERROR_UNCONVERTIBLE_CHARS error can be reported, unless the
+ * %TEPL_FILE_SAVER_FLAGS_IGNORE_UNCONVERTIBLE_CHARS flag is set. The
+ * %TEPL_FILE_SAVER_ERROR_INVALID_CHARS error can be reported, unless the
+ * %TEPL_FILE_SAVER_FLAGS_IGNORE_INVALID_CHARS flag is set. A buffer used by a
+ * #TeplFileViewer cannot be saved, the %TEPL_FILE_SAVER_ERROR_PARTIAL_CONTENT
+ * error is reported.
+ *
  * Since: 5.0
  */
 void
@@ -586,6 +1603,7 @@ tepl_file_saver_save_async (TeplFileSaver       *saver,
 	g_return_if_fail (!saver->priv->is_saving);
 
 	saver->priv->is_saving = TRUE;
+	g_array_set_size (saver->priv->unconvertible_char_offsets, 0);
 
 	task = g_task_new (saver, cancellable, callback, user_data);
 	g_task_set_priority (task, io_priority);
@@ -602,8 +1620,46 @@ tepl_file_saver_save_async (TeplFileSaver       *saver,
 		return;
 	}
 
-	get_all_buffer_content (task);
-	save_all_buffer_content (task);
+	if (_tepl_buffer_has_partial_content (saver->priv->buffer))
+	{
+		g_task_return_new_error (task,
+					 TEPL_FILE_SAVER_ERROR,
+					 TEPL_FILE_SAVER_ERROR_PARTIAL_CONTENT,
+					 _("The document is opened in the read-only viewer mode, "
+					   "it contains only a part of the file."));
+		g_object_unref (task);
+		return;
+	}
+
+	if ((saver->priv->flags & TEPL_FILE_SAVER_FLAGS_IGNORE_EDITED_LINE_SPLITS) == 0 &&
+	    _tepl_buffer_has_edited_line_splits (saver->priv->buffer))
+	{
+		g_task_return_new_error (task,
+					 TEPL_FILE_SAVER_ERROR,
+					 TEPL_FILE_SAVER_ERROR_EDITED_LINE_SPLITS,
+					 _("Some very long lines have been split when loading the file, "
+					   "and the text has been modified where they were split. "
+					   "The original lines cannot be exactly restored."));
+		g_object_unref (task);
+		return;
+	}
+
+	/* The invalid chars are counted by the buffer, so this check doesn't
+	 * depend on the buffer size.
+	 */
+	if ((saver->priv->flags & TEPL_FILE_SAVER_FLAGS_IGNORE_INVALID_CHARS) == 0 &&
+	    _tepl_buffer_has_invalid_chars (saver->priv->buffer))
+	{
+		g_task_return_new_error (task,
+					 TEPL_FILE_SAVER_ERROR,
+					 TEPL_FILE_SAVER_ERROR_INVALID_CHARS,
+					 _("The document contains invalid characters, "
+					   "the original bytes of the file cannot be restored."));
+		g_object_unref (task);
+		return;
+	}
+
+	launch_save_thread (task);
 }
 
 /**
@@ -615,10 +1671,11 @@ tepl_file_saver_save_async (TeplFileSaver       *saver,
  * Finishes a file saving started with tepl_file_saver_save_async().
  *
  * If the file has been saved successfully, the following #TeplFile
- * properties will be updated: the location and the newline type.
+ * properties will be updated: the location, the newline type and the charset.
  *
  * gtk_text_buffer_set_modified() is called with %FALSE if the file has been
- * saved successfully.
+ * saved successfully, and if the buffer has not been modified since the save
+ * operation was started.
  *
  * Returns: whether the file was saved successfully.
  * Since: 1.0
@@ -628,14 +1685,23 @@ tepl_file_saver_save_finish (TeplFileSaver  *saver,
 			     GAsyncResult   *result,
 			     GError        **error)
 {
+	TaskData *task_data;
 	gboolean ok;
 
 	g_return_val_if_fail (TEPL_IS_FILE_SAVER (saver), FALSE);
 	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
 	g_return_val_if_fail (g_task_is_valid (result, saver), FALSE);
 
+	task_data = g_task_get_task_data (G_TASK (result));
 	ok = g_task_propagate_boolean (G_TASK (result), error);
 
+	if (task_data->unconvertible_char_offsets != NULL)
+	{
+		g_array_append_vals (saver->priv->unconvertible_char_offsets,
+				     task_data->unconvertible_char_offsets->data,
+				     task_data->unconvertible_char_offsets->len);
+	}
+
 	if (ok && saver->priv->file != NULL)
 	{
 		tepl_file_set_location (saver->priv->file,
@@ -643,9 +1709,26 @@ tepl_file_saver_save_finish (TeplFileSaver  *saver,
 
 		_tepl_file_set_newline_type (saver->priv->file,
 					     saver->priv->newline_type);
+
+		_tepl_file_set_charset (saver->priv->file,
+					saver->priv->charset);
+
+		_tepl_file_set_etag (saver->priv->file, task_data->new_etag);
 	}
 
 	if (ok && saver->priv->buffer != NULL)
+	{
+		/* When the whitespace has been stripped, the file content is
+		 * not the same as the buffer content.
+		 */
+		_tepl_buffer_set_saved_content (saver->priv->buffer,
+						_tepl_newline_converter_content_is_modified (&task_data->newline_converter) ?
+						NULL : task_data->rope);
+	}
+
+	if (ok &&
+	    saver->priv->buffer != NULL &&
+	    _tepl_buffer_get_revision (saver->priv->buffer) == task_data->revision)
 	{
 		gtk_text_buffer_set_modified (GTK_TEXT_BUFFER (saver->priv->buffer), FALSE);
 	}
@@ -653,3 +1736,57 @@ tepl_file_saver_save_finish (TeplFileSaver  *saver,
 	saver->priv->is_saving = FALSE;
 	return ok;
 }
+
+/**
+ * tepl_file_saver_get_n_unconvertible_chars:
+ * @saver: a #TeplFileSaver.
+ *
+ * After a save operation, gets the number of characters that don't exist in
+ * the #TeplFileSaver:charset. Only the first 1000 characters are counted.
+ *
+ * Returns: the number of unconvertible characters.
+ * Since: 6.0
+ */
+guint
+tepl_file_saver_get_n_unconvertible_chars (TeplFileSaver *saver)
+{
+	g_return_val_if_fail (TEPL_IS_FILE_SAVER (saver), 0);
+
+	return saver->priv->unconvertible_char_offsets->len;
+}
+
+/**
+ * tepl_file_saver_get_unconvertible_char_offset:
+ * @saver: a #TeplFileSaver.
+ * @char_num: the index of the character, between 0 and
+ *   tepl_file_saver_get_n_unconvertible_chars() - 1.
+ *
+ * Gets the position of a character that doesn't exist in the
+ * #TeplFileSaver:charset. The positions are sorted.
+ *
+ * The position is a character offset in the buffer content of when the save
+ * operation was started, see gtk_text_buffer_get_iter_at_offset().
+ *
+ * Returns: the character offset.
+ * Since: 6.0
+ */
+gint
+tepl_file_saver_get_unconvertible_char_offset (TeplFileSaver *saver,
+					       guint          char_num)
+{
+	g_return_val_if_fail (TEPL_IS_FILE_SAVER (saver), 0);
+	g_return_val_if_fail (char_num < saver->priv->unconvertible_char_offsets->len, 0);
+
+	return g_array_index (saver->priv->unconvertible_char_offsets, gint, char_num);
+}
+
+/* For the unit tests, to compare the backup strategies. */
+void
+_tepl_file_saver_set_backup_strategy (TeplFileSaver      *saver,
+				      TeplBackupStrategy  strategy)
+{
+	g_return_if_fail (TEPL_IS_FILE_SAVER (saver));
+	g_return_if_fail (!saver->priv->is_saving);
+
+	saver->priv->backup_strategy = strategy;
+}
@@ -28,10 +28,53 @@ typedef struct _TeplFileSaver        TeplFileSaver;
 typedef struct _TeplFileSaverClass   TeplFileSaverClass;
 typedef struct _TeplFileSaverPrivate TeplFileSaverPrivate;
 
+#define TEPL_FILE_SAVER_ERROR tepl_file_saver_error_quark ()
+
+/**
+ * TeplFileSaverError:
+ * @TEPL_FILE_SAVER_ERROR_EDITED_LINE_SPLITS: Some newlines inserted by
+ *   #TeplFileLoader to split very long lines have been deleted or replaced, so
+ *   the original lines cannot be exactly restored. See the
+ *   #TeplFileLoader:line-split-length property.
+ * @TEPL_FILE_SAVER_ERROR_PARTIAL_CONTENT: The buffer contains only a part of
+ *   the file, see #TeplFileViewer.
+ * @TEPL_FILE_SAVER_ERROR_UNCONVERTIBLE_CHARS: Some characters of the buffer
+ *   don't exist in the #TeplFileSaver:charset. Their positions are available
+ *   with tepl_file_saver_get_unconvertible_char_offset().
+ * @TEPL_FILE_SAVER_ERROR_INVALID_CHARS: The buffer contains invalid bytes of
+ *   the loaded file, shown as escape sequences like “\FF” by
+ *   #TeplFileLoader. The original bytes are not restored, the escape
+ *   sequences would be saved as text.
+ *
+ * An error code used with the %TEPL_FILE_SAVER_ERROR domain.
+ *
+ * Since: 6.0
+ */
+typedef enum _TeplFileSaverError
+{
+	TEPL_FILE_SAVER_ERROR_EDITED_LINE_SPLITS,
+	TEPL_FILE_SAVER_ERROR_PARTIAL_CONTENT,
+	TEPL_FILE_SAVER_ERROR_UNCONVERTIBLE_CHARS,
+	TEPL_FILE_SAVER_ERROR_INVALID_CHARS
+} TeplFileSaverError;
+
 /**
  * TeplFileSaverFlags:
  * @TEPL_FILE_SAVER_FLAGS_NONE: No flags.
  * @TEPL_FILE_SAVER_FLAGS_CREATE_BACKUP: Create a backup before saving the file.
+ * @TEPL_FILE_SAVER_FLAGS_IGNORE_EDITED_LINE_SPLITS: Save the file even if the
+ *   %TEPL_FILE_SAVER_ERROR_EDITED_LINE_SPLITS error would occur. Since: 6.0.
+ * @TEPL_FILE_SAVER_FLAGS_IGNORE_UNCONVERTIBLE_CHARS: Save the file even if the
+ *   %TEPL_FILE_SAVER_ERROR_UNCONVERTIBLE_CHARS error would occur. The
+ *   characters are replaced by the substitution character of the charset.
+ *   Since: 6.0.
+ * @TEPL_FILE_SAVER_FLAGS_STRIP_TRAILING_WHITESPACE: Remove the spaces and tabs
+ *   at the end of each line, in the saved file only. Since: 6.0.
+ * @TEPL_FILE_SAVER_FLAGS_ENSURE_TRAILING_NEWLINE: Add a line terminator at the
+ *   end of the file if the content is not empty and doesn't already end with
+ *   one, in the saved file only. Since: 6.0.
+ * @TEPL_FILE_SAVER_FLAGS_IGNORE_INVALID_CHARS: Save the file even if the
+ *   %TEPL_FILE_SAVER_ERROR_INVALID_CHARS error would occur. Since: 6.0.
  *
  * Flags to define the behavior of a #TeplFileSaver.
  *
@@ -39,10 +82,48 @@ typedef struct _TeplFileSaverPrivate TeplFileSaverPrivate;
  */
 typedef enum
 {
-	TEPL_FILE_SAVER_FLAGS_NONE		= 0,
-	TEPL_FILE_SAVER_FLAGS_CREATE_BACKUP	= 1 << 0
+	TEPL_FILE_SAVER_FLAGS_NONE				= 0,
+	TEPL_FILE_SAVER_FLAGS_CREATE_BACKUP			= 1 << 0,
+	TEPL_FILE_SAVER_FLAGS_IGNORE_EDITED_LINE_SPLITS		= 1 << 1,
+	TEPL_FILE_SAVER_FLAGS_IGNORE_UNCONVERTIBLE_CHARS	= 1 << 2,
+	TEPL_FILE_SAVER_FLAGS_STRIP_TRAILING_WHITESPACE		= 1 << 3,
+	TEPL_FILE_SAVER_FLAGS_ENSURE_TRAILING_NEWLINE		= 1 << 4,
+	TEPL_FILE_SAVER_FLAGS_IGNORE_INVALID_CHARS		= 1 << 5
 } TeplFileSaverFlags;
 
+/**
+ * TeplFileSaverDurability:
+ * @TEPL_FILE_SAVER_DURABILITY_DEFAULT: The file is replaced atomically, the
+ *   new content is written to a temporary file that is then renamed. GIO
+ *   flushes the new content to the disk before the rename only when an
+ *   existing non-empty file is replaced.
+ * @TEPL_FILE_SAVER_DURABILITY_FAST: Like %TEPL_FILE_SAVER_DURABILITY_DEFAULT,
+ *   the file is replaced atomically, but for local files nothing is ever
+ *   flushed to the disk. It is the fastest mode: if an error occurs the file
+ *   is not modified, but if the system crashes shortly after the save
+ *   operation, the file can be empty. Suitable for scratch files. For remote
+ *   files, symlinks, files with several hard links or owned by another user,
+ *   the same as %TEPL_FILE_SAVER_DURABILITY_DEFAULT.
+ * @TEPL_FILE_SAVER_DURABILITY_DURABLE: Like
+ *   %TEPL_FILE_SAVER_DURABILITY_DEFAULT, and for local files the content of the
+ *   file and its parent directory are always flushed to the disk (with
+ *   fsync()) before the save operation finishes. So when the save operation
+ *   has succeeded, the file survives a system crash. Suitable for
+ *   configuration files.
+ *
+ * The durability policy of a #TeplFileSaver, that is, the trade-off between
+ * the speed of the save operation and the safety of the file content in case
+ * of a system crash.
+ *
+ * Since: 6.0
+ */
+typedef enum _TeplFileSaverDurability
+{
+	TEPL_FILE_SAVER_DURABILITY_DEFAULT,
+	TEPL_FILE_SAVER_DURABILITY_FAST,
+	TEPL_FILE_SAVER_DURABILITY_DURABLE
+} TeplFileSaverDurability;
+
 struct _TeplFileSaver
 {
 	GObject object;
@@ -60,6 +141,9 @@ struct _TeplFileSaverClass
 _TEPL_EXTERN
 GType			 tepl_file_saver_get_type		(void);
 
+_TEPL_EXTERN
+GQuark			 tepl_file_saver_error_quark		(void);
+
 _TEPL_EXTERN
 TeplFileSaver *		 tepl_file_saver_new			(TeplBuffer *buffer,
 								 TeplFile   *file);
@@ -85,6 +169,13 @@ void			 tepl_file_saver_set_newline_type	(TeplFileSaver   *saver,
 _TEPL_EXTERN
 TeplNewlineType		 tepl_file_saver_get_newline_type	(TeplFileSaver *saver);
 
+_TEPL_EXTERN
+void			 tepl_file_saver_set_charset		(TeplFileSaver *saver,
+								 const gchar   *charset);
+
+_TEPL_EXTERN
+const gchar *		 tepl_file_saver_get_charset		(TeplFileSaver *saver);
+
 _TEPL_EXTERN
 void			 tepl_file_saver_set_flags		(TeplFileSaver      *saver,
 								 TeplFileSaverFlags  flags);
@@ -92,6 +183,13 @@ void			 tepl_file_saver_set_flags		(TeplFileSaver      *saver,
 _TEPL_EXTERN
 TeplFileSaverFlags	 tepl_file_saver_get_flags		(TeplFileSaver *saver);
 
+_TEPL_EXTERN
+void			 tepl_file_saver_set_durability		(TeplFileSaver           *saver,
+								 TeplFileSaverDurability  durability);
+
+_TEPL_EXTERN
+TeplFileSaverDurability	 tepl_file_saver_get_durability		(TeplFileSaver *saver);
+
 _TEPL_EXTERN
 void			 tepl_file_saver_save_async		(TeplFileSaver       *saver,
 								 gint                 io_priority,
@@ -104,6 +202,13 @@ gboolean		 tepl_file_saver_save_finish		(TeplFileSaver  *saver,
 								 GAsyncResult   *result,
 								 GError        **error);
 
+_TEPL_EXTERN
+guint			 tepl_file_saver_get_n_unconvertible_chars (TeplFileSaver *saver);
+
+_TEPL_EXTERN
+gint			 tepl_file_saver_get_unconvertible_char_offset (TeplFileSaver *saver,
+									guint          char_num);
+
 G_END_DECLS
 
 #endif  /* TEPL_FILE_SAVER_H  */
@@ -0,0 +1,1472 @@
+/* SPDX-FileCopyrightText: 2020 - Sébastien Wilmet <swilmet@gnome.org>
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "config.h"
+#include "tepl-file-viewer.h"
+#include <string.h>
+#include "tepl-buffer.h"
+#include "tepl-file.h"
+
+/**
+ * SECTION:file-viewer
+ * @Title: TeplFileViewer
+ * @Short_description: Read-only viewer mode for big files
+ * @See_also: #TeplFileLoader
+ *
+ * A #TeplFileViewer permits to inspect a file that is too big to be loaded
+ * entirely into a #GtkTextBuffer, for example a log file of several gigabytes.
+ * See the #TeplFileLoader:max-file-size property.
+ *
+ * The #TeplBuffer of the #TeplView contains only a window of the file, a few
+ * thousand lines around the visible region. The window is read in a worker
+ * thread, by seeking to the position of its first line in a #GFileInputStream.
+ * When the view is scrolled near the start or the end of the window, or when
+ * tepl_view_goto_line() is called, another window is read. A line longer than
+ * the maximum size of a window is shown in several parts: the window can start
+ * and end in the middle of a line, and is moved within that line.
+ *
+ * To know where the lines start, a sparse index containing the position of
+ * one line every thousand lines is built in the background when the file is
+ * opened. The index is usable while it is being built; going to a line that is
+ * not yet indexed only needs to read the file from the last indexed line. The
+ * lines are delimited by "\n", and the invalid UTF-8 bytes are replaced by the
+ * U+FFFD replacement character.
+ *
+ * While the #TeplFileViewer exists, the #TeplView is not editable and its line
+ * numbers are hidden, since they would be relative to the window. The
+ * #TeplBuffer is marked as containing only a part of the file, so
+ * #TeplFileSaver refuses to save it with the
+ * %TEPL_FILE_SAVER_ERROR_PARTIAL_CONTENT error, until another content is
+ * loaded with #TeplFileLoader.
+ */
+
+/* The position of one line every INDEX_INTERVAL lines is kept in the index. */
+#define INDEX_INTERVAL (1024)
+
+#define READ_BLOCK_SIZE (1024 * 1024)
+
+/* The maximum number of lines and bytes in the buffer. */
+#define WINDOW_N_LINES (4000)
+#define WINDOW_MAX_SIZE (4 * 1024 * 1024)
+
+/* When the visible region is at less than WINDOW_MARGIN lines from the start
+ * or the end of the window, the window is moved. The same with
+ * WINDOW_BYTE_MARGIN bytes, for a line cut at the start or the end of the
+ * window.
+ */
+#define WINDOW_MARGIN (WINDOW_N_LINES / 8)
+#define WINDOW_BYTE_MARGIN (WINDOW_MAX_SIZE / 8)
+
+#define VIEW_DATA_KEY "tepl-file-viewer"
+
+/* Shared with the worker thread that builds it, so it is reference counted
+ * with g_atomic_rc_box_acquire().
+ */
+typedef struct _LineIndex LineIndex;
+struct _LineIndex
+{
+	GMutex mutex;
+
+	/* The position, in bytes, of the line number i * INDEX_INTERVAL, as
+	 * goffset's. The first element is always 0.
+	 */
+	GArray *line_offsets;
+
+	/* The number of lines found so far. */
+	gint64 n_lines;
+};
+
+struct _TeplFileViewerPrivate
+{
+	/* Weak ref. The view is not owned by the viewer. */
+	TeplView *view;
+
+	/* A line longer than the view width is scrolled horizontally, if the
+	 * text is not wrapped.
+	 */
+	GtkAdjustment *hadjustment;
+	GtkAdjustment *vadjustment;
+
+	GFile *location;
+	LineIndex *index;
+	GCancellable *index_cancellable;
+
+	/* Not NULL while a window is being read. */
+	GCancellable *window_cancellable;
+
+	/* To scroll the view to the line that was at the top, after moving
+	 * the window.
+	 */
+	GtkTextMark *scroll_mark;
+
+	gint64 window_first_line;
+	gint window_n_lines;
+
+	/* Positions in the file, in bytes. The window starts at
+	 * @window_start_offset, in the line that starts at
+	 * @window_line_offset; they are different when the window starts in
+	 * the middle of a line. When the window ends in the middle of a line,
+	 * that line starts at @window_last_line_offset.
+	 */
+	goffset window_start_offset;
+	goffset window_line_offset;
+	goffset window_end_offset;
+	goffset window_last_line_offset;
+
+	guint window_reaches_end : 1;
+	guint window_ends_within_line : 1;
+	guint index_complete : 1;
+	guint view_was_editable : 1;
+	guint view_showed_line_numbers : 1;
+};
+
+typedef struct _IndexData IndexData;
+struct _IndexData
+{
+	GFile *location;
+	LineIndex *index;
+};
+
+typedef struct _WindowData WindowData;
+struct _WindowData
+{
+	GFile *location;
+
+	/* Where to start reading: an indexed line, or a position in the
+	 * middle of @first_line, which starts at @line_offset. @line_offset is
+	 * -1 when it is not known yet.
+	 */
+	goffset start_offset;
+	gint64 n_lines_to_skip;
+	goffset line_offset;
+
+	gint64 first_line;
+
+	/* The line to scroll to, once the window is shown. Or the position in
+	 * the file if @target_offset is not -1.
+	 */
+	gint64 target_line;
+	goffset target_offset;
+	guint place_cursor : 1;
+
+	/* Filled by the worker thread. */
+	gchar *text;
+	goffset window_start_offset;
+	goffset window_end_offset;
+	goffset last_line_offset;
+	guint found : 1;
+	guint reaches_end : 1;
+	guint ends_within_line : 1;
+};
+
+enum
+{
+	PROP_0,
+	PROP_VIEW,
+	N_PROPERTIES
+};
+
+static GParamSpec *properties[N_PROPERTIES];
+
+G_DEFINE_TYPE_WITH_PRIVATE (TeplFileViewer, tepl_file_viewer, G_TYPE_OBJECT)
+
+static LineIndex *
+line_index_new (void)
+{
+	LineIndex *index;
+	goffset first_line_offset = 0;
+
+	index = g_atomic_rc_box_new0 (LineIndex);
+	g_mutex_init (&index->mutex);
+	index->line_offsets = g_array_new (FALSE, FALSE, sizeof (goffset));
+	g_array_append_val (index->line_offsets, first_line_offset);
+	index->n_lines = 1;
+
+	return index;
+}
+
+static void
+line_index_clear (LineIndex *index)
+{
+	g_mutex_clear (&index->mutex);
+	g_array_unref (index->line_offsets);
+}
+
+static void
+line_index_unref (LineIndex *index)
+{
+	if (index != NULL)
+	{
+		g_atomic_rc_box_release_full (index, (GDestroyNotify)line_index_clear);
+	}
+}
+
+/* Gets the nearest indexed line before @line. */
+static void
+line_index_lookup (LineIndex *index,
+		   gint64     line,
+		   gint64    *indexed_line,
+		   goffset   *offset)
+{
+	guint index_pos;
+
+	g_mutex_lock (&index->mutex);
+
+	index_pos = MIN (line / INDEX_INTERVAL, index->line_offsets->len - 1);
+	*indexed_line = (gint64) index_pos * INDEX_INTERVAL;
+	*offset = g_array_index (index->line_offsets, goffset, index_pos);
+
+	g_mutex_unlock (&index->mutex);
+}
+
+static gint64
+line_index_get_n_lines (LineIndex *index)
+{
+	gint64 n_lines;
+
+	g_mutex_lock (&index->mutex);
+	n_lines = index->n_lines;
+	g_mutex_unlock (&index->mutex);
+
+	return n_lines;
+}
+
+static void
+index_data_free (IndexData *data)
+{
+	if (data != NULL)
+	{
+		g_object_unref (data->location);
+		line_index_unref (data->index);
+		g_free (data);
+	}
+}
+
+static void
+window_data_free (WindowData *data)
+{
+	if (data != NULL)
+	{
+		g_object_unref (data->location);
+		g_free (data->text);
+		g_free (data);
+	}
+}
+
+static void
+tepl_file_viewer_get_property (GObject    *object,
+			       guint       prop_id,
+			       GValue     *value,
+			       GParamSpec *pspec)
+{
+	TeplFileViewer *viewer = TEPL_FILE_VIEWER (object);
+
+	switch (prop_id)
+	{
+		case PROP_VIEW:
+			g_value_set_object (value, tepl_file_viewer_get_view (viewer));
+			break;
+
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+			break;
+	}
+}
+
+static void
+tepl_file_viewer_set_property (GObject      *object,
+			       guint         prop_id,
+			       const GValue *value,
+			       GParamSpec   *pspec)
+{
+	TeplFileViewer *viewer = TEPL_FILE_VIEWER (object);
+
+	switch (prop_id)
+	{
+		case PROP_VIEW:
+			g_assert (viewer->priv->view == NULL);
+			g_set_weak_pointer (&viewer->priv->view, g_value_get_object (value));
+			break;
+
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+			break;
+	}
+}
+
+static void load_window (TeplFileViewer *viewer,
+			 gint64          first_line,
+			 gint64          target_line,
+			 gboolean        place_cursor,
+			 GTask          *open_task);
+
+static void load_window_within_line (TeplFileViewer *viewer,
+				     gint64          line,
+				     goffset         line_offset,
+				     goffset         start_offset,
+				     goffset         target_offset);
+
+/* Moves the window if the visible region, from @top to @bottom, is near its
+ * start or its end. Returns whether another window is being read.
+ */
+gboolean
+_tepl_file_viewer_update_window (TeplFileViewer    *viewer,
+				 const GtkTextIter *top,
+				 const GtkTextIter *bottom)
+{
+	TeplFileViewerPrivate *priv;
+	gint top_line;
+	gint bottom_line;
+	gboolean starts_within_line;
+	gint64 file_top_line;
+	gint64 new_first_line;
+
+	g_return_val_if_fail (TEPL_IS_FILE_VIEWER (viewer), FALSE);
+	g_return_val_if_fail (top != NULL, FALSE);
+	g_return_val_if_fail (bottom != NULL, FALSE);
+
+	priv = viewer->priv;
+
+	if (priv->view == NULL ||
+	    priv->location == NULL ||
+	    priv->window_cancellable != NULL)
+	{
+		return FALSE;
+	}
+
+	top_line = gtk_text_iter_get_line (top);
+	bottom_line = gtk_text_iter_get_line (bottom);
+	starts_within_line = priv->window_start_offset > priv->window_line_offset;
+
+	/* Within a line cut at the start of the window. The positions in the
+	 * file are approximate if the line contains invalid UTF-8 bytes,
+	 * which are replaced by U+FFFD.
+	 */
+	if (top_line == 0 &&
+	    starts_within_line &&
+	    gtk_text_iter_get_line_index (top) < WINDOW_BYTE_MARGIN)
+	{
+		goffset top_offset = priv->window_start_offset + gtk_text_iter_get_line_index (top);
+
+		load_window_within_line (viewer,
+					 priv->window_first_line,
+					 priv->window_line_offset,
+					 MAX (priv->window_line_offset, top_offset - WINDOW_MAX_SIZE / 2),
+					 top_offset);
+		return TRUE;
+	}
+
+	/* Within a line cut at the end of the window. */
+	if (bottom_line == priv->window_n_lines - 1 &&
+	    priv->window_ends_within_line)
+	{
+		gint n_bytes_after = gtk_text_iter_get_bytes_in_line (bottom) - gtk_text_iter_get_line_index (bottom);
+		goffset bottom_offset = priv->window_end_offset - n_bytes_after;
+		goffset new_start_offset;
+		goffset top_offset;
+
+		if (n_bytes_after >= WINDOW_BYTE_MARGIN)
+		{
+			return FALSE;
+		}
+
+		new_start_offset = MAX (priv->window_last_line_offset, bottom_offset - WINDOW_MAX_SIZE / 2);
+
+		top_offset = new_start_offset;
+		if (top_line == bottom_line)
+		{
+			top_offset = MAX (top_offset,
+					  priv->window_end_offset -
+					  (gtk_text_iter_get_bytes_in_line (top) - gtk_text_iter_get_line_index (top)));
+		}
+
+		load_window_within_line (viewer,
+					 priv->window_first_line + bottom_line,
+					 priv->window_last_line_offset,
+					 new_start_offset,
+					 top_offset);
+		return TRUE;
+	}
+
+	/* Keep the visible region at the middle of the new window. Moving the
+	 * window only towards the edge that is near avoids moving it back and
+	 * forth when it contains few lines. When the window starts in the
+	 * middle of a line, the previous lines are reached by moving within
+	 * that line first.
+	 */
+	file_top_line = priv->window_first_line + top_line;
+	new_first_line = MAX (0, file_top_line - WINDOW_N_LINES / 2);
+
+	if ((top_line < WINDOW_MARGIN &&
+	     !starts_within_line &&
+	     new_first_line < priv->window_first_line) ||
+	    (bottom_line >= priv->window_n_lines - WINDOW_MARGIN &&
+	     !priv->window_reaches_end &&
+	     new_first_line > priv->window_first_line))
+	{
+		load_window (viewer, new_first_line, file_top_line, FALSE, NULL);
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+static void
+adjustment_value_changed_cb (GtkAdjustment  *adjustment,
+			     TeplFileViewer *viewer)
+{
+	TeplFileViewerPrivate *priv = viewer->priv;
+	GtkTextView *text_view;
+	GdkRectangle visible_rect;
+	GtkTextIter top;
+	GtkTextIter bottom;
+
+	if (priv->view == NULL)
+	{
+		return;
+	}
+
+	/* The iters at the top and the bottom of the visible region, not only
+	 * the line starts, since a long line can be bigger than the view.
+	 */
+	text_view = GTK_TEXT_VIEW (priv->view);
+	gtk_text_view_get_visible_rect (text_view, &visible_rect);
+	gtk_text_view_get_iter_at_location (text_view, &top, visible_rect.x, visible_rect.y);
+	gtk_text_view_get_iter_at_location (text_view,
+					    &bottom,
+					    visible_rect.x + visible_rect.width,
+					    visible_rect.y + visible_rect.height);
+
+	_tepl_file_viewer_update_window (viewer, &top, &bottom);
+}
+
+static void
+set_adjustment (TeplFileViewer  *viewer,
+		GtkAdjustment  **adjustment_pointer,
+		GtkAdjustment   *adjustment)
+{
+	if (*adjustment_pointer == adjustment)
+	{
+		return;
+	}
+
+	if (*adjustment_pointer != NULL)
+	{
+		g_signal_handlers_disconnect_by_func (*adjustment_pointer,
+						      adjustment_value_changed_cb,
+						      viewer);
+		g_clear_object (adjustment_pointer);
+	}
+
+	if (adjustment != NULL)
+	{
+		*adjustment_pointer = g_object_ref (adjustment);
+
+		g_signal_connect (adjustment,
+				  "value-changed",
+				  G_CALLBACK (adjustment_value_changed_cb),
+				  viewer);
+	}
+}
+
+static void
+view_notify_adjustment_cb (TeplView       *view,
+			   GParamSpec     *pspec,
+			   TeplFileViewer *viewer)
+{
+	TeplFileViewerPrivate *priv = viewer->priv;
+
+	set_adjustment (viewer, &priv->hadjustment, gtk_scrollable_get_hadjustment (GTK_SCROLLABLE (view)));
+	set_adjustment (viewer, &priv->vadjustment, gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (view)));
+}
+
+static void
+tepl_file_viewer_constructed (GObject *object)
+{
+	TeplFileViewer *viewer = TEPL_FILE_VIEWER (object);
+	TeplFileViewerPrivate *priv = viewer->priv;
+
+	G_OBJECT_CLASS (tepl_file_viewer_parent_class)->constructed (object);
+
+	if (priv->view == NULL)
+	{
+		return;
+	}
+
+	g_object_set_data (G_OBJECT (priv->view), VIEW_DATA_KEY, viewer);
+
+	priv->view_was_editable = gtk_text_view_get_editable (GTK_TEXT_VIEW (priv->view));
+	priv->view_showed_line_numbers = gtk_source_view_get_show_line_numbers (GTK_SOURCE_VIEW (priv->view));
+	gtk_text_view_set_editable (GTK_TEXT_VIEW (priv->view), FALSE);
+	gtk_source_view_set_show_line_numbers (GTK_SOURCE_VIEW (priv->view), FALSE);
+
+	g_signal_connect_object (priv->view,
+				 "notify::hadjustment",
+				 G_CALLBACK (view_notify_adjustment_cb),
+				 viewer,
+				 0);
+
+	g_signal_connect_object (priv->view,
+				 "notify::vadjustment",
+				 G_CALLBACK (view_notify_adjustment_cb),
+				 viewer,
+				 0);
+
+	view_notify_adjustment_cb (priv->view, NULL, viewer);
+}
+
+static void
+cancel_operations (TeplFileViewer *viewer)
+{
+	TeplFileViewerPrivate *priv = viewer->priv;
+
+	if (priv->index_cancellable != NULL)
+	{
+		g_cancellable_cancel (priv->index_cancellable);
+		g_clear_object (&priv->index_cancellable);
+	}
+
+	if (priv->window_cancellable != NULL)
+	{
+		g_cancellable_cancel (priv->window_cancellable);
+		g_clear_object (&priv->window_cancellable);
+	}
+}
+
+static void
+tepl_file_viewer_dispose (GObject *object)
+{
+	TeplFileViewer *viewer = TEPL_FILE_VIEWER (object);
+	TeplFileViewerPrivate *priv = viewer->priv;
+
+	cancel_operations (viewer);
+	set_adjustment (viewer, &priv->hadjustment, NULL);
+	set_adjustment (viewer, &priv->vadjustment, NULL);
+
+	if (priv->scroll_mark != NULL)
+	{
+		if (!gtk_text_mark_get_deleted (priv->scroll_mark))
+		{
+			gtk_text_buffer_delete_mark (gtk_text_mark_get_buffer (priv->scroll_mark),
+						     priv->scroll_mark);
+		}
+
+		g_clear_object (&priv->scroll_mark);
+	}
+
+	/* The buffer content stays, and is still marked as partial. */
+	if (priv->view != NULL)
+	{
+		g_signal_handlers_disconnect_by_func (priv->view,
+						      view_notify_adjustment_cb,
+						      viewer);
+
+		g_object_set_data (G_OBJECT (priv->view), VIEW_DATA_KEY, NULL);
+		gtk_text_view_set_editable (GTK_TEXT_VIEW (priv->view), priv->view_was_editable);
+		gtk_source_view_set_show_line_numbers (GTK_SOURCE_VIEW (priv->view), priv->view_showed_line_numbers);
+		g_clear_weak_pointer (&priv->view);
+	}
+
+	g_clear_object (&priv->location);
+	g_clear_pointer (&priv->index, line_index_unref);
+
+	G_OBJECT_CLASS (tepl_file_viewer_parent_class)->dispose (object);
+}
+
+static void
+tepl_file_viewer_class_init (TeplFileViewerClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+	object_class->get_property = tepl_file_viewer_get_property;
+	object_class->set_property = tepl_file_viewer_set_property;
+	object_class->constructed = tepl_file_viewer_constructed;
+	object_class->dispose = tepl_file_viewer_dispose;
+
+	/**
+	 * TeplFileViewer:view:
+	 *
+	 * The #TeplView. The #TeplFileViewer object has a weak reference to
+	 * the view.
+	 *
+	 * Since: 6.0
+	 */
+	properties[PROP_VIEW] =
+		g_param_spec_object ("view",
+				     "view",
+				     "",
+				     TEPL_TYPE_VIEW,
+				     G_PARAM_READWRITE |
+				     G_PARAM_CONSTRUCT_ONLY |
+				     G_PARAM_STATIC_STRINGS);
+
+	g_object_class_install_properties (object_class, N_PROPERTIES, properties);
+}
+
+static void
+tepl_file_viewer_init (TeplFileViewer *viewer)
+{
+	viewer->priv = tepl_file_viewer_get_instance_private (viewer);
+}
+
+/**
+ * tepl_file_viewer_new:
+ * @view: a #TeplView.
+ *
+ * Creates a new #TeplFileViewer object. The @view is set as not editable until
+ * the #TeplFileViewer is finalized.
+ *
+ * Returns: a new #TeplFileViewer object.
+ * Since: 6.0
+ */
+TeplFileViewer *
+tepl_file_viewer_new (TeplView *view)
+{
+	g_return_val_if_fail (TEPL_IS_VIEW (view), NULL);
+	g_return_val_if_fail (_tepl_file_viewer_get_for_view (view) == NULL, NULL);
+
+	return g_object_new (TEPL_TYPE_FILE_VIEWER,
+			     "view", view,
+			     NULL);
+}
+
+/**
+ * tepl_file_viewer_get_view:
+ * @viewer: a #TeplFileViewer.
+ *
+ * Returns: (transfer none) (nullable): the #TeplView.
+ * Since: 6.0
+ */
+TeplView *
+tepl_file_viewer_get_view (TeplFileViewer *viewer)
+{
+	g_return_val_if_fail (TEPL_IS_FILE_VIEWER (viewer), NULL);
+
+	return viewer->priv->view;
+}
+
+/**
+ * tepl_file_viewer_get_location:
+ * @viewer: a #TeplFileViewer.
+ *
+ * Returns: (transfer none) (nullable): the #GFile opened with
+ * tepl_file_viewer_open_async(), or %NULL.
+ * Since: 6.0
+ */
+GFile *
+tepl_file_viewer_get_location (TeplFileViewer *viewer)
+{
+	g_return_val_if_fail (TEPL_IS_FILE_VIEWER (viewer), NULL);
+
+	return viewer->priv->location;
+}
+
+/* Runs in a worker thread. */
+static void
+build_index_thread (GTask        *task,
+		    gpointer      source_object,
+		    gpointer      task_data,
+		    GCancellable *cancellable)
+{
+	IndexData *data = task_data;
+	LineIndex *index = data->index;
+	GFileInputStream *stream;
+	GArray *new_line_offsets;
+	gchar *block;
+	goffset block_offset = 0;
+	gint64 n_lines = 1;
+	GError *error = NULL;
+
+	stream = g_file_read (data->location, cancellable, &error);
+	if (stream == NULL)
+	{
+		g_task_return_error (task, error);
+		return;
+	}
+
+	new_line_offsets = g_array_new (FALSE, FALSE, sizeof (goffset));
+	block = g_malloc (READ_BLOCK_SIZE);
+
+	while (TRUE)
+	{
+		gssize n_bytes_read;
+		const gchar *pos;
+		const gchar *end;
+		const gchar *newline;
+
+		n_bytes_read = g_input_stream_read (G_INPUT_STREAM (stream),
+						    block,
+						    READ_BLOCK_SIZE,
+						    cancellable,
+						    &error);
+
+		if (n_bytes_read <= 0)
+		{
+			break;
+		}
+
+		pos = block;
+		end = block + n_bytes_read;
+		g_array_set_size (new_line_offsets, 0);
+
+		while ((newline = memchr (pos, '\n', end - pos)) != NULL)
+		{
+			/* The line number @n_lines starts after the newline. */
+			if (n_lines % INDEX_INTERVAL == 0)
+			{
+				goffset line_offset = block_offset + (newline + 1 - block);
+				g_array_append_val (new_line_offsets, line_offset);
+			}
+
+			n_lines++;
+			pos = newline + 1;
+		}
+
+		block_offset += n_bytes_read;
+
+		/* Lock once per block, the main thread can use the index
+		 * in the meantime.
+		 */
+		g_mutex_lock (&index->mutex);
+		g_array_append_vals (index->line_offsets,
+				     new_line_offsets->data,
+				     new_line_offsets->len);
+		index->n_lines = n_lines;
+		g_mutex_unlock (&index->mutex);
+	}
+
+	g_free (block);
+	g_array_unref (new_line_offsets);
+	g_object_unref (stream);
+
+	if (error != NULL)
+	{
+		g_task_return_error (task, error);
+		return;
+	}
+
+	g_task_return_boolean (task, TRUE);
+}
+
+static void
+build_index_cb (GObject      *source_object,
+		GAsyncResult *result,
+		gpointer      user_data)
+{
+	TeplFileViewer *viewer = TEPL_FILE_VIEWER (source_object);
+	IndexData *data = g_task_get_task_data (G_TASK (result));
+	GError *error = NULL;
+
+	if (g_task_propagate_boolean (G_TASK (result), &error))
+	{
+		if (data->index == viewer->priv->index)
+		{
+			viewer->priv->index_complete = TRUE;
+			g_clear_object (&viewer->priv->index_cancellable);
+		}
+
+		return;
+	}
+
+	/* The partial index is still usable. */
+	if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+	{
+		g_warning ("Error when indexing the lines of the file: %s", error->message);
+	}
+
+	g_clear_error (&error);
+}
+
+static void
+build_index (TeplFileViewer *viewer,
+	     gint            io_priority)
+{
+	TeplFileViewerPrivate *priv = viewer->priv;
+	IndexData *data;
+	GTask *task;
+
+	data = g_new0 (IndexData, 1);
+	data->location = g_object_ref (priv->location);
+	data->index = g_atomic_rc_box_acquire (priv->index);
+
+	task = g_task_new (viewer, priv->index_cancellable, build_index_cb, NULL);
+	g_task_set_priority (task, io_priority);
+	g_task_set_task_data (task, data, (GDestroyNotify)index_data_free);
+	g_task_run_in_thread (task, build_index_thread);
+	g_object_unref (task);
+}
+
+/* Returns the number of bytes at the end of @data that are the start of an
+ * incomplete UTF-8 character.
+ */
+static guint
+get_incomplete_char_length (const guint8 *data,
+			    gsize         length)
+{
+	guint i;
+
+	for (i = 1; i <= MIN (length, 3); i++)
+	{
+		guint8 c = data[length - i];
+		guint char_length;
+
+		/* Continuation byte. */
+		if ((c & 0xC0) == 0x80)
+		{
+			continue;
+		}
+
+		if (c >= 0xF0)
+		{
+			char_length = 4;
+		}
+		else if (c >= 0xE0)
+		{
+			char_length = 3;
+		}
+		else if (c >= 0xC0)
+		{
+			char_length = 2;
+		}
+		else
+		{
+			char_length = 1;
+		}
+
+		return char_length > i ? i : 0;
+	}
+
+	return 0;
+}
+
+/* Runs in a worker thread. */
+static void
+read_window_thread (GTask        *task,
+		    gpointer      source_object,
+		    gpointer      task_data,
+		    GCancellable *cancellable)
+{
+	WindowData *data = task_data;
+	GFileInputStream *stream;
+	GByteArray *content;
+	gchar *block;
+	goffset block_offset = data->start_offset;
+	gint64 n_lines_to_skip = data->n_lines_to_skip;
+	gint n_lines = 0;
+	GError *error = NULL;
+
+	stream = g_file_read (data->location, cancellable, &error);
+	if (stream == NULL)
+	{
+		g_task_return_error (task, error);
+		return;
+	}
+
+	if (!g_seekable_seek (G_SEEKABLE (stream), data->start_offset, G_SEEK_SET, cancellable, &error))
+	{
+		g_object_unref (stream);
+		g_task_return_error (task, error);
+		return;
+	}
+
+	content = g_byte_array_new ();
+	block = g_malloc (READ_BLOCK_SIZE);
+
+	data->window_start_offset = data->start_offset;
+	data->last_line_offset = data->line_offset != -1 ? data->line_offset : data->start_offset;
+
+	while (n_lines < WINDOW_N_LINES && content->len < WINDOW_MAX_SIZE)
+	{
+		gssize n_bytes_read;
+		const gchar *pos;
+		const gchar *end;
+
+		n_bytes_read = g_input_stream_read (G_INPUT_STREAM (stream),
+						    block,
+						    READ_BLOCK_SIZE,
+						    cancellable,
+						    &error);
+
+		if (n_bytes_read < 0)
+		{
+			break;
+		}
+
+		if (n_bytes_read == 0)
+		{
+			data->reaches_end = TRUE;
+			break;
+		}
+
+		pos = block;
+		end = block + n_bytes_read;
+
+		while (n_lines_to_skip > 0 && pos < end)
+		{
+			const gchar *newline = memchr (pos, '\n', end - pos);
+
+			if (newline == NULL)
+			{
+				pos = end;
+				break;
+			}
+
+			pos = newline + 1;
+			n_lines_to_skip--;
+
+			if (n_lines_to_skip == 0)
+			{
+				data->window_start_offset = block_offset + (pos - block);
+				data->last_line_offset = data->window_start_offset;
+			}
+		}
+
+		/* A line longer than WINDOW_MAX_SIZE is cut. */
+		while (pos < end &&
+		       n_lines < WINDOW_N_LINES &&
+		       content->len < WINDOW_MAX_SIZE)
+		{
+			const gchar *newline = memchr (pos, '\n', end - pos);
+			const gchar *line_end = newline != NULL ? newline + 1 : end;
+			gsize length = MIN ((gsize) (line_end - pos), WINDOW_MAX_SIZE - content->len);
+
+			g_byte_array_append (content, (const guint8 *) pos, length);
+			pos += length;
+
+			if (newline != NULL && pos == newline + 1)
+			{
+				n_lines++;
+				data->last_line_offset = block_offset + (pos - block);
+			}
+		}
+
+		block_offset += n_bytes_read;
+	}
+
+	g_free (block);
+	g_object_unref (stream);
+
+	if (error != NULL)
+	{
+		g_byte_array_unref (content);
+		g_task_return_error (task, error);
+		return;
+	}
+
+	/* The first line is after the end of the file. */
+	data->found = n_lines_to_skip == 0;
+
+	/* Don't show the parts of the characters cut at the start or at the
+	 * end of the window as invalid bytes.
+	 */
+	if (data->line_offset != -1 &&
+	    data->window_start_offset > data->line_offset)
+	{
+		guint n_bytes = 0;
+
+		while (n_bytes < MIN (content->len, 3) &&
+		       (content->data[n_bytes] & 0xC0) == 0x80)
+		{
+			n_bytes++;
+		}
+
+		g_byte_array_remove_range (content, 0, n_bytes);
+		data->window_start_offset += n_bytes;
+	}
+
+	data->ends_within_line = (!data->reaches_end &&
+				  content->len >= WINDOW_MAX_SIZE &&
+				  content->data[content->len - 1] != '\n');
+
+	if (data->ends_within_line)
+	{
+		g_byte_array_set_size (content,
+				       content->len - get_incomplete_char_length (content->data, content->len));
+	}
+
+	data->window_end_offset = data->window_start_offset + content->len;
+
+	/* Otherwise an empty line would be shown at the end of the window. */
+	if (!data->reaches_end &&
+	    content->len > 0 &&
+	    content->data[content->len - 1] == '\n')
+	{
+		g_byte_array_set_size (content, content->len - 1);
+	}
+
+	data->text = g_utf8_make_valid ((const gchar *) content->data, content->len);
+	g_byte_array_unref (content);
+
+	g_task_return_boolean (task, TRUE);
+}
+
+static void
+show_window (TeplFileViewer *viewer,
+	     WindowData     *data)
+{
+	TeplFileViewerPrivate *priv = viewer->priv;
+	GtkTextBuffer *buffer;
+	GtkTextIter iter;
+	gint64 target_line;
+
+	buffer = gtk_text_view_get_buffer (GTK_TEXT_VIEW (priv->view));
+
+	gtk_source_buffer_begin_not_undoable_action (GTK_SOURCE_BUFFER (buffer));
+	gtk_text_buffer_set_text (buffer, data->text, -1);
+	gtk_source_buffer_end_not_undoable_action (GTK_SOURCE_BUFFER (buffer));
+	gtk_text_buffer_set_modified (buffer, FALSE);
+
+	if (TEPL_IS_BUFFER (buffer))
+	{
+		_tepl_buffer_set_partial_content (TEPL_BUFFER (buffer), TRUE);
+	}
+
+	priv->window_first_line = data->first_line;
+	priv->window_n_lines = gtk_text_buffer_get_line_count (buffer);
+	priv->window_start_offset = data->window_start_offset;
+	priv->window_line_offset = data->line_offset != -1 ? data->line_offset : data->window_start_offset;
+	priv->window_end_offset = data->window_end_offset;
+	priv->window_last_line_offset = data->last_line_offset;
+	priv->window_reaches_end = data->reaches_end;
+	priv->window_ends_within_line = data->ends_within_line;
+
+	if (data->target_offset != -1)
+	{
+		/* In the first line of the buffer. The text is valid UTF-8, so
+		 * going back over the continuation bytes gives a character
+		 * start.
+		 */
+		const gchar *line_end = strchr (data->text, '\n');
+		goffset line_length = line_end != NULL ? line_end - data->text : (goffset) strlen (data->text);
+		goffset line_index = CLAMP (data->target_offset - data->window_start_offset, 0, line_length);
+
+		while (line_index > 0 && (data->text[line_index] & 0xC0) == 0x80)
+		{
+			line_index--;
+		}
+
+		gtk_text_buffer_get_start_iter (buffer, &iter);
+		gtk_text_iter_set_line_index (&iter, line_index);
+	}
+	else
+	{
+		target_line = CLAMP (data->target_line - data->first_line, 0, priv->window_n_lines - 1);
+		gtk_text_buffer_get_iter_at_line (buffer, &iter, target_line);
+	}
+
+	if (data->place_cursor)
+	{
+		gtk_text_buffer_place_cursor (buffer, &iter);
+		tepl_view_scroll_to_cursor (priv->view);
+		return;
+	}
+
+	if (priv->scroll_mark == NULL)
+	{
+		priv->scroll_mark = gtk_text_buffer_create_mark (buffer, NULL, &iter, TRUE);
+		g_object_ref (priv->scroll_mark);
+	}
+	else
+	{
+		gtk_text_buffer_move_mark (buffer, priv->scroll_mark, &iter);
+	}
+
+	gtk_text_view_scroll_to_mark (GTK_TEXT_VIEW (priv->view),
+				      priv->scroll_mark,
+				      0.0,
+				      TRUE,
+				      0.0,
+				      0.0);
+}
+
+static void
+read_window_cb (GObject      *source_object,
+		GAsyncResult *result,
+		gpointer      user_data)
+{
+	TeplFileViewer *viewer = TEPL_FILE_VIEWER (source_object);
+	GTask *open_task = user_data;
+	WindowData *data = g_task_get_task_data (G_TASK (result));
+	GError *error = NULL;
+
+	if (viewer->priv->window_cancellable == g_task_get_cancellable (G_TASK (result)))
+	{
+		g_clear_object (&viewer->priv->window_cancellable);
+	}
+
+	if (!g_task_propagate_boolean (G_TASK (result), &error))
+	{
+		if (open_task != NULL)
+		{
+			g_task_return_error (open_task, error);
+			g_object_unref (open_task);
+			return;
+		}
+
+		if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+		{
+			g_warning ("Error when reading a part of the file: %s", error->message);
+		}
+
+		g_clear_error (&error);
+		return;
+	}
+
+	if (data->found && viewer->priv->view != NULL)
+	{
+		show_window (viewer, data);
+	}
+
+	if (open_task != NULL)
+	{
+		g_task_return_boolean (open_task, TRUE);
+		g_object_unref (open_task);
+	}
+}
+
+static WindowData *
+window_data_new (TeplFileViewer *viewer,
+		 gint64          first_line,
+		 gint64          target_line,
+		 gboolean        place_cursor)
+{
+	WindowData *data;
+
+	data = g_new0 (WindowData, 1);
+	data->location = g_object_ref (viewer->priv->location);
+	data->line_offset = -1;
+	data->first_line = first_line;
+	data->target_line = target_line;
+	data->target_offset = -1;
+	data->place_cursor = place_cursor != FALSE;
+
+	return data;
+}
+
+/* @data: (transfer full).
+ * @open_task: (transfer full) (nullable): returned when the window is shown.
+ */
+static void
+read_window (TeplFileViewer *viewer,
+	     WindowData     *data,
+	     GTask          *open_task)
+{
+	TeplFileViewerPrivate *priv = viewer->priv;
+	GTask *task;
+
+	if (priv->window_cancellable != NULL)
+	{
+		g_cancellable_cancel (priv->window_cancellable);
+		g_object_unref (priv->window_cancellable);
+	}
+
+	priv->window_cancellable = g_cancellable_new ();
+
+	task = g_task_new (viewer, priv->window_cancellable, read_window_cb, open_task);
+	if (open_task != NULL)
+	{
+		g_task_set_priority (task, g_task_get_priority (open_task));
+	}
+	g_task_set_task_data (task, data, (GDestroyNotify)window_data_free);
+	g_task_run_in_thread (task, read_window_thread);
+	g_object_unref (task);
+}
+
+/* @open_task: (transfer full) (nullable): returned when the window is shown. */
+static void
+load_window (TeplFileViewer *viewer,
+	     gint64          first_line,
+	     gint64          target_line,
+	     gboolean        place_cursor,
+	     GTask          *open_task)
+{
+	WindowData *data;
+	gint64 indexed_line;
+
+	data = window_data_new (viewer, first_line, target_line, place_cursor);
+
+	line_index_lookup (viewer->priv->index, first_line, &indexed_line, &data->start_offset);
+	data->n_lines_to_skip = first_line - indexed_line;
+
+	read_window (viewer, data, open_task);
+}
+
+/* Reads a window starting at @start_offset, in the middle of @line which starts
+ * at @line_offset, and scrolls to @target_offset.
+ */
+static void
+load_window_within_line (TeplFileViewer *viewer,
+			 gint64          line,
+			 goffset         line_offset,
+			 goffset         start_offset,
+			 goffset         target_offset)
+{
+	WindowData *data;
+
+	data = window_data_new (viewer, line, line, FALSE);
+	data->start_offset = start_offset;
+	data->line_offset = line_offset;
+	data->target_offset = target_offset;
+
+	read_window (viewer, data, NULL);
+}
+
+/**
+ * tepl_file_viewer_open_async:
+ * @viewer: a #TeplFileViewer.
+ * @location: a #GFile.
+ * @io_priority: the I/O priority of the request. E.g. %G_PRIORITY_LOW,
+ *   %G_PRIORITY_DEFAULT or %G_PRIORITY_HIGH.
+ * @cancellable: (nullable): optional #GCancellable object, %NULL to ignore.
+ * @callback: (scope async): a #GAsyncReadyCallback to call when the request is
+ *   satisfied.
+ * @user_data: user data to pass to @callback.
+ *
+ * Opens @location in the #TeplView. The operation is finished when the first
+ * window of the file is shown; the index of the lines continues to be built
+ * in the background. The #TeplFile location of the #TeplBuffer is set to
+ * @location.
+ *
+ * If @cancellable is cancelled, the index building is cancelled too.
+ *
+ * See the #GAsyncResult documentation to know how to use this function.
+ *
+ * Since: 6.0
+ */
+void
+tepl_file_viewer_open_async (TeplFileViewer      *viewer,
+			     GFile               *location,
+			     gint                 io_priority,
+			     GCancellable        *cancellable,
+			     GAsyncReadyCallback  callback,
+			     gpointer             user_data)
+{
+	TeplFileViewerPrivate *priv;
+	GtkTextBuffer *buffer;
+	GTask *task;
+
+	g_return_if_fail (TEPL_IS_FILE_VIEWER (viewer));
+	g_return_if_fail (G_IS_FILE (location));
+	g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+
+	priv = viewer->priv;
+
+	task = g_task_new (viewer, cancellable, callback, user_data);
+	g_task_set_priority (task, io_priority);
+
+	if (priv->view == NULL)
+	{
+		g_task_return_boolean (task, FALSE);
+		g_object_unref (task);
+		return;
+	}
+
+	cancel_operations (viewer);
+	g_set_object (&priv->location, location);
+	g_clear_pointer (&priv->index, line_index_unref);
+	priv->index = line_index_new ();
+	priv->index_complete = FALSE;
+	priv->window_first_line = 0;
+	priv->window_n_lines = 0;
+	priv->window_start_offset = 0;
+	priv->window_line_offset = 0;
+	priv->window_end_offset = 0;
+	priv->window_last_line_offset = 0;
+	priv->window_reaches_end = FALSE;
+	priv->window_ends_within_line = FALSE;
+
+	buffer = gtk_text_view_get_buffer (GTK_TEXT_VIEW (priv->view));
+	if (TEPL_IS_BUFFER (buffer))
+	{
+		TeplFile *file = tepl_buffer_get_file (TEPL_BUFFER (buffer));
+		tepl_file_set_location (file, location);
+	}
+
+	priv->index_cancellable = g_cancellable_new ();
+	build_index (viewer, io_priority);
+
+	load_window (viewer, 0, 0, TRUE, task);
+
+	if (cancellable != NULL)
+	{
+		g_signal_connect_object (cancellable,
+					 "cancelled",
+					 G_CALLBACK (g_cancellable_cancel),
+					 priv->index_cancellable,
+					 G_CONNECT_SWAPPED);
+
+		g_signal_connect_object (cancellable,
+					 "cancelled",
+					 G_CALLBACK (g_cancellable_cancel),
+					 priv->window_cancellable,
+					 G_CONNECT_SWAPPED);
+
+		if (g_cancellable_is_cancelled (cancellable))
+		{
+			cancel_operations (viewer);
+		}
+	}
+}
+
+/**
+ * tepl_file_viewer_open_finish:
+ * @viewer: a #TeplFileViewer.
+ * @result: a #GAsyncResult.
+ * @error: a #GError, or %NULL.
+ *
+ * Finishes an operation started with tepl_file_viewer_open_async().
+ *
+ * Returns: whether the file has been opened successfully.
+ * Since: 6.0
+ */
+gboolean
+tepl_file_viewer_open_finish (TeplFileViewer  *viewer,
+			      GAsyncResult    *result,
+			      GError         **error)
+{
+	g_return_val_if_fail (TEPL_IS_FILE_VIEWER (viewer), FALSE);
+	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+	g_return_val_if_fail (g_task_is_valid (result, viewer), FALSE);
+
+	return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+/**
+ * tepl_file_viewer_get_window_first_line:
+ * @viewer: a #TeplFileViewer.
+ *
+ * Gets the line of the file shown at the start of the buffer. The line number
+ * of the file is that value plus the buffer line number. If the buffer starts
+ * in the middle of a line longer than the window, it is that line.
+ *
+ * Returns: the first line of the window, counting from 0.
+ * Since: 6.0
+ */
+gint64
+tepl_file_viewer_get_window_first_line (TeplFileViewer *viewer)
+{
+	g_return_val_if_fail (TEPL_IS_FILE_VIEWER (viewer), 0);
+
+	return viewer->priv->window_first_line;
+}
+
+/**
+ * tepl_file_viewer_get_n_indexed_lines:
+ * @viewer: a #TeplFileViewer.
+ *
+ * Gets the number of lines found so far by the background indexing. When
+ * tepl_file_viewer_is_index_complete() returns %TRUE, it is the number of lines
+ * of the file.
+ *
+ * Returns: the number of indexed lines.
+ * Since: 6.0
+ */
+gint64
+tepl_file_viewer_get_n_indexed_lines (TeplFileViewer *viewer)
+{
+	g_return_val_if_fail (TEPL_IS_FILE_VIEWER (viewer), 0);
+
+	if (viewer->priv->index == NULL)
+	{
+		return 0;
+	}
+
+	return line_index_get_n_lines (viewer->priv->index);
+}
+
+/**
+ * tepl_file_viewer_is_index_complete:
+ * @viewer: a #TeplFileViewer.
+ *
+ * Returns: whether the index of the lines has been built for the whole file.
+ * Since: 6.0
+ */
+gboolean
+tepl_file_viewer_is_index_complete (TeplFileViewer *viewer)
+{
+	g_return_val_if_fail (TEPL_IS_FILE_VIEWER (viewer), FALSE);
+
+	return viewer->priv->index_complete;
+}
+
+/**
+ * tepl_file_viewer_goto_line:
+ * @viewer: a #TeplFileViewer.
+ * @line: a line number of the file, counting from 0.
+ *
+ * Places the cursor at the start of @line, and scrolls to that position. If
+ * @line is not in the current window, another window is read asynchronously,
+ * and the cursor is placed when it is shown.
+ *
+ * tepl_view_goto_line() calls this function for the #TeplView of a
+ * #TeplFileViewer.
+ *
+ * Returns: %FALSE if it is known that @line doesn't exist, %TRUE otherwise.
+ * Since: 6.0
+ */
+gboolean
+tepl_file_viewer_goto_line (TeplFileViewer *viewer,
+			    gint64          line)
+{
+	TeplFileViewerPrivate *priv;
+	gboolean line_exists = TRUE;
+
+	g_return_val_if_fail (TEPL_IS_FILE_VIEWER (viewer), FALSE);
+
+	priv = viewer->priv;
+
+	if (priv->view == NULL || priv->location == NULL)
+	{
+		return FALSE;
+	}
+
+	if (line < 0)
+	{
+		line = 0;
+		line_exists = FALSE;
+	}
+
+	if (priv->index_complete)
+	{
+		gint64 n_lines = line_index_get_n_lines (priv->index);
+
+		if (line >= n_lines)
+		{
+			line = n_lines - 1;
+			line_exists = FALSE;
+		}
+	}
+
+	/* The start of the first line is not in the window if the window
+	 * starts in the middle of it.
+	 */
+	if (priv->window_cancellable == NULL &&
+	    (line > priv->window_first_line ||
+	     (line == priv->window_first_line &&
+	      priv->window_start_offset == priv->window_line_offset)) &&
+	    line < priv->window_first_line + priv->window_n_lines)
+	{
+		GtkTextBuffer *buffer;
+		GtkTextIter iter;
+
+		buffer = gtk_text_view_get_buffer (GTK_TEXT_VIEW (priv->view));
+		gtk_text_buffer_get_iter_at_line (buffer, &iter, line - priv->window_first_line);
+		gtk_text_buffer_place_cursor (buffer, &iter);
+		tepl_view_scroll_to_cursor (priv->view);
+	}
+	else
+	{
+		load_window (viewer, MAX (0, line - WINDOW_N_LINES / 2), line, TRUE, NULL);
+	}
+
+	return line_exists;
+}
+
+TeplFileViewer *
+_tepl_file_viewer_get_for_view (TeplView *view)
+{
+	g_return_val_if_fail (TEPL_IS_VIEW (view), NULL);
+
+	return g_object_get_data (G_OBJECT (view), VIEW_DATA_KEY);
+}
@@ -0,0 +1,90 @@
+/* SPDX-FileCopyrightText: 2020 - Sébastien Wilmet <swilmet@gnome.org>
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef TEPL_FILE_VIEWER_H
+#define TEPL_FILE_VIEWER_H
+
+#if !defined (TEPL_H_INSIDE) && !defined (TEPL_COMPILATION)
+#error "Only <tepl/tepl.h> can be included directly."
+#endif
+
+#include <gio/gio.h>
+#include <tepl/tepl-view.h>
+
+G_BEGIN_DECLS
+
+#define TEPL_TYPE_FILE_VIEWER             (tepl_file_viewer_get_type ())
+#define TEPL_FILE_VIEWER(obj)             (G_TYPE_CHECK_INSTANCE_CAST ((obj), TEPL_TYPE_FILE_VIEWER, TeplFileViewer))
+#define TEPL_FILE_VIEWER_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST ((klass), TEPL_TYPE_FILE_VIEWER, TeplFileViewerClass))
+#define TEPL_IS_FILE_VIEWER(obj)          (G_TYPE_CHECK_INSTANCE_TYPE ((obj), TEPL_TYPE_FILE_VIEWER))
+#define TEPL_IS_FILE_VIEWER_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE ((klass), TEPL_TYPE_FILE_VIEWER))
+#define TEPL_FILE_VIEWER_GET_CLASS(obj)   (G_TYPE_INSTANCE_GET_CLASS ((obj), TEPL_TYPE_FILE_VIEWER, TeplFileViewerClass))
+
+typedef struct _TeplFileViewer         TeplFileViewer;
+typedef struct _TeplFileViewerClass    TeplFileViewerClass;
+typedef struct _TeplFileViewerPrivate  TeplFileViewerPrivate;
+
+struct _TeplFileViewer
+{
+	GObject parent;
+
+	TeplFileViewerPrivate *priv;
+};
+
+struct _TeplFileViewerClass
+{
+	GObjectClass parent_class;
+
+	gpointer padding[12];
+};
+
+_TEPL_EXTERN
+GType			tepl_file_viewer_get_type		(void);
+
+_TEPL_EXTERN
+TeplFileViewer *	tepl_file_viewer_new			(TeplView *view);
+
+_TEPL_EXTERN
+TeplView *		tepl_file_viewer_get_view		(TeplFileViewer *viewer);
+
+_TEPL_EXTERN
+GFile *			tepl_file_viewer_get_location		(TeplFileViewer *viewer);
+
+_TEPL_EXTERN
+void			tepl_file_viewer_open_async		(TeplFileViewer      *viewer,
+								 GFile               *location,
+								 gint                 io_priority,
+								 GCancellable        *cancellable,
+								 GAsyncReadyCallback  callback,
+								 gpointer             user_data);
+
+_TEPL_EXTERN
+gboolean		tepl_file_viewer_open_finish		(TeplFileViewer  *viewer,
+								 GAsyncResult    *result,
+								 GError         **error);
+
+_TEPL_EXTERN
+gint64			tepl_file_viewer_get_window_first_line	(TeplFileViewer *viewer);
+
+_TEPL_EXTERN
+gint64			tepl_file_viewer_get_n_indexed_lines	(TeplFileViewer *viewer);
+
+_TEPL_EXTERN
+gboolean		tepl_file_viewer_is_index_complete	(TeplFileViewer *viewer);
+
+_TEPL_EXTERN
+gboolean		tepl_file_viewer_goto_line		(TeplFileViewer *viewer,
+								 gint64          line);
+
+G_GNUC_INTERNAL
+TeplFileViewer *	_tepl_file_viewer_get_for_view		(TeplView *view);
+
+G_GNUC_INTERNAL
+gboolean		_tepl_file_viewer_update_window		(TeplFileViewer    *viewer,
+								 const GtkTextIter *top,
+								 const GtkTextIter *bottom);
+
+G_END_DECLS
+
+#endif /* TEPL_FILE_VIEWER_H */
@@ -35,6 +35,7 @@ struct _TeplFilePrivate
 {
 	GFile *location;
 	TeplNewlineType newline_type;
+	gchar *charset;
 
 	/* For the short-name. */
 	gint untitled_number;
@@ -55,6 +56,7 @@ enum
 	PROP_0,
 	PROP_LOCATION,
 	PROP_NEWLINE_TYPE,
+	PROP_CHARSET,
 	PROP_SHORT_NAME,
 	N_PROPERTIES
 };
@@ -134,6 +136,10 @@ tepl_file_get_property (GObject    *object,
 			g_value_set_enum (value, tepl_file_get_newline_type (file));
 			break;
 
+		case PROP_CHARSET:
+			g_value_set_string (value, tepl_file_get_charset (file));
+			break;
+
 		case PROP_SHORT_NAME:
 			g_value_take_string (value, tepl_file_get_short_name (file));
 			break;
@@ -190,6 +196,7 @@ tepl_file_finalize (GObject *object)
 		release_untitled_number (file->priv->untitled_number);
 	}
 
+	g_free (file->priv->charset);
 	g_free (file->priv->display_name);
 	g_free (file->priv->etag);
 
@@ -238,6 +245,22 @@ tepl_file_class_init (TeplFileClass *klass)
 				   G_PARAM_READABLE |
 				   G_PARAM_STATIC_STRINGS);
 
+	/**
+	 * TeplFile:charset:
+	 *
+	 * The character encoding, as an ICU converter name, for example
+	 * "UTF-8" or "ISO-8859-15". It is updated by #TeplFileLoader.
+	 *
+	 * Since: 6.0
+	 */
+	properties[PROP_CHARSET] =
+		g_param_spec_string ("charset",
+				     "charset",
+				     "",
+				     "UTF-8",
+				     G_PARAM_READABLE |
+				     G_PARAM_STATIC_STRINGS);
+
 	/**
 	 * TeplFile:short-name:
 	 *
@@ -367,6 +390,7 @@ tepl_file_init (TeplFile *file)
 	file->priv = tepl_file_get_instance_private (file);
 
 	file->priv->newline_type = TEPL_NEWLINE_TYPE_DEFAULT;
+	file->priv->charset = g_strdup ("UTF-8");
 	update_short_name (file);
 }
 
@@ -481,6 +505,36 @@ tepl_file_get_newline_type (TeplFile *file)
 	return file->priv->newline_type;
 }
 
+void
+_tepl_file_set_charset (TeplFile    *file,
+			const gchar *charset)
+{
+	g_return_if_fail (TEPL_IS_FILE (file));
+	g_return_if_fail (charset != NULL);
+
+	if (g_strcmp0 (file->priv->charset, charset) != 0)
+	{
+		g_free (file->priv->charset);
+		file->priv->charset = g_strdup (charset);
+		g_object_notify_by_pspec (G_OBJECT (file), properties[PROP_CHARSET]);
+	}
+}
+
+/**
+ * tepl_file_get_charset:
+ * @file: a #TeplFile.
+ *
+ * Returns: the value of the #TeplFile:charset property.
+ * Since: 6.0
+ */
+const gchar *
+tepl_file_get_charset (TeplFile *file)
+{
+	g_return_val_if_fail (TEPL_IS_FILE (file), NULL);
+
+	return file->priv->charset;
+}
+
 /**
  * tepl_file_set_mount_operation_factory:
  * @file: a #TeplFile.
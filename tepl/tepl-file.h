@@ -100,6 +100,9 @@ gchar *			tepl_file_get_short_name		(TeplFile *file);
 _TEPL_EXTERN
 TeplNewlineType		tepl_file_get_newline_type		(TeplFile *file);
 
+_TEPL_EXTERN
+const gchar *		tepl_file_get_charset			(TeplFile *file);
+
 _TEPL_EXTERN
 void		 	tepl_file_set_mount_operation_factory	(TeplFile                  *file,
 								 TeplMountOperationFactory  callback,
@@ -113,6 +116,10 @@ G_GNUC_INTERNAL
 void			_tepl_file_set_newline_type		(TeplFile        *file,
 								 TeplNewlineType  newline_type);
 
+G_GNUC_INTERNAL
+void			_tepl_file_set_charset			(TeplFile    *file,
+								 const gchar *charset);
+
 G_GNUC_INTERNAL
 GMountOperation *	_tepl_file_create_mount_operation	(TeplFile *file);
 
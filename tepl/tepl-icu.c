@@ -150,6 +150,50 @@ _tepl_icu_strdup (const UChar *uchars)
 	return u_strncpy (copy, uchars, length + 1);
 }
 
+/* Like ucnv_open(), but the converter stops on invalid input or on characters
+ * that cannot be mapped, instead of substituting them. The conversion functions
+ * then report the error with @pErrorCode, for example with
+ * %U_ILLEGAL_CHAR_FOUND.
+ *
+ * Returns: (nullable): the new converter. Free with ucnv_close() when no
+ * longer needed.
+ */
+UConverter *
+_tepl_icu_ucnv_open_strict (const char *converter_name,
+			    UErrorCode *pErrorCode)
+{
+	UConverter *converter;
+
+	converter = ucnv_open (converter_name, pErrorCode);
+	if (U_FAILURE (*pErrorCode))
+	{
+		if (converter != NULL)
+		{
+			ucnv_close (converter);
+		}
+
+		return NULL;
+	}
+
+	ucnv_setToUCallBack (converter,
+			     UCNV_TO_U_CALLBACK_STOP, NULL,
+			     NULL, NULL,
+			     pErrorCode);
+
+	ucnv_setFromUCallBack (converter,
+			       UCNV_FROM_U_CALLBACK_STOP, NULL,
+			       NULL, NULL,
+			       pErrorCode);
+
+	if (U_FAILURE (*pErrorCode))
+	{
+		ucnv_close (converter);
+		return NULL;
+	}
+
+	return converter;
+}
+
 /* A wrapper around utrans_openU(). */
 UTransliterator *
 _tepl_icu_trans_openUSimple (const char *utf8_id)
@@ -6,6 +6,7 @@
 #define TEPL_ICU_H
 
 #include <glib.h>
+#include <unicode/ucnv.h>
 #include <unicode/ustring.h>
 #include <unicode/utrans.h>
 
@@ -32,6 +33,10 @@ char *			_tepl_icu_strToUTF8Simple		(const UChar *uchars);
 G_GNUC_INTERNAL
 UChar *			_tepl_icu_strdup			(const UChar *uchars);
 
+G_GNUC_INTERNAL
+UConverter *		_tepl_icu_ucnv_open_strict		(const char *converter_name,
+								 UErrorCode *pErrorCode);
+
 G_GNUC_INTERNAL
 UTransliterator *	_tepl_icu_trans_openUSimple		(const char *utf8_id);
 
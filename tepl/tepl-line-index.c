@@ -0,0 +1,850 @@
+/* SPDX-FileCopyrightText: 2020 - Sébastien Wilmet <swilmet@gnome.org>
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "tepl-line-index.h"
+#include <string.h>
+
+/* The lengths of the lines of a TeplBuffer, in characters and in bytes, to
+ * convert between line numbers, character offsets and byte offsets in
+ * O(log n).
+ *
+ * GtkTextBuffer knows the number of characters of its nodes, but not the
+ * number of bytes, so a byte offset needs to walk through all the lines
+ * before it.
+ *
+ * The lines are stored in a B+tree: the leaves contain the lengths of up to
+ * LEAF_MAX_LINES consecutive lines, and each node has the totals of its
+ * subtree. The tree is updated from the insertions and deletions, the text is
+ * not read again.
+ *
+ * The lines are cut like in GtkTextBuffer: the text inserted is split at each
+ * line terminator ("\n", "\r", "\r\n" or U+2029, see
+ * pango_find_paragraph_boundary()), and a deletion joins the lines of its
+ * start and its end. So a "\r" and a "\n" can be on two different lines if
+ * they have been inserted separately.
+ */
+
+#define LEAF_MAX_LINES (64)
+#define NODE_MAX_CHILDREN (32)
+
+/* U+2029 PARAGRAPH SEPARATOR */
+#define PARAGRAPH_SEPARATOR "\xE2\x80\xA9"
+
+typedef enum
+{
+	KEY_LINES,
+	KEY_CHARS,
+	KEY_BYTES
+} Key;
+
+typedef struct _Node Node;
+struct _Node
+{
+	/* The totals of the subtree. */
+	gint n_lines;
+	gint n_chars;
+	gint64 n_bytes;
+
+	/* The number of lines for a leaf, of children otherwise. */
+	guint n_items;
+	guint is_leaf : 1;
+
+	union
+	{
+		struct
+		{
+			gint n_chars[LEAF_MAX_LINES];
+			gint n_bytes[LEAF_MAX_LINES];
+		} lines;
+
+		Node *children[NODE_MAX_CHILDREN];
+	} u;
+};
+
+struct _TeplLineIndex
+{
+	Node *root;
+};
+
+static Node *
+node_new (gboolean is_leaf)
+{
+	Node *node;
+
+	node = g_new0 (Node, 1);
+	node->is_leaf = is_leaf != FALSE;
+
+	return node;
+}
+
+static void
+node_free (Node *node)
+{
+	if (!node->is_leaf)
+	{
+		guint i;
+
+		for (i = 0; i < node->n_items; i++)
+		{
+			node_free (node->u.children[i]);
+		}
+	}
+
+	g_free (node);
+}
+
+static guint
+node_get_max_items (Node *node)
+{
+	return node->is_leaf ? LEAF_MAX_LINES : NODE_MAX_CHILDREN;
+}
+
+static void
+node_update_totals (Node *node)
+{
+	guint i;
+
+	node->n_lines = 0;
+	node->n_chars = 0;
+	node->n_bytes = 0;
+
+	if (node->is_leaf)
+	{
+		node->n_lines = node->n_items;
+
+		for (i = 0; i < node->n_items; i++)
+		{
+			node->n_chars += node->u.lines.n_chars[i];
+			node->n_bytes += node->u.lines.n_bytes[i];
+		}
+
+		return;
+	}
+
+	for (i = 0; i < node->n_items; i++)
+	{
+		Node *child = node->u.children[i];
+
+		node->n_lines += child->n_lines;
+		node->n_chars += child->n_chars;
+		node->n_bytes += child->n_bytes;
+	}
+}
+
+static gint64
+node_get_key (Node *node,
+	      Key   key)
+{
+	switch (key)
+	{
+		case KEY_LINES:
+			return node->n_lines;
+		case KEY_CHARS:
+			return node->n_chars;
+		case KEY_BYTES:
+			return node->n_bytes;
+		default:
+			g_assert_not_reached ();
+	}
+
+	return 0;
+}
+
+static gint64
+leaf_get_line_key (Node  *leaf,
+		   guint  pos,
+		   Key    key)
+{
+	switch (key)
+	{
+		case KEY_LINES:
+			return 1;
+		case KEY_CHARS:
+			return leaf->u.lines.n_chars[pos];
+		case KEY_BYTES:
+			return leaf->u.lines.n_bytes[pos];
+		default:
+			g_assert_not_reached ();
+	}
+
+	return 0;
+}
+
+/* Finds the line containing @value (a line number, or an offset in
+ * characters or bytes). An offset at the start of a line belongs to that
+ * line, and an offset after the end belongs to the last line.
+ */
+static void
+find_line (TeplLineIndex *index,
+	   Key            key,
+	   gint64         value,
+	   TeplLineInfo  *info)
+{
+	Node *node = index->root;
+	guint i;
+
+	info->line = 0;
+	info->char_offset = 0;
+	info->byte_offset = 0;
+
+	while (!node->is_leaf)
+	{
+		for (i = 0; i + 1 < node->n_items; i++)
+		{
+			Node *child = node->u.children[i];
+
+			if (value < node_get_key (child, key))
+			{
+				break;
+			}
+
+			value -= node_get_key (child, key);
+			info->line += child->n_lines;
+			info->char_offset += child->n_chars;
+			info->byte_offset += child->n_bytes;
+		}
+
+		node = node->u.children[i];
+	}
+
+	for (i = 0; i + 1 < node->n_items; i++)
+	{
+		if (value < leaf_get_line_key (node, i, key))
+		{
+			break;
+		}
+
+		value -= leaf_get_line_key (node, i, key);
+		info->line++;
+		info->char_offset += node->u.lines.n_chars[i];
+		info->byte_offset += node->u.lines.n_bytes[i];
+	}
+
+	info->n_chars = node->u.lines.n_chars[i];
+	info->n_bytes = node->u.lines.n_bytes[i];
+}
+
+static void
+node_add_to_line (Node *node,
+		  gint  line,
+		  gint  n_chars,
+		  gint  n_bytes)
+{
+	while (TRUE)
+	{
+		guint i;
+
+		node->n_chars += n_chars;
+		node->n_bytes += n_bytes;
+
+		if (node->is_leaf)
+		{
+			node->u.lines.n_chars[line] += n_chars;
+			node->u.lines.n_bytes[line] += n_bytes;
+			return;
+		}
+
+		for (i = 0; i + 1 < node->n_items; i++)
+		{
+			Node *child = node->u.children[i];
+
+			if (line < child->n_lines)
+			{
+				break;
+			}
+
+			line -= child->n_lines;
+		}
+
+		node = node->u.children[i];
+	}
+}
+
+/* Moves the items from @pos to the end of @node to a new node, and returns
+ * it.
+ */
+static Node *
+node_split (Node  *node,
+	    guint  pos)
+{
+	Node *right;
+	guint n_moved = node->n_items - pos;
+
+	right = node_new (node->is_leaf);
+
+	if (node->is_leaf)
+	{
+		memcpy (right->u.lines.n_chars, node->u.lines.n_chars + pos, n_moved * sizeof (gint));
+		memcpy (right->u.lines.n_bytes, node->u.lines.n_bytes + pos, n_moved * sizeof (gint));
+	}
+	else
+	{
+		memcpy (right->u.children, node->u.children + pos, n_moved * sizeof (Node *));
+	}
+
+	right->n_items = n_moved;
+	node->n_items = pos;
+
+	node_update_totals (node);
+	node_update_totals (right);
+
+	return right;
+}
+
+static void
+leaf_insert_line (Node  *leaf,
+		  guint  pos,
+		  gint   n_chars,
+		  gint   n_bytes)
+{
+	guint n_moved = leaf->n_items - pos;
+
+	memmove (leaf->u.lines.n_chars + pos + 1, leaf->u.lines.n_chars + pos, n_moved * sizeof (gint));
+	memmove (leaf->u.lines.n_bytes + pos + 1, leaf->u.lines.n_bytes + pos, n_moved * sizeof (gint));
+
+	leaf->u.lines.n_chars[pos] = n_chars;
+	leaf->u.lines.n_bytes[pos] = n_bytes;
+	leaf->n_items++;
+
+	leaf->n_lines++;
+	leaf->n_chars += n_chars;
+	leaf->n_bytes += n_bytes;
+}
+
+static void
+node_insert_child (Node  *node,
+		   guint  pos,
+		   Node  *child)
+{
+	memmove (node->u.children + pos + 1,
+		 node->u.children + pos,
+		 (node->n_items - pos) * sizeof (Node *));
+
+	node->u.children[pos] = child;
+	node->n_items++;
+}
+
+/* Splits a full @node before inserting an item at @pos. When inserting at the
+ * end, which is the common case when a file is loaded, the new node starts
+ * empty so that the nodes are filled completely.
+ *
+ * Returns: the new right node. @pos is updated to be the position in the node
+ * where to insert.
+ */
+static Node *
+split_full_node (Node   *node,
+		 guint  *pos,
+		 Node  **insert_node)
+{
+	Node *right;
+	guint split_pos;
+
+	split_pos = *pos == node->n_items ? node->n_items : node->n_items / 2;
+	right = node_split (node, split_pos);
+
+	if (*pos >= split_pos)
+	{
+		*pos -= split_pos;
+		*insert_node = right;
+	}
+	else
+	{
+		*insert_node = node;
+	}
+
+	return right;
+}
+
+/* Inserts a line before @line. Returns the new right sibling of @node if
+ * @node has been split, %NULL otherwise.
+ */
+static Node *
+node_insert_line (Node *node,
+		  gint  line,
+		  gint  n_chars,
+		  gint  n_bytes)
+{
+	Node *new_child;
+	Node *right = NULL;
+	Node *insert_node = node;
+	guint pos;
+	guint i;
+
+	if (node->is_leaf)
+	{
+		pos = line;
+
+		if (node->n_items == LEAF_MAX_LINES)
+		{
+			right = split_full_node (node, &pos, &insert_node);
+		}
+
+		leaf_insert_line (insert_node, pos, n_chars, n_bytes);
+		return right;
+	}
+
+	for (i = 0; i + 1 < node->n_items; i++)
+	{
+		Node *child = node->u.children[i];
+
+		if (line < child->n_lines)
+		{
+			break;
+		}
+
+		line -= child->n_lines;
+	}
+
+	new_child = node_insert_line (node->u.children[i], line, n_chars, n_bytes);
+
+	node->n_lines++;
+	node->n_chars += n_chars;
+	node->n_bytes += n_bytes;
+
+	if (new_child == NULL)
+	{
+		return NULL;
+	}
+
+	pos = i + 1;
+
+	if (node->n_items == NODE_MAX_CHILDREN)
+	{
+		right = split_full_node (node, &pos, &insert_node);
+	}
+
+	node_insert_child (insert_node, pos, new_child);
+
+	if (right != NULL)
+	{
+		node_update_totals (node);
+		node_update_totals (right);
+	}
+
+	return right;
+}
+
+static void
+insert_line (TeplLineIndex *index,
+	     gint           line,
+	     gint           n_chars,
+	     gint           n_bytes)
+{
+	Node *right;
+
+	right = node_insert_line (index->root, line, n_chars, n_bytes);
+
+	if (right != NULL)
+	{
+		Node *new_root;
+
+		new_root = node_new (FALSE);
+		new_root->u.children[0] = index->root;
+		new_root->u.children[1] = right;
+		new_root->n_items = 2;
+		node_update_totals (new_root);
+
+		index->root = new_root;
+	}
+}
+
+/* Appends the items of the node at @pos + 1 to the node at @pos. */
+static void
+merge_children (Node  *node,
+		guint  pos)
+{
+	Node *left = node->u.children[pos];
+	Node *right = node->u.children[pos + 1];
+
+	if (left->is_leaf)
+	{
+		memcpy (left->u.lines.n_chars + left->n_items,
+			right->u.lines.n_chars,
+			right->n_items * sizeof (gint));
+		memcpy (left->u.lines.n_bytes + left->n_items,
+			right->u.lines.n_bytes,
+			right->n_items * sizeof (gint));
+	}
+	else
+	{
+		memcpy (left->u.children + left->n_items,
+			right->u.children,
+			right->n_items * sizeof (Node *));
+	}
+
+	left->n_items += right->n_items;
+	node_update_totals (left);
+
+	/* The children of @right now belong to @left. */
+	right->n_items = 0;
+	node_free (right);
+
+	memmove (node->u.children + pos + 1,
+		 node->u.children + pos + 2,
+		 (node->n_items - pos - 2) * sizeof (Node *));
+	node->n_items--;
+}
+
+/* Deletes @n_lines lines starting at @line. Not all the lines of @node. */
+static void
+node_delete_lines (Node *node,
+		   gint  line,
+		   gint  n_lines)
+{
+	gint child_start = 0;
+	guint n_kept = 0;
+	guint i;
+
+	if (node->is_leaf)
+	{
+		guint n_moved = node->n_items - line - n_lines;
+
+		memmove (node->u.lines.n_chars + line,
+			 node->u.lines.n_chars + line + n_lines,
+			 n_moved * sizeof (gint));
+		memmove (node->u.lines.n_bytes + line,
+			 node->u.lines.n_bytes + line + n_lines,
+			 n_moved * sizeof (gint));
+
+		node->n_items -= n_lines;
+		node_update_totals (node);
+		return;
+	}
+
+	for (i = 0; i < node->n_items; i++)
+	{
+		Node *child = node->u.children[i];
+		gint child_end = child_start + child->n_lines;
+		gint start = MAX (line, child_start);
+		gint end = MIN (line + n_lines, child_end);
+
+		if (start <= child_start && child_end <= end)
+		{
+			node_free (child);
+		}
+		else
+		{
+			if (start < end)
+			{
+				node_delete_lines (child, start - child_start, end - start);
+			}
+
+			node->u.children[n_kept++] = child;
+		}
+
+		child_start = child_end;
+	}
+
+	node->n_items = n_kept;
+
+	/* Keeps the nodes around the deletion reasonably filled. */
+	i = 0;
+	while (i + 1 < node->n_items)
+	{
+		Node *left = node->u.children[i];
+		Node *right = node->u.children[i + 1];
+
+		if (left->n_items + right->n_items <= node_get_max_items (left))
+		{
+			merge_children (node, i);
+		}
+		else
+		{
+			i++;
+		}
+	}
+
+	node_update_totals (node);
+}
+
+static void
+delete_lines (TeplLineIndex *index,
+	      gint           line,
+	      gint           n_lines)
+{
+	if (n_lines <= 0)
+	{
+		return;
+	}
+
+	node_delete_lines (index->root, line, n_lines);
+
+	while (!index->root->is_leaf &&
+	       index->root->n_items == 1)
+	{
+		Node *old_root = index->root;
+
+		index->root = old_root->u.children[0];
+		old_root->n_items = 0;
+		node_free (old_root);
+	}
+}
+
+TeplLineIndex *
+_tepl_line_index_new (void)
+{
+	TeplLineIndex *index;
+
+	index = g_new0 (TeplLineIndex, 1);
+
+	/* An empty buffer has one empty line. */
+	index->root = node_new (TRUE);
+	leaf_insert_line (index->root, 0, 0, 0);
+
+	return index;
+}
+
+void
+_tepl_line_index_free (TeplLineIndex *index)
+{
+	if (index != NULL)
+	{
+		node_free (index->root);
+		g_free (index);
+	}
+}
+
+gint
+_tepl_line_index_get_n_lines (TeplLineIndex *index)
+{
+	g_return_val_if_fail (index != NULL, 0);
+	return index->root->n_lines;
+}
+
+gint
+_tepl_line_index_get_n_chars (TeplLineIndex *index)
+{
+	g_return_val_if_fail (index != NULL, 0);
+	return index->root->n_chars;
+}
+
+gint64
+_tepl_line_index_get_n_bytes (TeplLineIndex *index)
+{
+	g_return_val_if_fail (index != NULL, 0);
+	return index->root->n_bytes;
+}
+
+/* Returns: the end of the line terminator starting at @pos, or %NULL if there
+ * is no line terminator at @pos.
+ */
+static const gchar *
+get_line_terminator_end (const gchar *pos,
+			 const gchar *end)
+{
+	if (*pos == '\n')
+	{
+		return pos + 1;
+	}
+
+	if (*pos == '\r')
+	{
+		if (pos + 1 < end && pos[1] == '\n')
+		{
+			return pos + 2;
+		}
+
+		return pos + 1;
+	}
+
+	if (*pos == PARAGRAPH_SEPARATOR[0] &&
+	    end - pos >= 3 &&
+	    memcmp (pos, PARAGRAPH_SEPARATOR, 3) == 0)
+	{
+		return pos + 3;
+	}
+
+	return NULL;
+}
+
+/*
+ * _tepl_line_index_insert:
+ * @index: a #TeplLineIndex.
+ * @line: the line where @text is inserted.
+ * @line_offset: the position in @line, in characters.
+ * @line_index: the position in @line, in bytes.
+ * @text: the text inserted, in UTF-8.
+ * @length: the length of @text, in bytes.
+ */
+void
+_tepl_line_index_insert (TeplLineIndex *index,
+			 gint           line,
+			 gint           line_offset,
+			 gint           line_index,
+			 const gchar   *text,
+			 gsize          length)
+{
+	TeplLineInfo info;
+	const gchar *pos = text;
+	const gchar *end = text + length;
+	const gchar *line_start = text;
+	gint n_chars = 0;
+	gint cur_line = line;
+
+	g_return_if_fail (index != NULL);
+	g_return_if_fail (0 <= line && line < index->root->n_lines);
+	g_return_if_fail (text != NULL || length == 0);
+
+	/* The end of @line, moved to the last line inserted. */
+	_tepl_line_index_get_line_info (index, line, &info);
+	g_return_if_fail (line_offset <= info.n_chars);
+	g_return_if_fail (line_index <= info.n_bytes);
+
+	while (pos < end)
+	{
+		const gchar *terminator_end;
+
+		terminator_end = get_line_terminator_end (pos, end);
+
+		if (terminator_end == NULL)
+		{
+			if ((*pos & 0xC0) != 0x80)
+			{
+				n_chars++;
+			}
+
+			pos++;
+			continue;
+		}
+
+		/* "\r\n" is two characters. */
+		n_chars += terminator_end - pos == 2 ? 2 : 1;
+
+		if (cur_line == line)
+		{
+			node_add_to_line (index->root,
+					  line,
+					  line_offset + n_chars - info.n_chars,
+					  line_index + (terminator_end - line_start) - info.n_bytes);
+		}
+		else
+		{
+			insert_line (index, cur_line, n_chars, terminator_end - line_start);
+		}
+
+		cur_line++;
+		pos = terminator_end;
+		line_start = pos;
+		n_chars = 0;
+	}
+
+	if (cur_line == line)
+	{
+		node_add_to_line (index->root, line, n_chars, end - line_start);
+	}
+	else
+	{
+		insert_line (index,
+			     cur_line,
+			     n_chars + info.n_chars - line_offset,
+			     (end - line_start) + info.n_bytes - line_index);
+	}
+}
+
+/*
+ * _tepl_line_index_delete:
+ * @index: a #TeplLineIndex.
+ * @start_line: the line of the start of the deleted text.
+ * @start_line_offset: the position in @start_line, in characters.
+ * @start_line_index: the position in @start_line, in bytes.
+ * @end_line: the line of the end of the deleted text.
+ * @end_line_offset: the position in @end_line, in characters.
+ * @end_line_index: the position in @end_line, in bytes.
+ *
+ * The start must be before the end.
+ */
+void
+_tepl_line_index_delete (TeplLineIndex *index,
+			 gint           start_line,
+			 gint           start_line_offset,
+			 gint           start_line_index,
+			 gint           end_line,
+			 gint           end_line_offset,
+			 gint           end_line_index)
+{
+	TeplLineInfo start_info;
+	TeplLineInfo end_info;
+
+	g_return_if_fail (index != NULL);
+	g_return_if_fail (0 <= start_line && start_line <= end_line);
+	g_return_if_fail (end_line < index->root->n_lines);
+
+	if (start_line == end_line)
+	{
+		g_return_if_fail (start_line_offset <= end_line_offset);
+
+		node_add_to_line (index->root,
+				  start_line,
+				  start_line_offset - end_line_offset,
+				  start_line_index - end_line_index);
+		return;
+	}
+
+	_tepl_line_index_get_line_info (index, start_line, &start_info);
+	_tepl_line_index_get_line_info (index, end_line, &end_info);
+
+	/* The start of @start_line is joined with the end of @end_line. */
+	node_add_to_line (index->root,
+			  start_line,
+			  (start_line_offset + end_info.n_chars - end_line_offset) - start_info.n_chars,
+			  (start_line_index + end_info.n_bytes - end_line_index) - start_info.n_bytes);
+
+	delete_lines (index, start_line + 1, end_line - start_line);
+}
+
+/*
+ * _tepl_line_index_get_line_info:
+ * @index: a #TeplLineIndex.
+ * @line: a line number, counting from 0. It must exist.
+ * @info: (out): the #TeplLineInfo of @line.
+ */
+void
+_tepl_line_index_get_line_info (TeplLineIndex *index,
+				gint           line,
+				TeplLineInfo  *info)
+{
+	g_return_if_fail (index != NULL);
+	g_return_if_fail (0 <= line && line < index->root->n_lines);
+	g_return_if_fail (info != NULL);
+
+	find_line (index, KEY_LINES, line, info);
+}
+
+/*
+ * _tepl_line_index_get_line_info_at_char_offset:
+ * @index: a #TeplLineIndex.
+ * @char_offset: an offset in characters. The last line is returned if it is
+ *   greater than the number of characters.
+ * @info: (out): the #TeplLineInfo of the line containing @char_offset.
+ */
+void
+_tepl_line_index_get_line_info_at_char_offset (TeplLineIndex *index,
+					       gint           char_offset,
+					       TeplLineInfo  *info)
+{
+	g_return_if_fail (index != NULL);
+	g_return_if_fail (char_offset >= 0);
+	g_return_if_fail (info != NULL);
+
+	find_line (index, KEY_CHARS, char_offset, info);
+}
+
+/*
+ * _tepl_line_index_get_line_info_at_byte_offset:
+ * @index: a #TeplLineIndex.
+ * @byte_offset: an offset in bytes. The last line is returned if it is greater
+ *   than the number of bytes.
+ * @info: (out): the #TeplLineInfo of the line containing @byte_offset.
+ */
+void
+_tepl_line_index_get_line_info_at_byte_offset (TeplLineIndex *index,
+					       gint64         byte_offset,
+					       TeplLineInfo  *info)
+{
+	g_return_if_fail (index != NULL);
+	g_return_if_fail (byte_offset >= 0);
+	g_return_if_fail (info != NULL);
+
+	find_line (index, KEY_BYTES, byte_offset, info);
+}
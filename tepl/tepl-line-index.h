@@ -0,0 +1,77 @@
+/* SPDX-FileCopyrightText: 2020 - Sébastien Wilmet <swilmet@gnome.org>
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef TEPL_LINE_INDEX_H
+#define TEPL_LINE_INDEX_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _TeplLineIndex TeplLineIndex;
+
+typedef struct _TeplLineInfo TeplLineInfo;
+struct _TeplLineInfo
+{
+	gint line;
+
+	/* The offsets of the start of the line. */
+	gint char_offset;
+	gint64 byte_offset;
+
+	/* The length of the line, including the line terminator. */
+	gint n_chars;
+	gint n_bytes;
+};
+
+G_GNUC_INTERNAL
+TeplLineIndex *	_tepl_line_index_new				(void);
+
+G_GNUC_INTERNAL
+void		_tepl_line_index_free				(TeplLineIndex *index);
+
+G_GNUC_INTERNAL
+gint		_tepl_line_index_get_n_lines			(TeplLineIndex *index);
+
+G_GNUC_INTERNAL
+gint		_tepl_line_index_get_n_chars			(TeplLineIndex *index);
+
+G_GNUC_INTERNAL
+gint64		_tepl_line_index_get_n_bytes			(TeplLineIndex *index);
+
+G_GNUC_INTERNAL
+void		_tepl_line_index_insert				(TeplLineIndex *index,
+								 gint           line,
+								 gint           line_offset,
+								 gint           line_index,
+								 const gchar   *text,
+								 gsize          length);
+
+G_GNUC_INTERNAL
+void		_tepl_line_index_delete				(TeplLineIndex *index,
+								 gint           start_line,
+								 gint           start_line_offset,
+								 gint           start_line_index,
+								 gint           end_line,
+								 gint           end_line_offset,
+								 gint           end_line_index);
+
+G_GNUC_INTERNAL
+void		_tepl_line_index_get_line_info			(TeplLineIndex *index,
+								 gint           line,
+								 TeplLineInfo  *info);
+
+G_GNUC_INTERNAL
+void		_tepl_line_index_get_line_info_at_char_offset	(TeplLineIndex *index,
+								 gint           char_offset,
+								 TeplLineInfo  *info);
+
+G_GNUC_INTERNAL
+void		_tepl_line_index_get_line_info_at_byte_offset	(TeplLineIndex *index,
+								 gint64         byte_offset,
+								 TeplLineInfo  *info);
+
+G_END_DECLS
+
+#endif /* TEPL_LINE_INDEX_H */
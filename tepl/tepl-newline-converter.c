@@ -0,0 +1,530 @@
+/* SPDX-FileCopyrightText: 2020 - Sébastien Wilmet <swilmet@gnome.org>
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "tepl-newline-converter.h"
+#include <string.h>
+
+/* Conversion of the line terminators, for the hot path of the file saving.
+ *
+ * The text is fed in several parts, a "\r\n" can be cut between two parts.
+ * Every line terminator ("\n", "\r" or "\r\n") is replaced by the one of the
+ * newline type.
+ *
+ * The text is scanned for '\r' and '\n' with SSE2 or AVX2 instructions when
+ * available (runtime dispatch, resolved once), or by 8 bytes at a time
+ * otherwise. For %TEPL_NEWLINE_TYPE_LF only the '\r' need to be found, with
+ * memchr(). The output is allocated once with its maximum size, so the
+ * conversion is done in one pass. When nothing needs to be converted, which is
+ * the common case, no output is allocated.
+ *
+ * Optionally, in the same pass, the trailing spaces and tabs of each line are
+ * removed, and a line terminator is added at the end of the text if there is
+ * none. The spaces and tabs at the end of a part are kept in the converter,
+ * until it is known whether the line continues with other characters in the
+ * next part.
+ */
+
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#define HAVE_X86_SIMD 1
+#include <immintrin.h>
+#else
+#define HAVE_X86_SIMD 0
+#endif
+
+#define LOW_BITS_MASK (G_GUINT64_CONSTANT (0x0101010101010101))
+#define HIGH_BITS_MASK (G_GUINT64_CONSTANT (0x8080808080808080))
+#define LF_MASK (LOW_BITS_MASK * '\n')
+#define CR_MASK (LOW_BITS_MASK * '\r')
+
+/* Returns the position of the first '\r' or '\n' in @str, or @length. */
+typedef gsize (*FindNewlineCharFunc) (const guchar *str,
+				      gsize         length);
+
+static inline gboolean
+word_has_zero_byte (guint64 word)
+{
+	return ((word - LOW_BITS_MASK) & ~word & HIGH_BITS_MASK) != 0;
+}
+
+/* Returns the position of the first '\r' or '\n' in @str, or @length. */
+static gsize
+find_newline_char_scalar (const guchar *str,
+			  gsize         length)
+{
+	gsize i = 0;
+
+	for (; i + sizeof (guint64) <= length; i += sizeof (guint64))
+	{
+		guint64 word;
+
+		memcpy (&word, str + i, sizeof (guint64));
+
+		if (word_has_zero_byte (word ^ LF_MASK) ||
+		    word_has_zero_byte (word ^ CR_MASK))
+		{
+			break;
+		}
+	}
+
+	for (; i < length; i++)
+	{
+		if (str[i] == '\n' || str[i] == '\r')
+		{
+			break;
+		}
+	}
+
+	return i;
+}
+
+#if HAVE_X86_SIMD
+__attribute__ ((target ("sse2")))
+static gsize
+find_newline_char_sse2 (const guchar *str,
+			gsize         length)
+{
+	const __m128i lf = _mm_set1_epi8 ('\n');
+	const __m128i cr = _mm_set1_epi8 ('\r');
+	gsize i = 0;
+
+	for (; i + sizeof (__m128i) <= length; i += sizeof (__m128i))
+	{
+		__m128i block;
+		gint mask;
+
+		block = _mm_loadu_si128 ((const __m128i *) (str + i));
+		mask = _mm_movemask_epi8 (_mm_or_si128 (_mm_cmpeq_epi8 (block, lf),
+							_mm_cmpeq_epi8 (block, cr)));
+
+		if (mask != 0)
+		{
+			return i + __builtin_ctz ((guint) mask);
+		}
+	}
+
+	return i + find_newline_char_scalar (str + i, length - i);
+}
+
+__attribute__ ((target ("avx2")))
+static gsize
+find_newline_char_avx2 (const guchar *str,
+			gsize         length)
+{
+	const __m256i lf = _mm256_set1_epi8 ('\n');
+	const __m256i cr = _mm256_set1_epi8 ('\r');
+	gsize i = 0;
+
+	for (; i + sizeof (__m256i) <= length; i += sizeof (__m256i))
+	{
+		__m256i block;
+		gint mask;
+
+		block = _mm256_loadu_si256 ((const __m256i *) (str + i));
+		mask = _mm256_movemask_epi8 (_mm256_or_si256 (_mm256_cmpeq_epi8 (block, lf),
+							      _mm256_cmpeq_epi8 (block, cr)));
+
+		if (mask != 0)
+		{
+			return i + __builtin_ctz ((guint) mask);
+		}
+	}
+
+	return i + find_newline_char_scalar (str + i, length - i);
+}
+#endif /* HAVE_X86_SIMD */
+
+static FindNewlineCharFunc
+get_find_newline_char_func (void)
+{
+	static gsize find_newline_char_func = 0;
+
+	if (g_once_init_enter (&find_newline_char_func))
+	{
+		FindNewlineCharFunc func = find_newline_char_scalar;
+
+#if HAVE_X86_SIMD
+		__builtin_cpu_init ();
+
+		if (__builtin_cpu_supports ("avx2"))
+		{
+			func = find_newline_char_avx2;
+		}
+		else if (__builtin_cpu_supports ("sse2"))
+		{
+			func = find_newline_char_sse2;
+		}
+#endif
+
+		g_once_init_leave (&find_newline_char_func, (gsize) func);
+	}
+
+	return (FindNewlineCharFunc) find_newline_char_func;
+}
+
+/* Returns the position of the next line terminator that may need to be
+ * converted, or @length. When stripping the trailing whitespace, all the line
+ * terminators are needed.
+ */
+static gsize
+find_line_terminator (TeplNewlineConverter *converter,
+		      const guchar         *str,
+		      gsize                 length)
+{
+	if (converter->newline_type == TEPL_NEWLINE_TYPE_LF &&
+	    !converter->strip_trailing_whitespace)
+	{
+		const guchar *cr = memchr (str, '\r', length);
+		return cr != NULL ? (gsize) (cr - str) : length;
+	}
+
+	return get_find_newline_char_func () (str, length);
+}
+
+static const gchar *
+get_newline_string (TeplNewlineType newline_type)
+{
+	switch (newline_type)
+	{
+		case TEPL_NEWLINE_TYPE_LF:
+			return "\n";
+
+		case TEPL_NEWLINE_TYPE_CR:
+			return "\r";
+
+		case TEPL_NEWLINE_TYPE_CR_LF:
+			return "\r\n";
+
+		default:
+			g_return_val_if_reached ("\n");
+	}
+}
+
+void
+_tepl_newline_converter_init (TeplNewlineConverter *converter,
+			      TeplNewlineType       newline_type)
+{
+	g_return_if_fail (converter != NULL);
+
+	converter->newline_type = newline_type;
+	converter->prev_char_is_cr = FALSE;
+	converter->strip_trailing_whitespace = FALSE;
+	converter->ensure_trailing_newline = FALSE;
+	converter->has_output = FALSE;
+	converter->output_ends_with_newline = FALSE;
+	converter->content_modified = FALSE;
+	converter->held_whitespace = NULL;
+}
+
+/* Frees the memory allocated by the converter, not @converter itself. */
+void
+_tepl_newline_converter_clear (TeplNewlineConverter *converter)
+{
+	g_return_if_fail (converter != NULL);
+
+	if (converter->held_whitespace != NULL)
+	{
+		g_string_free (converter->held_whitespace, TRUE);
+		converter->held_whitespace = NULL;
+	}
+}
+
+/* Removes the spaces and tabs at the end of each line. Must be called before
+ * the first part of the text is converted.
+ */
+void
+_tepl_newline_converter_set_strip_trailing_whitespace (TeplNewlineConverter *converter,
+						       gboolean              strip_trailing_whitespace)
+{
+	g_return_if_fail (converter != NULL);
+
+	converter->strip_trailing_whitespace = strip_trailing_whitespace != FALSE;
+}
+
+/* Adds a line terminator at the end of the text, if it is not empty and doesn't
+ * already end with one. See _tepl_newline_converter_finish().
+ */
+void
+_tepl_newline_converter_set_ensure_trailing_newline (TeplNewlineConverter *converter,
+						     gboolean              ensure_trailing_newline)
+{
+	g_return_if_fail (converter != NULL);
+
+	converter->ensure_trailing_newline = ensure_trailing_newline != FALSE;
+}
+
+static inline gboolean
+is_blank (guchar c)
+{
+	return c == ' ' || c == '\t';
+}
+
+static inline gboolean
+is_newline_char (guchar c)
+{
+	return c == '\n' || c == '\r';
+}
+
+static void
+update_output_end (TeplNewlineConverter *converter,
+		   const gchar          *output,
+		   gsize                 output_length)
+{
+	if (output_length > 0)
+	{
+		converter->has_output = TRUE;
+		converter->output_ends_with_newline = is_newline_char (output[output_length - 1]);
+	}
+}
+
+/* Converts the next part of the text.
+ *
+ * Returns: %TRUE if the text has been modified, in which case @output is set
+ * to a newly allocated string (not nul-terminated) of @output_length bytes,
+ * possibly empty. %FALSE if @text can be used unchanged.
+ */
+gboolean
+_tepl_newline_converter_convert (TeplNewlineConverter  *converter,
+				 const gchar           *text,
+				 gsize                  length,
+				 gchar                **output,
+				 gsize                 *output_length)
+{
+	const guchar *str = (const guchar *) text;
+	const gchar *newline;
+	gsize newline_length;
+	gsize max_output_length;
+	gchar *out = NULL;
+	gsize out_length = 0;
+	gsize copied_pos = 0;
+	gsize line_start = 0;
+	gsize pos = 0;
+	gsize end;
+
+	g_return_val_if_fail (converter != NULL, FALSE);
+	g_return_val_if_fail (text != NULL || length == 0, FALSE);
+	g_return_val_if_fail (output != NULL, FALSE);
+	g_return_val_if_fail (output_length != NULL, FALSE);
+
+	*output = NULL;
+	*output_length = 0;
+
+	if (length == 0)
+	{
+		return FALSE;
+	}
+
+	newline = get_newline_string (converter->newline_type);
+	newline_length = strlen (newline);
+
+	/* Each line terminator is at least one byte, and is replaced by at
+	 * most two bytes.
+	 */
+	max_output_length = newline_length == 2 ? 2 * length : length;
+
+	if (converter->held_whitespace != NULL &&
+	    converter->held_whitespace->len > 0)
+	{
+		gsize first_non_blank = 0;
+
+		while (first_non_blank < length && is_blank (str[first_non_blank]))
+		{
+			first_non_blank++;
+		}
+
+		if (first_non_blank < length && !is_newline_char (str[first_non_blank]))
+		{
+			/* The line continues, the whitespace was not trailing. */
+			max_output_length += converter->held_whitespace->len;
+			out = g_malloc (max_output_length);
+			memcpy (out, converter->held_whitespace->str, converter->held_whitespace->len);
+			out_length = converter->held_whitespace->len;
+			g_string_truncate (converter->held_whitespace, 0);
+		}
+		else if (first_non_blank < length)
+		{
+			g_string_truncate (converter->held_whitespace, 0);
+			converter->content_modified = TRUE;
+		}
+	}
+
+	/* The second half of a "\r\n" already converted. */
+	if (converter->prev_char_is_cr && str[0] == '\n')
+	{
+		if (out == NULL)
+		{
+			out = g_malloc (max_output_length);
+		}
+
+		copied_pos = 1;
+		line_start = 1;
+		pos = 1;
+	}
+
+	converter->prev_char_is_cr = FALSE;
+
+	while (pos < length)
+	{
+		gsize terminator_length;
+		gsize content_end;
+		gboolean same;
+
+		pos += find_line_terminator (converter, str + pos, length - pos);
+		if (pos == length)
+		{
+			break;
+		}
+
+		if (str[pos] == '\n')
+		{
+			terminator_length = 1;
+			same = newline_length == 1 && newline[0] == '\n';
+		}
+		else if (pos + 1 < length && str[pos + 1] == '\n')
+		{
+			terminator_length = 2;
+			same = newline_length == 2;
+		}
+		else
+		{
+			/* A "\r" at the end can be followed by a "\n" in the
+			 * next part of the text. It is converted now.
+			 */
+			terminator_length = 1;
+			same = newline_length == 1 && newline[0] == '\r';
+			converter->prev_char_is_cr = pos + 1 == length;
+		}
+
+		content_end = pos;
+		if (converter->strip_trailing_whitespace)
+		{
+			while (content_end > line_start && is_blank (str[content_end - 1]))
+			{
+				content_end--;
+			}
+
+			if (content_end < pos)
+			{
+				same = FALSE;
+				converter->content_modified = TRUE;
+			}
+		}
+
+		if (!same)
+		{
+			if (out == NULL)
+			{
+				out = g_malloc (max_output_length);
+			}
+
+			memcpy (out + out_length, text + copied_pos, content_end - copied_pos);
+			out_length += content_end - copied_pos;
+
+			memcpy (out + out_length, newline, newline_length);
+			out_length += newline_length;
+
+			copied_pos = pos + terminator_length;
+		}
+
+		pos += terminator_length;
+		line_start = pos;
+	}
+
+	/* The whitespace at the end is trailing only if the line ends in the
+	 * next part.
+	 */
+	end = length;
+	if (converter->strip_trailing_whitespace)
+	{
+		while (end > line_start && is_blank (str[end - 1]))
+		{
+			end--;
+		}
+
+		if (end < length)
+		{
+			if (converter->held_whitespace == NULL)
+			{
+				converter->held_whitespace = g_string_new (NULL);
+			}
+
+			g_string_append_len (converter->held_whitespace, text + end, length - end);
+
+			if (out == NULL)
+			{
+				out = g_malloc (max_output_length);
+			}
+		}
+	}
+
+	if (out == NULL)
+	{
+		update_output_end (converter, text, length);
+		return FALSE;
+	}
+
+	memcpy (out + out_length, text + copied_pos, end - copied_pos);
+	out_length += end - copied_pos;
+
+	update_output_end (converter, out, out_length);
+
+	*output = out;
+	*output_length = out_length;
+	return TRUE;
+}
+
+/* To call after the last part of the text. The trailing whitespace of the last
+ * line is dropped.
+ *
+ * Returns: %TRUE if there is something more to output, in which case @output
+ * is set to a newly allocated string (not nul-terminated) of @output_length
+ * bytes.
+ */
+gboolean
+_tepl_newline_converter_finish (TeplNewlineConverter  *converter,
+				gchar                **output,
+				gsize                 *output_length)
+{
+	const gchar *newline;
+
+	g_return_val_if_fail (converter != NULL, FALSE);
+	g_return_val_if_fail (output != NULL, FALSE);
+	g_return_val_if_fail (output_length != NULL, FALSE);
+
+	*output = NULL;
+	*output_length = 0;
+
+	if (converter->held_whitespace != NULL &&
+	    converter->held_whitespace->len > 0)
+	{
+		g_string_truncate (converter->held_whitespace, 0);
+		converter->content_modified = TRUE;
+	}
+
+	if (!converter->ensure_trailing_newline ||
+	    !converter->has_output ||
+	    converter->output_ends_with_newline)
+	{
+		return FALSE;
+	}
+
+	newline = get_newline_string (converter->newline_type);
+	*output_length = strlen (newline);
+	*output = g_strdup (newline);
+
+	update_output_end (converter, *output, *output_length);
+	converter->content_modified = TRUE;
+	return TRUE;
+}
+
+/* Returns: whether the output differs from the text by more than the line
+ * terminators, because of the stripped whitespace or the added line
+ * terminator.
+ */
+gboolean
+_tepl_newline_converter_content_is_modified (TeplNewlineConverter *converter)
+{
+	g_return_val_if_fail (converter != NULL, FALSE);
+
+	return converter->content_modified;
+}
@@ -0,0 +1,79 @@
+/* SPDX-FileCopyrightText: 2020 - Sébastien Wilmet <swilmet@gnome.org>
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef TEPL_NEWLINE_CONVERTER_H
+#define TEPL_NEWLINE_CONVERTER_H
+
+#include <glib.h>
+#include "tepl-file.h"
+
+G_BEGIN_DECLS
+
+typedef struct _TeplNewlineConverter TeplNewlineConverter;
+
+/* The fields are private, use the functions. */
+struct _TeplNewlineConverter
+{
+	TeplNewlineType newline_type;
+
+	/* The previous text ended with a "\r", already converted. A "\n" at
+	 * the start of the next text is part of the same line terminator.
+	 */
+	guint prev_char_is_cr : 1;
+
+	guint strip_trailing_whitespace : 1;
+	guint ensure_trailing_newline : 1;
+
+	/* Whether something has been output, and whether the output ends with
+	 * a line terminator.
+	 */
+	guint has_output : 1;
+	guint output_ends_with_newline : 1;
+
+	/* Whether the content has been modified by the stripped whitespace or
+	 * the added line terminator.
+	 */
+	guint content_modified : 1;
+
+	/* The spaces and tabs at the end of the previous text, output only if
+	 * the line continues with other characters. Allocated on demand.
+	 */
+	GString *held_whitespace;
+};
+
+G_GNUC_INTERNAL
+void		_tepl_newline_converter_init		(TeplNewlineConverter *converter,
+							 TeplNewlineType       newline_type);
+
+G_GNUC_INTERNAL
+void		_tepl_newline_converter_clear		(TeplNewlineConverter *converter);
+
+G_GNUC_INTERNAL
+void		_tepl_newline_converter_set_strip_trailing_whitespace
+							(TeplNewlineConverter *converter,
+							 gboolean              strip_trailing_whitespace);
+
+G_GNUC_INTERNAL
+void		_tepl_newline_converter_set_ensure_trailing_newline
+							(TeplNewlineConverter *converter,
+							 gboolean              ensure_trailing_newline);
+
+G_GNUC_INTERNAL
+gboolean	_tepl_newline_converter_convert		(TeplNewlineConverter  *converter,
+							 const gchar           *text,
+							 gsize                  length,
+							 gchar                **output,
+							 gsize                 *output_length);
+
+G_GNUC_INTERNAL
+gboolean	_tepl_newline_converter_finish		(TeplNewlineConverter  *converter,
+							 gchar                **output,
+							 gsize                 *output_length);
+
+G_GNUC_INTERNAL
+gboolean	_tepl_newline_converter_content_is_modified	(TeplNewlineConverter *converter);
+
+G_END_DECLS
+
+#endif /* TEPL_NEWLINE_CONVERTER_H */
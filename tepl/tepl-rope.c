@@ -0,0 +1,930 @@
+/* SPDX-FileCopyrightText: 2020 - Sébastien Wilmet <swilmet@gnome.org>
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "tepl-rope.h"
+#include <string.h>
+
+/* A copy of the text of a TeplBuffer, that can be read from other threads.
+ *
+ * GtkTextBuffer and GtkTextIter can be used only on the main thread. So
+ * TeplBuffer keeps its text in a TeplRope too, updated at each insertion and
+ * deletion.
+ *
+ * The text is stored in immutable segments (GBytes) of at most
+ * SEGMENT_MAX_SIZE bytes, cut at character boundaries. The segments are the
+ * leaves of a balanced binary tree (an AVL tree), where each node knows the
+ * number of bytes, characters and segments below it. So finding the segment
+ * at a character offset is in O(log n). An edit rebuilds only the one or two
+ * segments where the text is edited, which are small, and the nodes on the
+ * path to them.
+ *
+ * The nodes are immutable and refcounted, and shared between the ropes. An
+ * edit creates new nodes only on the paths to the edited segments (path
+ * copying), the other subtrees are shared. So taking a snapshot of the text is
+ * just a ref, and editing a shared rope doesn't copy anything else.
+ *
+ * Only the main thread edits a rope, other threads only read it and unref it.
+ *
+ * Each segment has a polynomial hash of its bytes, computed when the segment is
+ * created. The hash of a concatenation can be computed from the hashes of the
+ * parts, so each internal node stores the hash of its subtree, computed from
+ * its two children. The hash of the whole text (see _tepl_rope_get_hash()) is
+ * thus the hash of the root: it doesn't depend on how the text is cut into
+ * segments, and is maintained at each edit in O(log n).
+ */
+
+#define SEGMENT_MAX_SIZE (4 * 1024)
+
+/* After a deletion, a segment smaller than that is merged with the next one
+ * when possible.
+ */
+#define SEGMENT_MIN_SIZE (SEGMENT_MAX_SIZE / 4)
+
+/* The hashes are computed modulo a Mersenne prime. */
+#define HASH_MODULO ((G_GUINT64_CONSTANT (1) << 61) - 1)
+
+typedef struct _Node Node;
+struct _Node
+{
+	gint ref_count;
+
+	/* 0 for a leaf, which is a segment. */
+	guint height;
+
+	/* For an internal node, both are non-NULL. */
+	Node *left;
+	Node *right;
+
+	/* For a leaf. */
+	GBytes *bytes;
+
+	/* For the whole subtree. */
+	guint64 n_bytes;
+	guint64 n_chars;
+	guint n_segments;
+
+	/* The polynomial hash of the bytes of the subtree, and
+	 * HASH_BASE^n_bytes.
+	 */
+	guint64 hash;
+	guint64 hash_power;
+};
+
+struct _TeplRope
+{
+	gint ref_count;
+
+	/* NULL for an empty text. */
+	Node *root;
+};
+
+/* Creates the new segments of an edit, from several pieces of text. The
+ * segments have about the same size, to not create tiny segments when typing
+ * in a full segment.
+ */
+typedef struct _SegmentBuilder SegmentBuilder;
+struct _SegmentBuilder
+{
+	/* Array of Node*, the new leaves. */
+	GPtrArray *leaves;
+	gsize segment_size;
+
+	gchar *buf;
+	gsize buf_length;
+};
+
+static guint64
+hash_reduce (guint64 value)
+{
+	value = (value & HASH_MODULO) + (value >> 61);
+	return value >= HASH_MODULO ? value - HASH_MODULO : value;
+}
+
+/* Returns (a * b) mod HASH_MODULO, for a and b lower than HASH_MODULO. */
+static guint64
+hash_multiply (guint64 a,
+	       guint64 b)
+{
+#ifdef __SIZEOF_INT128__
+	unsigned __int128 product = (unsigned __int128) a * b;
+
+	return hash_reduce ((guint64) (product & HASH_MODULO) + (guint64) (product >> 61));
+#else
+	guint64 a_high = a >> 32;
+	guint64 a_low = a & 0xFFFFFFFF;
+	guint64 b_high = b >> 32;
+	guint64 b_low = b & 0xFFFFFFFF;
+	guint64 middle;
+	guint64 low;
+	guint64 high;
+
+	/* product = high * 2^64 + low, with 2^64 = 8 modulo HASH_MODULO. */
+	middle = a_high * b_low + a_low * b_high;
+	low = a_low * b_low;
+	high = a_high * b_high + (middle >> 32);
+
+	if (low + (middle << 32) < low)
+	{
+		high++;
+	}
+	low += middle << 32;
+
+	return hash_reduce (hash_reduce (low) + (high << 3));
+#endif
+}
+
+/* A random base, so that the collisions cannot be predicted. */
+static guint64
+get_hash_base (void)
+{
+	static guint64 base;
+	static gsize initialized = 0;
+
+	if (g_once_init_enter (&initialized))
+	{
+		base = ((guint64) g_random_int () << 32) | g_random_int ();
+		base = MAX (hash_reduce (base), 256);
+		g_once_init_leave (&initialized, 1);
+	}
+
+	return base;
+}
+
+/* Returns base^exponent modulo HASH_MODULO, in O(log exponent). */
+static guint64
+hash_pow (guint64 base,
+	  guint64 exponent)
+{
+	guint64 result = 1;
+
+	while (exponent > 0)
+	{
+		if (exponent & 1)
+		{
+			result = hash_multiply (result, base);
+		}
+
+		base = hash_multiply (base, base);
+		exponent >>= 1;
+	}
+
+	return result;
+}
+
+/* Four bytes at a time: the multiplications of a block don't depend on each
+ * other, only one per block depends on the previous blocks.
+ */
+static void
+compute_hash (const gchar *data,
+	      gsize        length,
+	      guint64     *hash,
+	      guint64     *hash_power)
+{
+	const guchar *bytes = (const guchar *) data;
+	guint64 base = get_hash_base ();
+	guint64 base_2 = hash_multiply (base, base);
+	guint64 base_3 = hash_multiply (base_2, base);
+	guint64 base_4 = hash_multiply (base_3, base);
+	guint64 h = 0;
+	gsize i;
+
+	for (i = 0; i + 4 <= length; i += 4)
+	{
+		guint64 block;
+
+		block = hash_reduce (hash_multiply (bytes[i] + 1, base_3) +
+				     hash_multiply (bytes[i + 1] + 1, base_2));
+		block = hash_reduce (block +
+				     hash_reduce (hash_multiply (bytes[i + 2] + 1, base) + bytes[i + 3] + 1));
+
+		h = hash_reduce (hash_multiply (h, base_4) + block);
+	}
+
+	for (; i < length; i++)
+	{
+		h = hash_reduce (hash_multiply (h, base) + bytes[i] + 1);
+	}
+
+	*hash = h;
+	*hash_power = hash_pow (base, length);
+}
+
+/* @data is valid UTF-8: the characters are the bytes that are not continuation
+ * bytes. Faster than g_utf8_strlen(), and the compiler can vectorize it.
+ */
+static guint
+count_chars (const gchar *data,
+	     gsize        length)
+{
+	guint n_chars = 0;
+	gsize i;
+
+	for (i = 0; i < length; i++)
+	{
+		n_chars += ((guchar) data[i] & 0xC0) != 0x80;
+	}
+
+	return n_chars;
+}
+
+static Node *
+node_ref (Node *node)
+{
+	g_atomic_int_inc (&node->ref_count);
+	return node;
+}
+
+static void
+node_unref (Node *node)
+{
+	if (node != NULL && g_atomic_int_dec_and_test (&node->ref_count))
+	{
+		if (node->bytes != NULL)
+		{
+			g_bytes_unref (node->bytes);
+		}
+
+		node_unref (node->left);
+		node_unref (node->right);
+		g_free (node);
+	}
+}
+
+/* Takes ownership of @data. */
+static Node *
+leaf_new_take (gchar *data,
+	       gsize  length)
+{
+	Node *leaf;
+
+	leaf = g_new0 (Node, 1);
+	leaf->ref_count = 1;
+	leaf->n_bytes = length;
+	leaf->n_chars = count_chars (data, length);
+	leaf->n_segments = 1;
+	compute_hash (data, length, &leaf->hash, &leaf->hash_power);
+	leaf->bytes = g_bytes_new_take (data, length);
+
+	return leaf;
+}
+
+/* Takes ownership of @left and @right. */
+static Node *
+internal_node_new (Node *left,
+		   Node *right)
+{
+	Node *node;
+
+	node = g_new0 (Node, 1);
+	node->ref_count = 1;
+	node->height = MAX (left->height, right->height) + 1;
+	node->left = left;
+	node->right = right;
+	node->n_bytes = left->n_bytes + right->n_bytes;
+	node->n_chars = left->n_chars + right->n_chars;
+	node->n_segments = left->n_segments + right->n_segments;
+	node->hash = hash_reduce (hash_multiply (left->hash, right->hash_power) + right->hash);
+	node->hash_power = hash_multiply (left->hash_power, right->hash_power);
+
+	return node;
+}
+
+/* Like internal_node_new(), but the heights of @left and @right can differ by
+ * 2, the result is rebalanced with one or two rotations. Since the nodes are
+ * immutable, a rotation creates new nodes.
+ */
+static Node *
+balance (Node *left,
+	 Node *right)
+{
+	Node *result;
+
+	if (left->height > right->height + 1)
+	{
+		if (left->left->height >= left->right->height)
+		{
+			result = internal_node_new (node_ref (left->left),
+						    internal_node_new (node_ref (left->right), right));
+		}
+		else
+		{
+			Node *middle = left->right;
+
+			result = internal_node_new (internal_node_new (node_ref (left->left), node_ref (middle->left)),
+						    internal_node_new (node_ref (middle->right), right));
+		}
+
+		node_unref (left);
+		return result;
+	}
+
+	if (right->height > left->height + 1)
+	{
+		if (right->right->height >= right->left->height)
+		{
+			result = internal_node_new (internal_node_new (left, node_ref (right->left)),
+						    node_ref (right->right));
+		}
+		else
+		{
+			Node *middle = right->left;
+
+			result = internal_node_new (internal_node_new (left, node_ref (middle->left)),
+						    internal_node_new (node_ref (middle->right), node_ref (right->right)));
+		}
+
+		node_unref (right);
+		return result;
+	}
+
+	return internal_node_new (left, right);
+}
+
+/* Concatenates two balanced trees, in O(difference of heights). Takes
+ * ownership of @left and @right, which can be %NULL.
+ */
+static Node *
+join (Node *left,
+      Node *right)
+{
+	Node *result;
+
+	if (left == NULL)
+	{
+		return right;
+	}
+
+	if (right == NULL)
+	{
+		return left;
+	}
+
+	if (left->height > right->height + 1)
+	{
+		result = balance (node_ref (left->left),
+				  join (node_ref (left->right), right));
+		node_unref (left);
+		return result;
+	}
+
+	if (right->height > left->height + 1)
+	{
+		result = balance (join (left, node_ref (right->left)),
+				  node_ref (right->right));
+		node_unref (right);
+		return result;
+	}
+
+	return internal_node_new (left, right);
+}
+
+/* Splits @node (transfer none) before the segment @index, in O(log n). The
+ * segments are kept as is.
+ */
+static void
+split (Node  *node,
+       guint  index,
+       Node **left,
+       Node **right)
+{
+	Node *sub_left;
+	Node *sub_right;
+
+	if (node == NULL || index == 0)
+	{
+		*left = NULL;
+		*right = node != NULL ? node_ref (node) : NULL;
+		return;
+	}
+
+	if (index >= node->n_segments)
+	{
+		*left = node_ref (node);
+		*right = NULL;
+		return;
+	}
+
+	/* Not a leaf, since 0 < index < n_segments. */
+	if (index <= node->left->n_segments)
+	{
+		split (node->left, index, &sub_left, &sub_right);
+		*left = sub_left;
+		*right = join (sub_right, node_ref (node->right));
+	}
+	else
+	{
+		split (node->right, index - node->left->n_segments, &sub_left, &sub_right);
+		*left = join (node_ref (node->left), sub_left);
+		*right = sub_right;
+	}
+}
+
+/* Builds a balanced tree from the leaves, in order. */
+static Node *
+build_tree (GPtrArray *leaves,
+	    guint      start,
+	    guint      end)
+{
+	guint middle;
+
+	if (start == end)
+	{
+		return NULL;
+	}
+
+	if (end - start == 1)
+	{
+		return g_ptr_array_index (leaves, start);
+	}
+
+	middle = start + (end - start) / 2;
+
+	/* The heights of the two halves differ by at most one. */
+	return internal_node_new (build_tree (leaves, start, middle),
+				  build_tree (leaves, middle, end));
+}
+
+static void
+builder_init (SegmentBuilder *builder,
+	      gsize           total_length)
+{
+	gsize n_segments;
+
+	builder->leaves = g_ptr_array_new ();
+
+	n_segments = (total_length + SEGMENT_MAX_SIZE - 1) / SEGMENT_MAX_SIZE;
+	n_segments = MAX (n_segments, 1);
+
+	/* A few more bytes, since the segments are cut at character
+	 * boundaries.
+	 */
+	builder->segment_size = total_length / n_segments + 4;
+	builder->segment_size = MIN (builder->segment_size, SEGMENT_MAX_SIZE);
+
+	builder->buf = NULL;
+	builder->buf_length = 0;
+}
+
+static void
+builder_flush (SegmentBuilder *builder)
+{
+	if (builder->buf_length == 0)
+	{
+		return;
+	}
+
+	g_ptr_array_add (builder->leaves,
+			 leaf_new_take (g_realloc (builder->buf, builder->buf_length),
+					builder->buf_length));
+
+	builder->buf = NULL;
+	builder->buf_length = 0;
+}
+
+static void
+builder_append (SegmentBuilder *builder,
+		const gchar    *text,
+		gsize           length)
+{
+	while (length > 0)
+	{
+		gsize n = MIN (length, builder->segment_size - builder->buf_length);
+
+		if (n < length)
+		{
+			/* Cut at a character boundary. */
+			while (n > 0 && (text[n] & 0xC0) == 0x80)
+			{
+				n--;
+			}
+		}
+
+		if (n == 0)
+		{
+			builder_flush (builder);
+			continue;
+		}
+
+		if (builder->buf == NULL)
+		{
+			builder->buf = g_malloc (builder->segment_size);
+		}
+
+		memcpy (builder->buf + builder->buf_length, text, n);
+		builder->buf_length += n;
+		text += n;
+		length -= n;
+
+		if (builder->buf_length == builder->segment_size)
+		{
+			builder_flush (builder);
+		}
+	}
+}
+
+/* Returns: (transfer full) (nullable): the tree of the new segments. */
+static Node *
+builder_finish (SegmentBuilder *builder)
+{
+	Node *tree;
+
+	builder_flush (builder);
+
+	tree = build_tree (builder->leaves, 0, builder->leaves->len);
+	g_ptr_array_free (builder->leaves, TRUE);
+
+	return tree;
+}
+
+static const gchar *
+get_segment_data (Node  *leaf,
+		  gsize *size)
+{
+	return g_bytes_get_data (leaf->bytes, size);
+}
+
+static Node *
+get_segment (Node  *node,
+	     guint  index)
+{
+	while (node->height > 0)
+	{
+		if (index < node->left->n_segments)
+		{
+			node = node->left;
+		}
+		else
+		{
+			index -= node->left->n_segments;
+			node = node->right;
+		}
+	}
+
+	return node;
+}
+
+/* If @at_segment_end is %TRUE and @char_offset is at a boundary between two
+ * segments, the previous segment is returned. At the end of the rope, @index
+ * is the number of segments if no segment matches. In O(log n).
+ */
+static Node *
+find_segment (Node     *node,
+	      guint64   char_offset,
+	      gboolean  at_segment_end,
+	      guint    *index,
+	      guint    *char_offset_in_segment)
+{
+	*index = 0;
+	*char_offset_in_segment = 0;
+
+	if (node == NULL ||
+	    char_offset > node->n_chars ||
+	    (char_offset == node->n_chars && !at_segment_end))
+	{
+		*index = node != NULL ? node->n_segments : 0;
+		return NULL;
+	}
+
+	while (node->height > 0)
+	{
+		if (char_offset < node->left->n_chars ||
+		    (at_segment_end && char_offset == node->left->n_chars))
+		{
+			node = node->left;
+		}
+		else
+		{
+			char_offset -= node->left->n_chars;
+			*index += node->left->n_segments;
+			node = node->right;
+		}
+	}
+
+	*char_offset_in_segment = char_offset;
+	return node;
+}
+
+static gsize
+get_byte_index (const gchar *segment_data,
+		gsize        segment_size,
+		guint        char_offset)
+{
+	guint n_chars = 0;
+	gsize i;
+
+	for (i = 0; i < segment_size; i++)
+	{
+		if (((guchar) segment_data[i] & 0xC0) != 0x80)
+		{
+			if (n_chars == char_offset)
+			{
+				return i;
+			}
+
+			n_chars++;
+		}
+	}
+
+	return segment_size;
+}
+
+/* Replaces the segments from @index to @index + @n_removed_segments - 1 by
+ * @new_segments (transfer full).
+ */
+static void
+replace_segments (TeplRope *rope,
+		  guint     index,
+		  guint     n_removed_segments,
+		  Node     *new_segments)
+{
+	Node *left;
+	Node *rest;
+	Node *removed;
+	Node *right;
+
+	split (rope->root, index, &left, &rest);
+	split (rest, n_removed_segments, &removed, &right);
+
+	node_unref (rope->root);
+	node_unref (rest);
+	node_unref (removed);
+
+	rope->root = join (join (left, new_segments), right);
+}
+
+TeplRope *
+_tepl_rope_new (void)
+{
+	TeplRope *rope;
+
+	rope = g_new0 (TeplRope, 1);
+	rope->ref_count = 1;
+
+	return rope;
+}
+
+TeplRope *
+_tepl_rope_ref (TeplRope *rope)
+{
+	g_return_val_if_fail (rope != NULL, NULL);
+
+	g_atomic_int_inc (&rope->ref_count);
+	return rope;
+}
+
+void
+_tepl_rope_unref (TeplRope *rope)
+{
+	g_return_if_fail (rope != NULL);
+
+	if (g_atomic_int_dec_and_test (&rope->ref_count))
+	{
+		node_unref (rope->root);
+		g_free (rope);
+	}
+}
+
+/* Only the thread that edits the rope takes new refs, so if the rope is not
+ * shared, it cannot become shared in the meantime. The copy shares all the
+ * nodes, the edit then creates new nodes only where the text is edited.
+ */
+static void
+make_writable (TeplRope **rope)
+{
+	TeplRope *copy;
+
+	if (g_atomic_int_get (&(*rope)->ref_count) == 1)
+	{
+		return;
+	}
+
+	copy = _tepl_rope_new ();
+
+	if ((*rope)->root != NULL)
+	{
+		copy->root = node_ref ((*rope)->root);
+	}
+
+	_tepl_rope_unref (*rope);
+	*rope = copy;
+}
+
+/* If *@rope is shared, it is replaced by a copy before being edited. */
+void
+_tepl_rope_insert (TeplRope    **rope,
+		   guint64       char_offset,
+		   const gchar  *text,
+		   gsize         length)
+{
+	SegmentBuilder builder;
+	Node *segment;
+	guint index;
+	guint char_offset_in_segment;
+	guint n_removed_segments = 0;
+
+	g_return_if_fail (rope != NULL && *rope != NULL);
+	g_return_if_fail (char_offset <= _tepl_rope_get_n_chars (*rope));
+	g_return_if_fail (text != NULL || length == 0);
+
+	if (length == 0)
+	{
+		return;
+	}
+
+	make_writable (rope);
+
+	segment = find_segment ((*rope)->root, char_offset, TRUE, &index, &char_offset_in_segment);
+
+	if (segment != NULL)
+	{
+		const gchar *data;
+		gsize size;
+		gsize byte_index;
+
+		data = get_segment_data (segment, &size);
+		byte_index = get_byte_index (data, size, char_offset_in_segment);
+
+		builder_init (&builder, size + length);
+		builder_append (&builder, data, byte_index);
+		builder_append (&builder, text, length);
+		builder_append (&builder, data + byte_index, size - byte_index);
+
+		n_removed_segments = 1;
+	}
+	else
+	{
+		builder_init (&builder, length);
+		builder_append (&builder, text, length);
+	}
+
+	replace_segments (*rope, index, n_removed_segments, builder_finish (&builder));
+}
+
+/* If *@rope is shared, it is replaced by a copy before being edited. */
+void
+_tepl_rope_delete (TeplRope **rope,
+		   guint64    char_offset,
+		   guint64    n_chars)
+{
+	SegmentBuilder builder;
+	Node *start_segment;
+	Node *end_segment;
+	Node *next_segment = NULL;
+	guint start_index;
+	guint end_index;
+	guint start_char_offset;
+	guint end_char_offset;
+	const gchar *start_data;
+	const gchar *end_data;
+	gsize start_size;
+	gsize end_size;
+	gsize start_byte_index;
+	gsize end_byte_index;
+	gsize new_length;
+
+	g_return_if_fail (rope != NULL && *rope != NULL);
+	g_return_if_fail (char_offset + n_chars <= _tepl_rope_get_n_chars (*rope));
+
+	if (n_chars == 0)
+	{
+		return;
+	}
+
+	make_writable (rope);
+
+	start_segment = find_segment ((*rope)->root, char_offset, FALSE, &start_index, &start_char_offset);
+	end_segment = find_segment ((*rope)->root, char_offset + n_chars, TRUE, &end_index, &end_char_offset);
+	g_assert (start_segment != NULL && end_segment != NULL);
+	g_assert (start_index <= end_index);
+
+	start_data = get_segment_data (start_segment, &start_size);
+	end_data = get_segment_data (end_segment, &end_size);
+	start_byte_index = get_byte_index (start_data, start_size, start_char_offset);
+	end_byte_index = get_byte_index (end_data, end_size, end_char_offset);
+
+	new_length = start_byte_index + (end_size - end_byte_index);
+
+	if (new_length < SEGMENT_MIN_SIZE &&
+	    end_index + 1 < (*rope)->root->n_segments)
+	{
+		next_segment = get_segment ((*rope)->root, end_index + 1);
+
+		if (new_length + next_segment->n_bytes <= SEGMENT_MAX_SIZE)
+		{
+			new_length += next_segment->n_bytes;
+		}
+		else
+		{
+			next_segment = NULL;
+		}
+	}
+
+	builder_init (&builder, new_length);
+	builder_append (&builder, start_data, start_byte_index);
+	builder_append (&builder, end_data + end_byte_index, end_size - end_byte_index);
+
+	if (next_segment != NULL)
+	{
+		const gchar *next_data;
+		gsize next_size;
+
+		next_data = get_segment_data (next_segment, &next_size);
+		builder_append (&builder, next_data, next_size);
+	}
+
+	replace_segments (*rope,
+			  start_index,
+			  end_index - start_index + 1 + (next_segment != NULL ? 1 : 0),
+			  builder_finish (&builder));
+}
+
+guint64
+_tepl_rope_get_n_bytes (TeplRope *rope)
+{
+	g_return_val_if_fail (rope != NULL, 0);
+	return rope->root != NULL ? rope->root->n_bytes : 0;
+}
+
+guint64
+_tepl_rope_get_n_chars (TeplRope *rope)
+{
+	g_return_val_if_fail (rope != NULL, 0);
+	return rope->root != NULL ? rope->root->n_chars : 0;
+}
+
+guint
+_tepl_rope_get_n_segments (TeplRope *rope)
+{
+	g_return_val_if_fail (rope != NULL, 0);
+	return rope->root != NULL ? rope->root->n_segments : 0;
+}
+
+/* Returns: (transfer none): the bytes of the segment. In O(log n). */
+GBytes *
+_tepl_rope_get_segment (TeplRope *rope,
+			guint     index,
+			guint    *n_chars)
+{
+	Node *segment;
+
+	g_return_val_if_fail (rope != NULL, NULL);
+	g_return_val_if_fail (index < _tepl_rope_get_n_segments (rope), NULL);
+
+	segment = get_segment (rope->root, index);
+
+	if (n_chars != NULL)
+	{
+		*n_chars = segment->n_chars;
+	}
+
+	return segment->bytes;
+}
+
+/* Returns: a hash of the whole text. Two ropes with the same text have the same
+ * hash, regardless of their segments. Computed in O(1), the hash is maintained
+ * in the nodes at each edit.
+ */
+guint64
+_tepl_rope_get_hash (TeplRope *rope)
+{
+	g_return_val_if_fail (rope != NULL, 0);
+
+	return rope->root != NULL ? rope->root->hash : 0;
+}
+
+static void
+append_text (Node    *node,
+	     GString *text)
+{
+	if (node->height == 0)
+	{
+		const gchar *data;
+		gsize size;
+
+		data = get_segment_data (node, &size);
+		g_string_append_len (text, data, size);
+		return;
+	}
+
+	append_text (node->left, text);
+	append_text (node->right, text);
+}
+
+/* Returns: the whole text, nul-terminated. */
+gchar *
+_tepl_rope_get_text (TeplRope *rope)
+{
+	GString *text;
+
+	g_return_val_if_fail (rope != NULL, NULL);
+
+	text = g_string_sized_new (_tepl_rope_get_n_bytes (rope));
+
+	if (rope->root != NULL)
+	{
+		append_text (rope->root, text);
+	}
+
+	return g_string_free (text, FALSE);
+}
@@ -0,0 +1,64 @@
+/* SPDX-FileCopyrightText: 2020 - Sébastien Wilmet <swilmet@gnome.org>
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef TEPL_ROPE_H
+#define TEPL_ROPE_H
+
+#include "tepl-buffer.h"
+
+G_BEGIN_DECLS
+
+typedef struct _TeplRope TeplRope;
+
+G_GNUC_INTERNAL
+TeplRope *	_tepl_rope_new				(void);
+
+G_GNUC_INTERNAL
+TeplRope *	_tepl_rope_ref				(TeplRope *rope);
+
+G_GNUC_INTERNAL
+void		_tepl_rope_unref			(TeplRope *rope);
+
+G_GNUC_INTERNAL
+void		_tepl_rope_insert			(TeplRope    **rope,
+							 guint64       char_offset,
+							 const gchar  *text,
+							 gsize         length);
+
+G_GNUC_INTERNAL
+void		_tepl_rope_delete			(TeplRope **rope,
+							 guint64    char_offset,
+							 guint64    n_chars);
+
+G_GNUC_INTERNAL
+guint64		_tepl_rope_get_n_bytes			(TeplRope *rope);
+
+G_GNUC_INTERNAL
+guint64		_tepl_rope_get_n_chars			(TeplRope *rope);
+
+G_GNUC_INTERNAL
+guint		_tepl_rope_get_n_segments		(TeplRope *rope);
+
+G_GNUC_INTERNAL
+GBytes *	_tepl_rope_get_segment			(TeplRope *rope,
+							 guint     index,
+							 guint    *n_chars);
+
+G_GNUC_INTERNAL
+guint64		_tepl_rope_get_hash			(TeplRope *rope);
+
+G_GNUC_INTERNAL
+gchar *		_tepl_rope_get_text			(TeplRope *rope);
+
+/* Defined in tepl-buffer.c. */
+G_GNUC_INTERNAL
+TeplRope *	_tepl_buffer_get_rope			(TeplBuffer *buffer);
+
+G_GNUC_INTERNAL
+void		_tepl_buffer_set_saved_content		(TeplBuffer *buffer,
+							 TeplRope   *rope);
+
+G_END_DECLS
+
+#endif /* TEPL_ROPE_H */
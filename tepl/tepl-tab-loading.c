@@ -6,29 +6,217 @@
 #include "tepl-tab-loading.h"
 #include <glib/gi18n-lib.h>
 #include "tepl-file-loader.h"
+#include "tepl-file-viewer.h"
 #include "tepl-info-bar.h"
 
+#define FILE_VIEWER_KEY "tepl-tab-loading-file-viewer"
+
+/* The LoadData of the file loading in progress in the tab, if any. */
+#define LOAD_DATA_KEY "tepl-tab-loading-load-data"
+
+typedef struct _LoadData LoadData;
+struct _LoadData
+{
+	TeplTab *tab;
+
+	/* The file is loaded into this buffer, which is not attached to the
+	 * view, so that the GtkTextView doesn't update its layout and receive
+	 * the signals for each inserted chunk. It replaces the view buffer at
+	 * the end.
+	 */
+	TeplBuffer *buffer;
+
+	GCancellable *cancellable;
+
+	/* The view is not editable during the loading, since the text typed
+	 * into the previous buffer would be lost.
+	 */
+	guint view_was_editable : 1;
+};
+
+static LoadData *
+load_data_new (TeplTab      *tab,
+	       TeplBuffer   *buffer,
+	       GCancellable *cancellable)
+{
+	LoadData *data;
+
+	data = g_new0 (LoadData, 1);
+	data->tab = g_object_ref (tab);
+	data->buffer = g_object_ref (buffer);
+	data->cancellable = g_object_ref (cancellable);
+
+	return data;
+}
+
+static void
+load_data_free (LoadData *data)
+{
+	if (data != NULL)
+	{
+		g_object_unref (data->tab);
+		g_object_unref (data->buffer);
+		g_object_unref (data->cancellable);
+		g_free (data);
+	}
+}
+
+static void
+open_in_viewer_cb (GObject      *source_object,
+		   GAsyncResult *result,
+		   gpointer      user_data)
+{
+	TeplFileViewer *viewer = TEPL_FILE_VIEWER (source_object);
+	TeplTab *tab = TEPL_TAB (user_data);
+	GError *error = NULL;
+
+	tepl_file_viewer_open_finish (viewer, result, &error);
+
+	if (error != NULL &&
+	    !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+	{
+		TeplInfoBar *info_bar;
+
+		info_bar = tepl_info_bar_new_simple (GTK_MESSAGE_ERROR,
+						     _("Error when opening the file."),
+						     error->message);
+
+		tepl_tab_add_info_bar (tab, GTK_INFO_BAR (info_bar));
+		gtk_widget_show (GTK_WIDGET (info_bar));
+	}
+
+	g_clear_error (&error);
+	g_object_unref (tab);
+}
+
+static void
+open_in_viewer (TeplTab *tab,
+		GFile   *location)
+{
+	TeplFileViewer *viewer;
+	GCancellable *cancellable;
+
+	/* The tab owns the viewer, until another file is loaded. */
+	viewer = tepl_file_viewer_new (tepl_tab_get_view (tab));
+	g_object_set_data_full (G_OBJECT (tab), FILE_VIEWER_KEY, viewer, g_object_unref);
+
+	cancellable = g_cancellable_new ();
+	g_signal_connect_object (tab,
+				 "destroy",
+				 G_CALLBACK (g_cancellable_cancel),
+				 cancellable,
+				 G_CONNECT_SWAPPED);
+
+	tepl_file_viewer_open_async (viewer,
+				     location,
+				     G_PRIORITY_DEFAULT,
+				     cancellable,
+				     open_in_viewer_cb,
+				     g_object_ref (tab));
+
+	g_object_unref (cancellable);
+}
+
+static void
+too_big_info_bar_response_cb (GtkInfoBar *info_bar,
+			      gint        response_id,
+			      TeplTab    *tab)
+{
+	if (response_id == GTK_RESPONSE_ACCEPT)
+	{
+		GFile *location;
+
+		location = g_object_get_data (G_OBJECT (info_bar), "location");
+		open_in_viewer (tab, location);
+	}
+
+	gtk_widget_destroy (GTK_WIDGET (info_bar));
+}
+
+static void
+propose_viewer_mode (TeplTab        *tab,
+		     TeplFileLoader *loader,
+		     GError         *error)
+{
+	TeplInfoBar *info_bar;
+
+	info_bar = tepl_info_bar_new_simple (GTK_MESSAGE_WARNING,
+					     _("The file is too big to be edited."),
+					     error->message);
+
+	tepl_info_bar_add_secondary_message (info_bar,
+					     _("It can be opened in a read-only viewer mode, "
+					       "showing only a part of the file at a time."));
+
+	gtk_info_bar_add_button (GTK_INFO_BAR (info_bar),
+				 _("Open in _Viewer Mode"),
+				 GTK_RESPONSE_ACCEPT);
+
+	gtk_info_bar_add_button (GTK_INFO_BAR (info_bar),
+				 _("_Cancel"),
+				 GTK_RESPONSE_CANCEL);
+
+	g_object_set_data_full (G_OBJECT (info_bar),
+				"location",
+				g_object_ref (tepl_file_loader_get_location (loader)),
+				g_object_unref);
+
+	g_signal_connect_object (info_bar,
+				 "response",
+				 G_CALLBACK (too_big_info_bar_response_cb),
+				 tab,
+				 0);
+
+	tepl_tab_add_info_bar (tab, GTK_INFO_BAR (info_bar));
+	gtk_widget_show (GTK_WIDGET (info_bar));
+}
+
 static void
 load_file_cb (GObject      *source_object,
 	      GAsyncResult *result,
 	      gpointer      user_data)
 {
 	TeplFileLoader *loader = TEPL_FILE_LOADER (source_object);
-	TeplTab *tab = TEPL_TAB (user_data);
+	LoadData *data = user_data;
+	TeplTab *tab = data->tab;
+	gboolean success;
 	GError *error = NULL;
 
-	if (tepl_file_loader_load_finish (loader, result, &error))
+	success = tepl_file_loader_load_finish (loader, result, &error);
+
+	/* Not the case when the loading has been cancelled by another call to
+	 * tepl_tab_load_file().
+	 */
+	if (g_object_get_data (G_OBJECT (tab), LOAD_DATA_KEY) == data)
+	{
+		g_object_set_data (G_OBJECT (tab), LOAD_DATA_KEY, NULL);
+		gtk_text_view_set_editable (GTK_TEXT_VIEW (tepl_tab_get_view (tab)),
+					    data->view_was_editable);
+	}
+
+	/* When the tab is destroyed or when another file is loaded, the
+	 * operation is cancelled.
+	 */
+	if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+	{
+		gtk_text_view_set_buffer (GTK_TEXT_VIEW (tepl_tab_get_view (tab)),
+					  GTK_TEXT_BUFFER (data->buffer));
+	}
+
+	if (success)
 	{
-		TeplBuffer *buffer;
 		TeplFile *file;
 
-		buffer = tepl_tab_get_buffer (tab);
-		file = tepl_buffer_get_file (buffer);
+		file = tepl_buffer_get_file (data->buffer);
 		tepl_file_add_uri_to_recent_manager (file);
 	}
 
-	if (error != NULL &&
-	    !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+	if (g_error_matches (error, TEPL_FILE_LOADER_ERROR, TEPL_FILE_LOADER_ERROR_TOO_BIG))
+	{
+		propose_viewer_mode (tab, loader, error);
+	}
+	else if (error != NULL &&
+		 !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
 	{
 		TeplInfoBar *info_bar;
 
@@ -42,7 +230,7 @@ load_file_cb (GObject      *source_object,
 
 	g_clear_error (&error);
 	g_object_unref (loader);
-	g_object_unref (tab);
+	load_data_free (data);
 }
 
 /**
@@ -56,6 +244,20 @@ load_file_cb (GObject      *source_object,
  * This function is asynchronous, there is no way to know when the file loading
  * is finished.
  *
+ * The file is loaded into a new #TeplBuffer, which replaces the #TeplView
+ * buffer when the loading is finished. The new buffer shares the #TeplFile and
+ * the #TeplMetadata of the previous buffer, and has the same
+ * #GtkSourceBuffer settings, including the #GtkSourceLanguage, and the same
+ * construct properties added by a subclass of #TeplBuffer. So an application
+ * that keeps a reference to the #TeplBuffer, or that has connected to its
+ * signals, needs to listen to the #GtkTextView:buffer property. The view is
+ * not editable during the loading.
+ *
+ * If a file is already being loaded in @tab, that operation is cancelled.
+ *
+ * If the file is bigger than #TeplTab:max-file-size, an info bar proposes to
+ * open it with a #TeplFileViewer instead.
+ *
  * Since: 4.0
  */
 void
@@ -63,18 +265,38 @@ tepl_tab_load_file (TeplTab *tab,
 		    GFile   *location)
 {
 	TeplBuffer *buffer;
+	TeplBuffer *new_buffer;
 	TeplFile *file;
 	TeplFileLoader *loader;
 	GCancellable *cancellable;
+	TeplView *view;
+	LoadData *previous_data;
+	LoadData *data;
 
 	g_return_if_fail (TEPL_IS_TAB (tab));
 	g_return_if_fail (G_IS_FILE (location));
 
 	buffer = tepl_tab_get_buffer (tab);
 	file = tepl_buffer_get_file (buffer);
+	view = tepl_tab_get_view (tab);
 
+	/* Leave the viewer mode, if a file was opened with it. */
+	g_object_set_data (G_OBJECT (tab), FILE_VIEWER_KEY, NULL);
+
+	/* The TeplFile is shared by the two buffers, so its location is
+	 * already shown. Like when loading directly into the view buffer, the
+	 * previous content is removed.
+	 */
+	new_buffer = _tepl_buffer_new_sibling (buffer);
 	tepl_file_set_location (file, location);
-	loader = tepl_file_loader_new (buffer, file);
+
+	gtk_source_buffer_begin_not_undoable_action (GTK_SOURCE_BUFFER (buffer));
+	gtk_text_buffer_set_text (GTK_TEXT_BUFFER (buffer), "", -1);
+	gtk_source_buffer_end_not_undoable_action (GTK_SOURCE_BUFFER (buffer));
+	gtk_text_buffer_set_modified (GTK_TEXT_BUFFER (buffer), FALSE);
+
+	loader = tepl_file_loader_new (new_buffer, file);
+	tepl_file_loader_set_max_file_size (loader, tepl_tab_get_max_file_size (tab));
 
 	cancellable = g_cancellable_new ();
 
@@ -88,11 +310,28 @@ tepl_tab_load_file (TeplTab *tab,
 				 cancellable,
 				 G_CONNECT_SWAPPED);
 
+	data = load_data_new (tab, new_buffer, cancellable);
+
+	previous_data = g_object_get_data (G_OBJECT (tab), LOAD_DATA_KEY);
+	if (previous_data != NULL)
+	{
+		data->view_was_editable = previous_data->view_was_editable;
+		g_cancellable_cancel (previous_data->cancellable);
+	}
+	else
+	{
+		data->view_was_editable = gtk_text_view_get_editable (GTK_TEXT_VIEW (view));
+	}
+
+	g_object_set_data (G_OBJECT (tab), LOAD_DATA_KEY, data);
+	gtk_text_view_set_editable (GTK_TEXT_VIEW (view), FALSE);
+
 	tepl_file_loader_load_async (loader,
 				     G_PRIORITY_DEFAULT,
 				     cancellable,
 				     load_file_cb,
-				     g_object_ref (tab));
+				     data);
 
+	g_object_unref (new_buffer);
 	g_object_unref (cancellable);
 }
@@ -8,6 +8,7 @@
 #include "tepl-file.h"
 #include "tepl-file-saver.h"
 #include "tepl-info-bar.h"
+#include "tepl-io-error-info-bars.h"
 #include "tepl-utils.h"
 
 /* The functions in this file permits to run a TeplFileSaver, shows
@@ -17,6 +18,198 @@
  * If this becomes a class, a good name would be TeplTabSaver.
  */
 
+static void launch_saver (GTask *task);
+
+/* Called when the user has answered whether to save anyway. */
+typedef void (*SaveAnywayCallback) (gboolean save_anyway,
+				    gpointer user_data);
+
+typedef struct _SaveAnywayData SaveAnywayData;
+struct _SaveAnywayData
+{
+	TeplFileSaver *saver;
+
+	/* The TeplFileSaverFlags value to add when the user chooses to save
+	 * anyway.
+	 */
+	TeplFileSaverFlags ignore_flag;
+
+	SaveAnywayCallback callback;
+	gpointer user_data;
+};
+
+typedef struct _LaunchData LaunchData;
+struct _LaunchData
+{
+	TeplFileSaver *saver;
+
+	/* Whether the errors that the user can choose to ignore are returned
+	 * by the task, instead of asking to save anyway. For
+	 * tepl_tab_group_save_all_async(), which asks itself.
+	 */
+	guint return_ignorable_errors : 1;
+};
+
+static void
+save_anyway_data_free (SaveAnywayData *data)
+{
+	if (data != NULL)
+	{
+		g_object_unref (data->saver);
+		g_free (data);
+	}
+}
+
+static void
+launch_data_free (gpointer user_data)
+{
+	LaunchData *data = user_data;
+
+	if (data != NULL)
+	{
+		g_object_unref (data->saver);
+		g_free (data);
+	}
+}
+
+/* Returns: whether the user can choose to save anyway despite @error, and the
+ * flag to add to the TeplFileSaver in that case.
+ */
+static gboolean
+get_ignore_flag (const GError       *error,
+		 TeplFileSaverFlags *ignore_flag)
+{
+	if (g_error_matches (error, TEPL_FILE_SAVER_ERROR, TEPL_FILE_SAVER_ERROR_EDITED_LINE_SPLITS))
+	{
+		*ignore_flag = TEPL_FILE_SAVER_FLAGS_IGNORE_EDITED_LINE_SPLITS;
+		return TRUE;
+	}
+
+	if (g_error_matches (error, TEPL_FILE_SAVER_ERROR, TEPL_FILE_SAVER_ERROR_UNCONVERTIBLE_CHARS))
+	{
+		*ignore_flag = TEPL_FILE_SAVER_FLAGS_IGNORE_UNCONVERTIBLE_CHARS;
+		return TRUE;
+	}
+
+	if (g_error_matches (error, TEPL_FILE_SAVER_ERROR, TEPL_FILE_SAVER_ERROR_INVALID_CHARS))
+	{
+		*ignore_flag = TEPL_FILE_SAVER_FLAGS_IGNORE_INVALID_CHARS;
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+/* The info bar is destroyed without a response, for example when the tab is
+ * closed: the file is not saved.
+ */
+static void
+save_anyway_info_bar_destroy_cb (GtkWidget      *info_bar,
+				 SaveAnywayData *data)
+{
+	data->callback (FALSE, data->user_data);
+	save_anyway_data_free (data);
+}
+
+static void
+save_anyway_info_bar_response_cb (GtkInfoBar     *info_bar,
+				  gint            response_id,
+				  SaveAnywayData *data)
+{
+	g_signal_handlers_disconnect_by_func (info_bar,
+					      save_anyway_info_bar_destroy_cb,
+					      data);
+	gtk_widget_destroy (GTK_WIDGET (info_bar));
+
+	if (response_id == GTK_RESPONSE_YES)
+	{
+		TeplFileSaverFlags flags;
+
+		flags = tepl_file_saver_get_flags (data->saver);
+		tepl_file_saver_set_flags (data->saver, flags | data->ignore_flag);
+	}
+
+	data->callback (response_id == GTK_RESPONSE_YES, data->user_data);
+	save_anyway_data_free (data);
+}
+
+/* For the errors for which get_ignore_flag() returns %TRUE. Shows an info bar
+ * in @tab with the %GTK_RESPONSE_YES and %GTK_RESPONSE_CANCEL responses. If
+ * the user chooses to save anyway, @ignore_flag is added to @saver. @callback
+ * is called exactly once, also when the info bar is destroyed without a
+ * response.
+ *
+ * Returns: (transfer none): the info bar.
+ */
+static GtkWidget *
+ask_to_save_anyway (TeplTab            *tab,
+		    TeplFileSaver      *saver,
+		    const GError       *error,
+		    TeplFileSaverFlags  ignore_flag,
+		    SaveAnywayCallback  callback,
+		    gpointer            user_data)
+{
+	SaveAnywayData *data;
+	TeplInfoBar *info_bar;
+
+	data = g_new0 (SaveAnywayData, 1);
+	data->saver = g_object_ref (saver);
+	data->ignore_flag = ignore_flag;
+	data->callback = callback;
+	data->user_data = user_data;
+
+	if (ignore_flag == TEPL_FILE_SAVER_FLAGS_IGNORE_INVALID_CHARS)
+	{
+		info_bar = tepl_io_error_info_bar_invalid_characters (tepl_file_saver_get_location (saver));
+	}
+	else
+	{
+		info_bar = tepl_info_bar_new_simple (GTK_MESSAGE_WARNING,
+						     _("Save the file anyway?"),
+						     error->message);
+
+		gtk_info_bar_add_button (GTK_INFO_BAR (info_bar),
+					 _("S_ave Anyway"),
+					 GTK_RESPONSE_YES);
+
+		gtk_info_bar_add_button (GTK_INFO_BAR (info_bar),
+					 _("_Don’t Save"),
+					 GTK_RESPONSE_CANCEL);
+	}
+
+	g_signal_connect (info_bar,
+			  "response",
+			  G_CALLBACK (save_anyway_info_bar_response_cb),
+			  data);
+
+	g_signal_connect (info_bar,
+			  "destroy",
+			  G_CALLBACK (save_anyway_info_bar_destroy_cb),
+			  data);
+
+	tepl_tab_add_info_bar (tab, GTK_INFO_BAR (info_bar));
+	gtk_widget_show (GTK_WIDGET (info_bar));
+
+	return GTK_WIDGET (info_bar);
+}
+
+static void
+launch_saver_save_anyway_cb (gboolean save_anyway,
+			     gpointer user_data)
+{
+	GTask *task = G_TASK (user_data);
+
+	if (save_anyway)
+	{
+		launch_saver (task);
+	}
+	else
+	{
+		g_task_return_boolean (task, FALSE);
+		g_object_unref (task);
+	}
+}
+
 static void
 launch_saver_cb (GObject      *source_object,
 		 GAsyncResult *result,
@@ -24,8 +217,10 @@ launch_saver_cb (GObject      *source_object,
 {
 	TeplFileSaver *saver = TEPL_FILE_SAVER (source_object);
 	GTask *task = G_TASK (user_data);
+	LaunchData *data = g_task_get_task_data (task);
 	TeplTab *tab;
 	GApplication *app;
+	TeplFileSaverFlags ignore_flag;
 	GError *error = NULL;
 	gboolean success;
 
@@ -33,6 +228,27 @@ launch_saver_cb (GObject      *source_object,
 
 	success = tepl_file_saver_save_finish (saver, result, &error);
 
+	app = g_application_get_default ();
+	if (app != NULL)
+	{
+		g_application_unmark_busy (app);
+		g_application_release (app);
+	}
+
+	if (get_ignore_flag (error, &ignore_flag))
+	{
+		if (data->return_ignorable_errors)
+		{
+			g_task_return_error (task, error);
+			g_object_unref (task);
+			return;
+		}
+
+		ask_to_save_anyway (tab, saver, error, ignore_flag, launch_saver_save_anyway_cb, task);
+		g_clear_error (&error);
+		return;
+	}
+
 	if (success)
 	{
 		TeplFile *file;
@@ -43,22 +259,27 @@ launch_saver_cb (GObject      *source_object,
 
 	if (error != NULL)
 	{
-		TeplInfoBar *info_bar;
+		/* Not an error to show, the caller has cancelled the save. */
+		if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+		{
+			TeplInfoBar *info_bar;
 
-		info_bar = tepl_info_bar_new_simple (GTK_MESSAGE_ERROR,
-						     _("Error when saving the file."),
-						     error->message);
-		tepl_info_bar_setup_close_button (info_bar);
-		tepl_tab_add_info_bar (tab, GTK_INFO_BAR (info_bar));
-		gtk_widget_show (GTK_WIDGET (info_bar));
+			info_bar = tepl_info_bar_new_simple (GTK_MESSAGE_ERROR,
+							     _("Error when saving the file."),
+							     error->message);
+			tepl_info_bar_setup_close_button (info_bar);
+			tepl_tab_add_info_bar (tab, GTK_INFO_BAR (info_bar));
+			gtk_widget_show (GTK_WIDGET (info_bar));
+		}
 
-		g_clear_error (&error);
+		/* Already shown to the user, but the error is kept for
+		 * tepl_tab_group_save_all_async().
+		 */
+		g_task_return_error (task, error);
+		g_object_unref (task);
+		return;
 	}
 
-	app = g_application_get_default ();
-	g_application_unmark_busy (app);
-	g_application_release (app);
-
 	g_task_return_boolean (task, success);
 	g_object_unref (task);
 }
@@ -66,49 +287,68 @@ launch_saver_cb (GObject      *source_object,
 static void
 launch_saver (GTask *task)
 {
-	TeplFileSaver *saver;
+	LaunchData *data;
 	GApplication *app;
 
-	saver = g_task_get_task_data (task);
+	data = g_task_get_task_data (task);
 
+	/* There can be no GApplication, for example in the unit tests. */
 	app = g_application_get_default ();
-	g_application_hold (app);
-	g_application_mark_busy (app);
+	if (app != NULL)
+	{
+		g_application_hold (app);
+		g_application_mark_busy (app);
+	}
 
-	tepl_file_saver_save_async (saver,
+	tepl_file_saver_save_async (data->saver,
 				    G_PRIORITY_DEFAULT,
-				    NULL,
+				    g_task_get_cancellable (task),
 				    launch_saver_cb,
 				    task);
 }
 
 static void
-launch_saver_async (TeplTab             *tab,
-		    TeplFileSaver       *saver,
-		    GAsyncReadyCallback  callback,
-		    gpointer             user_data)
+launch_saver_async_full (TeplTab             *tab,
+			 TeplFileSaver       *saver,
+			 gboolean             return_ignorable_errors,
+			 GCancellable        *cancellable,
+			 GAsyncReadyCallback  callback,
+			 gpointer             user_data)
 {
 	GTask *task;
+	LaunchData *data;
 
 	g_return_if_fail (TEPL_IS_TAB (tab));
 	g_return_if_fail (TEPL_IS_FILE_SAVER (saver));
 
-	task = g_task_new (tab, NULL, callback, user_data);
-	g_task_set_task_data (task,
-			      g_object_ref (saver),
-			      g_object_unref);
+	task = g_task_new (tab, cancellable, callback, user_data);
+
+	data = g_new0 (LaunchData, 1);
+	data->saver = g_object_ref (saver);
+	data->return_ignorable_errors = return_ignorable_errors != FALSE;
+	g_task_set_task_data (task, data, launch_data_free);
 
 	launch_saver (task);
 }
 
+static void
+launch_saver_async (TeplTab             *tab,
+		    TeplFileSaver       *saver,
+		    GAsyncReadyCallback  callback,
+		    gpointer             user_data)
+{
+	launch_saver_async_full (tab, saver, FALSE, NULL, callback, user_data);
+}
+
 static gboolean
-launch_saver_finish (TeplTab      *tab,
-		     GAsyncResult *result)
+launch_saver_finish (TeplTab       *tab,
+		     GAsyncResult  *result,
+		     GError       **error)
 {
 	g_return_val_if_fail (TEPL_IS_TAB (tab), FALSE);
 	g_return_val_if_fail (g_task_is_valid (result, tab), FALSE);
 
-	return g_task_propagate_boolean (G_TASK (result), NULL);
+	return g_task_propagate_boolean (G_TASK (result), error);
 }
 
 /**
@@ -161,7 +401,7 @@ gboolean
 tepl_tab_save_finish (TeplTab      *tab,
 		      GAsyncResult *result)
 {
-	return launch_saver_finish (tab, result);
+	return launch_saver_finish (tab, result, NULL);
 }
 
 static void
@@ -207,7 +447,7 @@ save_as_cb (GObject      *source_object,
 	GTask *task = G_TASK (user_data);
 	gboolean ok;
 
-	ok = launch_saver_finish (tab, result);
+	ok = launch_saver_finish (tab, result, NULL);
 
 	g_task_return_boolean (task, ok);
 	g_object_unref (task);
@@ -355,3 +595,826 @@ tepl_tab_save_as_async_simple (TeplTab *tab)
 				save_as_async_simple_cb,
 				NULL);
 }
+
+/* Save all */
+
+#define DEFAULT_MAX_CONCURRENT_SAVES (2)
+
+/* For all the devices together, so that saving many tabs on many devices
+ * doesn't open too many files at once.
+ */
+#define MAX_TOTAL_CONCURRENT_SAVES (8)
+
+typedef struct _SaveAllQuery SaveAllQuery;
+struct _SaveAllQuery
+{
+	/* Unowned, the task waits for all the queries. */
+	GTask *task;
+
+	TeplTab *tab;
+
+	/* NULL until the query is finished. */
+	gchar *device_id;
+};
+
+/* A tab waiting in a device queue. */
+typedef struct _SaveAllItem SaveAllItem;
+struct _SaveAllItem
+{
+	TeplTab *tab;
+
+	/* NULL for the first attempt. When the user has chosen to save anyway,
+	 * the saver with the flag to ignore the error.
+	 */
+	TeplFileSaver *saver;
+};
+
+typedef struct _SaveAllData SaveAllData;
+struct _SaveAllData
+{
+	/* The tabs to save, in the order of the tab group. The device IDs are
+	 * queried in parallel, the tabs are then added to the queues in that
+	 * order.
+	 */
+	GPtrArray *queries;
+	guint n_running_queries;
+
+	/* Key: device ID (owned gchar *).
+	 * Value: owned GQueue of owned SaveAllItem's.
+	 * The order is kept in @device_ids.
+	 */
+	GHashTable *device_queues;
+	GPtrArray *device_ids;
+
+	/* Key: device ID. Value: GUINT_TO_POINTER (number of running saves). */
+	GHashTable *running_saves;
+
+	/* The device where the next free slot is looked for first, so that the
+	 * devices take turns when MAX_TOTAL_CONCURRENT_SAVES is reached.
+	 */
+	guint next_device_index;
+
+	guint max_concurrent_saves;
+	guint n_running_saves;
+
+	/* The info bars asking to save anyway, unowned. The tabs waiting for
+	 * the user don't use a slot.
+	 */
+	GList *waiting_info_bars;
+
+	/* To remove @waiting_info_bars when the operation is cancelled. */
+	GSource *cancelled_source;
+
+	/* For the unit tests. */
+	guint max_n_running_saves;
+	guint max_n_running_saves_per_device;
+
+	GList *failed_tabs;
+	GString *error_messages;
+};
+
+typedef struct _SaveAllTabData SaveAllTabData;
+struct _SaveAllTabData
+{
+	GTask *task;
+	gchar *device_id;
+	TeplTab *tab;
+	TeplFileSaver *saver;
+
+	/* While the user is asked to save anyway. */
+	GtkWidget *info_bar;
+};
+
+static void save_all_launch_saves (GTask *task);
+
+static void
+save_all_query_free (gpointer data)
+{
+	SaveAllQuery *query = data;
+
+	if (query != NULL)
+	{
+		g_object_unref (query->tab);
+		g_free (query->device_id);
+		g_free (query);
+	}
+}
+
+static SaveAllItem *
+save_all_item_new (TeplTab       *tab,
+		   TeplFileSaver *saver)
+{
+	SaveAllItem *item;
+
+	item = g_new0 (SaveAllItem, 1);
+	item->tab = g_object_ref (tab);
+	item->saver = saver != NULL ? g_object_ref (saver) : NULL;
+
+	return item;
+}
+
+static void
+save_all_item_free (gpointer data)
+{
+	SaveAllItem *item = data;
+
+	if (item != NULL)
+	{
+		g_object_unref (item->tab);
+		g_clear_object (&item->saver);
+		g_free (item);
+	}
+}
+
+static void
+queue_free (gpointer data)
+{
+	g_queue_free_full (data, save_all_item_free);
+}
+
+static void
+save_all_tab_data_free (SaveAllTabData *tab_data)
+{
+	if (tab_data != NULL)
+	{
+		g_object_unref (tab_data->tab);
+		g_object_unref (tab_data->saver);
+		g_free (tab_data);
+	}
+}
+
+static SaveAllData *
+save_all_data_new (guint max_concurrent_saves)
+{
+	SaveAllData *data;
+
+	data = g_new0 (SaveAllData, 1);
+	data->queries = g_ptr_array_new_with_free_func (save_all_query_free);
+	data->device_queues = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, queue_free);
+	data->device_ids = g_ptr_array_new ();
+	data->running_saves = g_hash_table_new (g_str_hash, g_str_equal);
+	data->max_concurrent_saves = max_concurrent_saves > 0 ? max_concurrent_saves : DEFAULT_MAX_CONCURRENT_SAVES;
+
+	return data;
+}
+
+static void
+save_all_data_free (gpointer user_data)
+{
+	SaveAllData *data = user_data;
+
+	if (data != NULL)
+	{
+		g_assert (data->waiting_info_bars == NULL);
+
+		if (data->cancelled_source != NULL)
+		{
+			g_source_destroy (data->cancelled_source);
+			g_source_unref (data->cancelled_source);
+		}
+
+		g_ptr_array_unref (data->queries);
+		g_hash_table_unref (data->running_saves);
+		g_ptr_array_unref (data->device_ids);
+		g_hash_table_unref (data->device_queues);
+		g_list_free_full (data->failed_tabs, g_object_unref);
+
+		if (data->error_messages != NULL)
+		{
+			g_string_free (data->error_messages, TRUE);
+		}
+
+		g_free (data);
+	}
+}
+
+static void
+save_all_return (GTask *task)
+{
+	SaveAllData *data = g_task_get_task_data (task);
+	guint n_failed_tabs;
+
+	if (data->cancelled_source != NULL)
+	{
+		g_source_destroy (data->cancelled_source);
+		g_clear_pointer (&data->cancelled_source, g_source_unref);
+	}
+
+	n_failed_tabs = g_list_length (data->failed_tabs);
+
+	if (n_failed_tabs == 0)
+	{
+		g_task_return_boolean (task, TRUE);
+		g_object_unref (task);
+		return;
+	}
+
+	/* In the order in which the saves have finished. */
+	data->failed_tabs = g_list_reverse (data->failed_tabs);
+
+	if (data->error_messages != NULL)
+	{
+		g_task_return_new_error (task,
+					 G_IO_ERROR,
+					 G_IO_ERROR_FAILED,
+					 ngettext ("%u document could not be saved:\n%s",
+						   "%u documents could not be saved:\n%s",
+						   n_failed_tabs),
+					 n_failed_tabs,
+					 data->error_messages->str);
+	}
+	else
+	{
+		/* Only tabs that the user chose to not save, or that were not
+		 * saved because the operation has been cancelled.
+		 */
+		g_task_return_new_error (task,
+					 G_IO_ERROR,
+					 G_IO_ERROR_CANCELLED,
+					 ngettext ("%u document was not saved.",
+						   "%u documents were not saved.",
+						   n_failed_tabs),
+					 n_failed_tabs);
+	}
+
+	g_object_unref (task);
+}
+
+/* @error can be %NULL if the tab has not been saved without an error to
+ * report.
+ */
+static void
+save_all_add_error (SaveAllData  *data,
+		    TeplTab      *tab,
+		    const GError *error)
+{
+	TeplFile *file;
+	gchar *short_name;
+
+	data->failed_tabs = g_list_prepend (data->failed_tabs, g_object_ref (tab));
+
+	if (error == NULL ||
+	    g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+	{
+		return;
+	}
+
+	if (data->error_messages == NULL)
+	{
+		data->error_messages = g_string_new (NULL);
+	}
+	else
+	{
+		g_string_append_c (data->error_messages, '\n');
+	}
+
+	file = tepl_buffer_get_file (tepl_tab_get_buffer (tab));
+	short_name = tepl_file_get_short_name (file);
+
+	/* Translators: the first %s is a filename, the second %s is an error
+	 * message.
+	 */
+	g_string_append_printf (data->error_messages, _("%s: %s"), short_name, error->message);
+
+	g_free (short_name);
+}
+
+static void
+save_all_save_anyway_cb (gboolean save_anyway,
+			 gpointer user_data)
+{
+	SaveAllTabData *tab_data = user_data;
+	GTask *task = tab_data->task;
+	SaveAllData *data = g_task_get_task_data (task);
+
+	data->waiting_info_bars = g_list_remove (data->waiting_info_bars, tab_data->info_bar);
+
+	if (save_anyway &&
+	    !g_cancellable_is_cancelled (g_task_get_cancellable (task)))
+	{
+		GQueue *queue;
+
+		/* First in its queue, the user is waiting for it. */
+		queue = g_hash_table_lookup (data->device_queues, tab_data->device_id);
+		g_queue_push_head (queue, save_all_item_new (tab_data->tab, tab_data->saver));
+	}
+	else
+	{
+		save_all_add_error (data, tab_data->tab, NULL);
+	}
+
+	save_all_tab_data_free (tab_data);
+	save_all_launch_saves (task);
+}
+
+static void
+save_all_tab_cb (GObject      *source_object,
+		 GAsyncResult *result,
+		 gpointer      user_data)
+{
+	TeplTab *tab = TEPL_TAB (source_object);
+	SaveAllTabData *tab_data = user_data;
+	GTask *task = tab_data->task;
+	SaveAllData *data = g_task_get_task_data (task);
+	guint n_running_saves_for_device;
+	TeplFileSaverFlags ignore_flag;
+	GError *error = NULL;
+
+	n_running_saves_for_device = GPOINTER_TO_UINT (g_hash_table_lookup (data->running_saves,
+									     tab_data->device_id));
+	g_assert (n_running_saves_for_device > 0);
+	g_hash_table_insert (data->running_saves,
+			     tab_data->device_id,
+			     GUINT_TO_POINTER (n_running_saves_for_device - 1));
+
+	g_assert (data->n_running_saves > 0);
+	data->n_running_saves--;
+
+	if (launch_saver_finish (tab, result, &error))
+	{
+		save_all_tab_data_free (tab_data);
+	}
+	else if (get_ignore_flag (error, &ignore_flag) &&
+		 !g_cancellable_is_cancelled (g_task_get_cancellable (task)))
+	{
+		/* The slot is released while the user decides, the tab is
+		 * queued again if the user chooses to save anyway.
+		 */
+		tab_data->info_bar = ask_to_save_anyway (tab,
+							 tab_data->saver,
+							 error,
+							 ignore_flag,
+							 save_all_save_anyway_cb,
+							 tab_data);
+		data->waiting_info_bars = g_list_prepend (data->waiting_info_bars, tab_data->info_bar);
+	}
+	else
+	{
+		save_all_add_error (data, tab, error);
+		save_all_tab_data_free (tab_data);
+	}
+
+	g_clear_error (&error);
+	save_all_launch_saves (task);
+}
+
+static void
+save_all_launch_save (GTask  *task,
+		      gchar  *device_id,
+		      GQueue *queue,
+		      guint   n_running_saves_for_device)
+{
+	SaveAllData *data = g_task_get_task_data (task);
+	SaveAllItem *item;
+	SaveAllTabData *tab_data;
+
+	item = g_queue_pop_head (queue);
+
+	tab_data = g_new0 (SaveAllTabData, 1);
+	tab_data->task = task;
+
+	/* Owned by data->device_queues. */
+	tab_data->device_id = device_id;
+
+	tab_data->tab = g_object_ref (item->tab);
+
+	if (item->saver != NULL)
+	{
+		tab_data->saver = g_object_ref (item->saver);
+	}
+	else
+	{
+		TeplBuffer *buffer = tepl_tab_get_buffer (item->tab);
+
+		tab_data->saver = tepl_file_saver_new (buffer, tepl_buffer_get_file (buffer));
+	}
+
+	g_hash_table_insert (data->running_saves,
+			     device_id,
+			     GUINT_TO_POINTER (n_running_saves_for_device + 1));
+	data->n_running_saves++;
+
+	data->max_n_running_saves = MAX (data->max_n_running_saves, data->n_running_saves);
+	data->max_n_running_saves_per_device = MAX (data->max_n_running_saves_per_device,
+						    n_running_saves_for_device + 1);
+
+	launch_saver_async_full (item->tab,
+				 tab_data->saver,
+				 TRUE,
+				 g_task_get_cancellable (task),
+				 save_all_tab_cb,
+				 tab_data);
+
+	save_all_item_free (item);
+}
+
+/* When the operation is cancelled, the tabs still in the queues are not
+ * saved.
+ */
+static void
+save_all_clear_queues (SaveAllData *data)
+{
+	guint i;
+
+	for (i = 0; i < data->device_ids->len; i++)
+	{
+		gchar *device_id = g_ptr_array_index (data->device_ids, i);
+		GQueue *queue = g_hash_table_lookup (data->device_queues, device_id);
+		SaveAllItem *item;
+
+		while ((item = g_queue_pop_head (queue)) != NULL)
+		{
+			save_all_add_error (data, item->tab, NULL);
+			save_all_item_free (item);
+		}
+	}
+}
+
+/* Launches the next saves, at most data->max_concurrent_saves at a time on
+ * each device, so that a slow device (for example a network mount) doesn't
+ * delay the saves on the other devices, and isn't flooded with requests. And
+ * at most MAX_TOTAL_CONCURRENT_SAVES in total, the devices taking turns to
+ * have the free slots.
+ */
+static void
+save_all_launch_saves (GTask *task)
+{
+	SaveAllData *data = g_task_get_task_data (task);
+	guint n_devices = data->device_ids->len;
+	guint n_visited_devices = 0;
+	gboolean all_queues_empty = TRUE;
+	guint i;
+
+	if (g_cancellable_is_cancelled (g_task_get_cancellable (task)))
+	{
+		save_all_clear_queues (data);
+	}
+
+	/* Visits the devices in turn, one save at a time, until a whole round
+	 * doesn't launch anything.
+	 */
+	while (n_visited_devices < n_devices &&
+	       data->n_running_saves < MAX_TOTAL_CONCURRENT_SAVES)
+	{
+		gchar *device_id;
+		GQueue *queue;
+		guint n_running_saves_for_device;
+
+		device_id = g_ptr_array_index (data->device_ids, data->next_device_index);
+		queue = g_hash_table_lookup (data->device_queues, device_id);
+		n_running_saves_for_device = GPOINTER_TO_UINT (g_hash_table_lookup (data->running_saves,
+										     device_id));
+
+		data->next_device_index = (data->next_device_index + 1) % n_devices;
+
+		if (n_running_saves_for_device < data->max_concurrent_saves &&
+		    !g_queue_is_empty (queue))
+		{
+			save_all_launch_save (task, device_id, queue, n_running_saves_for_device);
+			n_visited_devices = 0;
+		}
+		else
+		{
+			n_visited_devices++;
+		}
+	}
+
+	for (i = 0; i < n_devices; i++)
+	{
+		gchar *device_id = g_ptr_array_index (data->device_ids, i);
+		GQueue *queue = g_hash_table_lookup (data->device_queues, device_id);
+
+		if (!g_queue_is_empty (queue))
+		{
+			all_queues_empty = FALSE;
+			break;
+		}
+	}
+
+	if (all_queues_empty &&
+	    data->n_running_saves == 0 &&
+	    data->waiting_info_bars == NULL)
+	{
+		save_all_return (task);
+	}
+}
+
+/* The info bars are destroyed, so the tabs waiting for the user are not
+ * saved.
+ */
+static gboolean
+save_all_cancelled_cb (GCancellable *cancellable,
+		       gpointer      user_data)
+{
+	GTask *task = G_TASK (user_data);
+	SaveAllData *data = g_task_get_task_data (task);
+
+	/* The task can return when the last info bar is destroyed. */
+	g_object_ref (task);
+
+	/* The destroy callbacks modify the list. */
+	while (data->waiting_info_bars != NULL)
+	{
+		gtk_widget_destroy (data->waiting_info_bars->data);
+	}
+
+	g_object_unref (task);
+	return G_SOURCE_REMOVE;
+}
+
+static void
+save_all_add_tab_to_queue (SaveAllData *data,
+			   TeplTab     *tab,
+			   const gchar *device_id)
+{
+	GQueue *queue;
+
+	queue = g_hash_table_lookup (data->device_queues, device_id);
+
+	if (queue == NULL)
+	{
+		gchar *device_id_copy = g_strdup (device_id);
+
+		queue = g_queue_new ();
+		g_hash_table_insert (data->device_queues, device_id_copy, queue);
+		g_ptr_array_add (data->device_ids, device_id_copy);
+	}
+
+	g_queue_push_tail (queue, save_all_item_new (tab, NULL));
+}
+
+static void
+query_device_id_cb (GObject      *source_object,
+		    GAsyncResult *result,
+		    gpointer      user_data)
+{
+	GFile *location = G_FILE (source_object);
+	SaveAllQuery *query = user_data;
+	GTask *task = query->task;
+	SaveAllData *data = g_task_get_task_data (task);
+	GFileInfo *info;
+	const gchar *filesystem_id = NULL;
+	guint i;
+
+	/* Errors are ignored here, for example when the file doesn't exist yet.
+	 * The saver will report them if the error persists.
+	 */
+	info = g_file_query_info_finish (location, result, NULL);
+
+	if (info != NULL)
+	{
+		filesystem_id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILESYSTEM);
+	}
+
+	if (filesystem_id != NULL)
+	{
+		query->device_id = g_strdup (filesystem_id);
+	}
+	else
+	{
+		/* Fallback: group by URI scheme, all the remote locations of
+		 * the same kind are thus considered as one device.
+		 */
+		query->device_id = g_file_get_uri_scheme (location);
+
+		if (query->device_id == NULL)
+		{
+			query->device_id = g_strdup ("");
+		}
+	}
+
+	g_clear_object (&info);
+
+	g_assert (data->n_running_queries > 0);
+	data->n_running_queries--;
+
+	if (data->n_running_queries > 0)
+	{
+		return;
+	}
+
+	for (i = 0; i < data->queries->len; i++)
+	{
+		SaveAllQuery *cur_query = g_ptr_array_index (data->queries, i);
+
+		save_all_add_tab_to_queue (data, cur_query->tab, cur_query->device_id);
+	}
+
+	g_ptr_array_set_size (data->queries, 0);
+
+	save_all_launch_saves (task);
+}
+
+/* The queries are independent, and can be slow for remote locations, so they
+ * are all launched at once.
+ */
+static void
+save_all_query_device_ids (GTask *task)
+{
+	SaveAllData *data = g_task_get_task_data (task);
+	guint i;
+
+	if (data->queries->len == 0)
+	{
+		save_all_launch_saves (task);
+		return;
+	}
+
+	data->n_running_queries = data->queries->len;
+
+	for (i = 0; i < data->queries->len; i++)
+	{
+		SaveAllQuery *query = g_ptr_array_index (data->queries, i);
+		TeplFile *file;
+		GFile *location;
+
+		file = tepl_buffer_get_file (tepl_tab_get_buffer (query->tab));
+		location = tepl_file_get_location (file);
+
+		g_file_query_info_async (location,
+					 G_FILE_ATTRIBUTE_ID_FILESYSTEM,
+					 G_FILE_QUERY_INFO_NONE,
+					 G_PRIORITY_DEFAULT,
+					 g_task_get_cancellable (task),
+					 query_device_id_cb,
+					 query);
+	}
+}
+
+static gboolean
+tab_needs_saving (TeplTab *tab)
+{
+	TeplBuffer *buffer;
+	TeplFile *file;
+
+	buffer = tepl_tab_get_buffer (tab);
+	file = tepl_buffer_get_file (buffer);
+
+	return (tepl_file_get_location (file) != NULL &&
+		gtk_text_buffer_get_modified (GTK_TEXT_BUFFER (buffer)));
+}
+
+/**
+ * tepl_tab_group_save_all_async:
+ * @tab_group: a #TeplTabGroup.
+ * @max_concurrent_saves: the maximum number of files to save at the same time
+ *   on the same device, or 0 for a default value.
+ * @cancellable: (nullable): optional #GCancellable object, %NULL to ignore.
+ * @callback: (scope async): a #GAsyncReadyCallback to call when the request is
+ *   satisfied.
+ * @user_data: user data to pass to @callback.
+ *
+ * Saves asynchronously all the modified #TeplTab's of @tab_group that have a
+ * #TeplFile:location. Untitled documents are not saved, use
+ * tepl_tab_save_as_async() for them.
+ *
+ * The tabs are grouped by the device (the filesystem) that contains their
+ * #TeplFile:location, and each device has its own queue: at most
+ * @max_concurrent_saves files are saved at the same time on one device, while
+ * the different devices are saved in parallel. So a slow network mount is not
+ * flooded with requests, and doesn't delay the saving of the local files. At
+ * most 8 files are saved at the same time in total.
+ *
+ * Each tab is saved like with tepl_tab_save_async(), so the errors are shown in
+ * #TeplInfoBar's on the affected tabs. The summary of the errors is returned by
+ * tepl_tab_group_save_all_finish(). While a #TeplInfoBar asks the user whether
+ * to save a file anyway, the other files of the same device are saved; if the
+ * user chooses to save anyway, the file is queued again.
+ *
+ * If @cancellable is cancelled, the running saves are cancelled, the files not
+ * yet saved are not saved, and the #TeplInfoBar's asking to save anyway are
+ * removed.
+ *
+ * See the #GAsyncResult documentation to know how to use this function.
+ *
+ * Since: 6.0
+ */
+void
+tepl_tab_group_save_all_async (TeplTabGroup        *tab_group,
+			       guint                max_concurrent_saves,
+			       GCancellable        *cancellable,
+			       GAsyncReadyCallback  callback,
+			       gpointer             user_data)
+{
+	GTask *task;
+	SaveAllData *data;
+	GList *tabs;
+	GList *l;
+
+	g_return_if_fail (TEPL_IS_TAB_GROUP (tab_group));
+	g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+
+	task = g_task_new (tab_group, cancellable, callback, user_data);
+
+	/* The tabs not saved because of the cancellation are reported like
+	 * the other ones, see save_all_return().
+	 */
+	g_task_set_check_cancellable (task, FALSE);
+
+	data = save_all_data_new (max_concurrent_saves);
+	g_task_set_task_data (task, data, save_all_data_free);
+
+	if (cancellable != NULL)
+	{
+		data->cancelled_source = g_cancellable_source_new (cancellable);
+		g_source_set_callback (data->cancelled_source,
+				       (GSourceFunc) save_all_cancelled_cb,
+				       task,
+				       NULL);
+		g_source_attach (data->cancelled_source, g_main_context_get_thread_default ());
+	}
+
+	tabs = tepl_tab_group_get_tabs (tab_group);
+
+	for (l = tabs; l != NULL; l = l->next)
+	{
+		TeplTab *cur_tab = l->data;
+
+		if (tab_needs_saving (cur_tab))
+		{
+			SaveAllQuery *query;
+
+			query = g_new0 (SaveAllQuery, 1);
+			query->task = task;
+			query->tab = g_object_ref (cur_tab);
+			g_ptr_array_add (data->queries, query);
+		}
+	}
+
+	g_list_free (tabs);
+
+	save_all_query_device_ids (task);
+}
+
+/**
+ * tepl_tab_group_save_all_finish:
+ * @tab_group: a #TeplTabGroup.
+ * @result: a #GAsyncResult.
+ * @failed_tabs: (out) (optional) (transfer full) (element-type TeplTab): the
+ *   list of the #TeplTab's that have not been saved, or %NULL.
+ * @error: a #GError, or %NULL.
+ *
+ * Finishes a save operation started with tepl_tab_group_save_all_async().
+ *
+ * If one or more tabs have not been saved, @error contains a summary with the
+ * error message of each tab, and @failed_tabs contains the list of those tabs.
+ * If the user has chosen to not save some tabs (see
+ * %TEPL_FILE_SAVER_ERROR_EDITED_LINE_SPLITS,
+ * %TEPL_FILE_SAVER_ERROR_UNCONVERTIBLE_CHARS and
+ * %TEPL_FILE_SAVER_ERROR_INVALID_CHARS), or has closed the info bar asking it,
+ * or if the operation has been cancelled, and there were no other errors,
+ * @error is %G_IO_ERROR_CANCELLED.
+ *
+ * Returns: whether all the tabs were saved successfully.
+ * Since: 6.0
+ */
+gboolean
+tepl_tab_group_save_all_finish (TeplTabGroup  *tab_group,
+				GAsyncResult  *result,
+				GList        **failed_tabs,
+				GError       **error)
+{
+	SaveAllData *data;
+
+	g_return_val_if_fail (TEPL_IS_TAB_GROUP (tab_group), FALSE);
+	g_return_val_if_fail (g_task_is_valid (result, tab_group), FALSE);
+
+	data = g_task_get_task_data (G_TASK (result));
+
+	if (failed_tabs != NULL)
+	{
+		*failed_tabs = data->failed_tabs;
+		data->failed_tabs = NULL;
+	}
+
+	return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+/* For the unit tests. To be called before tepl_tab_group_save_all_finish(). */
+void
+_tepl_tab_group_save_all_get_stats (GAsyncResult *result,
+				    guint        *n_devices,
+				    guint        *max_running_saves,
+				    guint        *max_running_saves_per_device)
+{
+	SaveAllData *data;
+
+	g_return_if_fail (G_IS_TASK (result));
+
+	data = g_task_get_task_data (G_TASK (result));
+
+	if (n_devices != NULL)
+	{
+		*n_devices = data->device_ids->len;
+	}
+
+	if (max_running_saves != NULL)
+	{
+		*max_running_saves = data->max_n_running_saves;
+	}
+
+	if (max_running_saves_per_device != NULL)
+	{
+		*max_running_saves_per_device = data->max_n_running_saves_per_device;
+	}
+}
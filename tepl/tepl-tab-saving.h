@@ -10,6 +10,7 @@
 #endif
 
 #include <tepl/tepl-tab.h>
+#include <tepl/tepl-tab-group.h>
 
 G_BEGIN_DECLS
 
@@ -37,6 +38,25 @@ gboolean	tepl_tab_save_as_finish		(TeplTab      *tab,
 _TEPL_EXTERN
 void		tepl_tab_save_as_async_simple	(TeplTab *tab);
 
+_TEPL_EXTERN
+void		tepl_tab_group_save_all_async	(TeplTabGroup        *tab_group,
+						 guint                max_concurrent_saves,
+						 GCancellable        *cancellable,
+						 GAsyncReadyCallback  callback,
+						 gpointer             user_data);
+
+_TEPL_EXTERN
+gboolean	tepl_tab_group_save_all_finish	(TeplTabGroup  *tab_group,
+						 GAsyncResult  *result,
+						 GList        **failed_tabs,
+						 GError       **error);
+
+G_GNUC_INTERNAL
+void		_tepl_tab_group_save_all_get_stats	(GAsyncResult *result,
+							 guint        *n_devices,
+							 guint        *max_running_saves,
+							 guint        *max_running_saves_per_device);
+
 G_END_DECLS
 
 #endif /* TEPL_TAB_SAVING_H */
@@ -49,8 +49,14 @@ struct _TeplTabPrivate
 	GtkScrolledWindow *scrolled_window;
 	TeplView *view;
 	TeplGotoLineBar *goto_line_bar;
+	guint64 max_file_size;
 };
 
+/* Above this size, tepl_tab_load_file() proposes to open the file with a
+ * TeplFileViewer.
+ */
+#define DEFAULT_MAX_FILE_SIZE (100 * 1000 * 1000)
+
 enum
 {
 	PROP_0,
@@ -58,6 +64,7 @@ enum
 	PROP_ACTIVE_TAB,
 	PROP_ACTIVE_VIEW,
 	PROP_ACTIVE_BUFFER,
+	PROP_MAX_FILE_SIZE,
 };
 
 enum
@@ -235,6 +242,10 @@ tepl_tab_get_property (GObject    *object,
 			g_value_set_object (value, tepl_tab_group_get_active_buffer (tab_group));
 			break;
 
+		case PROP_MAX_FILE_SIZE:
+			g_value_set_uint64 (value, tepl_tab_get_max_file_size (tab));
+			break;
+
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 			break;
@@ -260,6 +271,10 @@ tepl_tab_set_property (GObject      *object,
 			tepl_tab_group_set_active_tab (tab_group, g_value_get_object (value));
 			break;
 
+		case PROP_MAX_FILE_SIZE:
+			tepl_tab_set_max_file_size (tab, g_value_get_uint64 (value));
+			break;
+
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 			break;
@@ -314,6 +329,26 @@ tepl_tab_class_init (TeplTabClass *klass)
 	g_object_class_override_property (object_class, PROP_ACTIVE_VIEW, "active-view");
 	g_object_class_override_property (object_class, PROP_ACTIVE_BUFFER, "active-buffer");
 
+	/**
+	 * TeplTab:max-file-size:
+	 *
+	 * The maximum size, in bytes, of a file loaded with
+	 * tepl_tab_load_file(), or 0 for no limit. A bigger file is proposed to
+	 * be opened with a #TeplFileViewer instead.
+	 *
+	 * Since: 6.0
+	 */
+	g_object_class_install_property (object_class,
+					 PROP_MAX_FILE_SIZE,
+					 g_param_spec_uint64 ("max-file-size",
+							      "max-file-size",
+							      "",
+							      0, G_MAXUINT64,
+							      DEFAULT_MAX_FILE_SIZE,
+							      G_PARAM_READWRITE |
+							      G_PARAM_CONSTRUCT |
+							      G_PARAM_STATIC_STRINGS));
+
 	/**
 	 * TeplTab::close-request:
 	 * @tab: the #TeplTab emitting the signal.
@@ -323,7 +358,8 @@ tepl_tab_class_init (TeplTabClass *klass)
 	 *
 	 * The default object method handler does the following:
 	 * - If the buffer is not modified (according to
-	 *   gtk_text_buffer_get_modified()), close the tab.
+	 *   gtk_text_buffer_get_modified()), or if its content is the same as
+	 *   when the file was last saved, close the tab.
 	 * - Else, show a message dialog to propose to save the file before
 	 *   closing.
 	 *
@@ -475,6 +511,44 @@ tepl_tab_get_goto_line_bar (TeplTab *tab)
 	return tab->priv->goto_line_bar;
 }
 
+/**
+ * tepl_tab_get_max_file_size:
+ * @tab: a #TeplTab.
+ *
+ * Returns: the value of the #TeplTab:max-file-size property.
+ * Since: 6.0
+ */
+guint64
+tepl_tab_get_max_file_size (TeplTab *tab)
+{
+	g_return_val_if_fail (TEPL_IS_TAB (tab), 0);
+
+	return tab->priv->max_file_size;
+}
+
+/**
+ * tepl_tab_set_max_file_size:
+ * @tab: a #TeplTab.
+ * @max_file_size: the new value, in bytes.
+ *
+ * Sets the #TeplTab:max-file-size property. It is taken into account by the
+ * next call to tepl_tab_load_file().
+ *
+ * Since: 6.0
+ */
+void
+tepl_tab_set_max_file_size (TeplTab *tab,
+			    guint64  max_file_size)
+{
+	g_return_if_fail (TEPL_IS_TAB (tab));
+
+	if (tab->priv->max_file_size != max_file_size)
+	{
+		tab->priv->max_file_size = max_file_size;
+		g_object_notify (G_OBJECT (tab), "max-file-size");
+	}
+}
+
 /**
  * tepl_tab_add_info_bar:
  * @tab: a #TeplTab.
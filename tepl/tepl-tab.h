@@ -91,6 +91,13 @@ TeplBuffer *	tepl_tab_get_buffer		(TeplTab *tab);
 _TEPL_EXTERN
 TeplGotoLineBar *tepl_tab_get_goto_line_bar	(TeplTab *tab);
 
+_TEPL_EXTERN
+guint64		tepl_tab_get_max_file_size	(TeplTab *tab);
+
+_TEPL_EXTERN
+void		tepl_tab_set_max_file_size	(TeplTab *tab,
+						 guint64  max_file_size);
+
 _TEPL_EXTERN
 void		tepl_tab_add_info_bar		(TeplTab    *tab,
 						 GtkInfoBar *info_bar);
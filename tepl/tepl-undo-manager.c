@@ -0,0 +1,1413 @@
+/* SPDX-FileCopyrightText: 2020 - Sébastien Wilmet <swilmet@gnome.org>
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "tepl-undo-manager.h"
+#include <string.h>
+
+/**
+ * SECTION:undo-manager
+ * @Title: TeplUndoManager
+ * @Short_description: Undo manager with a memory budget
+ * @See_also: #GtkSourceUndoManager
+ *
+ * #TeplUndoManager is a #GtkSourceUndoManager implementation, installed by
+ * default on each #TeplBuffer. It can be retrieved with
+ * gtk_source_buffer_get_undo_manager().
+ *
+ * Compared to the default undo manager of GtkSourceView:
+ * - Only the text that is not in the buffer is kept: the deleted text for the
+ *   edits that can be undone, and the inserted text for the edits that can be
+ *   redone. So pasting a big text and deleting it keeps only one copy of the
+ *   text in the history.
+ * - The big texts are compressed, in a worker thread.
+ * - The memory used by the history is limited by the
+ *   #TeplUndoManager:memory-budget. When the budget is exceeded, the oldest
+ *   undo steps are discarded. The #GtkSourceBuffer:max-undo-levels is also
+ *   taken into account.
+ * - The characters typed (or deleted) one at a time are grouped in one undo
+ *   step per word.
+ *
+ * The #TeplUndoManager:memory-usage property permits to display or monitor the
+ * memory used by the undo/redo history of each buffer.
+ *
+ * Each user action, between gtk_text_buffer_begin_user_action() and
+ * gtk_text_buffer_end_user_action(), is one undo step. An insertion or deletion
+ * outside a user action is also one undo step.
+ *
+ * The pixbufs and child anchors are restored as the U+FFFC character.
+ */
+
+/* A step bigger than this is never merged with the next typed character. The
+ * texts bigger than this are compressed.
+ */
+#define COMPRESSION_MIN_SIZE (64 * 1024)
+
+/* A fast compression level, since big texts are compressed at each big deletion
+ * and at each undo of a big insertion.
+ */
+#define COMPRESSION_LEVEL (1)
+
+#define DEFAULT_MEMORY_BUDGET (64 * 1024 * 1024)
+
+/* The memory used by the structures, in addition to the texts. */
+#define STEP_SIZE (sizeof (Step) + sizeof (GPtrArray))
+#define ACTION_SIZE (sizeof (Action) + sizeof (gpointer))
+
+typedef enum _ActionType
+{
+	ACTION_INSERT,
+	ACTION_DELETE
+} ActionType;
+
+typedef struct _Action Action;
+struct _Action
+{
+	ActionType type;
+
+	/* Character offsets. */
+	gint start;
+	gint end;
+
+	/* The text between @start and @end when it is not in the buffer: for an
+	 * insertion when its step is undone, for a deletion when its step is
+	 * done. %NULL otherwise, the text can be retrieved from the buffer.
+	 */
+	GBytes *text;
+
+	/* The size of @text when uncompressed. */
+	gsize text_size;
+
+	guint compressed : 1;
+
+	/* Non-%NULL while @text is being compressed. */
+	GCancellable *compression_cancellable;
+};
+
+typedef struct _Step Step;
+struct _Step
+{
+	GPtrArray *actions;
+
+	/* Each state of the buffer content, reachable with undo and redo, has a
+	 * different ID.
+	 */
+	guint64 state_before;
+	guint64 state_after;
+
+	/* The character of the last action, if the step contains only one
+	 * action of one character.
+	 */
+	gunichar typed_char;
+
+	/* Whether the step contains only characters typed or deleted one at a
+	 * time, so that the next one can be merged.
+	 */
+	guint typing : 1;
+};
+
+struct _TeplUndoManagerPrivate
+{
+	/* Weak ref. */
+	TeplBuffer *buffer;
+
+	/* The oldest step first. */
+	GQueue undo_steps;
+
+	/* The next step to redo first. */
+	GQueue redo_steps;
+
+	/* The step being recorded, during a user action. */
+	Step *current_step;
+
+	guint64 last_state;
+	guint64 current_state;
+
+	/* The state of the buffer content when it was last saved, or 0 if it is
+	 * unknown.
+	 */
+	guint64 saved_state;
+
+	guint64 memory_budget;
+	guint64 memory_usage;
+	gint max_undo_levels;
+
+	guint n_nested_not_undoable_actions;
+
+	/* Whether the buffer is being modified by undo or redo. */
+	guint applying : 1;
+
+	guint in_user_action : 1;
+	guint can_undo : 1;
+	guint can_redo : 1;
+};
+
+enum
+{
+	PROP_0,
+	PROP_BUFFER,
+	PROP_MEMORY_BUDGET,
+	PROP_MEMORY_USAGE,
+	N_PROPERTIES
+};
+
+static GParamSpec *properties[N_PROPERTIES];
+
+static void gtk_source_undo_manager_interface_init (gpointer g_iface,
+						    gpointer iface_data);
+
+G_DEFINE_TYPE_WITH_CODE (TeplUndoManager,
+			 tepl_undo_manager,
+			 G_TYPE_OBJECT,
+			 G_ADD_PRIVATE (TeplUndoManager)
+			 G_IMPLEMENT_INTERFACE (GTK_SOURCE_TYPE_UNDO_MANAGER,
+						gtk_source_undo_manager_interface_init))
+
+static void
+add_memory_usage (TeplUndoManager *manager,
+		  gint64           delta)
+{
+	if (delta != 0)
+	{
+		manager->priv->memory_usage += delta;
+		g_object_notify_by_pspec (G_OBJECT (manager), properties[PROP_MEMORY_USAGE]);
+	}
+}
+
+/* Runs @converter on the whole @input. */
+static GBytes *
+convert_bytes (GConverter  *converter,
+	       GBytes      *input,
+	       gsize        output_size_hint,
+	       GError     **error)
+{
+	const guint8 *input_data;
+	gsize input_size;
+	gsize input_pos = 0;
+	GByteArray *output;
+	gsize output_pos = 0;
+
+	input_data = g_bytes_get_data (input, &input_size);
+
+	output = g_byte_array_new ();
+	g_byte_array_set_size (output, MAX (output_size_hint, 1024));
+
+	while (TRUE)
+	{
+		GConverterResult result;
+		gsize bytes_read = 0;
+		gsize bytes_written = 0;
+		GError *my_error = NULL;
+
+		if (output_pos == output->len)
+		{
+			g_byte_array_set_size (output, output->len * 2);
+		}
+
+		result = g_converter_convert (converter,
+					      input_data + input_pos,
+					      input_size - input_pos,
+					      output->data + output_pos,
+					      output->len - output_pos,
+					      G_CONVERTER_INPUT_AT_END,
+					      &bytes_read,
+					      &bytes_written,
+					      &my_error);
+
+		if (result == G_CONVERTER_ERROR)
+		{
+			if (g_error_matches (my_error, G_IO_ERROR, G_IO_ERROR_NO_SPACE))
+			{
+				g_error_free (my_error);
+				g_byte_array_set_size (output, output->len * 2);
+				continue;
+			}
+
+			g_propagate_error (error, my_error);
+			g_byte_array_unref (output);
+			return NULL;
+		}
+
+		input_pos += bytes_read;
+		output_pos += bytes_written;
+
+		if (result == G_CONVERTER_FINISHED)
+		{
+			break;
+		}
+	}
+
+	g_byte_array_set_size (output, output_pos);
+	return g_byte_array_free_to_bytes (output);
+}
+
+static void
+compress_thread_cb (GTask        *task,
+		    gpointer      source_object,
+		    gpointer      task_data,
+		    GCancellable *cancellable)
+{
+	GBytes *text = task_data;
+	GZlibCompressor *compressor;
+	GBytes *compressed_text;
+	GError *error = NULL;
+
+	compressor = g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_RAW, COMPRESSION_LEVEL);
+	compressed_text = convert_bytes (G_CONVERTER (compressor),
+					 text,
+					 g_bytes_get_size (text) / 2,
+					 &error);
+	g_object_unref (compressor);
+
+	if (error != NULL)
+	{
+		g_task_return_error (task, error);
+	}
+	else
+	{
+		g_task_return_pointer (task, compressed_text, (GDestroyNotify) g_bytes_unref);
+	}
+}
+
+static void set_action_text (TeplUndoManager *manager,
+			     Action          *action,
+			     GBytes          *text,
+			     gboolean         compressed);
+
+static void
+compress_finished_cb (GObject      *source_object,
+		      GAsyncResult *result,
+		      gpointer      user_data)
+{
+	TeplUndoManager *manager = TEPL_UNDO_MANAGER (source_object);
+	Action *action;
+	GBytes *compressed_text;
+	GError *error = NULL;
+
+	compressed_text = g_task_propagate_pointer (G_TASK (result), &error);
+
+	/* The action has been freed, or its text has changed. */
+	if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+	{
+		g_error_free (error);
+		return;
+	}
+
+	action = user_data;
+	g_clear_object (&action->compression_cancellable);
+
+	if (error != NULL)
+	{
+		g_warning ("Failed to compress an undo step: %s", error->message);
+		g_error_free (error);
+		return;
+	}
+
+	/* Not worth it. */
+	if (g_bytes_get_size (compressed_text) >= action->text_size)
+	{
+		g_bytes_unref (compressed_text);
+		return;
+	}
+
+	set_action_text (manager, action, compressed_text, TRUE);
+}
+
+static void
+compress_action_text (TeplUndoManager *manager,
+		      Action          *action)
+{
+	GTask *task;
+
+	g_assert (action->compression_cancellable == NULL);
+	action->compression_cancellable = g_cancellable_new ();
+
+	task = g_task_new (manager,
+			   action->compression_cancellable,
+			   compress_finished_cb,
+			   action);
+	g_task_set_task_data (task, g_bytes_ref (action->text), (GDestroyNotify) g_bytes_unref);
+	g_task_run_in_thread (task, compress_thread_cb);
+	g_object_unref (task);
+}
+
+/* Takes ownership of @text, which can be %NULL. */
+static void
+set_action_text (TeplUndoManager *manager,
+		 Action          *action,
+		 GBytes          *text,
+		 gboolean         compressed)
+{
+	if (action->compression_cancellable != NULL)
+	{
+		g_cancellable_cancel (action->compression_cancellable);
+		g_clear_object (&action->compression_cancellable);
+	}
+
+	if (action->text != NULL)
+	{
+		add_memory_usage (manager, - (gint64) g_bytes_get_size (action->text));
+		g_bytes_unref (action->text);
+	}
+
+	action->text = text;
+	action->compressed = compressed != FALSE;
+
+	if (text == NULL)
+	{
+		return;
+	}
+
+	add_memory_usage (manager, g_bytes_get_size (text));
+
+	if (!compressed)
+	{
+		action->text_size = g_bytes_get_size (text);
+
+		if (action->text_size >= COMPRESSION_MIN_SIZE)
+		{
+			compress_action_text (manager, action);
+		}
+	}
+}
+
+/* Returns: (transfer full): the uncompressed text of @action. */
+static GBytes *
+get_action_text (Action *action)
+{
+	GZlibDecompressor *decompressor;
+	GBytes *text;
+	GError *error = NULL;
+
+	g_assert (action->text != NULL);
+
+	if (!action->compressed)
+	{
+		return g_bytes_ref (action->text);
+	}
+
+	decompressor = g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_RAW);
+	text = convert_bytes (G_CONVERTER (decompressor),
+			      action->text,
+			      action->text_size,
+			      &error);
+	g_object_unref (decompressor);
+
+	if (error != NULL)
+	{
+		g_warning ("Failed to decompress an undo step: %s", error->message);
+		g_error_free (error);
+		return g_bytes_new_static ("", 0);
+	}
+
+	return text;
+}
+
+static Action *
+action_new (TeplUndoManager *manager,
+	    ActionType       type,
+	    gint             start,
+	    gint             end)
+{
+	Action *action;
+
+	action = g_new0 (Action, 1);
+	action->type = type;
+	action->start = start;
+	action->end = end;
+
+	add_memory_usage (manager, ACTION_SIZE);
+
+	return action;
+}
+
+static void
+action_free (TeplUndoManager *manager,
+	     Action          *action)
+{
+	set_action_text (manager, action, NULL, FALSE);
+	add_memory_usage (manager, - (gint64) ACTION_SIZE);
+	g_free (action);
+}
+
+static Step *
+step_new (TeplUndoManager *manager)
+{
+	Step *step;
+
+	step = g_new0 (Step, 1);
+	step->actions = g_ptr_array_new ();
+
+	add_memory_usage (manager, STEP_SIZE);
+
+	return step;
+}
+
+static void
+step_free (TeplUndoManager *manager,
+	   Step            *step)
+{
+	guint i;
+
+	for (i = 0; i < step->actions->len; i++)
+	{
+		action_free (manager, g_ptr_array_index (step->actions, i));
+	}
+
+	g_ptr_array_free (step->actions, TRUE);
+	add_memory_usage (manager, - (gint64) STEP_SIZE);
+	g_free (step);
+}
+
+static gboolean
+is_newline (gunichar ch)
+{
+	return ch == '\n' || ch == '\r' || ch == 0x2029;
+}
+
+static gboolean
+is_typing_step (Step *step)
+{
+	Action *action;
+
+	if (step->actions->len != 1)
+	{
+		return FALSE;
+	}
+
+	action = g_ptr_array_index (step->actions, 0);
+	return action->end - action->start == 1 && !is_newline (step->typed_char);
+}
+
+static void
+update_can_undo_redo (TeplUndoManager *manager)
+{
+	TeplUndoManagerPrivate *priv = manager->priv;
+	gboolean can_undo;
+	gboolean can_redo;
+
+	can_undo = (priv->n_nested_not_undoable_actions == 0 &&
+		    !g_queue_is_empty (&priv->undo_steps));
+	can_redo = (priv->n_nested_not_undoable_actions == 0 &&
+		    !g_queue_is_empty (&priv->redo_steps));
+
+	if (priv->can_undo != can_undo)
+	{
+		priv->can_undo = can_undo;
+		gtk_source_undo_manager_can_undo_changed (GTK_SOURCE_UNDO_MANAGER (manager));
+	}
+
+	if (priv->can_redo != can_redo)
+	{
+		priv->can_redo = can_redo;
+		gtk_source_undo_manager_can_redo_changed (GTK_SOURCE_UNDO_MANAGER (manager));
+	}
+}
+
+static void
+clear_steps (TeplUndoManager *manager,
+	     GQueue          *steps)
+{
+	Step *step;
+
+	while ((step = g_queue_pop_head (steps)) != NULL)
+	{
+		step_free (manager, step);
+	}
+}
+
+static void
+clear_all (TeplUndoManager *manager)
+{
+	TeplUndoManagerPrivate *priv = manager->priv;
+
+	clear_steps (manager, &priv->undo_steps);
+	clear_steps (manager, &priv->redo_steps);
+
+	if (priv->current_step != NULL)
+	{
+		step_free (manager, priv->current_step);
+		priv->current_step = NULL;
+	}
+}
+
+static gboolean
+is_over_limits (TeplUndoManager *manager)
+{
+	TeplUndoManagerPrivate *priv = manager->priv;
+	guint n_steps = priv->undo_steps.length + priv->redo_steps.length;
+
+	if (priv->max_undo_levels > 0 &&
+	    n_steps > (guint) priv->max_undo_levels)
+	{
+		return TRUE;
+	}
+
+	return (priv->memory_budget > 0 &&
+		priv->memory_usage > priv->memory_budget);
+}
+
+/* Discards the oldest undo steps, or the farthest redo steps, until the limits
+ * are respected. The last undo step is kept even if it exceeds the memory
+ * budget on its own, so that a big deletion can always be undone.
+ */
+static void
+trim (TeplUndoManager *manager)
+{
+	TeplUndoManagerPrivate *priv = manager->priv;
+
+	if (priv->max_undo_levels == 0)
+	{
+		clear_all (manager);
+		return;
+	}
+
+	while (priv->undo_steps.length + priv->redo_steps.length > 1 &&
+	       is_over_limits (manager))
+	{
+		if (priv->undo_steps.length > 1)
+		{
+			step_free (manager, g_queue_pop_head (&priv->undo_steps));
+		}
+		else
+		{
+			step_free (manager, g_queue_pop_tail (&priv->redo_steps));
+		}
+	}
+}
+
+/* Merges @step into the last undo step if they are both typing steps,
+ * contiguous, in the same word, and if the state between them is not the saved
+ * one.
+ */
+static gboolean
+merge_step (TeplUndoManager *manager,
+	    Step            *step)
+{
+	TeplUndoManagerPrivate *priv = manager->priv;
+	Step *prev_step;
+	Action *prev_action;
+	Action *action;
+
+	prev_step = g_queue_peek_tail (&priv->undo_steps);
+
+	if (prev_step == NULL ||
+	    !prev_step->typing ||
+	    !is_typing_step (step) ||
+	    prev_step->state_after != step->state_before ||
+	    prev_step->state_after == priv->saved_state)
+	{
+		return FALSE;
+	}
+
+	prev_action = g_ptr_array_index (prev_step->actions, 0);
+	action = g_ptr_array_index (step->actions, 0);
+
+	if (prev_action->type != action->type)
+	{
+		return FALSE;
+	}
+
+	/* A new step at the beginning of each word. */
+	if (g_unichar_isspace (prev_step->typed_char) &&
+	    !g_unichar_isspace (step->typed_char))
+	{
+		return FALSE;
+	}
+
+	if (action->type == ACTION_INSERT)
+	{
+		if (action->start != prev_action->end)
+		{
+			return FALSE;
+		}
+
+		prev_action->end = action->end;
+	}
+	else
+	{
+		GByteArray *text;
+		gboolean backspace;
+
+		if (prev_action->text_size >= COMPRESSION_MIN_SIZE)
+		{
+			return FALSE;
+		}
+
+		if (action->end == prev_action->start)
+		{
+			backspace = TRUE;
+		}
+		else if (action->start == prev_action->start)
+		{
+			backspace = FALSE;
+		}
+		else
+		{
+			return FALSE;
+		}
+
+		text = g_byte_array_new ();
+
+		if (backspace)
+		{
+			g_byte_array_append (text,
+					     g_bytes_get_data (action->text, NULL),
+					     g_bytes_get_size (action->text));
+		}
+
+		g_byte_array_append (text,
+				     g_bytes_get_data (prev_action->text, NULL),
+				     g_bytes_get_size (prev_action->text));
+
+		if (!backspace)
+		{
+			g_byte_array_append (text,
+					     g_bytes_get_data (action->text, NULL),
+					     g_bytes_get_size (action->text));
+		}
+
+		if (backspace)
+		{
+			prev_action->start = action->start;
+		}
+		else
+		{
+			prev_action->end += action->end - action->start;
+		}
+
+		set_action_text (manager, prev_action, g_byte_array_free_to_bytes (text), FALSE);
+	}
+
+	prev_step->typed_char = step->typed_char;
+	prev_step->state_after = step->state_after;
+
+	return TRUE;
+}
+
+static void
+close_current_step (TeplUndoManager *manager)
+{
+	TeplUndoManagerPrivate *priv = manager->priv;
+	Step *step = priv->current_step;
+
+	if (step == NULL)
+	{
+		return;
+	}
+
+	priv->current_step = NULL;
+
+	priv->last_state++;
+	step->state_after = priv->last_state;
+	priv->current_state = step->state_after;
+
+	if (merge_step (manager, step))
+	{
+		step_free (manager, step);
+	}
+	else
+	{
+		step->typing = is_typing_step (step);
+		g_queue_push_tail (&priv->undo_steps, step);
+	}
+
+	trim (manager);
+	update_can_undo_redo (manager);
+}
+
+static gboolean
+is_recording (TeplUndoManager *manager)
+{
+	TeplUndoManagerPrivate *priv = manager->priv;
+
+	return (!priv->applying &&
+		priv->n_nested_not_undoable_actions == 0 &&
+		priv->max_undo_levels != 0);
+}
+
+static Step *
+get_current_step (TeplUndoManager *manager)
+{
+	TeplUndoManagerPrivate *priv = manager->priv;
+
+	if (priv->current_step == NULL)
+	{
+		clear_steps (manager, &priv->redo_steps);
+
+		priv->current_step = step_new (manager);
+		priv->current_step->state_before = priv->current_state;
+	}
+
+	return priv->current_step;
+}
+
+static void
+record_insertion (TeplUndoManager *manager,
+		  gint             offset,
+		  gint             n_chars,
+		  gunichar         first_char)
+{
+	Step *step;
+	Action *last_action = NULL;
+
+	step = get_current_step (manager);
+
+	if (step->actions->len > 0)
+	{
+		last_action = g_ptr_array_index (step->actions, step->actions->len - 1);
+	}
+
+	/* Contiguous insertions in the same step, for example when a text is
+	 * inserted by chunks.
+	 */
+	if (last_action != NULL &&
+	    last_action->type == ACTION_INSERT &&
+	    last_action->end == offset)
+	{
+		last_action->end += n_chars;
+	}
+	else
+	{
+		g_ptr_array_add (step->actions,
+				 action_new (manager, ACTION_INSERT, offset, offset + n_chars));
+	}
+
+	step->typed_char = first_char;
+
+	if (!manager->priv->in_user_action)
+	{
+		close_current_step (manager);
+	}
+}
+
+/* The signal handlers are called before the default handlers, when the iters
+ * are still valid.
+ */
+static void
+insert_text_cb (GtkTextBuffer   *buffer,
+		GtkTextIter     *location,
+		const gchar     *text,
+		gint             length,
+		TeplUndoManager *manager)
+{
+	gint n_chars;
+
+	if (!is_recording (manager))
+	{
+		return;
+	}
+
+	if (length < 0)
+	{
+		length = strlen (text);
+	}
+
+	n_chars = g_utf8_strlen (text, length);
+
+	if (n_chars > 0)
+	{
+		record_insertion (manager,
+				  gtk_text_iter_get_offset (location),
+				  n_chars,
+				  g_utf8_get_char (text));
+	}
+}
+
+static void
+insert_object_cb (GtkTextBuffer   *buffer,
+		  GtkTextIter     *location,
+		  gpointer         object,
+		  TeplUndoManager *manager)
+{
+	if (is_recording (manager))
+	{
+		record_insertion (manager, gtk_text_iter_get_offset (location), 1, 0xFFFC);
+	}
+}
+
+static void
+delete_range_cb (GtkTextBuffer   *buffer,
+		 GtkTextIter     *start,
+		 GtkTextIter     *end,
+		 TeplUndoManager *manager)
+{
+	gint start_offset;
+	gint end_offset;
+	Step *step;
+	Action *action;
+	gchar *text;
+
+	if (!is_recording (manager))
+	{
+		return;
+	}
+
+	start_offset = gtk_text_iter_get_offset (start);
+	end_offset = gtk_text_iter_get_offset (end);
+
+	if (start_offset == end_offset)
+	{
+		return;
+	}
+
+	text = gtk_text_buffer_get_slice (buffer, start, end, TRUE);
+
+	step = get_current_step (manager);
+	action = action_new (manager,
+			     ACTION_DELETE,
+			     MIN (start_offset, end_offset),
+			     MAX (start_offset, end_offset));
+	g_ptr_array_add (step->actions, action);
+
+	step->typed_char = g_utf8_get_char (text);
+	set_action_text (manager, action, g_bytes_new_take (text, strlen (text)), FALSE);
+
+	if (!manager->priv->in_user_action)
+	{
+		close_current_step (manager);
+	}
+}
+
+static void
+begin_user_action_cb (GtkTextBuffer   *buffer,
+		      TeplUndoManager *manager)
+{
+	manager->priv->in_user_action = TRUE;
+}
+
+static void
+end_user_action_cb (GtkTextBuffer   *buffer,
+		    TeplUndoManager *manager)
+{
+	manager->priv->in_user_action = FALSE;
+	close_current_step (manager);
+}
+
+static void
+modified_changed_cb (GtkTextBuffer   *buffer,
+		     TeplUndoManager *manager)
+{
+	TeplUndoManagerPrivate *priv = manager->priv;
+
+	/* The buffer has been saved. */
+	if (!priv->applying &&
+	    !gtk_text_buffer_get_modified (buffer))
+	{
+		close_current_step (manager);
+		priv->saved_state = priv->current_state;
+	}
+}
+
+static void
+max_undo_levels_notify_cb (GtkSourceBuffer *buffer,
+			   GParamSpec      *pspec,
+			   TeplUndoManager *manager)
+{
+	manager->priv->max_undo_levels = gtk_source_buffer_get_max_undo_levels (buffer);
+
+	trim (manager);
+	update_can_undo_redo (manager);
+}
+
+/* Removes the text of @action from the buffer, and keeps it in @action. */
+static void
+remove_action_text (TeplUndoManager *manager,
+		    Action          *action)
+{
+	GtkTextBuffer *buffer = GTK_TEXT_BUFFER (manager->priv->buffer);
+	GtkTextIter start;
+	GtkTextIter end;
+	gchar *text;
+
+	gtk_text_buffer_get_iter_at_offset (buffer, &start, action->start);
+	gtk_text_buffer_get_iter_at_offset (buffer, &end, action->end);
+
+	text = gtk_text_buffer_get_slice (buffer, &start, &end, TRUE);
+	set_action_text (manager, action, g_bytes_new_take (text, strlen (text)), FALSE);
+
+	gtk_text_buffer_delete (buffer, &start, &end);
+	gtk_text_buffer_place_cursor (buffer, &start);
+}
+
+/* Inserts the text of @action in the buffer, and frees it from @action. */
+static void
+restore_action_text (TeplUndoManager *manager,
+		     Action          *action)
+{
+	GtkTextBuffer *buffer = GTK_TEXT_BUFFER (manager->priv->buffer);
+	GtkTextIter iter;
+	GBytes *text;
+
+	text = get_action_text (action);
+	set_action_text (manager, action, NULL, FALSE);
+
+	gtk_text_buffer_get_iter_at_offset (buffer, &iter, action->start);
+	gtk_text_buffer_insert (buffer,
+				&iter,
+				g_bytes_get_data (text, NULL),
+				g_bytes_get_size (text));
+	gtk_text_buffer_place_cursor (buffer, &iter);
+
+	g_bytes_unref (text);
+}
+
+static void
+begin_applying (TeplUndoManager *manager)
+{
+	manager->priv->applying = TRUE;
+	gtk_text_buffer_begin_user_action (GTK_TEXT_BUFFER (manager->priv->buffer));
+}
+
+static void
+end_applying (TeplUndoManager *manager)
+{
+	TeplUndoManagerPrivate *priv = manager->priv;
+
+	gtk_text_buffer_end_user_action (GTK_TEXT_BUFFER (priv->buffer));
+
+	gtk_text_buffer_set_modified (GTK_TEXT_BUFFER (priv->buffer),
+				      priv->current_state != priv->saved_state);
+	priv->applying = FALSE;
+
+	trim (manager);
+	update_can_undo_redo (manager);
+}
+
+static gboolean
+tepl_undo_manager_can_undo (GtkSourceUndoManager *undo_manager)
+{
+	return TEPL_UNDO_MANAGER (undo_manager)->priv->can_undo;
+}
+
+static gboolean
+tepl_undo_manager_can_redo (GtkSourceUndoManager *undo_manager)
+{
+	return TEPL_UNDO_MANAGER (undo_manager)->priv->can_redo;
+}
+
+static void
+tepl_undo_manager_undo (GtkSourceUndoManager *undo_manager)
+{
+	TeplUndoManager *manager = TEPL_UNDO_MANAGER (undo_manager);
+	TeplUndoManagerPrivate *priv = manager->priv;
+	Step *step;
+	guint i;
+
+	g_return_if_fail (priv->buffer != NULL);
+
+	close_current_step (manager);
+	g_return_if_fail (priv->can_undo);
+
+	step = g_queue_pop_tail (&priv->undo_steps);
+	priv->current_state = step->state_before;
+
+	begin_applying (manager);
+
+	for (i = step->actions->len; i > 0; i--)
+	{
+		Action *action = g_ptr_array_index (step->actions, i - 1);
+
+		if (action->type == ACTION_INSERT)
+		{
+			remove_action_text (manager, action);
+		}
+		else
+		{
+			restore_action_text (manager, action);
+		}
+	}
+
+	g_queue_push_head (&priv->redo_steps, step);
+
+	end_applying (manager);
+}
+
+static void
+tepl_undo_manager_redo (GtkSourceUndoManager *undo_manager)
+{
+	TeplUndoManager *manager = TEPL_UNDO_MANAGER (undo_manager);
+	TeplUndoManagerPrivate *priv = manager->priv;
+	Step *step;
+	guint i;
+
+	g_return_if_fail (priv->buffer != NULL);
+
+	close_current_step (manager);
+	g_return_if_fail (priv->can_redo);
+
+	step = g_queue_pop_head (&priv->redo_steps);
+	priv->current_state = step->state_after;
+
+	begin_applying (manager);
+
+	for (i = 0; i < step->actions->len; i++)
+	{
+		Action *action = g_ptr_array_index (step->actions, i);
+
+		if (action->type == ACTION_INSERT)
+		{
+			restore_action_text (manager, action);
+		}
+		else
+		{
+			remove_action_text (manager, action);
+		}
+	}
+
+	g_queue_push_tail (&priv->undo_steps, step);
+
+	end_applying (manager);
+}
+
+static void
+tepl_undo_manager_begin_not_undoable_action (GtkSourceUndoManager *undo_manager)
+{
+	TeplUndoManager *manager = TEPL_UNDO_MANAGER (undo_manager);
+
+	clear_all (manager);
+	manager->priv->n_nested_not_undoable_actions++;
+	update_can_undo_redo (manager);
+}
+
+static void
+tepl_undo_manager_end_not_undoable_action (GtkSourceUndoManager *undo_manager)
+{
+	TeplUndoManager *manager = TEPL_UNDO_MANAGER (undo_manager);
+	TeplUndoManagerPrivate *priv = manager->priv;
+
+	g_return_if_fail (priv->n_nested_not_undoable_actions > 0);
+	priv->n_nested_not_undoable_actions--;
+
+	if (priv->n_nested_not_undoable_actions == 0)
+	{
+		/* The buffer content is a new state, which is the saved one if
+		 * the buffer has just been loaded.
+		 */
+		priv->last_state++;
+		priv->current_state = priv->last_state;
+
+		if (priv->buffer != NULL &&
+		    !gtk_text_buffer_get_modified (GTK_TEXT_BUFFER (priv->buffer)))
+		{
+			priv->saved_state = priv->current_state;
+		}
+		else
+		{
+			priv->saved_state = 0;
+		}
+	}
+
+	update_can_undo_redo (manager);
+}
+
+static void
+gtk_source_undo_manager_interface_init (gpointer g_iface,
+					gpointer iface_data)
+{
+	GtkSourceUndoManagerIface *interface = g_iface;
+
+	interface->can_undo = tepl_undo_manager_can_undo;
+	interface->can_redo = tepl_undo_manager_can_redo;
+	interface->undo = tepl_undo_manager_undo;
+	interface->redo = tepl_undo_manager_redo;
+	interface->begin_not_undoable_action = tepl_undo_manager_begin_not_undoable_action;
+	interface->end_not_undoable_action = tepl_undo_manager_end_not_undoable_action;
+}
+
+static void
+tepl_undo_manager_get_property (GObject    *object,
+				guint       prop_id,
+				GValue     *value,
+				GParamSpec *pspec)
+{
+	TeplUndoManager *manager = TEPL_UNDO_MANAGER (object);
+
+	switch (prop_id)
+	{
+		case PROP_BUFFER:
+			g_value_set_object (value, tepl_undo_manager_get_buffer (manager));
+			break;
+
+		case PROP_MEMORY_BUDGET:
+			g_value_set_uint64 (value, tepl_undo_manager_get_memory_budget (manager));
+			break;
+
+		case PROP_MEMORY_USAGE:
+			g_value_set_uint64 (value, tepl_undo_manager_get_memory_usage (manager));
+			break;
+
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+			break;
+	}
+}
+
+static void
+tepl_undo_manager_set_property (GObject      *object,
+				guint         prop_id,
+				const GValue *value,
+				GParamSpec   *pspec)
+{
+	TeplUndoManager *manager = TEPL_UNDO_MANAGER (object);
+
+	switch (prop_id)
+	{
+		case PROP_BUFFER:
+			g_assert (manager->priv->buffer == NULL);
+			g_set_weak_pointer (&manager->priv->buffer, g_value_get_object (value));
+			break;
+
+		case PROP_MEMORY_BUDGET:
+			tepl_undo_manager_set_memory_budget (manager, g_value_get_uint64 (value));
+			break;
+
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+			break;
+	}
+}
+
+static void
+tepl_undo_manager_constructed (GObject *object)
+{
+	TeplUndoManager *manager = TEPL_UNDO_MANAGER (object);
+	TeplUndoManagerPrivate *priv = manager->priv;
+
+	G_OBJECT_CLASS (tepl_undo_manager_parent_class)->constructed (object);
+
+	if (priv->buffer == NULL)
+	{
+		return;
+	}
+
+	priv->max_undo_levels = gtk_source_buffer_get_max_undo_levels (GTK_SOURCE_BUFFER (priv->buffer));
+
+	if (!gtk_text_buffer_get_modified (GTK_TEXT_BUFFER (priv->buffer)))
+	{
+		priv->saved_state = priv->current_state;
+	}
+
+	g_signal_connect (priv->buffer,
+			  "insert-text",
+			  G_CALLBACK (insert_text_cb),
+			  manager);
+
+	g_signal_connect (priv->buffer,
+			  "insert-pixbuf",
+			  G_CALLBACK (insert_object_cb),
+			  manager);
+
+	g_signal_connect (priv->buffer,
+			  "insert-child-anchor",
+			  G_CALLBACK (insert_object_cb),
+			  manager);
+
+	g_signal_connect (priv->buffer,
+			  "delete-range",
+			  G_CALLBACK (delete_range_cb),
+			  manager);
+
+	g_signal_connect (priv->buffer,
+			  "begin-user-action",
+			  G_CALLBACK (begin_user_action_cb),
+			  manager);
+
+	g_signal_connect (priv->buffer,
+			  "end-user-action",
+			  G_CALLBACK (end_user_action_cb),
+			  manager);
+
+	g_signal_connect (priv->buffer,
+			  "modified-changed",
+			  G_CALLBACK (modified_changed_cb),
+			  manager);
+
+	g_signal_connect (priv->buffer,
+			  "notify::max-undo-levels",
+			  G_CALLBACK (max_undo_levels_notify_cb),
+			  manager);
+}
+
+static void
+tepl_undo_manager_dispose (GObject *object)
+{
+	TeplUndoManager *manager = TEPL_UNDO_MANAGER (object);
+
+	if (manager->priv->buffer != NULL)
+	{
+		g_signal_handlers_disconnect_by_data (manager->priv->buffer, manager);
+		g_clear_weak_pointer (&manager->priv->buffer);
+	}
+
+	clear_all (manager);
+
+	G_OBJECT_CLASS (tepl_undo_manager_parent_class)->dispose (object);
+}
+
+static void
+tepl_undo_manager_class_init (TeplUndoManagerClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+	object_class->get_property = tepl_undo_manager_get_property;
+	object_class->set_property = tepl_undo_manager_set_property;
+	object_class->constructed = tepl_undo_manager_constructed;
+	object_class->dispose = tepl_undo_manager_dispose;
+
+	/**
+	 * TeplUndoManager:buffer:
+	 *
+	 * The #TeplBuffer whose edits are recorded.
+	 *
+	 * Since: 6.0
+	 */
+	properties[PROP_BUFFER] =
+		g_param_spec_object ("buffer",
+				     "Buffer",
+				     "",
+				     TEPL_TYPE_BUFFER,
+				     G_PARAM_READWRITE |
+				     G_PARAM_CONSTRUCT_ONLY |
+				     G_PARAM_STATIC_STRINGS);
+
+	/**
+	 * TeplUndoManager:memory-budget:
+	 *
+	 * The maximum memory used by the undo/redo history, in bytes, or 0 for
+	 * no limit. The last undo step is kept even if it is bigger.
+	 *
+	 * Since: 6.0
+	 */
+	properties[PROP_MEMORY_BUDGET] =
+		g_param_spec_uint64 ("memory-budget",
+				     "memory-budget",
+				     "",
+				     0, G_MAXUINT64,
+				     DEFAULT_MEMORY_BUDGET,
+				     G_PARAM_READWRITE |
+				     G_PARAM_CONSTRUCT |
+				     G_PARAM_STATIC_STRINGS);
+
+	/**
+	 * TeplUndoManager:memory-usage:
+	 *
+	 * The memory used by the undo/redo history, in bytes. It is an
+	 * approximation that doesn't take into account the overhead of the
+	 * memory allocator.
+	 *
+	 * Since: 6.0
+	 */
+	properties[PROP_MEMORY_USAGE] =
+		g_param_spec_uint64 ("memory-usage",
+				     "memory-usage",
+				     "",
+				     0, G_MAXUINT64,
+				     0,
+				     G_PARAM_READABLE |
+				     G_PARAM_STATIC_STRINGS);
+
+	g_object_class_install_properties (object_class, N_PROPERTIES, properties);
+}
+
+static void
+tepl_undo_manager_init (TeplUndoManager *manager)
+{
+	manager->priv = tepl_undo_manager_get_instance_private (manager);
+	manager->priv->max_undo_levels = -1;
+	manager->priv->last_state = 1;
+	manager->priv->current_state = 1;
+}
+
+/**
+ * tepl_undo_manager_new:
+ * @buffer: a #TeplBuffer.
+ *
+ * Creates a new #TeplUndoManager. To use it, call
+ * gtk_source_buffer_set_undo_manager(). A #TeplBuffer has already a
+ * #TeplUndoManager by default.
+ *
+ * Returns: a new #TeplUndoManager object.
+ * Since: 6.0
+ */
+TeplUndoManager *
+tepl_undo_manager_new (TeplBuffer *buffer)
+{
+	g_return_val_if_fail (TEPL_IS_BUFFER (buffer), NULL);
+
+	return g_object_new (TEPL_TYPE_UNDO_MANAGER,
+			     "buffer", buffer,
+			     NULL);
+}
+
+/**
+ * tepl_undo_manager_get_buffer:
+ * @manager: a #TeplUndoManager.
+ *
+ * Returns: (transfer none) (nullable): the #TeplUndoManager:buffer.
+ * Since: 6.0
+ */
+TeplBuffer *
+tepl_undo_manager_get_buffer (TeplUndoManager *manager)
+{
+	g_return_val_if_fail (TEPL_IS_UNDO_MANAGER (manager), NULL);
+
+	return manager->priv->buffer;
+}
+
+/**
+ * tepl_undo_manager_get_memory_budget:
+ * @manager: a #TeplUndoManager.
+ *
+ * Returns: the #TeplUndoManager:memory-budget.
+ * Since: 6.0
+ */
+guint64
+tepl_undo_manager_get_memory_budget (TeplUndoManager *manager)
+{
+	g_return_val_if_fail (TEPL_IS_UNDO_MANAGER (manager), 0);
+
+	return manager->priv->memory_budget;
+}
+
+/**
+ * tepl_undo_manager_set_memory_budget:
+ * @manager: a #TeplUndoManager.
+ * @memory_budget: the new value, in bytes, or 0 for no limit.
+ *
+ * Sets the #TeplUndoManager:memory-budget. The oldest undo steps are discarded
+ * if needed.
+ *
+ * Since: 6.0
+ */
+void
+tepl_undo_manager_set_memory_budget (TeplUndoManager *manager,
+				     guint64          memory_budget)
+{
+	g_return_if_fail (TEPL_IS_UNDO_MANAGER (manager));
+
+	if (manager->priv->memory_budget != memory_budget)
+	{
+		manager->priv->memory_budget = memory_budget;
+
+		trim (manager);
+		update_can_undo_redo (manager);
+
+		g_object_notify_by_pspec (G_OBJECT (manager), properties[PROP_MEMORY_BUDGET]);
+	}
+}
+
+/**
+ * tepl_undo_manager_get_memory_usage:
+ * @manager: a #TeplUndoManager.
+ *
+ * Returns: the #TeplUndoManager:memory-usage.
+ * Since: 6.0
+ */
+guint64
+tepl_undo_manager_get_memory_usage (TeplUndoManager *manager)
+{
+	g_return_val_if_fail (TEPL_IS_UNDO_MANAGER (manager), 0);
+
+	return manager->priv->memory_usage;
+}
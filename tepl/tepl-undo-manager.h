@@ -0,0 +1,62 @@
+/* SPDX-FileCopyrightText: 2020 - Sébastien Wilmet <swilmet@gnome.org>
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef TEPL_UNDO_MANAGER_H
+#define TEPL_UNDO_MANAGER_H
+
+#if !defined (TEPL_H_INSIDE) && !defined (TEPL_COMPILATION)
+#error "Only <tepl/tepl.h> can be included directly."
+#endif
+
+#include <tepl/tepl-buffer.h>
+
+G_BEGIN_DECLS
+
+#define TEPL_TYPE_UNDO_MANAGER             (tepl_undo_manager_get_type ())
+#define TEPL_UNDO_MANAGER(obj)             (G_TYPE_CHECK_INSTANCE_CAST ((obj), TEPL_TYPE_UNDO_MANAGER, TeplUndoManager))
+#define TEPL_UNDO_MANAGER_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST ((klass), TEPL_TYPE_UNDO_MANAGER, TeplUndoManagerClass))
+#define TEPL_IS_UNDO_MANAGER(obj)          (G_TYPE_CHECK_INSTANCE_TYPE ((obj), TEPL_TYPE_UNDO_MANAGER))
+#define TEPL_IS_UNDO_MANAGER_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE ((klass), TEPL_TYPE_UNDO_MANAGER))
+#define TEPL_UNDO_MANAGER_GET_CLASS(obj)   (G_TYPE_INSTANCE_GET_CLASS ((obj), TEPL_TYPE_UNDO_MANAGER, TeplUndoManagerClass))
+
+typedef struct _TeplUndoManager         TeplUndoManager;
+typedef struct _TeplUndoManagerClass    TeplUndoManagerClass;
+typedef struct _TeplUndoManagerPrivate  TeplUndoManagerPrivate;
+
+struct _TeplUndoManager
+{
+	GObject parent;
+
+	TeplUndoManagerPrivate *priv;
+};
+
+struct _TeplUndoManagerClass
+{
+	GObjectClass parent_class;
+
+	gpointer padding[12];
+};
+
+_TEPL_EXTERN
+GType			tepl_undo_manager_get_type		(void);
+
+_TEPL_EXTERN
+TeplUndoManager *	tepl_undo_manager_new			(TeplBuffer *buffer);
+
+_TEPL_EXTERN
+TeplBuffer *		tepl_undo_manager_get_buffer		(TeplUndoManager *manager);
+
+_TEPL_EXTERN
+guint64			tepl_undo_manager_get_memory_budget	(TeplUndoManager *manager);
+
+_TEPL_EXTERN
+void			tepl_undo_manager_set_memory_budget	(TeplUndoManager *manager,
+								 guint64          memory_budget);
+
+_TEPL_EXTERN
+guint64			tepl_undo_manager_get_memory_usage	(TeplUndoManager *manager);
+
+G_END_DECLS
+
+#endif /* TEPL_UNDO_MANAGER_H */
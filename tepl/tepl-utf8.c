@@ -0,0 +1,578 @@
+/* SPDX-FileCopyrightText: 2020 - Sébastien Wilmet <swilmet@gnome.org>
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "tepl-utf8.h"
+#include <string.h>
+
+/* UTF-8 validation, for the hot path of the file loading.
+ *
+ * With SSSE3 or AVX2 (runtime dispatch, resolved once), whole blocks of 16 or
+ * 32 bytes are validated at once, including the multi-byte characters, with
+ * the lookup algorithm of John Keiser and Daniel Lemire ("Validating UTF-8 In
+ * Less Than One Instruction Per Byte", 2020): each pair of consecutive bytes is
+ * classified with three 16-entry lookup tables, which gives the possible
+ * errors, and the expected continuation bytes of the 3 and 4-byte characters
+ * are checked separately. A block of ASCII characters, the common case in text
+ * files, needs only one test.
+ *
+ * When a block contains an error, or for the remaining bytes at the end, the
+ * scalar validator takes over from the last character boundary, to find the
+ * exact offset of the first invalid sequence. Without SIMD instructions, the
+ * scalar validator skips the ASCII characters 8 bytes at a time.
+ *
+ * Like g_utf8_validate_len(), a nul byte is considered invalid. The rules are
+ * the same as the GLib validator: overlong forms, surrogates and code points
+ * above U+10FFFF are rejected.
+ */
+
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#define HAVE_X86_SIMD 1
+#include <immintrin.h>
+#else
+#define HAVE_X86_SIMD 0
+#endif
+
+#define HIGH_BITS_MASK (G_GUINT64_CONSTANT (0x8080808080808080))
+#define LOW_BITS_MASK (G_GUINT64_CONSTANT (0x0101010101010101))
+
+/* Returns the length of the valid prefix of @str. */
+typedef gsize (*ValidateFunc) (const guchar *str,
+			       gsize         length);
+
+/* Returns the number of ASCII non-nul bytes at the beginning of @str. */
+static gsize
+get_ascii_prefix_length (const guchar *str,
+			 gsize         length)
+{
+	gsize i = 0;
+
+	for (; i + sizeof (guint64) <= length; i += sizeof (guint64))
+	{
+		guint64 word;
+
+		memcpy (&word, str + i, sizeof (guint64));
+
+		/* A byte with the high bit set, or a nul byte. */
+		if ((word & HIGH_BITS_MASK) != 0 ||
+		    ((word - LOW_BITS_MASK) & ~word & HIGH_BITS_MASK) != 0)
+		{
+			break;
+		}
+	}
+
+	for (; i < length; i++)
+	{
+		if (str[i] >= 0x80 || str[i] == 0)
+		{
+			break;
+		}
+	}
+
+	return i;
+}
+
+static inline gboolean
+is_continuation_byte (guchar byte)
+{
+	return (byte & 0xC0) == 0x80;
+}
+
+/* Returns the length of the valid multi-byte character at the beginning of
+ * @str, or 0 if it is invalid or incomplete.
+ */
+static gsize
+get_valid_multi_byte_char_length (const guchar *str,
+				  gsize         length)
+{
+	guchar first_byte = str[0];
+	guchar second_byte_min = 0x80;
+	guchar second_byte_max = 0xBF;
+	gsize char_length;
+	gsize i;
+
+	char_length = _tepl_utf8_get_char_length (first_byte);
+
+	if (char_length == 0 || char_length > length)
+	{
+		return 0;
+	}
+
+	switch (first_byte)
+	{
+		/* Overlong forms. */
+		case 0xE0:
+			second_byte_min = 0xA0;
+			break;
+		case 0xF0:
+			second_byte_min = 0x90;
+			break;
+
+		/* Surrogates. */
+		case 0xED:
+			second_byte_max = 0x9F;
+			break;
+
+		/* Above U+10FFFF. */
+		case 0xF4:
+			second_byte_max = 0x8F;
+			break;
+
+		default:
+			break;
+	}
+
+	if (str[1] < second_byte_min || str[1] > second_byte_max)
+	{
+		return 0;
+	}
+
+	for (i = 2; i < char_length; i++)
+	{
+		if (!is_continuation_byte (str[i]))
+		{
+			return 0;
+		}
+	}
+
+	return char_length;
+}
+
+static gsize
+validate_scalar (const guchar *str,
+		 gsize         length)
+{
+	gsize pos = 0;
+
+	while (pos < length)
+	{
+		gsize char_length;
+
+		if (str[pos] < 0x80)
+		{
+			pos += get_ascii_prefix_length (str + pos, length - pos);
+
+			if (pos == length || str[pos] == 0)
+			{
+				break;
+			}
+		}
+
+		char_length = get_valid_multi_byte_char_length (str + pos, length - pos);
+		if (char_length == 0)
+		{
+			break;
+		}
+
+		pos += char_length;
+	}
+
+	return pos;
+}
+
+#if HAVE_X86_SIMD
+
+/* The possible errors for a pair of consecutive bytes. Each lookup table gives
+ * the errors compatible with one nibble, so the errors present in all three
+ * lookups are the actual ones.
+ */
+#define TOO_SHORT	(1 << 0) /* 11______ 0_______ or 11______ 11______ */
+#define TOO_LONG	(1 << 1) /* 0_______ 10______ */
+#define OVERLONG_3	(1 << 2) /* 11100000 100_____ */
+#define TOO_LARGE	(1 << 3) /* 11110100 1001____, 11110100 101_____, or a bigger first byte */
+#define SURROGATE	(1 << 4) /* 11101101 101_____ */
+#define OVERLONG_2	(1 << 5) /* 1100000_ 10______ */
+#define TOO_LARGE_1000	(1 << 6) /* 11110101 1000____, or a bigger first byte */
+#define OVERLONG_4	(1 << 6) /* 11110000 1000____ */
+#define TWO_CONTS	(1 << 7) /* 10______ 10______ */
+
+/* The errors that depend only on the high nibble of the first byte. */
+#define CARRY		(TOO_SHORT | TOO_LONG | TWO_CONTS)
+
+/* Indexed by the high nibble of the first byte of the pair. */
+static const guint8 byte_1_high_table[16] =
+{
+	/* 0_______ ASCII. */
+	TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+	TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+
+	/* 10______ continuation. */
+	TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+
+	/* 1100____ two-byte lead. */
+	TOO_SHORT | OVERLONG_2,
+
+	/* 1101____ two-byte lead. */
+	TOO_SHORT,
+
+	/* 1110____ three-byte lead. */
+	TOO_SHORT | OVERLONG_3 | SURROGATE,
+
+	/* 1111____ four-byte lead. */
+	TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4
+};
+
+/* Indexed by the low nibble of the first byte of the pair. */
+static const guint8 byte_1_low_table[16] =
+{
+	/* ____0000 */
+	CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+
+	/* ____0001 */
+	CARRY | OVERLONG_2,
+
+	/* ____001_ */
+	CARRY,
+	CARRY,
+
+	/* ____0100 */
+	CARRY | TOO_LARGE,
+
+	/* ____0101 */
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+
+	/* ____011_ */
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+
+	/* ____1___ */
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+
+	/* ____1101 */
+	CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000
+};
+
+/* Indexed by the high nibble of the second byte of the pair. */
+static const guint8 byte_2_high_table[16] =
+{
+	/* 0_______ ASCII. */
+	TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+	TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+
+	/* 1000____ */
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+
+	/* 1001____ */
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+
+	/* 101_____ */
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+
+	/* 11______ */
+	TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT
+};
+
+/* A block is incomplete if one of its last 3 bytes starts a character that
+ * doesn't fit in the block: the bytes are compared to these maximum values.
+ */
+static const guint8 incomplete_max_values[32] =
+{
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xF0 - 1, 0xE0 - 1, 0xC0 - 1
+};
+
+/* Returns the offset of the first byte of the character containing the byte
+ * before @pos, or @pos if a character starts at @pos.
+ */
+static gsize
+get_char_start (const guchar *str,
+		gsize         pos)
+{
+	gsize i;
+
+	for (i = 1; i <= 3 && i <= pos; i++)
+	{
+		guchar byte = str[pos - i];
+
+		if (byte < 0x80)
+		{
+			break;
+		}
+
+		if (byte >= 0xC0)
+		{
+			return pos - i;
+		}
+	}
+
+	return pos;
+}
+
+/* The blocks before @pos are valid, except maybe the last character. */
+static gsize
+finish_with_scalar (const guchar *str,
+		    gsize         length,
+		    gsize         pos)
+{
+	pos = get_char_start (str, pos);
+	return pos + validate_scalar (str + pos, length - pos);
+}
+
+__attribute__ ((target ("ssse3")))
+static gsize
+validate_ssse3 (const guchar *str,
+		gsize         length)
+{
+	const __m128i zero = _mm_setzero_si128 ();
+	const __m128i low_nibble_mask = _mm_set1_epi8 (0x0F);
+	const __m128i byte_1_high = _mm_loadu_si128 ((const __m128i *) byte_1_high_table);
+	const __m128i byte_1_low = _mm_loadu_si128 ((const __m128i *) byte_1_low_table);
+	const __m128i byte_2_high = _mm_loadu_si128 ((const __m128i *) byte_2_high_table);
+	const __m128i incomplete_max = _mm_loadu_si128 ((const __m128i *) (incomplete_max_values + 16));
+	__m128i prev_input = zero;
+	__m128i prev_incomplete = zero;
+	gsize pos;
+
+	for (pos = 0; pos + sizeof (__m128i) <= length; pos += sizeof (__m128i))
+	{
+		__m128i input;
+		__m128i error;
+
+		input = _mm_loadu_si128 ((const __m128i *) (str + pos));
+
+		if (_mm_movemask_epi8 (_mm_cmpeq_epi8 (input, zero)) != 0)
+		{
+			break;
+		}
+
+		if (_mm_movemask_epi8 (input) == 0)
+		{
+			/* ASCII. */
+			error = prev_incomplete;
+			prev_incomplete = zero;
+		}
+		else
+		{
+			__m128i prev1 = _mm_alignr_epi8 (input, prev_input, 15);
+			__m128i prev2 = _mm_alignr_epi8 (input, prev_input, 14);
+			__m128i prev3 = _mm_alignr_epi8 (input, prev_input, 13);
+			__m128i special_cases;
+			__m128i is_third_byte;
+			__m128i is_fourth_byte;
+			__m128i must_be_continuation;
+
+			special_cases =
+				_mm_and_si128 (_mm_and_si128 (_mm_shuffle_epi8 (byte_1_high, _mm_and_si128 (_mm_srli_epi16 (prev1, 4), low_nibble_mask)),
+							      _mm_shuffle_epi8 (byte_1_low, _mm_and_si128 (prev1, low_nibble_mask))),
+					       _mm_shuffle_epi8 (byte_2_high, _mm_and_si128 (_mm_srli_epi16 (input, 4), low_nibble_mask)));
+
+			/* The third and fourth bytes of the 3 and 4-byte
+			 * characters, not covered by the pairs.
+			 */
+			is_third_byte = _mm_subs_epu8 (prev2, _mm_set1_epi8 ((gchar) (0xE0 - 0x80)));
+			is_fourth_byte = _mm_subs_epu8 (prev3, _mm_set1_epi8 ((gchar) (0xF0 - 0x80)));
+			must_be_continuation = _mm_and_si128 (_mm_or_si128 (is_third_byte, is_fourth_byte),
+							      _mm_set1_epi8 ((gchar) 0x80));
+
+			error = _mm_xor_si128 (must_be_continuation, special_cases);
+			prev_incomplete = _mm_subs_epu8 (input, incomplete_max);
+		}
+
+		if (_mm_movemask_epi8 (_mm_cmpeq_epi8 (error, zero)) != 0xFFFF)
+		{
+			break;
+		}
+
+		prev_input = input;
+	}
+
+	return finish_with_scalar (str, length, pos);
+}
+
+__attribute__ ((target ("avx2")))
+static gsize
+validate_avx2 (const guchar *str,
+	       gsize         length)
+{
+	const __m256i zero = _mm256_setzero_si256 ();
+	const __m256i low_nibble_mask = _mm256_set1_epi8 (0x0F);
+	const __m256i byte_1_high = _mm256_broadcastsi128_si256 (_mm_loadu_si128 ((const __m128i *) byte_1_high_table));
+	const __m256i byte_1_low = _mm256_broadcastsi128_si256 (_mm_loadu_si128 ((const __m128i *) byte_1_low_table));
+	const __m256i byte_2_high = _mm256_broadcastsi128_si256 (_mm_loadu_si128 ((const __m128i *) byte_2_high_table));
+	const __m256i incomplete_max = _mm256_loadu_si256 ((const __m256i *) incomplete_max_values);
+	__m256i prev_input = zero;
+	__m256i prev_incomplete = zero;
+	gsize pos;
+
+	for (pos = 0; pos + sizeof (__m256i) <= length; pos += sizeof (__m256i))
+	{
+		__m256i input;
+		__m256i error;
+
+		input = _mm256_loadu_si256 ((const __m256i *) (str + pos));
+
+		if (_mm256_movemask_epi8 (_mm256_cmpeq_epi8 (input, zero)) != 0)
+		{
+			break;
+		}
+
+		if (_mm256_movemask_epi8 (input) == 0)
+		{
+			/* ASCII. */
+			error = prev_incomplete;
+			prev_incomplete = zero;
+		}
+		else
+		{
+			/* The alignr instruction works on each 128-bit lane,
+			 * so the previous bytes are first shifted by one lane.
+			 */
+			__m256i shifted_input = _mm256_permute2x128_si256 (prev_input, input, 0x21);
+			__m256i prev1 = _mm256_alignr_epi8 (input, shifted_input, 15);
+			__m256i prev2 = _mm256_alignr_epi8 (input, shifted_input, 14);
+			__m256i prev3 = _mm256_alignr_epi8 (input, shifted_input, 13);
+			__m256i special_cases;
+			__m256i is_third_byte;
+			__m256i is_fourth_byte;
+			__m256i must_be_continuation;
+
+			special_cases =
+				_mm256_and_si256 (_mm256_and_si256 (_mm256_shuffle_epi8 (byte_1_high, _mm256_and_si256 (_mm256_srli_epi16 (prev1, 4), low_nibble_mask)),
+								    _mm256_shuffle_epi8 (byte_1_low, _mm256_and_si256 (prev1, low_nibble_mask))),
+						  _mm256_shuffle_epi8 (byte_2_high, _mm256_and_si256 (_mm256_srli_epi16 (input, 4), low_nibble_mask)));
+
+			is_third_byte = _mm256_subs_epu8 (prev2, _mm256_set1_epi8 ((gchar) (0xE0 - 0x80)));
+			is_fourth_byte = _mm256_subs_epu8 (prev3, _mm256_set1_epi8 ((gchar) (0xF0 - 0x80)));
+			must_be_continuation = _mm256_and_si256 (_mm256_or_si256 (is_third_byte, is_fourth_byte),
+								 _mm256_set1_epi8 ((gchar) 0x80));
+
+			error = _mm256_xor_si256 (must_be_continuation, special_cases);
+			prev_incomplete = _mm256_subs_epu8 (input, incomplete_max);
+		}
+
+		if (!_mm256_testz_si256 (error, error))
+		{
+			break;
+		}
+
+		prev_input = input;
+	}
+
+	return finish_with_scalar (str, length, pos);
+}
+#endif /* HAVE_X86_SIMD */
+
+static ValidateFunc
+get_validate_func (void)
+{
+	static gsize validate_func = 0;
+
+	if (g_once_init_enter (&validate_func))
+	{
+		ValidateFunc func = validate_scalar;
+
+#if HAVE_X86_SIMD
+		__builtin_cpu_init ();
+
+		if (__builtin_cpu_supports ("avx2"))
+		{
+			func = validate_avx2;
+		}
+		else if (__builtin_cpu_supports ("ssse3"))
+		{
+			func = validate_ssse3;
+		}
+#endif
+
+		g_once_init_leave (&validate_func, (gsize) func);
+	}
+
+	return (ValidateFunc) validate_func;
+}
+
+/*
+ * _tepl_utf8_validate:
+ * @str: a string.
+ * @length: the number of bytes of @str to validate.
+ * @valid_length: (out) (optional): location to store the number of bytes at
+ *   the beginning of @str that are valid UTF-8. It is thus the offset of the
+ *   first invalid (or incomplete) sequence, if any.
+ *
+ * A faster g_utf8_validate_len().
+ *
+ * Returns: whether the @length bytes of @str are valid UTF-8.
+ */
+gboolean
+_tepl_utf8_validate (const gchar *str,
+		     gsize        length,
+		     gsize       *valid_length)
+{
+	gsize pos;
+
+	g_return_val_if_fail (str != NULL || length == 0, FALSE);
+
+	pos = get_validate_func () ((const guchar *) str, length);
+
+	if (valid_length != NULL)
+	{
+		*valid_length = pos;
+	}
+
+	return pos == length;
+}
+
+/* Returns the number of bytes of the UTF-8 character starting with @first_byte,
+ * or 0 if @first_byte cannot start a multi-byte character.
+ */
+gsize
+_tepl_utf8_get_char_length (guchar first_byte)
+{
+	if (0xC2 <= first_byte && first_byte <= 0xDF)
+	{
+		return 2;
+	}
+	if (0xE0 <= first_byte && first_byte <= 0xEF)
+	{
+		return 3;
+	}
+	if (0xF0 <= first_byte && first_byte <= 0xF4)
+	{
+		return 4;
+	}
+
+	return 0;
+}
+
+/* Returns whether @str can be the beginning of a multi-byte UTF-8 character
+ * that continues after @length bytes, for example in the next chunk when
+ * reading a file.
+ */
+gboolean
+_tepl_utf8_is_incomplete_char (const gchar *str,
+			       gsize        length)
+{
+	gsize char_length;
+	gsize i;
+
+	if (length == 0)
+	{
+		return FALSE;
+	}
+
+	char_length = _tepl_utf8_get_char_length ((guchar) str[0]);
+	if (length >= char_length)
+	{
+		return FALSE;
+	}
+
+	for (i = 1; i < length; i++)
+	{
+		if (!is_continuation_byte ((guchar) str[i]))
+		{
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
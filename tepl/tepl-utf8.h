@@ -0,0 +1,29 @@
+/* SPDX-FileCopyrightText: 2020 - Sébastien Wilmet <swilmet@gnome.org>
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef TEPL_UTF8_H
+#define TEPL_UTF8_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* The maximum number of bytes of a valid UTF-8 character. */
+#define TEPL_UTF8_CHAR_MAX_LENGTH (4)
+
+G_GNUC_INTERNAL
+gboolean	_tepl_utf8_validate			(const gchar *str,
+							 gsize        length,
+							 gsize       *valid_length);
+
+G_GNUC_INTERNAL
+gsize		_tepl_utf8_get_char_length		(guchar first_byte);
+
+G_GNUC_INTERNAL
+gboolean	_tepl_utf8_is_incomplete_char		(const gchar *str,
+							 gsize        length);
+
+G_END_DECLS
+
+#endif /* TEPL_UTF8_H */
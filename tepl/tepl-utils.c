@@ -8,11 +8,17 @@
  */
 
 #include "tepl-utils.h"
+#include <errno.h>
 #include <string.h>
 #include "tepl-application-window.h"
 #include "tepl-icu.h"
 #include "tepl-pango.h"
 
+#ifdef G_OS_UNIX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 /**
  * SECTION:utils
  * @Short_description: Utility functions
@@ -598,6 +604,87 @@ _tepl_utils_get_fallback_basename_for_display (GFile *location)
 	return basename;
 }
 
+#ifdef G_OS_UNIX
+static gboolean
+sync_path (const gchar  *path,
+	   gint          flags,
+	   GError      **error)
+{
+	gint fd;
+	gint saved_errno;
+
+	fd = open (path, flags | O_CLOEXEC);
+
+	if (fd == -1 || fsync (fd) != 0)
+	{
+		saved_errno = errno;
+
+		if (fd != -1)
+		{
+			close (fd);
+		}
+
+		g_set_error_literal (error,
+				     G_IO_ERROR,
+				     g_io_error_from_errno (saved_errno),
+				     g_strerror (saved_errno));
+		return FALSE;
+	}
+
+	close (fd);
+	return TRUE;
+}
+#endif
+
+/*
+ * _tepl_utils_sync_file:
+ * @location: a #GFile.
+ * @sync_directory: whether to also flush the parent directory, after a file
+ *   has been created or renamed.
+ * @error: (out) (optional): a location to a %NULL #GError, or %NULL.
+ *
+ * Flushes the content of @location to the disk with fsync(). Blocking, to
+ * call from a worker thread. Does nothing for non-local files.
+ *
+ * Returns: %FALSE on error.
+ */
+gboolean
+_tepl_utils_sync_file (GFile     *location,
+		       gboolean   sync_directory,
+		       GError   **error)
+{
+#ifdef G_OS_UNIX
+	gchar *path;
+	gboolean ok;
+
+	g_return_val_if_fail (G_IS_FILE (location), FALSE);
+	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+	path = g_file_get_path (location);
+	if (path == NULL)
+	{
+		/* Not possible for remote files. */
+		return TRUE;
+	}
+
+	ok = sync_path (path, O_RDONLY, error);
+
+	if (ok && sync_directory)
+	{
+		gchar *directory_path;
+
+		directory_path = g_path_get_dirname (path);
+		ok = sync_path (directory_path, O_RDONLY | O_DIRECTORY, error);
+		g_free (directory_path);
+	}
+
+	g_free (path);
+	return ok;
+#else
+	return TRUE;
+#endif
+}
+
 /**
  * tepl_utils_create_parent_directories:
  * @file: a file
@@ -76,6 +76,11 @@ gboolean	tepl_utils_decode_uri				(const gchar  *uri,
 G_GNUC_INTERNAL
 gchar *		_tepl_utils_get_fallback_basename_for_display	(GFile *location);
 
+G_GNUC_INTERNAL
+gboolean	_tepl_utils_sync_file				(GFile     *location,
+								 gboolean   sync_directory,
+								 GError   **error);
+
 _TEPL_EXTERN
 gboolean	tepl_utils_create_parent_directories		(GFile         *file,
 								 GCancellable  *cancellable,
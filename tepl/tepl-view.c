@@ -9,6 +9,7 @@
 
 #include "tepl-view.h"
 #include "tepl-buffer.h"
+#include "tepl-file-viewer.h"
 
 /**
  * SECTION:view
@@ -258,6 +259,9 @@ tepl_view_scroll_to_cursor (TeplView *view)
  * Places the cursor at the position returned by
  * gtk_text_buffer_get_iter_at_line(), and scrolls to that position.
  *
+ * If @view is used by a #TeplFileViewer, @line is a line of the file, see
+ * tepl_file_viewer_goto_line().
+ *
  * Returns: %TRUE if the cursor has been moved exactly to @line, %FALSE if that
  *   line didn't exist.
  * Since: 2.0
@@ -266,16 +270,30 @@ gboolean
 tepl_view_goto_line (TeplView *view,
 		     gint      line)
 {
+	TeplFileViewer *file_viewer;
 	GtkTextBuffer *buffer;
 	GtkTextIter iter;
 	gboolean line_exists;
 
 	g_return_val_if_fail (TEPL_IS_VIEW (view), FALSE);
 
+	file_viewer = _tepl_file_viewer_get_for_view (view);
+	if (file_viewer != NULL)
+	{
+		return tepl_file_viewer_goto_line (file_viewer, line);
+	}
+
 	buffer = gtk_text_view_get_buffer (GTK_TEXT_VIEW (view));
 
-	gtk_text_buffer_get_iter_at_line (buffer, &iter, line);
-	line_exists = gtk_text_iter_get_line (&iter) == line;
+	if (TEPL_IS_BUFFER (buffer))
+	{
+		line_exists = _tepl_buffer_get_iter_at_line (TEPL_BUFFER (buffer), &iter, line);
+	}
+	else
+	{
+		gtk_text_buffer_get_iter_at_line (buffer, &iter, line);
+		line_exists = gtk_text_iter_get_line (&iter) == line;
+	}
 
 	gtk_text_buffer_place_cursor (buffer, &iter);
 	tepl_view_scroll_to_cursor (view);
@@ -360,12 +378,20 @@ tepl_view_select_lines (TeplView *view,
 
 	buffer = gtk_text_view_get_buffer (GTK_TEXT_VIEW (view));
 
-	gtk_text_buffer_get_iter_at_line (buffer, &start_iter, start_line);
-	gtk_text_buffer_get_iter_at_line (buffer, &end_iter, end_line);
-
-	if (!gtk_text_iter_ends_line (&end_iter))
+	if (TEPL_IS_BUFFER (buffer))
 	{
-		gtk_text_iter_forward_to_line_end (&end_iter);
+		_tepl_buffer_get_iter_at_line (TEPL_BUFFER (buffer), &start_iter, start_line);
+		_tepl_buffer_get_iter_at_line_end (TEPL_BUFFER (buffer), &end_iter, end_line);
+	}
+	else
+	{
+		gtk_text_buffer_get_iter_at_line (buffer, &start_iter, start_line);
+		gtk_text_buffer_get_iter_at_line (buffer, &end_iter, end_line);
+
+		if (!gtk_text_iter_ends_line (&end_iter))
+		{
+			gtk_text_iter_forward_to_line_end (&end_iter);
+		}
 	}
 
 	gtk_text_buffer_select_range (buffer, &start_iter, &end_iter);
@@ -16,10 +16,13 @@
 #include <tepl/tepl-application.h>
 #include <tepl/tepl-application-window.h>
 #include <tepl/tepl-buffer.h>
+#include <tepl/tepl-buffer-snapshot.h>
+#include <tepl/tepl-edit-journal.h>
 #include <tepl/tepl-file.h>
 #include <tepl/tepl-file-chooser.h>
 #include <tepl/tepl-file-loader.h>
 #include <tepl/tepl-file-saver.h>
+#include <tepl/tepl-file-viewer.h>
 #include <tepl/tepl-fold-region.h>
 #include <tepl/tepl-goto-line-bar.h>
 #include <tepl/tepl-gutter-renderer-folds.h>
@@ -46,6 +49,7 @@
 #include <tepl/tepl-tab-label.h>
 #include <tepl/tepl-tab-loading.h>
 #include <tepl/tepl-tab-saving.h>
+#include <tepl/tepl-undo-manager.h>
 #include <tepl/tepl-utils.h>
 #include <tepl/tepl-view.h>
 
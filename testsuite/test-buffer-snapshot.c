@@ -0,0 +1,252 @@
+/* SPDX-FileCopyrightText: 2020 - Sébastien Wilmet <swilmet@gnome.org>
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <tepl/tepl.h>
+#include <string.h>
+
+static gchar *
+get_buffer_text (TeplBuffer *buffer)
+{
+	GtkTextIter start;
+	GtkTextIter end;
+
+	gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (buffer), &start, &end);
+	return gtk_text_buffer_get_text (GTK_TEXT_BUFFER (buffer), &start, &end, TRUE);
+}
+
+static gchar *
+get_snapshot_text (TeplBufferSnapshot *snapshot)
+{
+	GString *text;
+	guint n_chunks;
+	guint chunk_num;
+
+	text = g_string_new (NULL);
+	n_chunks = tepl_buffer_snapshot_get_n_chunks (snapshot);
+
+	for (chunk_num = 0; chunk_num < n_chunks; chunk_num++)
+	{
+		GBytes *chunk;
+		gconstpointer chunk_data;
+		gsize chunk_size;
+
+		chunk = tepl_buffer_snapshot_get_chunk (snapshot, chunk_num);
+		chunk_data = g_bytes_get_data (chunk, &chunk_size);
+		g_assert_cmpuint (chunk_size, >, 0);
+
+		g_string_append_len (text, chunk_data, chunk_size);
+	}
+
+	return g_string_free (text, FALSE);
+}
+
+/* More than one chunk, with multi-byte characters. */
+static gchar *
+create_long_text (void)
+{
+	GString *text;
+	gint i;
+
+	text = g_string_new (NULL);
+
+	for (i = 0; i < 10000; i++)
+	{
+		g_string_append_printf (text, "%d é€\r\n", i);
+	}
+
+	return g_string_free (text, FALSE);
+}
+
+static void
+test_edits (void)
+{
+	TeplBuffer *buffer;
+	TeplBufferSnapshot *snapshot;
+	TeplBufferSnapshot *new_snapshot;
+	GtkTextIter iter;
+	gchar *text;
+
+	buffer = tepl_buffer_new ();
+	gtk_text_buffer_set_text (GTK_TEXT_BUFFER (buffer), "Hello wörld", -1);
+
+	snapshot = tepl_buffer_snapshot_new (buffer);
+	g_assert_true (tepl_buffer_snapshot_is_current (snapshot, buffer));
+	g_assert_cmpint (tepl_buffer_snapshot_get_n_chars (snapshot), ==, 11);
+	g_assert_cmpint (tepl_buffer_snapshot_get_n_bytes (snapshot), ==, 12);
+
+	new_snapshot = tepl_buffer_snapshot_new (buffer);
+	g_assert_true (tepl_buffer_snapshot_is_current (new_snapshot, buffer));
+	tepl_buffer_snapshot_unref (new_snapshot);
+
+	gtk_text_buffer_get_end_iter (GTK_TEXT_BUFFER (buffer), &iter);
+	gtk_text_buffer_insert (GTK_TEXT_BUFFER (buffer), &iter, "!", -1);
+	g_assert_false (tepl_buffer_snapshot_is_current (snapshot, buffer));
+
+	text = get_snapshot_text (snapshot);
+	g_assert_cmpstr (text, ==, "Hello wörld");
+	g_free (text);
+
+	new_snapshot = tepl_buffer_snapshot_new (buffer);
+	g_assert_true (tepl_buffer_snapshot_is_current (new_snapshot, buffer));
+
+	text = get_snapshot_text (new_snapshot);
+	g_assert_cmpstr (text, ==, "Hello wörld!");
+	g_free (text);
+
+	/* The snapshots outlive the buffer. */
+	g_object_unref (buffer);
+
+	text = tepl_buffer_snapshot_get_slice (snapshot, 6, -1);
+	g_assert_cmpstr (text, ==, "wörld");
+	g_free (text);
+
+	tepl_buffer_snapshot_unref (snapshot);
+	tepl_buffer_snapshot_unref (new_snapshot);
+}
+
+static void
+test_read (void)
+{
+	TeplBuffer *buffer;
+	TeplBufferSnapshot *snapshot;
+	gchar *long_text;
+	gchar *text;
+	const gchar *p;
+	gint n_chars;
+	gint char_offset;
+
+	buffer = tepl_buffer_new ();
+
+	snapshot = tepl_buffer_snapshot_new (buffer);
+	g_assert_cmpint (tepl_buffer_snapshot_get_n_chars (snapshot), ==, 0);
+	g_assert_cmpuint (tepl_buffer_snapshot_get_n_chunks (snapshot), ==, 0);
+	text = tepl_buffer_snapshot_get_slice (snapshot, 0, -1);
+	g_assert_cmpstr (text, ==, "");
+	g_free (text);
+	tepl_buffer_snapshot_unref (snapshot);
+
+	long_text = create_long_text ();
+	gtk_text_buffer_set_text (GTK_TEXT_BUFFER (buffer), long_text, -1);
+	n_chars = g_utf8_strlen (long_text, -1);
+
+	snapshot = tepl_buffer_snapshot_new (buffer);
+	g_assert_cmpint (tepl_buffer_snapshot_get_n_chars (snapshot), ==, n_chars);
+	g_assert_cmpint (tepl_buffer_snapshot_get_n_bytes (snapshot), ==, strlen (long_text));
+	g_assert_cmpuint (tepl_buffer_snapshot_get_n_chunks (snapshot), >, 1);
+
+	text = get_snapshot_text (snapshot);
+	g_assert_cmpstr (text, ==, long_text);
+	g_free (text);
+
+	for (p = long_text, char_offset = 0; *p != '\0'; p = g_utf8_next_char (p), char_offset++)
+	{
+		g_assert_cmpuint (tepl_buffer_snapshot_get_char (snapshot, char_offset), ==, g_utf8_get_char (p));
+	}
+
+	/* Slices across several chunks. */
+	for (char_offset = 0; char_offset < n_chars; char_offset += 997)
+	{
+		gint end_char_offset = MIN (char_offset + 20000, n_chars);
+		const gchar *start_pos = g_utf8_offset_to_pointer (long_text, char_offset);
+		const gchar *end_pos = g_utf8_offset_to_pointer (long_text, end_char_offset);
+		gchar *expected_slice;
+
+		expected_slice = g_strndup (start_pos, end_pos - start_pos);
+		text = tepl_buffer_snapshot_get_slice (snapshot, char_offset, end_char_offset);
+		g_assert_cmpstr (text, ==, expected_slice);
+		g_free (text);
+		g_free (expected_slice);
+	}
+
+	text = tepl_buffer_snapshot_get_slice (snapshot, n_chars, -1);
+	g_assert_cmpstr (text, ==, "");
+	g_free (text);
+
+	tepl_buffer_snapshot_unref (snapshot);
+	g_object_unref (buffer);
+	g_free (long_text);
+}
+
+static void
+read_thread_cb (GTask        *task,
+		gpointer      source_object,
+		gpointer      task_data,
+		GCancellable *cancellable)
+{
+	TeplBufferSnapshot *snapshot = task_data;
+
+	g_task_return_pointer (task, get_snapshot_text (snapshot), g_free);
+}
+
+static void
+read_finished_cb (GObject      *source_object,
+		  GAsyncResult *result,
+		  gpointer      user_data)
+{
+	gchar **text = user_data;
+
+	*text = g_task_propagate_pointer (G_TASK (result), NULL);
+}
+
+static void
+test_thread (void)
+{
+	TeplBuffer *buffer;
+	TeplBufferSnapshot *snapshot;
+	GTask *task;
+	gchar *long_text;
+	gchar *text = NULL;
+	gint i;
+
+	buffer = tepl_buffer_new ();
+	long_text = create_long_text ();
+	gtk_text_buffer_set_text (GTK_TEXT_BUFFER (buffer), long_text, -1);
+
+	snapshot = tepl_buffer_snapshot_new (buffer);
+
+	task = g_task_new (NULL, NULL, read_finished_cb, &text);
+	g_task_set_task_data (task, tepl_buffer_snapshot_ref (snapshot),
+			      (GDestroyNotify) tepl_buffer_snapshot_unref);
+	g_task_run_in_thread (task, read_thread_cb);
+	g_object_unref (task);
+
+	/* Edit the buffer while the snapshot is read in the other thread. */
+	for (i = 0; i < 1000; i++)
+	{
+		GtkTextIter iter;
+
+		gtk_text_buffer_get_iter_at_offset (GTK_TEXT_BUFFER (buffer), &iter, i * 7);
+		gtk_text_buffer_insert (GTK_TEXT_BUFFER (buffer), &iter, "x", -1);
+	}
+
+	while (text == NULL)
+	{
+		g_main_context_iteration (NULL, TRUE);
+	}
+
+	g_assert_cmpstr (text, ==, long_text);
+	g_assert_false (tepl_buffer_snapshot_is_current (snapshot, buffer));
+
+	g_free (text);
+	text = get_buffer_text (buffer);
+	g_assert_cmpint (g_utf8_strlen (text, -1), ==, g_utf8_strlen (long_text, -1) + 1000);
+
+	g_free (text);
+	g_free (long_text);
+	tepl_buffer_snapshot_unref (snapshot);
+	g_object_unref (buffer);
+}
+
+gint
+main (gint    argc,
+      gchar **argv)
+{
+	gtk_test_init (&argc, &argv);
+
+	g_test_add_func ("/buffer-snapshot/edits", test_edits);
+	g_test_add_func ("/buffer-snapshot/read", test_read);
+	g_test_add_func ("/buffer-snapshot/thread", test_thread);
+
+	return g_test_run ();
+}
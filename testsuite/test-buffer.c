@@ -0,0 +1,563 @@
+/* SPDX-FileCopyrightText: 2020 - Sébastien Wilmet <swilmet@gnome.org>
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <tepl/tepl.h>
+#include <string.h>
+#include "tepl/tepl-rope.h"
+
+/* The pieces of text inserted by do_random_edits(), with all the kinds of
+ * line terminators, and non-ASCII characters.
+ */
+static const gchar *text_pieces[] =
+{
+	"a",
+	"é",
+	"€€",
+	"\n",
+	"\r",
+	"\r\n",
+	"\xE2\x80\xA9",
+	"line\n",
+};
+
+static void
+do_random_edits (TeplBuffer *buffer,
+		 gint        n_edits)
+{
+	GtkTextBuffer *text_buffer = GTK_TEXT_BUFFER (buffer);
+	gint i;
+
+	for (i = 0; i < n_edits; i++)
+	{
+		gint n_chars = gtk_text_buffer_get_char_count (text_buffer);
+		GtkTextIter start;
+		GtkTextIter end;
+		gint choice;
+
+		gtk_text_buffer_get_iter_at_offset (text_buffer,
+						    &start,
+						    g_random_int_range (0, n_chars + 1));
+
+		choice = g_random_int_range (0, 10);
+
+		if (choice == 0)
+		{
+			gtk_text_buffer_create_child_anchor (text_buffer, &start);
+		}
+		else if (n_chars == 0 || choice < 7)
+		{
+			GString *text = g_string_new (NULL);
+			gint n_pieces = g_random_int_range (1, 10);
+			gint piece_num;
+
+			for (piece_num = 0; piece_num < n_pieces; piece_num++)
+			{
+				gint piece = g_random_int_range (0, G_N_ELEMENTS (text_pieces));
+				g_string_append (text, text_pieces[piece]);
+			}
+
+			gtk_text_buffer_insert (text_buffer, &start, text->str, -1);
+			g_string_free (text, TRUE);
+		}
+		else
+		{
+			gint length = g_random_int_range (0, 20);
+
+			gtk_text_buffer_get_iter_at_offset (text_buffer,
+							    &end,
+							    MIN (gtk_text_iter_get_offset (&start) + length, n_chars));
+			gtk_text_buffer_delete (text_buffer, &start, &end);
+		}
+	}
+}
+
+/* The conversions done with GtkTextIter only. */
+static goffset
+iter_get_byte_offset (const GtkTextIter *iter)
+{
+	GtkTextIter line_iter = *iter;
+	goffset byte_offset;
+
+	byte_offset = gtk_text_iter_get_line_index (iter);
+
+	gtk_text_iter_set_line_offset (&line_iter, 0);
+	while (gtk_text_iter_backward_line (&line_iter))
+	{
+		byte_offset += gtk_text_iter_get_bytes_in_line (&line_iter);
+	}
+
+	return byte_offset;
+}
+
+static void
+check_offsets (TeplBuffer *buffer)
+{
+	GtkTextBuffer *text_buffer = GTK_TEXT_BUFFER (buffer);
+	gint n_lines = gtk_text_buffer_get_line_count (text_buffer);
+	gint n_chars = gtk_text_buffer_get_char_count (text_buffer);
+	goffset byte_offset = 0;
+	GtkTextIter iter;
+	GtkTextIter index_iter;
+	gint line;
+	gint char_offset;
+
+	for (line = 0; line < n_lines; line++)
+	{
+		GtkTextIter line_end;
+
+		gtk_text_buffer_get_iter_at_line (text_buffer, &iter, line);
+
+		g_assert_cmpint (tepl_buffer_get_line_char_offset (buffer, line), ==, gtk_text_iter_get_offset (&iter));
+		g_assert_cmpint (tepl_buffer_get_line_byte_offset (buffer, line), ==, byte_offset);
+
+		g_assert_true (_tepl_buffer_get_iter_at_line (buffer, &index_iter, line));
+		g_assert_true (gtk_text_iter_equal (&index_iter, &iter));
+
+		line_end = iter;
+		if (!gtk_text_iter_ends_line (&line_end))
+		{
+			gtk_text_iter_forward_to_line_end (&line_end);
+		}
+
+		_tepl_buffer_get_iter_at_line_end (buffer, &index_iter, line);
+		g_assert_cmpint (gtk_text_iter_get_offset (&index_iter), ==, gtk_text_iter_get_offset (&line_end));
+
+		byte_offset += gtk_text_iter_get_bytes_in_line (&iter);
+	}
+
+	/* Out of range: the last line, like GtkTextBuffer. */
+	gtk_text_buffer_get_iter_at_line (text_buffer, &iter, n_lines - 1);
+	g_assert_false (_tepl_buffer_get_iter_at_line (buffer, &index_iter, n_lines));
+	g_assert_true (gtk_text_iter_equal (&index_iter, &iter));
+	g_assert_false (_tepl_buffer_get_iter_at_line (buffer, &index_iter, -1));
+	g_assert_true (gtk_text_iter_equal (&index_iter, &iter));
+
+	gtk_text_buffer_get_end_iter (text_buffer, &iter);
+	_tepl_buffer_get_iter_at_line_end (buffer, &index_iter, n_lines);
+	g_assert_true (gtk_text_iter_equal (&index_iter, &iter));
+
+	g_assert_cmpint (tepl_buffer_get_line_char_offset (buffer, n_lines), ==, n_chars);
+	g_assert_cmpint (tepl_buffer_get_line_byte_offset (buffer, n_lines), ==, byte_offset);
+
+	for (char_offset = 0; char_offset <= n_chars; char_offset++)
+	{
+		goffset iter_byte_offset;
+
+		gtk_text_buffer_get_iter_at_offset (text_buffer, &iter, char_offset);
+		iter_byte_offset = iter_get_byte_offset (&iter);
+
+		g_assert_cmpint (tepl_buffer_get_line_at_char_offset (buffer, char_offset), ==, gtk_text_iter_get_line (&iter));
+		g_assert_cmpint (tepl_buffer_get_line_at_byte_offset (buffer, iter_byte_offset), ==, gtk_text_iter_get_line (&iter));
+		g_assert_cmpint (tepl_buffer_char_offset_to_byte_offset (buffer, char_offset), ==, iter_byte_offset);
+		g_assert_cmpint (tepl_buffer_byte_offset_to_char_offset (buffer, iter_byte_offset), ==, char_offset);
+	}
+
+	g_assert_cmpint (tepl_buffer_get_line_at_char_offset (buffer, -1), ==, n_lines - 1);
+	g_assert_cmpint (tepl_buffer_char_offset_to_byte_offset (buffer, -1), ==, byte_offset);
+	g_assert_cmpint (tepl_buffer_byte_offset_to_char_offset (buffer, -1), ==, n_chars);
+}
+
+static void
+test_line_offsets (void)
+{
+	TeplBuffer *buffer;
+	gint i;
+
+	buffer = tepl_buffer_new ();
+	check_offsets (buffer);
+
+	gtk_text_buffer_set_text (GTK_TEXT_BUFFER (buffer), "a\nbé\r\n\r\xE2\x80\xA9last", -1);
+	check_offsets (buffer);
+
+	for (i = 0; i < 20; i++)
+	{
+		do_random_edits (buffer, 50);
+		check_offsets (buffer);
+	}
+
+	gtk_text_buffer_set_text (GTK_TEXT_BUFFER (buffer), "", -1);
+	check_offsets (buffer);
+
+	g_object_unref (buffer);
+}
+
+/* Compares with the conversions done with GtkTextIter. */
+static void
+test_line_offsets_perf (void)
+{
+	TeplBuffer *buffer;
+	GtkTextBuffer *text_buffer;
+	GString *text;
+	GTimer *timer;
+	gint n_chars;
+	gint n_lookups = 20;
+	gint line_num;
+	gint lookup_num;
+	goffset sum_index = 0;
+	goffset sum_iter = 0;
+	gdouble elapsed;
+
+	if (!g_test_perf ())
+	{
+		g_test_skip ("Performance test, run it with -m perf.");
+		return;
+	}
+
+	buffer = tepl_buffer_new ();
+	text_buffer = GTK_TEXT_BUFFER (buffer);
+
+	text = g_string_new (NULL);
+	for (line_num = 0; line_num < 1000 * 1000; line_num++)
+	{
+		g_string_append_printf (text, "Line %d, with a non-ASCII character: é\n", line_num);
+	}
+	gtk_text_buffer_set_text (text_buffer, text->str, text->len);
+	g_string_free (text, TRUE);
+
+	n_chars = gtk_text_buffer_get_char_count (text_buffer);
+	timer = g_timer_new ();
+
+	g_random_set_seed (0);
+	g_timer_start (timer);
+	for (lookup_num = 0; lookup_num < n_lookups; lookup_num++)
+	{
+		sum_index += tepl_buffer_char_offset_to_byte_offset (buffer, g_random_int_range (0, n_chars));
+	}
+	elapsed = g_timer_elapsed (timer, NULL) / n_lookups;
+
+	g_test_minimized_result (elapsed,
+				 "Char offset to byte offset in 1M lines, with the line index: %.2f µs",
+				 elapsed * 1000.0 * 1000.0);
+
+	g_random_set_seed (0);
+	g_timer_start (timer);
+	for (lookup_num = 0; lookup_num < n_lookups; lookup_num++)
+	{
+		GtkTextIter iter;
+
+		gtk_text_buffer_get_iter_at_offset (text_buffer, &iter, g_random_int_range (0, n_chars));
+		sum_iter += iter_get_byte_offset (&iter);
+	}
+	elapsed = g_timer_elapsed (timer, NULL) / n_lookups;
+
+	g_test_message ("Char offset to byte offset in 1M lines, with GtkTextIter: %.2f µs",
+			elapsed * 1000.0 * 1000.0);
+
+	g_assert_cmpint (sum_index, ==, sum_iter);
+
+	g_timer_destroy (timer);
+	g_object_unref (buffer);
+}
+
+static void
+set_as_invalid_chars (TeplBuffer *buffer,
+		      gint        start_offset,
+		      gint        end_offset)
+{
+	GArray *offsets;
+
+	offsets = g_array_new (FALSE, FALSE, sizeof (gint));
+	g_array_append_val (offsets, start_offset);
+	g_array_append_val (offsets, end_offset);
+
+	_tepl_buffer_set_as_invalid_chars (buffer, offsets);
+	g_array_unref (offsets);
+}
+
+static void
+delete_range (TeplBuffer *buffer,
+	      gint        start_offset,
+	      gint        end_offset)
+{
+	GtkTextIter start;
+	GtkTextIter end;
+
+	gtk_text_buffer_get_iter_at_offset (GTK_TEXT_BUFFER (buffer), &start, start_offset);
+	gtk_text_buffer_get_iter_at_offset (GTK_TEXT_BUFFER (buffer), &end, end_offset);
+	gtk_text_buffer_delete (GTK_TEXT_BUFFER (buffer), &start, &end);
+}
+
+static void
+test_invalid_chars (void)
+{
+	TeplBuffer *buffer;
+	GtkTextIter iter;
+
+	buffer = tepl_buffer_new ();
+	g_assert_false (_tepl_buffer_has_invalid_chars (buffer));
+
+	gtk_text_buffer_set_text (GTK_TEXT_BUFFER (buffer), "0123456789", -1);
+	set_as_invalid_chars (buffer, 2, 4);
+	set_as_invalid_chars (buffer, 3, 5);
+	set_as_invalid_chars (buffer, 7, 9);
+	g_assert_true (_tepl_buffer_has_invalid_chars (buffer));
+
+	/* "0156789", 78 is invalid. */
+	delete_range (buffer, 2, 5);
+	g_assert_true (_tepl_buffer_has_invalid_chars (buffer));
+
+	/* Inserted inside the tagged range, so invalid too: "01567x89". */
+	gtk_text_buffer_get_iter_at_offset (GTK_TEXT_BUFFER (buffer), &iter, 5);
+	gtk_text_buffer_insert (GTK_TEXT_BUFFER (buffer), &iter, "x", -1);
+
+	/* "0156x89" */
+	delete_range (buffer, 4, 5);
+	g_assert_true (_tepl_buffer_has_invalid_chars (buffer));
+
+	/* The iters in the reverse order. */
+	delete_range (buffer, 6, 2);
+	g_assert_false (_tepl_buffer_has_invalid_chars (buffer));
+
+	set_as_invalid_chars (buffer, 0, 2);
+	g_assert_true (_tepl_buffer_has_invalid_chars (buffer));
+	gtk_text_buffer_set_text (GTK_TEXT_BUFFER (buffer), "", -1);
+	g_assert_false (_tepl_buffer_has_invalid_chars (buffer));
+
+	g_object_unref (buffer);
+}
+
+static void
+cursor_moved_cb (TeplBuffer *buffer,
+		 gint       *n_signals)
+{
+	(*n_signals)++;
+}
+
+static void
+flush_main_context (void)
+{
+	while (g_main_context_iteration (NULL, FALSE))
+	{
+	}
+}
+
+static void
+test_apply_edits (void)
+{
+	TeplBuffer *buffer;
+	GtkTextBuffer *text_buffer;
+	GtkTextIter start;
+	GtkTextIter end;
+	gchar *text;
+	gint n_signals = 0;
+	const TeplBufferEdit edits[] =
+	{
+		{ 0, 0, "<" },
+		{ 0, 5, "Bye" },
+		{ 6, 6, "big " },
+		{ 11, 12, NULL },
+		{ 12, 12, "!" },
+	};
+
+	buffer = tepl_buffer_new ();
+	text_buffer = GTK_TEXT_BUFFER (buffer);
+	gtk_source_buffer_begin_not_undoable_action (GTK_SOURCE_BUFFER (buffer));
+	gtk_text_buffer_set_text (text_buffer, "Hello world.", -1);
+	gtk_source_buffer_end_not_undoable_action (GTK_SOURCE_BUFFER (buffer));
+	flush_main_context ();
+
+	g_signal_connect (buffer,
+			  "tepl-cursor-moved",
+			  G_CALLBACK (cursor_moved_cb),
+			  &n_signals);
+
+	tepl_buffer_apply_edits (buffer, edits, G_N_ELEMENTS (edits));
+	flush_main_context ();
+	g_assert_cmpint (n_signals, ==, 1);
+
+	gtk_text_buffer_get_bounds (text_buffer, &start, &end);
+	text = gtk_text_buffer_get_text (text_buffer, &start, &end, TRUE);
+	g_assert_cmpstr (text, ==, "<Bye big world!");
+	g_free (text);
+
+	/* One undo step. */
+	gtk_source_buffer_undo (GTK_SOURCE_BUFFER (buffer));
+	g_assert_false (gtk_source_buffer_can_undo (GTK_SOURCE_BUFFER (buffer)));
+	gtk_text_buffer_get_bounds (text_buffer, &start, &end);
+	text = gtk_text_buffer_get_text (text_buffer, &start, &end, TRUE);
+	g_assert_cmpstr (text, ==, "Hello world.");
+	g_free (text);
+
+	g_object_unref (buffer);
+}
+
+#define N_PERF_EDITS (100 * 1000)
+
+static TeplBuffer *
+create_perf_buffer (void)
+{
+	TeplBuffer *buffer;
+	GString *text;
+	gint line_num;
+
+	buffer = tepl_buffer_new ();
+
+	text = g_string_new (NULL);
+	for (line_num = 0; line_num < N_PERF_EDITS; line_num++)
+	{
+		g_string_append (text, "foo = 1;\n");
+	}
+
+	gtk_source_buffer_begin_not_undoable_action (GTK_SOURCE_BUFFER (buffer));
+	gtk_text_buffer_set_text (GTK_TEXT_BUFFER (buffer), text->str, text->len);
+	gtk_source_buffer_end_not_undoable_action (GTK_SOURCE_BUFFER (buffer));
+	g_string_free (text, TRUE);
+
+	flush_main_context ();
+	return buffer;
+}
+
+/* Replaces the "foo" at the start of each line, with
+ * tepl_buffer_apply_edits() and then with one edit at a time.
+ */
+static void
+test_apply_edits_perf (void)
+{
+	TeplBuffer *buffer;
+	TeplBufferEdit *edits;
+	GTimer *timer;
+	gdouble elapsed;
+	gint edit_num;
+
+	if (!g_test_perf ())
+	{
+		g_test_skip ("Performance test, run it with -m perf.");
+		return;
+	}
+
+	edits = g_new (TeplBufferEdit, N_PERF_EDITS);
+	for (edit_num = 0; edit_num < N_PERF_EDITS; edit_num++)
+	{
+		edits[edit_num].start_offset = edit_num * strlen ("foo = 1;\n");
+		edits[edit_num].end_offset = edits[edit_num].start_offset + strlen ("foo");
+		edits[edit_num].text = "bar_baz";
+	}
+
+	timer = g_timer_new ();
+
+	buffer = create_perf_buffer ();
+	g_timer_start (timer);
+	tepl_buffer_apply_edits (buffer, edits, N_PERF_EDITS);
+	flush_main_context ();
+	elapsed = g_timer_elapsed (timer, NULL);
+	g_object_unref (buffer);
+
+	g_test_minimized_result (elapsed,
+				 "Apply 10^5 edits with tepl_buffer_apply_edits(): %.3f s",
+				 elapsed);
+
+	buffer = create_perf_buffer ();
+	g_timer_start (timer);
+	for (edit_num = 0; edit_num < N_PERF_EDITS; edit_num++)
+	{
+		/* Each previous edit added 4 characters. */
+		gint shift = edit_num * (strlen ("bar_baz") - strlen ("foo"));
+		GtkTextIter start;
+		GtkTextIter end;
+
+		gtk_text_buffer_get_iter_at_offset (GTK_TEXT_BUFFER (buffer), &start, edits[edit_num].start_offset + shift);
+		gtk_text_buffer_get_iter_at_offset (GTK_TEXT_BUFFER (buffer), &end, edits[edit_num].end_offset + shift);
+		gtk_text_buffer_delete (GTK_TEXT_BUFFER (buffer), &start, &end);
+		gtk_text_buffer_insert (GTK_TEXT_BUFFER (buffer), &start, edits[edit_num].text, -1);
+	}
+	flush_main_context ();
+	elapsed = g_timer_elapsed (timer, NULL);
+	g_object_unref (buffer);
+
+	g_test_message ("Apply 10^5 edits one at a time: %.3f s", elapsed);
+
+	g_timer_destroy (timer);
+	g_free (edits);
+}
+
+static void
+test_lazy_rope (void)
+{
+	TeplBuffer *buffer;
+	GtkTextBuffer *text_buffer;
+	GtkTextChildAnchor *anchor;
+	GtkTextIter iter;
+	GtkTextIter end;
+	gchar *text;
+
+	buffer = tepl_buffer_new ();
+	text_buffer = GTK_TEXT_BUFFER (buffer);
+	gtk_text_buffer_set_text (text_buffer, "Hello wörld", -1);
+	_tepl_buffer_set_current_content_as_saved (buffer);
+	g_assert_true (_tepl_buffer_is_unchanged_since_save (buffer));
+
+	/* Without the rope, only the revision is known. */
+	gtk_text_buffer_get_end_iter (text_buffer, &iter);
+	gtk_text_buffer_insert (text_buffer, &iter, "!", -1);
+	g_assert_false (_tepl_buffer_is_unchanged_since_save (buffer));
+
+	gtk_text_buffer_get_end_iter (text_buffer, &end);
+	iter = end;
+	gtk_text_iter_backward_char (&iter);
+	gtk_text_buffer_delete (text_buffer, &iter, &end);
+	g_assert_false (_tepl_buffer_is_unchanged_since_save (buffer));
+
+	/* Created from the text, with the pixbufs as U+FFFC. */
+	gtk_text_buffer_get_start_iter (text_buffer, &iter);
+	anchor = gtk_text_child_anchor_new ();
+	gtk_text_buffer_insert_child_anchor (text_buffer, &iter, anchor);
+	g_object_unref (anchor);
+	text = _tepl_rope_get_text (_tepl_buffer_get_rope (buffer));
+	g_assert_cmpstr (text, ==, "\xEF\xBF\xBC" "Hello wörld");
+	g_free (text);
+
+	/* Then kept up to date. */
+	gtk_text_buffer_get_end_iter (text_buffer, &iter);
+	gtk_text_buffer_insert (text_buffer, &iter, "!", -1);
+	text = _tepl_rope_get_text (_tepl_buffer_get_rope (buffer));
+	g_assert_cmpstr (text, ==, "\xEF\xBF\xBC" "Hello wörld!");
+	g_free (text);
+
+	/* With the rope, a content typed and then deleted is detected. */
+	_tepl_buffer_set_current_content_as_saved (buffer);
+	gtk_text_buffer_get_end_iter (text_buffer, &iter);
+	gtk_text_buffer_insert (text_buffer, &iter, "?", -1);
+	g_assert_false (_tepl_buffer_is_unchanged_since_save (buffer));
+
+	gtk_text_buffer_get_end_iter (text_buffer, &end);
+	iter = end;
+	gtk_text_iter_backward_char (&iter);
+	gtk_text_buffer_delete (text_buffer, &iter, &end);
+	g_assert_true (_tepl_buffer_is_unchanged_since_save (buffer));
+
+	g_object_unref (buffer);
+
+	/* The rope created after a load without edits has the saved hash. */
+	buffer = tepl_buffer_new ();
+	text_buffer = GTK_TEXT_BUFFER (buffer);
+	gtk_text_buffer_set_text (text_buffer, "abc", -1);
+	_tepl_buffer_set_current_content_as_saved (buffer);
+	_tepl_buffer_get_rope (buffer);
+
+	gtk_text_buffer_get_end_iter (text_buffer, &iter);
+	gtk_text_buffer_insert (text_buffer, &iter, "d", -1);
+	gtk_text_buffer_get_end_iter (text_buffer, &end);
+	iter = end;
+	gtk_text_iter_backward_char (&iter);
+	gtk_text_buffer_delete (text_buffer, &iter, &end);
+	g_assert_true (_tepl_buffer_is_unchanged_since_save (buffer));
+
+	g_object_unref (buffer);
+}
+
+gint
+main (gint    argc,
+      gchar **argv)
+{
+	gtk_test_init (&argc, &argv);
+
+	g_test_add_func ("/buffer/line_offsets", test_line_offsets);
+	g_test_add_func ("/buffer/line_offsets_perf", test_line_offsets_perf);
+	g_test_add_func ("/buffer/invalid_chars", test_invalid_chars);
+	g_test_add_func ("/buffer/lazy_rope", test_lazy_rope);
+	g_test_add_func ("/buffer/apply_edits", test_apply_edits);
+	g_test_add_func ("/buffer/apply_edits_perf", test_apply_edits_perf);
+
+	return g_test_run ();
+}
@@ -0,0 +1,391 @@
+/* SPDX-FileCopyrightText: 2020 - Sébastien Wilmet <swilmet@gnome.org>
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <tepl/tepl.h>
+#include <string.h>
+#include "tepl-test-utils.h"
+
+#define ORIGINAL_CONTENT "Original content\nsecond line\n"
+
+static GFile *
+get_journal_location (void)
+{
+	return g_file_new_build_filename (g_get_tmp_dir (), "tepl-edit-journal-test", NULL);
+}
+
+static gchar *
+get_buffer_text (TeplBuffer *buffer)
+{
+	GtkTextIter start;
+	GtkTextIter end;
+
+	gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (buffer), &start, &end);
+	return gtk_text_buffer_get_text (GTK_TEXT_BUFFER (buffer), &start, &end, TRUE);
+}
+
+static TeplBuffer *
+create_original_buffer (void)
+{
+	TeplBuffer *buffer;
+
+	buffer = tepl_buffer_new ();
+	gtk_text_buffer_set_text (GTK_TEXT_BUFFER (buffer), ORIGINAL_CONTENT, -1);
+	gtk_text_buffer_set_modified (GTK_TEXT_BUFFER (buffer), FALSE);
+
+	return buffer;
+}
+
+static void
+do_random_edits (TeplBuffer *buffer,
+		 gint        n_edits)
+{
+	GtkTextBuffer *text_buffer = GTK_TEXT_BUFFER (buffer);
+	gint i;
+
+	for (i = 0; i < n_edits; i++)
+	{
+		gint n_chars = gtk_text_buffer_get_char_count (text_buffer);
+		GtkTextIter start;
+		GtkTextIter end;
+
+		gtk_text_buffer_get_iter_at_offset (text_buffer,
+						    &start,
+						    g_random_int_range (0, n_chars + 1));
+
+		if (n_chars == 0 || g_random_boolean ())
+		{
+			gtk_text_buffer_insert (text_buffer, &start, "héllo\n", -1);
+		}
+		else
+		{
+			gtk_text_buffer_get_iter_at_offset (text_buffer,
+							    &end,
+							    g_random_int_range (0, n_chars + 1));
+			gtk_text_buffer_delete (text_buffer, &start, &end);
+		}
+	}
+}
+
+/* Replays the journal over the original content, and compares with
+ * @buffer.
+ */
+static void
+check_replay (TeplBuffer *buffer,
+	      GFile      *location)
+{
+	TeplBuffer *recovered_buffer;
+	gchar *expected_text;
+	gchar *recovered_text;
+	GError *error = NULL;
+
+	recovered_buffer = create_original_buffer ();
+	tepl_edit_journal_replay (recovered_buffer, location, &error);
+	g_assert_no_error (error);
+
+	expected_text = get_buffer_text (buffer);
+	recovered_text = get_buffer_text (recovered_buffer);
+	g_assert_cmpstr (recovered_text, ==, expected_text);
+
+	g_free (expected_text);
+	g_free (recovered_text);
+	g_object_unref (recovered_buffer);
+}
+
+static void
+test_replay (void)
+{
+	TeplBuffer *buffer;
+	GFile *location;
+	TeplEditJournal *journal;
+
+	buffer = create_original_buffer ();
+	location = get_journal_location ();
+	journal = tepl_edit_journal_new (buffer, location);
+
+	tepl_edit_journal_sync (journal);
+	check_replay (buffer, location);
+
+	do_random_edits (buffer, 500);
+	tepl_edit_journal_sync (journal);
+	check_replay (buffer, location);
+
+	do_random_edits (buffer, 500);
+	tepl_edit_journal_sync (journal);
+	check_replay (buffer, location);
+
+	g_object_unref (journal);
+	g_file_delete (location, NULL, NULL);
+	g_object_unref (location);
+	g_object_unref (buffer);
+}
+
+/* The journal starts with a copy of the content of a modified buffer. */
+static void
+test_modified_buffer (void)
+{
+	TeplBuffer *buffer;
+	GFile *location;
+	TeplEditJournal *journal;
+
+	buffer = create_original_buffer ();
+	gtk_text_buffer_set_text (GTK_TEXT_BUFFER (buffer), "Modified", -1);
+
+	location = get_journal_location ();
+	journal = tepl_edit_journal_new (buffer, location);
+
+	do_random_edits (buffer, 100);
+	tepl_edit_journal_sync (journal);
+	check_replay (buffer, location);
+
+	g_object_unref (journal);
+	g_file_delete (location, NULL, NULL);
+	g_object_unref (location);
+	g_object_unref (buffer);
+}
+
+static void
+save_cb (GObject      *source_object,
+	 GAsyncResult *result,
+	 gpointer      user_data)
+{
+	TeplFileSaver *saver = TEPL_FILE_SAVER (source_object);
+	GError *error = NULL;
+
+	tepl_file_saver_save_finish (saver, result, &error);
+	g_assert_no_error (error);
+
+	gtk_main_quit ();
+}
+
+/* Saves @buffer to @location, and does @n_edits random edits while the save
+ * is running.
+ */
+static void
+save_with_edits (TeplBuffer *buffer,
+		 GFile      *location,
+		 gint        n_edits)
+{
+	TeplFileSaver *saver;
+
+	saver = tepl_file_saver_new_with_target (buffer, tepl_buffer_get_file (buffer), location);
+	tepl_file_saver_save_async (saver, G_PRIORITY_DEFAULT, NULL, save_cb, NULL);
+	do_random_edits (buffer, n_edits);
+	gtk_main ();
+	g_object_unref (saver);
+}
+
+/* Replays the journal over the saved file, and compares with @buffer. */
+static void
+check_replay_over_file (TeplBuffer *buffer,
+			GFile      *journal_location,
+			GFile      *saved_location)
+{
+	TeplBuffer *recovered_buffer;
+	gchar *saved_content;
+	gchar *expected_text;
+	gchar *recovered_text;
+	GError *error = NULL;
+
+	g_file_load_contents (saved_location, NULL, &saved_content, NULL, NULL, &error);
+	g_assert_no_error (error);
+
+	recovered_buffer = tepl_buffer_new ();
+	gtk_text_buffer_set_text (GTK_TEXT_BUFFER (recovered_buffer), saved_content, -1);
+	tepl_edit_journal_replay (recovered_buffer, journal_location, &error);
+	g_assert_no_error (error);
+
+	expected_text = get_buffer_text (buffer);
+	recovered_text = get_buffer_text (recovered_buffer);
+	g_assert_cmpstr (recovered_text, ==, expected_text);
+
+	g_free (saved_content);
+	g_free (expected_text);
+	g_free (recovered_text);
+	g_object_unref (recovered_buffer);
+}
+
+static void
+test_reset (void)
+{
+	TeplBuffer *buffer;
+	GFile *location;
+	GFile *saved_location;
+	TeplEditJournal *journal;
+	GFileInfo *info;
+
+	buffer = create_original_buffer ();
+	location = get_journal_location ();
+	saved_location = g_file_new_build_filename (g_get_tmp_dir (), "tepl-edit-journal-test-saved", NULL);
+	journal = tepl_edit_journal_new (buffer, location);
+
+	/* No edits during the save, the journal is emptied. */
+	do_random_edits (buffer, 100);
+	save_with_edits (buffer, saved_location, 0);
+	tepl_edit_journal_reset (journal);
+	tepl_edit_journal_sync (journal);
+
+	info = g_file_query_info (location, G_FILE_ATTRIBUTE_STANDARD_SIZE, G_FILE_QUERY_INFO_NONE, NULL, NULL);
+	g_assert_nonnull (info);
+	g_assert_cmpint (g_file_info_get_size (info), ==, strlen ("TEPLJRN1"));
+	g_object_unref (info);
+
+	do_random_edits (buffer, 100);
+	tepl_edit_journal_sync (journal);
+	check_replay_over_file (buffer, location, saved_location);
+
+	/* The edits done during the save are kept. */
+	save_with_edits (buffer, saved_location, 100);
+	tepl_edit_journal_reset (journal);
+	tepl_edit_journal_sync (journal);
+	check_replay_over_file (buffer, location, saved_location);
+
+	do_random_edits (buffer, 100);
+	tepl_edit_journal_sync (journal);
+	check_replay_over_file (buffer, location, saved_location);
+
+	g_object_unref (journal);
+	g_file_delete (location, NULL, NULL);
+	g_file_delete (saved_location, NULL, NULL);
+	g_object_unref (location);
+	g_object_unref (saved_location);
+	g_object_unref (buffer);
+}
+
+/* The journal becomes bigger than the document. */
+static void
+test_compaction (void)
+{
+	TeplBuffer *buffer;
+	GtkTextBuffer *text_buffer;
+	GFile *location;
+	TeplEditJournal *journal;
+	GString *big_text;
+	GFileInfo *info;
+	gint i;
+
+	buffer = create_original_buffer ();
+	text_buffer = GTK_TEXT_BUFFER (buffer);
+	location = get_journal_location ();
+	journal = tepl_edit_journal_new (buffer, location);
+
+	big_text = g_string_new (NULL);
+	while (big_text->len < 256 * 1024)
+	{
+		g_string_append (big_text, "big text\n");
+	}
+
+	for (i = 0; i < 10; i++)
+	{
+		GtkTextIter start;
+		GtkTextIter end;
+
+		gtk_text_buffer_get_start_iter (text_buffer, &start);
+		gtk_text_buffer_insert (text_buffer, &start, big_text->str, -1);
+
+		gtk_text_buffer_get_start_iter (text_buffer, &start);
+		gtk_text_buffer_get_iter_at_offset (text_buffer, &end, big_text->len);
+		gtk_text_buffer_delete (text_buffer, &start, &end);
+
+		tepl_edit_journal_sync (journal);
+	}
+
+	do_random_edits (buffer, 10);
+	tepl_edit_journal_sync (journal);
+
+	/* 2.5 MiB of edits. */
+	info = g_file_query_info (location, G_FILE_ATTRIBUTE_STANDARD_SIZE, G_FILE_QUERY_INFO_NONE, NULL, NULL);
+	g_assert_nonnull (info);
+	g_assert_cmpint (g_file_info_get_size (info), <, 2 * 1024 * 1024);
+	g_object_unref (info);
+
+	check_replay (buffer, location);
+
+	g_string_free (big_text, TRUE);
+	g_object_unref (journal);
+	g_file_delete (location, NULL, NULL);
+	g_object_unref (location);
+	g_object_unref (buffer);
+}
+
+/* A crash while the last record was being written. */
+static void
+test_truncated (void)
+{
+	TeplBuffer *buffer;
+	GtkTextBuffer *text_buffer;
+	GFile *location;
+	TeplEditJournal *journal;
+	gchar *contents;
+	gsize length;
+	gchar *text;
+	GtkTextIter iter;
+	GError *error = NULL;
+
+	buffer = create_original_buffer ();
+	text_buffer = GTK_TEXT_BUFFER (buffer);
+	location = get_journal_location ();
+	journal = tepl_edit_journal_new (buffer, location);
+
+	gtk_text_buffer_get_start_iter (text_buffer, &iter);
+	gtk_text_buffer_insert (text_buffer, &iter, "a", -1);
+	gtk_text_buffer_get_end_iter (text_buffer, &iter);
+	gtk_text_buffer_insert (text_buffer, &iter, "last", -1);
+	tepl_edit_journal_sync (journal);
+	g_object_unref (journal);
+
+	g_file_load_contents (location, NULL, &contents, &length, NULL, &error);
+	g_assert_no_error (error);
+	g_file_replace_contents (location, contents, length - 2, NULL, FALSE, G_FILE_CREATE_NONE, NULL, NULL, &error);
+	g_assert_no_error (error);
+	g_free (contents);
+
+	g_object_unref (buffer);
+	buffer = create_original_buffer ();
+	tepl_edit_journal_replay (buffer, location, &error);
+	g_assert_no_error (error);
+
+	text = get_buffer_text (buffer);
+	g_assert_cmpstr (text, ==, "a" ORIGINAL_CONTENT);
+	g_free (text);
+
+	g_file_delete (location, NULL, NULL);
+	g_object_unref (location);
+	g_object_unref (buffer);
+}
+
+static void
+test_invalid (void)
+{
+	TeplBuffer *buffer;
+	GFile *location;
+	GError *error = NULL;
+
+	buffer = create_original_buffer ();
+	location = get_journal_location ();
+	_tepl_test_utils_set_file_content (location, "Not a journal");
+
+	g_assert_false (tepl_edit_journal_replay (buffer, location, &error));
+	g_assert_error (error, TEPL_EDIT_JOURNAL_ERROR, TEPL_EDIT_JOURNAL_ERROR_INVALID);
+	g_clear_error (&error);
+
+	g_file_delete (location, NULL, NULL);
+	g_object_unref (location);
+	g_object_unref (buffer);
+}
+
+gint
+main (gint    argc,
+      gchar **argv)
+{
+	gtk_test_init (&argc, &argv);
+
+	g_test_add_func ("/edit_journal/replay", test_replay);
+	g_test_add_func ("/edit_journal/modified_buffer", test_modified_buffer);
+	g_test_add_func ("/edit_journal/reset", test_reset);
+	g_test_add_func ("/edit_journal/compaction", test_compaction);
+	g_test_add_func ("/edit_journal/truncated", test_truncated);
+	g_test_add_func ("/edit_journal/invalid", test_invalid);
+
+	return g_test_run ();
+}
@@ -4,6 +4,8 @@
 
 #include <tepl/tepl.h>
 #include <string.h>
+#include "tepl/tepl-charset-detector.h"
+#include "tepl/tepl-utf8.h"
 #include "tepl-test-utils.h"
 
 static GFile *
@@ -25,17 +27,25 @@ load_sync_cb (GObject      *source_object,
 }
 
 static void
-load_sync (TeplFileLoader  *loader,
-	   GError         **error)
+load_sync_with_cancellable (TeplFileLoader  *loader,
+			    GCancellable    *cancellable,
+			    GError         **error)
 {
 	tepl_file_loader_load_async (loader,
 				     G_PRIORITY_DEFAULT,
-				     NULL,
+				     cancellable,
 				     load_sync_cb,
 				     error);
 	gtk_main ();
 }
 
+static void
+load_sync (TeplFileLoader  *loader,
+	   GError         **error)
+{
+	load_sync_with_cancellable (loader, NULL, error);
+}
+
 static void
 load_sync_expect_no_error (TeplFileLoader *loader)
 {
@@ -105,6 +115,15 @@ test_properties (void)
 	g_assert_true (tepl_file_loader_get_file (loader) == file);
 	g_assert_true (tepl_file_loader_get_location (loader) == location);
 
+	g_assert_null (tepl_file_loader_get_charset (loader));
+	g_assert_cmpint (tepl_file_loader_get_detected_charset_confidence (loader), ==, -1);
+	tepl_file_loader_set_charset (loader, "ISO-8859-15");
+	g_assert_cmpstr (tepl_file_loader_get_charset (loader), ==, "ISO-8859-15");
+
+	g_assert_cmpuint (tepl_file_loader_get_insertion_time_budget (loader), >, 0);
+	tepl_file_loader_set_insertion_time_budget (loader, 1000);
+	g_assert_cmpuint (tepl_file_loader_get_insertion_time_budget (loader), ==, 1000);
+
 	g_object_unref (buffer);
 	g_object_unref (location);
 	g_object_unref (loader);
@@ -144,6 +163,40 @@ test_non_existing_file (void)
 	g_object_unref (loader);
 }
 
+static void
+test_max_file_size (void)
+{
+	TeplBuffer *buffer;
+	TeplFile *file;
+	GFile *location;
+	TeplFileLoader *loader;
+	GError *error = NULL;
+
+	buffer = create_buffer ();
+	file = tepl_buffer_get_file (buffer);
+
+	location = get_tmp_location ();
+	_tepl_test_utils_set_file_content (location, "0123456789");
+
+	tepl_file_set_location (file, location);
+	loader = tepl_file_loader_new (buffer, file);
+	g_assert_cmpuint (tepl_file_loader_get_max_file_size (loader), ==, 0);
+
+	tepl_file_loader_set_max_file_size (loader, 9);
+	load_sync (loader, &error);
+	g_assert_error (error, TEPL_FILE_LOADER_ERROR, TEPL_FILE_LOADER_ERROR_TOO_BIG);
+	g_clear_error (&error);
+	check_buffer_state_after_load (buffer, "");
+
+	tepl_file_loader_set_max_file_size (loader, 10);
+	load_sync_expect_no_error (loader);
+	check_buffer_state_after_load (buffer, "0123456789");
+
+	g_object_unref (buffer);
+	g_object_unref (location);
+	g_object_unref (loader);
+}
+
 static void
 test_utf8_file (void)
 {
@@ -171,6 +224,1280 @@ test_utf8_file (void)
 	g_object_unref (loader);
 }
 
+static void
+check_load_content_full (const gchar *content,
+			 gboolean     use_mapped_file)
+{
+	TeplBuffer *buffer;
+	TeplFile *file;
+	GFile *location;
+	TeplFileLoader *loader;
+
+	buffer = create_buffer ();
+	file = tepl_buffer_get_file (buffer);
+
+	location = get_tmp_location ();
+	_tepl_test_utils_set_file_content (location, content);
+
+	tepl_file_set_location (file, location);
+	loader = tepl_file_loader_new (buffer, file);
+	_tepl_file_loader_set_use_mapped_file (loader, use_mapped_file);
+	load_sync_expect_no_error (loader);
+
+	check_buffer_state_after_load (buffer, content);
+
+	g_object_unref (buffer);
+	g_object_unref (location);
+	g_object_unref (loader);
+}
+
+/* With the mapped file and with the input stream. */
+static void
+check_load_content (const gchar *content)
+{
+	check_load_content_full (content, TRUE);
+	check_load_content_full (content, FALSE);
+}
+
+/* The content is read by chunks, with a multi-byte character split between two
+ * chunks.
+ */
+static void
+check_load_content_with_split_char (const gchar *multi_byte_char)
+{
+	/* Must be at least the chunk size used by TeplFileLoader. */
+	const gsize chunk_size = 64 * 1024;
+	GString *content;
+	gsize i;
+
+	content = g_string_new (NULL);
+
+	for (i = 0; i < 3; i++)
+	{
+		while (content->len < (i + 1) * chunk_size - 1)
+		{
+			g_string_append_c (content, 'a');
+		}
+
+		g_string_append (content, multi_byte_char);
+	}
+
+	check_load_content (content->str);
+	g_string_free (content, TRUE);
+}
+
+static void
+test_utf8_file_several_chunks (void)
+{
+	check_load_content_with_split_char ("É");
+	check_load_content_with_split_char ("€");
+	check_load_content_with_split_char ("\xF0\x9F\x98\x80");
+}
+
+static void
+load_cb (GObject      *source_object,
+	 GAsyncResult *result,
+	 gpointer      user_data)
+{
+	TeplFileLoader *loader = TEPL_FILE_LOADER (source_object);
+	gboolean *finished = user_data;
+	GError *error = NULL;
+
+	tepl_file_loader_load_finish (loader, result, &error);
+	g_assert_no_error (error);
+	*finished = TRUE;
+}
+
+/* The mapped file is truncated by another process during the loading. */
+static void
+test_truncated_mapped_file (void)
+{
+	TeplBuffer *buffer;
+	TeplFile *file;
+	GFile *location;
+	TeplFileLoader *loader;
+	GString *content;
+	GFileIOStream *io_stream;
+	GOutputStream *output_stream;
+	gboolean finished = FALSE;
+	GError *error = NULL;
+
+	content = g_string_new (NULL);
+	while (content->len < 4 * 1024 * 1024)
+	{
+		g_string_append (content, "A line of the file.\n");
+	}
+
+	buffer = create_buffer ();
+	file = tepl_buffer_get_file (buffer);
+
+	location = get_tmp_location ();
+	_tepl_test_utils_set_file_content (location, content->str);
+
+	tepl_file_set_location (file, location);
+	loader = tepl_file_loader_new (buffer, file);
+	_tepl_file_loader_set_use_mapped_file (loader, TRUE);
+	tepl_file_loader_set_charset (loader, "UTF-8");
+
+	tepl_file_loader_load_async (loader, G_PRIORITY_DEFAULT, NULL, load_cb, &finished);
+
+	/* The file is mapped, and the first window is being inserted. */
+	while (gtk_text_buffer_get_char_count (GTK_TEXT_BUFFER (buffer)) == 0)
+	{
+		g_main_context_iteration (NULL, TRUE);
+	}
+
+	/* Truncated in place, not replaced by a new file. */
+	io_stream = g_file_open_readwrite (location, NULL, &error);
+	g_assert_no_error (error);
+	g_seekable_truncate (G_SEEKABLE (io_stream), 0, NULL, &error);
+	g_assert_no_error (error);
+	output_stream = g_io_stream_get_output_stream (G_IO_STREAM (io_stream));
+	g_output_stream_write_all (output_stream, "truncated", strlen ("truncated"), NULL, NULL, &error);
+	g_assert_no_error (error);
+	g_io_stream_close (G_IO_STREAM (io_stream), NULL, &error);
+	g_assert_no_error (error);
+	g_object_unref (io_stream);
+
+	while (!finished)
+	{
+		g_main_context_iteration (NULL, TRUE);
+	}
+
+	check_buffer_state_after_load (buffer, "truncated");
+
+	g_file_delete (location, NULL, NULL);
+	g_string_free (content, TRUE);
+	g_object_unref (buffer);
+	g_object_unref (location);
+	g_object_unref (loader);
+}
+
+/* The content contains one range of invalid bytes. */
+static void
+check_invalid_utf8_content_full (const gchar *content,
+				 const gchar *expected_buffer_content,
+				 goffset      expected_range_start,
+				 goffset      expected_range_length,
+				 gboolean     use_mapped_file)
+{
+	TeplBuffer *buffer;
+	TeplFile *file;
+	GFile *location;
+	TeplFileLoader *loader;
+	goffset range_start;
+	goffset range_length;
+
+	buffer = create_buffer ();
+	file = tepl_buffer_get_file (buffer);
+
+	location = get_tmp_location ();
+	_tepl_test_utils_set_file_content (location, content);
+
+	tepl_file_set_location (file, location);
+	loader = tepl_file_loader_new (buffer, file);
+
+	_tepl_file_loader_set_use_mapped_file (loader, use_mapped_file);
+
+	/* Otherwise another charset can be detected. */
+	tepl_file_loader_set_charset (loader, "UTF-8");
+
+	load_sync_expect_no_error (loader);
+	check_buffer_state_after_load (buffer, expected_buffer_content);
+	g_assert_true (_tepl_buffer_has_invalid_chars (buffer));
+
+	g_assert_cmpuint (tepl_file_loader_get_n_invalid_ranges (loader), ==, 1);
+	tepl_file_loader_get_invalid_range (loader, 0, &range_start, &range_length);
+	g_assert_cmpint (range_start, ==, expected_range_start);
+	g_assert_cmpint (range_length, ==, expected_range_length);
+
+	g_object_unref (buffer);
+	g_object_unref (location);
+	g_object_unref (loader);
+}
+
+static void
+check_invalid_utf8_content (const gchar *content,
+			    const gchar *expected_buffer_content,
+			    goffset      expected_range_start,
+			    goffset      expected_range_length)
+{
+	check_invalid_utf8_content_full (content,
+					 expected_buffer_content,
+					 expected_range_start,
+					 expected_range_length,
+					 TRUE);
+
+	check_invalid_utf8_content_full (content,
+					 expected_buffer_content,
+					 expected_range_start,
+					 expected_range_length,
+					 FALSE);
+}
+
+static void
+test_invalid_utf8_file (void)
+{
+	GString *content;
+	GString *expected_content;
+
+	check_invalid_utf8_content ("\xFF", "\\FF", 0, 1);
+	check_invalid_utf8_content ("Valid, then invalid: \xC3\x28",
+				    "Valid, then invalid: \\C3(",
+				    21, 1);
+
+	/* Consecutive invalid bytes form one range. */
+	check_invalid_utf8_content ("a\x80\x80\x80b", "a\\80\\80\\80b", 1, 3);
+
+	/* Truncated multi-byte character at the end of the file. */
+	check_invalid_utf8_content ("Truncated: \xE2\x82", "Truncated: \\E2\\82", 11, 2);
+
+	/* In the second chunk. */
+	content = g_string_new (NULL);
+	while (content->len < 100 * 1000)
+	{
+		g_string_append (content, "0123456789");
+	}
+	expected_content = g_string_new (content->str);
+	g_string_append (content, "\xC0\x80");
+	g_string_append (expected_content, "\\C0\\80");
+	check_invalid_utf8_content (content->str, expected_content->str, 100 * 1000, 2);
+	g_string_free (content, TRUE);
+	g_string_free (expected_content, TRUE);
+
+	/* Invalid character split between two chunks. */
+	content = g_string_new (NULL);
+	while (content->len < 64 * 1024 - 1)
+	{
+		g_string_append_c (content, 'a');
+	}
+	expected_content = g_string_new (content->str);
+	g_string_append (content, "\xE2(");
+	g_string_append (expected_content, "\\E2(");
+	check_invalid_utf8_content (content->str, expected_content->str, 64 * 1024 - 1, 1);
+	g_string_free (content, TRUE);
+	g_string_free (expected_content, TRUE);
+}
+
+static void
+check_content_analysis (const gchar     *content,
+			TeplNewlineType  expected_newline_type,
+			guint64          expected_n_lines,
+			guint64          expected_max_line_length,
+			gdouble          expected_mean_line_length,
+			gboolean         expected_has_bom)
+{
+	TeplBuffer *buffer;
+	TeplFile *file;
+	GFile *location;
+	TeplFileLoader *loader;
+
+	buffer = create_buffer ();
+	file = tepl_buffer_get_file (buffer);
+
+	location = get_tmp_location ();
+	_tepl_test_utils_set_file_content (location, content);
+
+	tepl_file_set_location (file, location);
+	loader = tepl_file_loader_new (buffer, file);
+	tepl_file_loader_set_charset (loader, "UTF-8");
+	load_sync_expect_no_error (loader);
+
+	g_assert_cmpint (tepl_file_get_newline_type (file), ==, expected_newline_type);
+	g_assert_cmpuint (tepl_file_loader_get_n_lines (loader), ==, expected_n_lines);
+	g_assert_cmpuint (tepl_file_loader_get_n_lines (loader), ==,
+			  gtk_text_buffer_get_line_count (GTK_TEXT_BUFFER (buffer)));
+	g_assert_cmpuint (tepl_file_loader_get_max_line_length (loader), ==, expected_max_line_length);
+	g_assert_cmpfloat_with_epsilon (tepl_file_loader_get_mean_line_length (loader),
+					expected_mean_line_length,
+					0.001);
+	g_assert_true (tepl_file_loader_has_bom (loader) == expected_has_bom);
+	g_assert_cmpuint (tepl_file_loader_get_n_invalid_ranges (loader), ==, 0);
+
+	g_object_unref (buffer);
+	g_object_unref (location);
+	g_object_unref (loader);
+}
+
+static void
+test_content_analysis (void)
+{
+	GString *content;
+
+	check_content_analysis ("", TEPL_NEWLINE_TYPE_DEFAULT, 1, 0, 0.0, FALSE);
+	check_content_analysis ("abc", TEPL_NEWLINE_TYPE_DEFAULT, 1, 3, 3.0, FALSE);
+	check_content_analysis ("a\nbb\nccc\n", TEPL_NEWLINE_TYPE_LF, 4, 3, 1.5, FALSE);
+	check_content_analysis ("a\r\nbb\r\nccc\n", TEPL_NEWLINE_TYPE_CR_LF, 4, 3, 1.5, FALSE);
+	check_content_analysis ("é\rxy\r\rÉÈßÇ", TEPL_NEWLINE_TYPE_CR, 4, 4, 1.75, FALSE);
+	check_content_analysis ("\xEF\xBB\xBF" "abc\n", TEPL_NEWLINE_TYPE_LF, 2, 4, 2.0, TRUE);
+
+	/* "\r\n" split between two chunks. */
+	content = g_string_new (NULL);
+	while (content->len < 64 * 1024 - 1)
+	{
+		g_string_append_c (content, 'a');
+	}
+	g_string_append (content, "\r\nb");
+	check_content_analysis (content->str,
+				TEPL_NEWLINE_TYPE_CR_LF,
+				2,
+				64 * 1024 - 1,
+				(64 * 1024) / 2.0,
+				FALSE);
+	g_string_free (content, TRUE);
+}
+
+static void
+set_file_content_with_length (GFile       *location,
+			      const gchar *content,
+			      gsize        length)
+{
+	GError *error = NULL;
+
+	g_file_replace_contents (location,
+				 content,
+				 length,
+				 NULL,
+				 FALSE,
+				 G_FILE_CREATE_REPLACE_DESTINATION,
+				 NULL,
+				 NULL,
+				 &error);
+	g_assert_no_error (error);
+}
+
+static void
+check_load_content_with_charset (const gchar *charset,
+				 const gchar *content,
+				 gsize        length,
+				 const gchar *expected_buffer_content)
+{
+	TeplBuffer *buffer;
+	TeplFile *file;
+	GFile *location;
+	TeplFileLoader *loader;
+
+	buffer = create_buffer ();
+	file = tepl_buffer_get_file (buffer);
+
+	location = get_tmp_location ();
+	set_file_content_with_length (location, content, length);
+
+	tepl_file_set_location (file, location);
+	loader = tepl_file_loader_new (buffer, file);
+	tepl_file_loader_set_charset (loader, charset);
+	load_sync_expect_no_error (loader);
+
+	check_buffer_state_after_load (buffer, expected_buffer_content);
+	g_assert_cmpstr (tepl_file_get_charset (file), ==, charset);
+
+	g_object_unref (buffer);
+	g_object_unref (location);
+	g_object_unref (loader);
+}
+
+static void
+check_load_error_with_charset (const gchar *charset,
+			       const gchar *content,
+			       gsize        length,
+			       gint         expected_error_code)
+{
+	TeplBuffer *buffer;
+	TeplFile *file;
+	GFile *location;
+	TeplFileLoader *loader;
+	GError *error = NULL;
+
+	buffer = create_buffer ();
+	file = tepl_buffer_get_file (buffer);
+
+	location = get_tmp_location ();
+	set_file_content_with_length (location, content, length);
+
+	tepl_file_set_location (file, location);
+	loader = tepl_file_loader_new (buffer, file);
+	tepl_file_loader_set_charset (loader, charset);
+
+	load_sync (loader, &error);
+	g_assert_error (error, G_IO_ERROR, expected_error_code);
+	g_clear_error (&error);
+
+	check_buffer_state_after_load (buffer, "");
+	g_assert_cmpstr (tepl_file_get_charset (file), ==, "UTF-8");
+
+	g_object_unref (buffer);
+	g_object_unref (location);
+	g_object_unref (loader);
+}
+
+static void
+test_charset_conversion (void)
+{
+	/* Must be at least the chunk size used by TeplFileLoader. */
+	const gsize chunk_size = 64 * 1024;
+	GString *utf16_content;
+	GString *expected_content;
+
+	check_load_content_with_charset ("UTF-8", "é", 2, "é");
+	check_load_content_with_charset ("ISO-8859-15", "caf\xE9 \xA4", 6, "café €");
+
+	/* Little-endian, with a BOM. */
+	check_load_content_with_charset ("UTF-16", "\xFF\xFE" "a\0\xE9\0", 6, "aé");
+
+	/* Several chunks, with a surrogate pair split between two chunks. */
+	utf16_content = g_string_new (NULL);
+	expected_content = g_string_new (NULL);
+
+	while (utf16_content->len < 3 * chunk_size)
+	{
+		if (utf16_content->len % chunk_size == chunk_size - 2)
+		{
+			/* U+1F600 */
+			g_string_append_len (utf16_content, "\x3D\xD8\x00\xDE", 4);
+			g_string_append (expected_content, "\xF0\x9F\x98\x80");
+		}
+		else
+		{
+			g_string_append_len (utf16_content, "b\0", 2);
+			g_string_append_c (expected_content, 'b');
+		}
+	}
+
+	check_load_content_with_charset ("UTF-16LE",
+					 utf16_content->str,
+					 utf16_content->len,
+					 expected_content->str);
+
+	g_string_free (utf16_content, TRUE);
+	g_string_free (expected_content, TRUE);
+}
+
+static void
+test_charset_conversion_errors (void)
+{
+	/* Truncated character at the end. */
+	check_load_error_with_charset ("UTF-16LE", "a\0b", 3, G_IO_ERROR_INVALID_DATA);
+
+	/* Lone surrogate. */
+	check_load_error_with_charset ("UTF-16LE", "a\0\x3D\xD8" "b\0", 6, G_IO_ERROR_INVALID_DATA);
+
+	check_load_error_with_charset ("NOT-A-CHARSET", "a", 1, G_IO_ERROR_NOT_SUPPORTED);
+}
+
+static void
+store_charset (GFile       *location,
+	       const gchar *charset)
+{
+	TeplMetadata *metadata;
+
+	metadata = tepl_metadata_new ();
+	tepl_metadata_set (metadata, "tepl-character-encoding", charset);
+	tepl_metadata_manager_merge_into (tepl_metadata_manager_get_singleton (), location, metadata);
+	g_object_unref (metadata);
+}
+
+static gchar *
+get_stored_charset (GFile *location)
+{
+	TeplMetadata *metadata;
+	gchar *charset;
+
+	metadata = tepl_metadata_new ();
+	tepl_metadata_manager_copy_from (tepl_metadata_manager_get_singleton (), location, metadata);
+	charset = tepl_metadata_get (metadata, "tepl-character-encoding");
+	g_object_unref (metadata);
+
+	return charset;
+}
+
+static void
+forget_detected_charset (GFile *location)
+{
+	store_charset (location, NULL);
+}
+
+static void
+test_charset_detection (void)
+{
+	const gchar *latin1_sentence = "Un caf\xE9 cr\xE8me, s'il vous pla\xEEt. Le gar\xE7on est tr\xE8s gentil. ";
+	const gchar *utf8_sentence = "Un café crème, s'il vous plaît. Le garçon est très gentil. ";
+	TeplBuffer *buffer;
+	TeplFile *file;
+	GFile *location;
+	GString *content;
+	GString *expected_buffer_content;
+	TeplFileLoader *loader;
+	gchar *charset;
+	gchar *stored_charset;
+	gint confidence;
+	gint i;
+
+	buffer = create_buffer ();
+	file = tepl_buffer_get_file (buffer);
+
+	location = g_file_new_build_filename (g_get_tmp_dir (), "tepl-file-loader-test-charset-detection", NULL);
+	forget_detected_charset (location);
+
+	content = g_string_new (NULL);
+	expected_buffer_content = g_string_new (NULL);
+	for (i = 0; i < 20; i++)
+	{
+		g_string_append (content, latin1_sentence);
+		g_string_append (expected_buffer_content, utf8_sentence);
+	}
+
+	_tepl_test_utils_set_file_content (location, content->str);
+	tepl_file_set_location (file, location);
+
+	loader = tepl_file_loader_new (buffer, file);
+	load_sync_expect_no_error (loader);
+	check_buffer_state_after_load (buffer, expected_buffer_content->str);
+
+	g_assert_cmpstr (tepl_file_get_charset (file), !=, "UTF-8");
+	confidence = tepl_file_loader_get_detected_charset_confidence (loader);
+	g_assert_cmpint (confidence, >, 0);
+	g_assert_cmpint (confidence, <=, 100);
+	g_object_unref (loader);
+
+	/* The second time, the charset is known from the metadata. */
+	loader = tepl_file_loader_new (buffer, file);
+	load_sync_expect_no_error (loader);
+	check_buffer_state_after_load (buffer, expected_buffer_content->str);
+	g_assert_cmpint (tepl_file_loader_get_detected_charset_confidence (loader), ==, -1);
+	g_object_unref (loader);
+
+	/* A stored charset that doesn't match the content is replaced. */
+	charset = g_strdup (tepl_file_get_charset (file));
+
+	store_charset (location, "UTF-8");
+	loader = tepl_file_loader_new (buffer, file);
+	load_sync_expect_no_error (loader);
+	check_buffer_state_after_load (buffer, expected_buffer_content->str);
+	g_assert_cmpint (tepl_file_loader_get_n_invalid_ranges (loader), ==, 0);
+	g_assert_cmpint (tepl_file_loader_get_detected_charset_confidence (loader), >, 0);
+	g_assert_cmpstr (tepl_file_get_charset (file), ==, charset);
+	stored_charset = get_stored_charset (location);
+	g_assert_cmpstr (stored_charset, ==, charset);
+	g_free (stored_charset);
+	g_object_unref (loader);
+
+	store_charset (location, "NOT-A-CHARSET");
+	loader = tepl_file_loader_new (buffer, file);
+	load_sync_expect_no_error (loader);
+	check_buffer_state_after_load (buffer, expected_buffer_content->str);
+	stored_charset = get_stored_charset (location);
+	g_assert_cmpstr (stored_charset, ==, charset);
+	g_free (stored_charset);
+	g_object_unref (loader);
+
+	/* Invalid bytes after the first chunk: the stored charset is kept. */
+	g_string_truncate (content, 0);
+	for (i = 0; i < 20000; i++)
+	{
+		g_string_append (content, utf8_sentence);
+		g_string_append_c (content, '\n');
+	}
+	g_string_assign (expected_buffer_content, content->str);
+	g_string_append (content, "\xFF");
+	g_string_append (expected_buffer_content, "\\FF");
+
+	_tepl_test_utils_set_file_content (location, content->str);
+	store_charset (location, "UTF-8");
+	loader = tepl_file_loader_new (buffer, file);
+	load_sync_expect_no_error (loader);
+	check_buffer_state_after_load (buffer, expected_buffer_content->str);
+	g_assert_cmpint (tepl_file_loader_get_n_invalid_ranges (loader), ==, 1);
+	g_assert_cmpint (tepl_file_loader_get_detected_charset_confidence (loader), ==, -1);
+	g_assert_cmpstr (tepl_file_get_charset (file), ==, "UTF-8");
+	stored_charset = get_stored_charset (location);
+	g_assert_cmpstr (stored_charset, ==, "UTF-8");
+	g_free (stored_charset);
+	g_object_unref (loader);
+
+	g_free (charset);
+	forget_detected_charset (location);
+
+	g_object_unref (buffer);
+	g_object_unref (location);
+	g_string_free (content, TRUE);
+	g_string_free (expected_buffer_content, TRUE);
+}
+
+static void
+check_charset_detect (const gchar * const *samples,
+		      gboolean             last_sample_is_end,
+		      const gchar         *expected_charset,
+		      gint                 expected_confidence)
+{
+	GPtrArray *samples_array;
+	gchar *charset;
+	gint confidence;
+	gint i;
+
+	samples_array = g_ptr_array_new_with_free_func ((GDestroyNotify)g_bytes_unref);
+
+	for (i = 0; samples[i] != NULL; i++)
+	{
+		g_ptr_array_add (samples_array, g_bytes_new (samples[i], strlen (samples[i])));
+	}
+
+	charset = _tepl_charset_detect (samples_array, last_sample_is_end, &confidence);
+	g_assert_cmpstr (charset, ==, expected_charset);
+	g_assert_cmpint (confidence, ==, expected_confidence);
+
+	g_free (charset);
+	g_ptr_array_unref (samples_array);
+}
+
+static void
+test_charset_detect_samples (void)
+{
+	const gchar *utf8_bom[] = { "\xEF\xBB\xBFabc", NULL };
+	const gchar *utf16_bom[] = { "\xFF\xFEa", NULL };
+	const gchar *ascii[] = { "abc", NULL };
+
+	/* A UTF-8 character split at the end of the first sample, and at the
+	 * beginning and end of the second one.
+	 */
+	const gchar *split_utf8[] = { "ab\xC3", "\xA9z\xE2\x82", NULL };
+
+	check_charset_detect (utf8_bom, TRUE, "UTF-8", 100);
+	check_charset_detect (utf16_bom, TRUE, "UTF-16", 100);
+	check_charset_detect (ascii, TRUE, "UTF-8", 80);
+	check_charset_detect (split_utf8, FALSE, "UTF-8", 80);
+}
+
+static void
+check_utf8_validate (const gchar *str,
+		     gsize        length,
+		     gsize        expected_valid_length)
+{
+	const gchar *glib_valid_end = NULL;
+	gsize valid_length = 0;
+	gboolean valid;
+
+	valid = _tepl_utf8_validate (str, length, &valid_length);
+	g_assert_cmpuint (valid_length, ==, expected_valid_length);
+	g_assert_true (valid == (valid_length == length));
+
+	/* Same result as the GLib validator. */
+	g_assert_true (g_utf8_validate_len (str, length, &glib_valid_end) == valid);
+	g_assert_cmpuint (glib_valid_end - str, ==, valid_length);
+}
+
+static void
+test_utf8_validate (void)
+{
+	gchar *str;
+	gsize length;
+	gsize pos;
+
+	check_utf8_validate ("", 0, 0);
+	check_utf8_validate ("a", 1, 1);
+	check_utf8_validate ("Évo € \xF0\x9F\x98\x80", 13, 13);
+
+	/* Nul byte. */
+	check_utf8_validate ("a\0b", 3, 1);
+
+	/* Invalid first bytes. */
+	check_utf8_validate ("a\x80", 2, 1);
+	check_utf8_validate ("a\xC1\xBF", 3, 1);
+	check_utf8_validate ("a\xF5\x80\x80\x80", 5, 1);
+	check_utf8_validate ("a\xFF", 2, 1);
+
+	/* Overlong forms. */
+	check_utf8_validate ("a\xE0\x9F\xBF", 4, 1);
+	check_utf8_validate ("a\xF0\x8F\xBF\xBF", 5, 1);
+
+	/* Surrogate. */
+	check_utf8_validate ("a\xED\xA0\x80", 4, 1);
+
+	/* Above U+10FFFF. */
+	check_utf8_validate ("a\xF4\x90\x80\x80", 5, 1);
+
+	/* Bad or missing continuation bytes. */
+	check_utf8_validate ("a\xC3\x28", 3, 1);
+	check_utf8_validate ("a\xE2\x82\x28", 4, 1);
+	check_utf8_validate ("a\xE2\x82", 3, 1);
+
+	/* An invalid byte and a multi-byte character at every position, to
+	 * test the vectorized code paths and the tails.
+	 */
+	length = 200;
+	str = g_malloc (length);
+
+	for (pos = 0; pos < length; pos++)
+	{
+		memset (str, 'a', length);
+		str[pos] = '\xFF';
+		check_utf8_validate (str, length, pos);
+
+		str[pos] = '\0';
+		check_utf8_validate (str, length, pos);
+
+		if (pos + 1 < length)
+		{
+			str[pos] = '\xC3';
+			str[pos + 1] = '\xA9';
+			check_utf8_validate (str, length, length);
+		}
+	}
+
+	g_free (str);
+}
+
+static void
+test_utf8_validate_random (void)
+{
+	const gchar *chars[] = { "a", "\n", "é", "€", "\xF0\x9F\x98\x80", "\xFF", "\xED\xA0\x80", "\xE2\x82" };
+	gint iteration;
+
+	for (iteration = 0; iteration < 2000; iteration++)
+	{
+		GString *str;
+		const gchar *glib_valid_end = NULL;
+		gsize valid_length = 0;
+		gint n_chars;
+		gint i;
+
+		str = g_string_new (NULL);
+		n_chars = g_test_rand_int_range (0, 200);
+
+		for (i = 0; i < n_chars; i++)
+		{
+			/* Mostly ASCII, like most text files, or mostly
+			 * multi-byte characters, for the vectorized validation
+			 * of the multi-byte characters across the blocks.
+			 */
+			if (iteration % 2 == 0 && g_test_rand_int_range (0, 100) < 90)
+			{
+				g_string_append (str, chars[0]);
+			}
+			else if (iteration % 2 == 1 && g_test_rand_int_range (0, 100) < 97)
+			{
+				g_string_append (str, chars[g_test_rand_int_range (2, 5)]);
+			}
+			else
+			{
+				g_string_append (str, chars[g_test_rand_int_range (1, G_N_ELEMENTS (chars))]);
+			}
+		}
+
+		g_assert_true (_tepl_utf8_validate (str->str, str->len, &valid_length) ==
+			       g_utf8_validate_len (str->str, str->len, &glib_valid_end));
+		g_assert_cmpuint (valid_length, ==, glib_valid_end - str->str);
+
+		g_string_free (str, TRUE);
+	}
+}
+
+static gdouble
+get_validation_throughput (gboolean     use_glib,
+			   const gchar *str,
+			   gsize        length)
+{
+	const gint n_iterations = 20;
+	gdouble elapsed;
+	gint i;
+
+	g_test_timer_start ();
+
+	for (i = 0; i < n_iterations; i++)
+	{
+		if (use_glib)
+		{
+			g_assert_true (g_utf8_validate_len (str, length, NULL));
+		}
+		else
+		{
+			g_assert_true (_tepl_utf8_validate (str, length, NULL));
+		}
+	}
+
+	elapsed = g_test_timer_elapsed ();
+
+	/* In MB/s. */
+	return (n_iterations * length) / (elapsed * 1000.0 * 1000.0);
+}
+
+static void
+test_utf8_validate_perf (void)
+{
+	GString *str;
+	gdouble glib_throughput;
+	gdouble tepl_throughput;
+
+	if (!g_test_perf ())
+	{
+		g_test_skip ("Performance test, run it with -m perf.");
+		return;
+	}
+
+	/* ASCII-heavy content, like source code. */
+	str = g_string_new (NULL);
+	while (str->len < 32 * 1024 * 1024)
+	{
+		g_string_append (str, "\tif (value != NULL) /* Évaluation. */\n");
+	}
+
+	glib_throughput = get_validation_throughput (TRUE, str->str, str->len);
+	tepl_throughput = get_validation_throughput (FALSE, str->str, str->len);
+
+	g_test_message ("ASCII-heavy, g_utf8_validate_len(): %.0f MB/s", glib_throughput);
+	g_test_message ("ASCII-heavy, _tepl_utf8_validate(): %.0f MB/s", tepl_throughput);
+	g_test_maximized_result (tepl_throughput, "_tepl_utf8_validate(): %.0f MB/s", tepl_throughput);
+
+	g_string_free (str, TRUE);
+
+	/* Mostly multi-byte characters. */
+	str = g_string_new (NULL);
+	while (str->len < 32 * 1024 * 1024)
+	{
+		g_string_append (str, "Ελληνικά κείμενο. 日本語のテキスト。\n");
+	}
+
+	glib_throughput = get_validation_throughput (TRUE, str->str, str->len);
+	tepl_throughput = get_validation_throughput (FALSE, str->str, str->len);
+
+	g_test_message ("Non-ASCII, g_utf8_validate_len(): %.0f MB/s", glib_throughput);
+	g_test_message ("Non-ASCII, _tepl_utf8_validate(): %.0f MB/s", tepl_throughput);
+
+	g_string_free (str, TRUE);
+}
+
+static void
+save_sync_cb (GObject      *source_object,
+	      GAsyncResult *result,
+	      gpointer      user_data)
+{
+	TeplFileSaver *saver = TEPL_FILE_SAVER (source_object);
+	GError **error = user_data;
+
+	tepl_file_saver_save_finish (saver, result, error);
+	gtk_main_quit ();
+}
+
+static void
+save_sync (TeplFileSaver  *saver,
+	   GError        **error)
+{
+	tepl_file_saver_save_async (saver,
+				    G_PRIORITY_DEFAULT,
+				    NULL,
+				    save_sync_cb,
+				    error);
+	gtk_main ();
+}
+
+static void
+check_line_split (const gchar *content,
+		  guint        line_split_length,
+		  const gchar *expected_buffer_content,
+		  guint        expected_n_line_splits)
+{
+	TeplBuffer *buffer;
+	TeplFile *file;
+	GFile *location;
+	TeplFileLoader *loader;
+	TeplFileSaver *saver;
+	GError *error = NULL;
+
+	buffer = create_buffer ();
+	file = tepl_buffer_get_file (buffer);
+
+	location = get_tmp_location ();
+	_tepl_test_utils_set_file_content (location, content);
+
+	tepl_file_set_location (file, location);
+	loader = tepl_file_loader_new (buffer, file);
+	tepl_file_loader_set_charset (loader, "UTF-8");
+	tepl_file_loader_set_line_split_length (loader, line_split_length);
+	load_sync_expect_no_error (loader);
+
+	check_buffer_state_after_load (buffer, expected_buffer_content);
+	g_assert_cmpuint (tepl_file_loader_get_n_line_splits (loader), ==, expected_n_line_splits);
+
+	/* The analysis is about the original content. */
+	g_assert_cmpuint (tepl_file_loader_get_n_lines (loader) + expected_n_line_splits, ==,
+			  gtk_text_buffer_get_line_count (GTK_TEXT_BUFFER (buffer)));
+
+	/* The original lines are saved. The escaped invalid bytes are not
+	 * saved as-is.
+	 */
+	if (g_utf8_validate (content, -1, NULL))
+	{
+		_tepl_test_utils_set_file_content (location, "");
+		saver = tepl_file_saver_new (buffer, file);
+		save_sync (saver, &error);
+		g_assert_no_error (error);
+		_tepl_test_utils_check_file_content (location, content);
+		g_object_unref (saver);
+	}
+
+	g_object_unref (buffer);
+	g_object_unref (location);
+	g_object_unref (loader);
+}
+
+static void
+test_line_split (void)
+{
+	check_line_split ("", 4, "", 0);
+	check_line_split ("0123", 4, "0123", 0);
+	check_line_split ("0123456789\nab", 4, "0123\n4567\n89\nab", 2);
+	check_line_split ("0123\r\n4567\r\n", 4, "0123\r\n4567\r\n", 0);
+	check_line_split ("ÉÈßÇÉÈ", 4, "ÉÈßÇ\nÉÈ", 1);
+
+	/* Not before a combining mark. */
+	check_line_split ("abcde\xCC\x81" "f", 5, "abcde\xCC\x81\nf", 1);
+
+	/* Not inside the escape sequence of an invalid byte. */
+	check_line_split ("ab\xFF\xFE" "cd", 4, "ab\\FF\n\\FEc\nd", 2);
+	check_line_split ("abc\xFF" "d", 4, "abc\\FF\nd", 1);
+}
+
+static void
+test_line_split_edited (void)
+{
+	const gchar *content = "0123456789";
+	TeplBuffer *buffer;
+	GtkTextBuffer *text_buffer;
+	TeplFile *file;
+	GFile *location;
+	TeplFileLoader *loader;
+	TeplFileSaver *saver;
+	GtkTextIter iter;
+	GtkTextIter newline_end;
+	GError *error = NULL;
+
+	buffer = create_buffer ();
+	text_buffer = GTK_TEXT_BUFFER (buffer);
+	file = tepl_buffer_get_file (buffer);
+
+	location = get_tmp_location ();
+	_tepl_test_utils_set_file_content (location, content);
+
+	tepl_file_set_location (file, location);
+	loader = tepl_file_loader_new (buffer, file);
+	tepl_file_loader_set_charset (loader, "UTF-8");
+	tepl_file_loader_set_line_split_length (loader, 5);
+	load_sync_expect_no_error (loader);
+	check_buffer_state_after_load (buffer, "01234\n56789");
+
+	/* Inserting text at the end of the split line is not a problem. */
+	gtk_text_buffer_get_iter_at_offset (text_buffer, &iter, 5);
+	gtk_text_buffer_insert (text_buffer, &iter, "ab", -1);
+
+	saver = tepl_file_saver_new (buffer, file);
+	save_sync (saver, &error);
+	g_assert_no_error (error);
+	_tepl_test_utils_check_file_content (location, "01234ab56789");
+	g_object_unref (saver);
+
+	/* Replace the inserted newline by a real one. */
+	gtk_text_buffer_get_iter_at_offset (text_buffer, &iter, 7);
+	newline_end = iter;
+	gtk_text_iter_forward_char (&newline_end);
+	gtk_text_buffer_delete (text_buffer, &iter, &newline_end);
+	gtk_text_buffer_insert (text_buffer, &iter, "\n", -1);
+
+	saver = tepl_file_saver_new (buffer, file);
+	save_sync (saver, &error);
+	g_assert_error (error, TEPL_FILE_SAVER_ERROR, TEPL_FILE_SAVER_ERROR_EDITED_LINE_SPLITS);
+	g_clear_error (&error);
+	_tepl_test_utils_check_file_content (location, "01234ab56789");
+	g_object_unref (saver);
+
+	saver = tepl_file_saver_new (buffer, file);
+	tepl_file_saver_set_flags (saver, TEPL_FILE_SAVER_FLAGS_IGNORE_EDITED_LINE_SPLITS);
+	save_sync (saver, &error);
+	g_assert_no_error (error);
+	_tepl_test_utils_check_file_content (location, "01234ab\n56789");
+	g_object_unref (saver);
+
+	g_object_unref (buffer);
+	g_object_unref (location);
+	g_object_unref (loader);
+}
+
+/* Returns: the time to load the file, in seconds. */
+static gdouble
+get_load_time (GFile    *location,
+	       gboolean  use_mapped_file)
+{
+	TeplBuffer *buffer;
+	TeplFile *file;
+	TeplFileLoader *loader;
+	gdouble elapsed;
+
+	buffer = tepl_buffer_new ();
+	file = tepl_buffer_get_file (buffer);
+	tepl_file_set_location (file, location);
+
+	loader = tepl_file_loader_new (buffer, file);
+	tepl_file_loader_set_charset (loader, "UTF-8");
+	_tepl_file_loader_set_use_mapped_file (loader, use_mapped_file);
+
+	g_test_timer_start ();
+	load_sync_expect_no_error (loader);
+	elapsed = g_test_timer_elapsed ();
+
+	g_object_unref (buffer);
+	g_object_unref (loader);
+
+	return elapsed;
+}
+
+static void
+test_load_perf (void)
+{
+	GString *content;
+	GFile *location;
+	gdouble stream_time;
+	gdouble mapped_time;
+
+	if (!g_test_perf ())
+	{
+		g_test_skip ("Performance test, run it with -m perf.");
+		return;
+	}
+
+	content = g_string_new (NULL);
+	while (content->len < 64 * 1024 * 1024)
+	{
+		g_string_append (content, "\tif (value != NULL) /* Évaluation. */\n");
+	}
+
+	location = get_tmp_location ();
+	_tepl_test_utils_set_file_content (location, content->str);
+	g_string_free (content, TRUE);
+
+	stream_time = get_load_time (location, FALSE);
+	mapped_time = get_load_time (location, TRUE);
+
+	g_test_message ("Input stream: %.3f s", stream_time);
+	g_test_message ("Mapped file: %.3f s", mapped_time);
+	g_test_minimized_result (mapped_time, "Mapped file: %.3f s", mapped_time);
+
+	g_object_unref (location);
+}
+
+static gboolean
+view_draw_cb (GtkWidget *view,
+	      cairo_t   *cr,
+	      gboolean  *drawn)
+{
+	*drawn = TRUE;
+	return GDK_EVENT_PROPAGATE;
+}
+
+static void
+view_notify_buffer_cb (GtkTextView *view,
+		       GParamSpec  *pspec,
+		       gboolean    *buffer_replaced)
+{
+	*buffer_replaced = TRUE;
+}
+
+/* Returns: the time, in seconds, from the start of the load operation until
+ * the view is drawn with the new content. With a detached buffer, the file is
+ * loaded with tepl_tab_load_file(), otherwise it is loaded directly into the
+ * view buffer.
+ */
+static gdouble
+get_time_to_first_paint (GFile       *location,
+			 const gchar *content,
+			 gboolean     detached_buffer)
+{
+	GtkWidget *window;
+	TeplTab *tab;
+	GtkTextView *view;
+	TeplBuffer *previous_buffer;
+	TeplBuffer *buffer;
+	GtkTextIter start;
+	GtkTextIter end;
+	gchar *received_content;
+	gboolean drawn = FALSE;
+	gdouble elapsed;
+
+	window = gtk_window_new (GTK_WINDOW_TOPLEVEL);
+	gtk_window_set_default_size (GTK_WINDOW (window), 800, 600);
+	tab = tepl_tab_new ();
+	gtk_container_add (GTK_CONTAINER (window), GTK_WIDGET (tab));
+	gtk_widget_show_all (window);
+
+	while (gtk_events_pending ())
+	{
+		gtk_main_iteration ();
+	}
+
+	view = GTK_TEXT_VIEW (tepl_tab_get_view (tab));
+	previous_buffer = tepl_tab_get_buffer (tab);
+	g_assert_true (gtk_text_view_get_editable (view));
+
+	g_signal_connect_after (view, "draw", G_CALLBACK (view_draw_cb), &drawn);
+
+	g_test_timer_start ();
+
+	if (detached_buffer)
+	{
+		gboolean buffer_replaced = FALSE;
+
+		g_signal_connect (view,
+				  "notify::buffer",
+				  G_CALLBACK (view_notify_buffer_cb),
+				  &buffer_replaced);
+
+		tepl_tab_load_file (tab, location);
+
+		/* The view keeps the previous buffer, and is not editable,
+		 * until the loading is finished.
+		 */
+		while (!buffer_replaced)
+		{
+			g_assert_true (tepl_tab_get_buffer (tab) == previous_buffer);
+			g_assert_false (gtk_text_view_get_editable (view));
+			gtk_main_iteration ();
+		}
+
+		g_signal_handlers_disconnect_by_func (view, view_notify_buffer_cb, &buffer_replaced);
+	}
+	else
+	{
+		TeplFileLoader *loader;
+
+		tepl_file_set_location (tepl_buffer_get_file (previous_buffer), location);
+		loader = tepl_file_loader_new (previous_buffer, tepl_buffer_get_file (previous_buffer));
+		load_sync_expect_no_error (loader);
+		g_object_unref (loader);
+	}
+
+	drawn = FALSE;
+	gtk_widget_queue_draw (GTK_WIDGET (view));
+	while (!drawn)
+	{
+		gtk_main_iteration ();
+	}
+
+	elapsed = g_test_timer_elapsed ();
+
+	g_signal_handlers_disconnect_by_func (view, view_draw_cb, &drawn);
+
+	buffer = tepl_tab_get_buffer (tab);
+	g_assert_true (gtk_text_view_get_buffer (view) == GTK_TEXT_BUFFER (buffer));
+	if (detached_buffer)
+	{
+		g_assert_true (buffer != previous_buffer);
+		g_assert_true (tepl_buffer_get_file (buffer) == tepl_buffer_get_file (previous_buffer));
+	}
+
+	g_assert_true (gtk_text_view_get_editable (view));
+	g_assert_true (g_file_equal (tepl_file_get_location (tepl_buffer_get_file (buffer)), location));
+
+	gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (buffer), &start, &end);
+	received_content = gtk_text_buffer_get_text (GTK_TEXT_BUFFER (buffer), &start, &end, TRUE);
+	g_assert_true (g_str_equal (received_content, content));
+	g_free (received_content);
+	g_assert_false (gtk_text_buffer_get_modified (GTK_TEXT_BUFFER (buffer)));
+
+	gtk_widget_destroy (window);
+
+	return elapsed;
+}
+
+static void
+test_detached_buffer_perf (void)
+{
+	GString *content;
+	GFile *location;
+	gdouble attached_time;
+	gdouble detached_time;
+
+	if (!g_test_perf ())
+	{
+		g_test_skip ("Performance test, run it with -m perf.");
+		return;
+	}
+
+	content = g_string_new (NULL);
+	while (content->len < 16 * 1024 * 1024)
+	{
+		g_string_append (content, "\tif (value != NULL) /* Évaluation. */\n");
+	}
+
+	location = get_tmp_location ();
+	_tepl_test_utils_set_file_content (location, content->str);
+
+	attached_time = get_time_to_first_paint (location, content->str, FALSE);
+	detached_time = get_time_to_first_paint (location, content->str, TRUE);
+
+	g_test_message ("Buffer attached to the view: %.3f s", attached_time);
+	g_test_message ("Detached buffer, with tepl_tab_load_file(): %.3f s", detached_time);
+	g_test_minimized_result (detached_time, "Detached buffer: %.3f s", detached_time);
+
+	g_string_free (content, TRUE);
+	g_object_unref (location);
+}
+
+static void
+cancel_on_insert_text_cb (GtkTextBuffer *buffer,
+			  GtkTextIter   *location,
+			  const gchar   *text,
+			  gint           length,
+			  GCancellable  *cancellable)
+{
+	g_cancellable_cancel (cancellable);
+}
+
+static void
+test_cancel (void)
+{
+	TeplBuffer *buffer;
+	TeplFile *file;
+	GFile *location;
+	GString *content;
+	TeplFileLoader *loader;
+	GCancellable *cancellable;
+	GError *error = NULL;
+
+	buffer = create_buffer ();
+	file = tepl_buffer_get_file (buffer);
+
+	/* Big enough to need several batches. */
+	content = g_string_new (NULL);
+	while (content->len < 1024 * 1024)
+	{
+		g_string_append (content, "Some content to load.\n");
+	}
+
+	location = get_tmp_location ();
+	_tepl_test_utils_set_file_content (location, content->str);
+	g_string_free (content, TRUE);
+
+	tepl_file_set_location (file, location);
+	loader = tepl_file_loader_new (buffer, file);
+	tepl_file_loader_set_insertion_time_budget (loader, 1);
+
+	/* Cancel after the first batch. */
+	cancellable = g_cancellable_new ();
+	g_signal_connect (buffer,
+			  "insert-text",
+			  G_CALLBACK (cancel_on_insert_text_cb),
+			  cancellable);
+
+	load_sync_with_cancellable (loader, cancellable, &error);
+	g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+	g_clear_error (&error);
+
+	g_signal_handlers_disconnect_by_func (buffer, cancel_on_insert_text_cb, cancellable);
+	check_buffer_state_after_load (buffer, "");
+
+	g_object_unref (buffer);
+	g_object_unref (location);
+	g_object_unref (loader);
+	g_object_unref (cancellable);
+}
+
 int
 main (int    argc,
       char **argv)
@@ -179,7 +1506,24 @@ main (int    argc,
 
 	g_test_add_func ("/file_loader/properties", test_properties);
 	g_test_add_func ("/file_loader/non_existing_file", test_non_existing_file);
+	g_test_add_func ("/file_loader/max_file_size", test_max_file_size);
 	g_test_add_func ("/file_loader/utf8_file", test_utf8_file);
+	g_test_add_func ("/file_loader/utf8_file_several_chunks", test_utf8_file_several_chunks);
+	g_test_add_func ("/file_loader/truncated_mapped_file", test_truncated_mapped_file);
+	g_test_add_func ("/file_loader/invalid_utf8_file", test_invalid_utf8_file);
+	g_test_add_func ("/file_loader/content_analysis", test_content_analysis);
+	g_test_add_func ("/file_loader/cancel", test_cancel);
+	g_test_add_func ("/file_loader/line_split", test_line_split);
+	g_test_add_func ("/file_loader/line_split_edited", test_line_split_edited);
+	g_test_add_func ("/file_loader/load_perf", test_load_perf);
+	g_test_add_func ("/file_loader/detached_buffer_perf", test_detached_buffer_perf);
+	g_test_add_func ("/file_loader/charset_conversion", test_charset_conversion);
+	g_test_add_func ("/file_loader/charset_conversion_errors", test_charset_conversion_errors);
+	g_test_add_func ("/file_loader/charset_detection", test_charset_detection);
+	g_test_add_func ("/file_loader/charset_detect_samples", test_charset_detect_samples);
+	g_test_add_func ("/file_loader/utf8_validate", test_utf8_validate);
+	g_test_add_func ("/file_loader/utf8_validate_random", test_utf8_validate_random);
+	g_test_add_func ("/file_loader/utf8_validate_perf", test_utf8_validate_perf);
 
 	return g_test_run ();
 }
@@ -3,8 +3,17 @@
  */
 
 #include <tepl/tepl.h>
+#include <string.h>
+#include <glib/gstdio.h>
+#include "tepl/tepl-backup.h"
+#include "tepl/tepl-newline-converter.h"
+#include "tepl/tepl-rope.h"
 #include "tepl-test-utils.h"
 
+#ifdef G_OS_UNIX
+#include <unistd.h>
+#endif
+
 static GFile *
 get_tmp_location (void)
 {
@@ -79,7 +88,52 @@ test_basic (void)
 }
 
 static void
-test_backup (void)
+save_with_backup_cb (GObject      *source_object,
+		     GAsyncResult *result,
+		     gpointer      user_data)
+{
+	TeplFileSaver *saver = TEPL_FILE_SAVER (source_object);
+	gboolean *supported = user_data;
+	GError *error = NULL;
+
+	*supported = tepl_file_saver_save_finish (saver, result, &error);
+
+	if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED))
+	{
+		g_clear_error (&error);
+	}
+	g_assert_no_error (error);
+
+	gtk_main_quit ();
+}
+
+/* Returns: %FALSE if @strategy is not supported for @location. */
+static gboolean
+save_with_backup (TeplBuffer         *buffer,
+		  TeplFile           *file,
+		  GFile              *location,
+		  TeplBackupStrategy  strategy)
+{
+	TeplFileSaver *saver;
+	gboolean supported = FALSE;
+
+	saver = tepl_file_saver_new_with_target (buffer, file, location);
+	tepl_file_saver_set_flags (saver, TEPL_FILE_SAVER_FLAGS_CREATE_BACKUP);
+	_tepl_file_saver_set_backup_strategy (saver, strategy);
+
+	tepl_file_saver_save_async (saver,
+				    G_PRIORITY_DEFAULT,
+				    NULL,
+				    save_with_backup_cb,
+				    &supported);
+	gtk_main ();
+
+	g_object_unref (saver);
+	return supported;
+}
+
+static void
+check_backup (TeplBackupStrategy strategy)
 {
 	TeplBuffer *buffer;
 	TeplFile *file;
@@ -92,6 +146,8 @@ test_backup (void)
 
 	file = tepl_file_new ();
 	location = get_tmp_location ();
+	backup_location = get_tmp_backup_location ();
+	g_file_delete (backup_location, NULL, NULL);
 
 	saver = tepl_file_saver_new_with_target (buffer, file, location);
 	save_sync (saver);
@@ -100,14 +156,17 @@ test_backup (void)
 
 	gtk_text_buffer_set_text (GTK_TEXT_BUFFER (buffer), "contentB", -1);
 
-	saver = tepl_file_saver_new_with_target (buffer, file, location);
-	tepl_file_saver_set_flags (saver, TEPL_FILE_SAVER_FLAGS_CREATE_BACKUP);
-	save_sync (saver);
-	_tepl_test_utils_check_file_content (location, "contentB");
-	g_object_unref (saver);
-
-	backup_location = get_tmp_backup_location ();
-	_tepl_test_utils_check_file_content (backup_location, "contentA");
+	if (save_with_backup (buffer, file, location, strategy))
+	{
+		_tepl_test_utils_check_file_content (location, "contentB");
+		_tepl_test_utils_check_file_content (backup_location, "contentA");
+	}
+	else
+	{
+		/* The original file is kept. */
+		g_assert_true (strategy == TEPL_BACKUP_STRATEGY_REFLINK);
+		_tepl_test_utils_check_file_content (location, "contentA");
+	}
 
 	g_object_unref (buffer);
 	g_object_unref (file);
@@ -115,6 +174,100 @@ test_backup (void)
 	g_object_unref (backup_location);
 }
 
+static void
+test_backup (void)
+{
+	check_backup (TEPL_BACKUP_STRATEGY_AUTO);
+	check_backup (TEPL_BACKUP_STRATEGY_REFLINK);
+	check_backup (TEPL_BACKUP_STRATEGY_RENAME);
+	check_backup (TEPL_BACKUP_STRATEGY_COPY);
+}
+
+/* To compare filesystems, set the TMPDIR environment variable, for example to
+ * a tmpfs, and to a directory on an ext4 or Btrfs filesystem.
+ */
+static void
+test_backup_perf (void)
+{
+	const TeplBackupStrategy strategies[] =
+	{
+		TEPL_BACKUP_STRATEGY_REFLINK,
+		TEPL_BACKUP_STRATEGY_RENAME,
+		TEPL_BACKUP_STRATEGY_COPY
+	};
+	const gchar *strategy_names[] = { "reflink", "rename", "copy" };
+	TeplBuffer *buffer;
+	TeplFile *file;
+	GFile *location;
+	GString *text;
+	GTimer *timer;
+	guint i;
+
+	if (!g_test_perf ())
+	{
+		g_test_skip ("Performance test, run it with -m perf.");
+		return;
+	}
+
+	text = g_string_new (NULL);
+	while (text->len < 32 * 1024 * 1024)
+	{
+		g_string_append (text, "\tif (value != NULL) /* Évaluation. */\n");
+	}
+
+	buffer = tepl_buffer_new ();
+	gtk_text_buffer_set_text (GTK_TEXT_BUFFER (buffer), text->str, text->len);
+
+	file = tepl_file_new ();
+	location = get_tmp_location ();
+	timer = g_timer_new ();
+
+	g_test_message ("Directory: %s", g_get_tmp_dir ());
+
+	for (i = 0; i < G_N_ELEMENTS (strategies); i++)
+	{
+		TeplFileSaver *saver;
+		GtkTextIter iter;
+		gdouble elapsed;
+
+		/* The file to backup. */
+		saver = tepl_file_saver_new_with_target (buffer, file, location);
+		save_sync (saver);
+		g_object_unref (saver);
+
+		/* Otherwise the file would not be rewritten. */
+		gtk_text_buffer_get_end_iter (GTK_TEXT_BUFFER (buffer), &iter);
+		gtk_text_buffer_insert (GTK_TEXT_BUFFER (buffer), &iter, strategy_names[i], -1);
+
+		g_timer_start (timer);
+		if (!save_with_backup (buffer, file, location, strategies[i]))
+		{
+			g_test_message ("Save with a %s backup: not supported", strategy_names[i]);
+			continue;
+		}
+		elapsed = g_timer_elapsed (timer, NULL);
+
+		g_test_minimized_result (elapsed,
+					 "Save of 32 MiB with a %s backup: %.3f s",
+					 strategy_names[i],
+					 elapsed);
+	}
+
+	gtk_text_buffer_set_text (GTK_TEXT_BUFFER (buffer), text->str, text->len);
+
+	g_timer_start (timer);
+	save_with_backup (buffer, file, location, TEPL_BACKUP_STRATEGY_AUTO);
+	g_test_message ("Save of 32 MiB with the default backup strategy: %.3f s",
+			g_timer_elapsed (timer, NULL));
+
+	g_file_delete (location, NULL, NULL);
+	g_timer_destroy (timer);
+	g_object_unref (location);
+	g_object_unref (file);
+	g_object_unref (buffer);
+	g_string_free (text, TRUE);
+}
+
 static void
 test_properties (void)
 {
@@ -164,6 +317,1122 @@ test_properties (void)
 	g_object_unref (saver);
 }
 
+/* Content bigger than the chunks written at once by the saver. */
+static void
+test_several_chunks (void)
+{
+	GString *content;
+	gint i;
+
+	/* Short lines. */
+	content = g_string_new (NULL);
+	for (i = 0; i < 20000; i++)
+	{
+		g_string_append_printf (content, "line %d Évo\n", i);
+	}
+	check_save_content (content->str);
+	g_string_free (content, TRUE);
+
+	/* A single very long line, with multi-byte characters. */
+	content = g_string_new (NULL);
+	for (i = 0; i < 100000; i++)
+	{
+		g_string_append (content, "abÉ");
+	}
+	check_save_content (content->str);
+
+	/* Followed by short lines. */
+	g_string_append (content, "\nend\nof\nfile");
+	check_save_content (content->str);
+	g_string_free (content, TRUE);
+}
+
+static void
+check_rope_content (TeplBuffer *buffer)
+{
+	GtkTextIter start;
+	GtkTextIter end;
+	gchar *buffer_text;
+	gchar *rope_text;
+
+	gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (buffer), &start, &end);
+	buffer_text = gtk_text_buffer_get_text (GTK_TEXT_BUFFER (buffer), &start, &end, TRUE);
+	rope_text = _tepl_rope_get_text (_tepl_buffer_get_rope (buffer));
+
+	g_assert_cmpstr (rope_text, ==, buffer_text);
+
+	g_free (buffer_text);
+	g_free (rope_text);
+}
+
+/* The copy of the text kept by TeplBuffer follows the edits, and a snapshot
+ * is not affected by the next edits.
+ */
+static void
+test_rope_random_edits (void)
+{
+	const gchar *pieces[] = { "a", "é", "\n", "hello world ", "€€€" };
+	TeplBuffer *buffer;
+	GtkTextBuffer *text_buffer;
+	TeplRope *snapshot = NULL;
+	gchar *snapshot_text = NULL;
+	gint i;
+
+	buffer = tepl_buffer_new ();
+	text_buffer = GTK_TEXT_BUFFER (buffer);
+
+	for (i = 0; i < 5000; i++)
+	{
+		gint n_chars = gtk_text_buffer_get_char_count (text_buffer);
+		GtkTextIter start;
+		GtkTextIter end;
+
+		gtk_text_buffer_get_iter_at_offset (text_buffer,
+						    &start,
+						    g_random_int_range (0, n_chars + 1));
+
+		if (n_chars == 0 || g_random_int_range (0, 3) != 0)
+		{
+			GString *text = g_string_new (NULL);
+			gint n_pieces = g_random_int_range (0, 100) == 0 ? 10000 : 3;
+			gint j;
+
+			for (j = 0; j < n_pieces; j++)
+			{
+				g_string_append (text, pieces[g_random_int_range (0, G_N_ELEMENTS (pieces))]);
+			}
+
+			gtk_text_buffer_insert (text_buffer, &start, text->str, -1);
+			g_string_free (text, TRUE);
+		}
+		else
+		{
+			gtk_text_buffer_get_iter_at_offset (text_buffer,
+							    &end,
+							    g_random_int_range (0, n_chars + 1));
+			gtk_text_buffer_delete (text_buffer, &start, &end);
+		}
+
+		if (i % 100 == 0)
+		{
+			check_rope_content (buffer);
+
+			if (snapshot != NULL)
+			{
+				gchar *text = _tepl_rope_get_text (snapshot);
+				g_assert_cmpstr (text, ==, snapshot_text);
+				g_free (text);
+
+				_tepl_rope_unref (snapshot);
+				g_free (snapshot_text);
+			}
+
+			snapshot = _tepl_rope_ref (_tepl_buffer_get_rope (buffer));
+			snapshot_text = _tepl_rope_get_text (snapshot);
+		}
+	}
+
+	check_rope_content (buffer);
+
+	_tepl_rope_unref (snapshot);
+	g_free (snapshot_text);
+	g_object_unref (buffer);
+}
+
+/* The buffer is modified while the snapshot is being written. */
+static void
+test_edit_during_save (void)
+{
+	TeplBuffer *buffer;
+	GtkTextBuffer *text_buffer;
+	TeplFile *file;
+	GFile *location;
+	TeplFileSaver *saver;
+	GtkTextIter iter;
+
+	buffer = tepl_buffer_new ();
+	text_buffer = GTK_TEXT_BUFFER (buffer);
+	gtk_text_buffer_set_text (text_buffer, "saved content", -1);
+
+	file = tepl_file_new ();
+	location = get_tmp_location ();
+	saver = tepl_file_saver_new_with_target (buffer, file, location);
+
+	/* Not modified during the save operation. */
+	save_sync (saver);
+	_tepl_test_utils_check_file_content (location, "saved content");
+	g_assert_false (gtk_text_buffer_get_modified (text_buffer));
+	g_object_unref (saver);
+
+	/* Modified. */
+	gtk_text_buffer_set_text (text_buffer, "saved content 2", -1);
+	saver = tepl_file_saver_new_with_target (buffer, file, location);
+	tepl_file_saver_save_async (saver, G_PRIORITY_DEFAULT, NULL, save_sync_cb, NULL);
+
+	gtk_text_buffer_get_end_iter (text_buffer, &iter);
+	gtk_text_buffer_insert (text_buffer, &iter, " not saved", -1);
+	gtk_main ();
+
+	_tepl_test_utils_check_file_content (location, "saved content 2");
+	g_assert_true (gtk_text_buffer_get_modified (text_buffer));
+
+	g_object_unref (buffer);
+	g_object_unref (file);
+	g_object_unref (location);
+	g_object_unref (saver);
+}
+
+static void
+save_with_durability (TeplBuffer              *buffer,
+		      GFile                   *location,
+		      TeplFileSaverDurability  durability)
+{
+	TeplFile *file;
+	TeplFileSaver *saver;
+
+	file = tepl_file_new ();
+	saver = tepl_file_saver_new_with_target (buffer, file, location);
+	tepl_file_saver_set_durability (saver, durability);
+	save_sync (saver);
+
+	g_object_unref (saver);
+	g_object_unref (file);
+}
+
+static guint32
+get_unix_mode (GFile *location)
+{
+	GFileInfo *info;
+	guint32 mode;
+
+	info = g_file_query_info (location, G_FILE_ATTRIBUTE_UNIX_MODE, G_FILE_QUERY_INFO_NONE, NULL, NULL);
+	g_assert_nonnull (info);
+	mode = g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_MODE);
+	g_object_unref (info);
+
+	return mode & 0777;
+}
+
+/* No temporary file is left in the directory. */
+static void
+check_no_tmp_file (void)
+{
+	GDir *dir;
+	const gchar *name;
+
+	dir = g_dir_open (g_get_tmp_dir (), 0, NULL);
+	g_assert_nonnull (dir);
+
+	while ((name = g_dir_read_name (dir)) != NULL)
+	{
+		g_assert_false (g_str_has_prefix (name, ".tepl-file-saver-test."));
+	}
+
+	g_dir_close (dir);
+}
+
+static void
+check_durability (TeplFileSaverDurability durability)
+{
+	TeplBuffer *buffer;
+	GFile *location;
+	GFile *symlink_location;
+	gchar *path;
+	GError *error = NULL;
+
+	buffer = tepl_buffer_new ();
+	location = get_tmp_location ();
+	g_file_delete (location, NULL, NULL);
+
+	/* New file. */
+	gtk_text_buffer_set_text (GTK_TEXT_BUFFER (buffer), "a longer content", -1);
+	save_with_durability (buffer, location, durability);
+	_tepl_test_utils_check_file_content (location, "a longer content");
+
+	/* Existing file, with a shorter content. The permissions are kept. */
+	path = g_file_get_path (location);
+	g_assert_cmpint (g_chmod (path, 0600), ==, 0);
+
+	gtk_text_buffer_set_text (GTK_TEXT_BUFFER (buffer), "short", -1);
+	save_with_durability (buffer, location, durability);
+	_tepl_test_utils_check_file_content (location, "short");
+	g_assert_cmpuint (get_unix_mode (location), ==, 0600);
+	check_no_tmp_file ();
+
+	/* The extended attributes are kept, if the filesystem supports them. */
+	if (g_file_set_attribute_string (location, "xattr::tepl-test", "value",
+					 G_FILE_QUERY_INFO_NONE, NULL, NULL))
+	{
+		GFileInfo *info;
+
+		save_with_durability (buffer, location, durability);
+
+		info = g_file_query_info (location, "xattr::tepl-test", G_FILE_QUERY_INFO_NONE, NULL, NULL);
+		g_assert_nonnull (info);
+		g_assert_cmpstr (g_file_info_get_attribute_string (info, "xattr::tepl-test"), ==, "value");
+		g_object_unref (info);
+	}
+
+	/* Saved through a symlink, the symlink is kept. */
+	symlink_location = g_file_new_build_filename (g_get_tmp_dir (), "tepl-file-saver-test-symlink", NULL);
+	g_file_delete (symlink_location, NULL, NULL);
+	g_file_make_symbolic_link (symlink_location, path, NULL, &error);
+	g_assert_no_error (error);
+
+	gtk_text_buffer_set_text (GTK_TEXT_BUFFER (buffer), "through the symlink", -1);
+	save_with_durability (buffer, symlink_location, durability);
+	_tepl_test_utils_check_file_content (location, "through the symlink");
+	g_assert_true (g_file_query_file_type (symlink_location, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, NULL) ==
+		       G_FILE_TYPE_SYMBOLIC_LINK);
+	g_file_delete (symlink_location, NULL, NULL);
+	g_object_unref (symlink_location);
+
+#ifdef G_OS_UNIX
+	/* With a hard link, both paths have the new content. */
+	{
+		gchar *hard_link_path;
+		GFile *hard_link_location;
+
+		hard_link_path = g_build_filename (g_get_tmp_dir (), "tepl-file-saver-test-hard-link", NULL);
+		hard_link_location = g_file_new_for_path (hard_link_path);
+		g_unlink (hard_link_path);
+		g_assert_cmpint (link (path, hard_link_path), ==, 0);
+
+		gtk_text_buffer_set_text (GTK_TEXT_BUFFER (buffer), "both links", -1);
+		save_with_durability (buffer, location, durability);
+		_tepl_test_utils_check_file_content (location, "both links");
+		_tepl_test_utils_check_file_content (hard_link_location, "both links");
+
+		g_file_delete (hard_link_location, NULL, NULL);
+		g_object_unref (hard_link_location);
+		g_free (hard_link_path);
+	}
+#endif
+
+	check_no_tmp_file ();
+
+	g_file_delete (location, NULL, NULL);
+	g_free (path);
+	g_object_unref (buffer);
+	g_object_unref (location);
+}
+
+static void
+test_durability (void)
+{
+	check_durability (TEPL_FILE_SAVER_DURABILITY_DEFAULT);
+	check_durability (TEPL_FILE_SAVER_DURABILITY_FAST);
+	check_durability (TEPL_FILE_SAVER_DURABILITY_DURABLE);
+}
+
+/* The latency depends a lot on the filesystem and the storage, run it with
+ * TMPDIR pointing to the directory where the files are saved.
+ */
+static void
+test_durability_perf (void)
+{
+	const TeplFileSaverDurability modes[] =
+	{
+		TEPL_FILE_SAVER_DURABILITY_FAST,
+		TEPL_FILE_SAVER_DURABILITY_DEFAULT,
+		TEPL_FILE_SAVER_DURABILITY_DURABLE
+	};
+	const gchar *mode_names[] = { "fast", "default", "durable" };
+	const gint n_small_saves = 50;
+	TeplBuffer *buffer;
+	GtkTextBuffer *text_buffer;
+	GFile *location;
+	GString *big_text;
+	GTimer *timer;
+	guint i;
+
+	if (!g_test_perf ())
+	{
+		g_test_skip ("Performance test, run it with -m perf.");
+		return;
+	}
+
+	buffer = tepl_buffer_new ();
+	text_buffer = GTK_TEXT_BUFFER (buffer);
+	location = get_tmp_location ();
+	timer = g_timer_new ();
+
+	big_text = g_string_new (NULL);
+	while (big_text->len < 16 * 1024 * 1024)
+	{
+		g_string_append (big_text, "\tif (value != NULL) /* Évaluation. */\n");
+	}
+
+	g_test_message ("Directory: %s", g_get_tmp_dir ());
+
+	for (i = 0; i < G_N_ELEMENTS (modes); i++)
+	{
+		gdouble elapsed;
+		gint save_num;
+
+		/* Small file, replaced at each save. */
+		g_timer_start (timer);
+		for (save_num = 0; save_num < n_small_saves; save_num++)
+		{
+			gchar *text;
+
+			text = g_strdup_printf ("key=value\nsave=%d\n", save_num);
+			gtk_text_buffer_set_text (text_buffer, text, -1);
+			g_free (text);
+
+			save_with_durability (buffer, location, modes[i]);
+		}
+		elapsed = g_timer_elapsed (timer, NULL) / n_small_saves;
+
+		g_test_minimized_result (elapsed,
+					 "Save of a small file, %s mode: %.2f ms",
+					 mode_names[i],
+					 elapsed * 1000.0);
+
+		/* Big file. */
+		gtk_text_buffer_set_text (text_buffer, big_text->str, big_text->len);
+		g_timer_start (timer);
+		save_with_durability (buffer, location, modes[i]);
+		elapsed = g_timer_elapsed (timer, NULL);
+
+		g_test_minimized_result (elapsed,
+					 "Save of 16 MiB, %s mode: %.3f s",
+					 mode_names[i],
+					 elapsed);
+	}
+
+	g_file_delete (location, NULL, NULL);
+	g_string_free (big_text, TRUE);
+	g_timer_destroy (timer);
+	g_object_unref (location);
+	g_object_unref (buffer);
+}
+
+static guint64
+get_inode (GFile *location)
+{
+	GFileInfo *info;
+	guint64 inode;
+
+	info = g_file_query_info (location, G_FILE_ATTRIBUTE_UNIX_INODE, G_FILE_QUERY_INFO_NONE, NULL, NULL);
+	g_assert_nonnull (info);
+	inode = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_UNIX_INODE);
+	g_object_unref (info);
+
+	return inode;
+}
+
+static void
+type_and_delete_a_char (GtkTextBuffer *text_buffer)
+{
+	GtkTextIter start;
+	GtkTextIter end;
+
+	gtk_text_buffer_get_start_iter (text_buffer, &start);
+	gtk_text_buffer_insert (text_buffer, &start, "x", -1);
+
+	gtk_text_buffer_get_start_iter (text_buffer, &start);
+	gtk_text_buffer_get_iter_at_offset (text_buffer, &end, 1);
+	gtk_text_buffer_delete (text_buffer, &start, &end);
+}
+
+/* The file is not rewritten when the content has not changed. */
+static void
+test_unchanged_content (void)
+{
+	TeplBuffer *buffer;
+	GtkTextBuffer *text_buffer;
+	TeplFile *file;
+	GFile *location;
+	TeplFileSaver *saver;
+	guint64 inode;
+
+	buffer = tepl_buffer_new ();
+	text_buffer = GTK_TEXT_BUFFER (buffer);
+	gtk_text_buffer_set_text (text_buffer, "saved content", -1);
+
+	file = tepl_buffer_get_file (buffer);
+	location = get_tmp_location ();
+	saver = tepl_file_saver_new_with_target (buffer, file, location);
+	save_sync (saver);
+	g_object_unref (saver);
+
+	type_and_delete_a_char (text_buffer);
+	g_assert_true (gtk_text_buffer_get_modified (text_buffer));
+	g_assert_true (_tepl_buffer_is_unchanged_since_save (buffer));
+
+	inode = get_inode (location);
+	saver = tepl_file_saver_new (buffer, file);
+	save_sync (saver);
+	g_object_unref (saver);
+
+	g_assert_cmpuint (get_inode (location), ==, inode);
+	g_assert_false (gtk_text_buffer_get_modified (text_buffer));
+
+	/* Modified by another program. */
+	_tepl_test_utils_set_file_content (location, "other content");
+	type_and_delete_a_char (text_buffer);
+
+	saver = tepl_file_saver_new (buffer, file);
+	save_sync (saver);
+	g_object_unref (saver);
+	_tepl_test_utils_check_file_content (location, "saved content");
+
+	/* Modified. */
+	gtk_text_buffer_set_text (text_buffer, "new content", -1);
+	g_assert_false (_tepl_buffer_is_unchanged_since_save (buffer));
+
+	saver = tepl_file_saver_new (buffer, file);
+	save_sync (saver);
+	g_object_unref (saver);
+	_tepl_test_utils_check_file_content (location, "new content");
+	g_assert_true (_tepl_buffer_is_unchanged_since_save (buffer));
+
+	g_object_unref (buffer);
+	g_object_unref (location);
+}
+
+static void
+load_sync_cb (GObject      *source_object,
+	      GAsyncResult *result,
+	      gpointer      user_data)
+{
+	TeplFileLoader *loader = TEPL_FILE_LOADER (source_object);
+	gboolean ok;
+	GError *error = NULL;
+
+	ok = tepl_file_loader_load_finish (loader, result, &error);
+	g_assert_true (ok);
+	g_assert_no_error (error);
+
+	gtk_main_quit ();
+}
+
+static void
+load_sync (TeplBuffer *buffer,
+	   GFile      *location)
+{
+	TeplFile *file;
+	TeplFileLoader *loader;
+
+	file = tepl_buffer_get_file (buffer);
+	tepl_file_set_location (file, location);
+
+	loader = tepl_file_loader_new (buffer, file);
+	tepl_file_loader_load_async (loader,
+				     G_PRIORITY_DEFAULT,
+				     NULL,
+				     load_sync_cb,
+				     NULL);
+	gtk_main ();
+	g_object_unref (loader);
+}
+
+/* A file with mixed line terminators is normalized even if the buffer has not
+ * changed.
+ */
+static void
+test_unchanged_content_mixed_newlines (void)
+{
+	TeplBuffer *buffer;
+	GFile *location;
+	TeplFileSaver *saver;
+
+	location = get_tmp_location ();
+
+	/* Only one kind of line terminators: not rewritten. */
+	_tepl_test_utils_set_file_content (location, "a\r\nb\r\n");
+	buffer = tepl_buffer_new ();
+	load_sync (buffer, location);
+	g_assert_true (_tepl_buffer_is_unchanged_since_save (buffer));
+	g_object_unref (buffer);
+
+	/* Mixed. */
+	_tepl_test_utils_set_file_content (location, "a\r\nb\r\nc\n");
+	buffer = tepl_buffer_new ();
+	load_sync (buffer, location);
+	g_assert_false (_tepl_buffer_is_unchanged_since_save (buffer));
+	g_assert_cmpint (tepl_file_get_newline_type (tepl_buffer_get_file (buffer)), ==, TEPL_NEWLINE_TYPE_CR_LF);
+
+	saver = tepl_file_saver_new (buffer, tepl_buffer_get_file (buffer));
+	save_sync (saver);
+	g_object_unref (saver);
+
+	_tepl_test_utils_check_file_content (location, "a\r\nb\r\nc\r\n");
+	g_assert_true (_tepl_buffer_is_unchanged_since_save (buffer));
+
+	g_object_unref (buffer);
+	g_object_unref (location);
+}
+
+static void
+check_newline_type (const gchar     *content,
+		    TeplNewlineType  newline_type,
+		    const gchar     *expected_file_content)
+{
+	TeplBuffer *buffer;
+	TeplFile *file;
+	GFile *location;
+	TeplFileSaver *saver;
+
+	buffer = tepl_buffer_new ();
+	gtk_text_buffer_set_text (GTK_TEXT_BUFFER (buffer), content, -1);
+
+	file = tepl_file_new ();
+	location = get_tmp_location ();
+	saver = tepl_file_saver_new_with_target (buffer, file, location);
+	tepl_file_saver_set_newline_type (saver, newline_type);
+
+	save_sync (saver);
+	_tepl_test_utils_check_file_content (location, expected_file_content);
+	g_assert_cmpint (tepl_file_get_newline_type (file), ==, newline_type);
+
+	g_object_unref (buffer);
+	g_object_unref (file);
+	g_object_unref (location);
+	g_object_unref (saver);
+}
+
+static void
+test_newline_type (void)
+{
+	const gchar *content = "a\nb\r\nc\rd\n\ne\r\r\n";
+	GString *big_content;
+	GString *expected;
+	gint i;
+
+	check_newline_type (content, TEPL_NEWLINE_TYPE_LF, "a\nb\nc\nd\n\ne\n\n");
+	check_newline_type (content, TEPL_NEWLINE_TYPE_CR, "a\rb\rc\rd\r\re\r\r");
+	check_newline_type (content, TEPL_NEWLINE_TYPE_CR_LF, "a\r\nb\r\nc\r\nd\r\n\r\ne\r\n\r\n");
+	check_newline_type ("no newline", TEPL_NEWLINE_TYPE_CR_LF, "no newline");
+
+	/* Several chunks. */
+	big_content = g_string_new (NULL);
+	expected = g_string_new (NULL);
+	for (i = 0; i < 20000; i++)
+	{
+		g_string_append_printf (big_content, "line %d\r\n", i);
+		g_string_append_printf (expected, "line %d\n", i);
+	}
+	check_newline_type (big_content->str, TEPL_NEWLINE_TYPE_LF, expected->str);
+	g_string_free (big_content, TRUE);
+	g_string_free (expected, TRUE);
+}
+
+/* A "\r\n" cut between two parts of the text. */
+static void
+test_newline_converter_parts (void)
+{
+	const gchar *text = "a\r\nb\rc\n";
+	const gchar *expected = "a\r\nb\r\nc\r\n";
+	gsize length = strlen (text);
+	gsize split_pos;
+
+	for (split_pos = 0; split_pos <= length; split_pos++)
+	{
+		TeplNewlineConverter converter;
+		GString *result;
+		gsize parts[2][2] = { { 0, split_pos }, { split_pos, length - split_pos } };
+		gint i;
+
+		_tepl_newline_converter_init (&converter, TEPL_NEWLINE_TYPE_CR_LF);
+		result = g_string_new (NULL);
+
+		for (i = 0; i < 2; i++)
+		{
+			gchar *output;
+			gsize output_length;
+
+			if (_tepl_newline_converter_convert (&converter,
+							     text + parts[i][0],
+							     parts[i][1],
+							     &output,
+							     &output_length))
+			{
+				g_string_append_len (result, output, output_length);
+				g_free (output);
+			}
+			else
+			{
+				g_string_append_len (result, text + parts[i][0], parts[i][1]);
+			}
+		}
+
+		g_assert_cmpstr (result->str, ==, expected);
+		g_string_free (result, TRUE);
+	}
+}
+
+/* The trailing whitespace cut between two parts of the text. */
+static void
+test_newline_converter_strip_parts (void)
+{
+	const gchar *text = "a \t\nb  \r\n  c  d \n \t";
+	const gchar *expected = "a\nb\n  c  d\n";
+	gsize length = strlen (text);
+	gsize split_pos;
+
+	for (split_pos = 0; split_pos <= length; split_pos++)
+	{
+		TeplNewlineConverter converter;
+		GString *result;
+		gsize parts[2][2] = { { 0, split_pos }, { split_pos, length - split_pos } };
+		gchar *output;
+		gsize output_length;
+		gint i;
+
+		_tepl_newline_converter_init (&converter, TEPL_NEWLINE_TYPE_LF);
+		_tepl_newline_converter_set_strip_trailing_whitespace (&converter, TRUE);
+		_tepl_newline_converter_set_ensure_trailing_newline (&converter, TRUE);
+		result = g_string_new (NULL);
+
+		for (i = 0; i < 2; i++)
+		{
+			if (_tepl_newline_converter_convert (&converter,
+							     text + parts[i][0],
+							     parts[i][1],
+							     &output,
+							     &output_length))
+			{
+				g_string_append_len (result, output, output_length);
+				g_free (output);
+			}
+			else
+			{
+				g_string_append_len (result, text + parts[i][0], parts[i][1]);
+			}
+		}
+
+		if (_tepl_newline_converter_finish (&converter, &output, &output_length))
+		{
+			g_string_append_len (result, output, output_length);
+			g_free (output);
+		}
+
+		g_assert_cmpstr (result->str, ==, expected);
+		g_assert_true (_tepl_newline_converter_content_is_modified (&converter));
+
+		g_string_free (result, TRUE);
+		_tepl_newline_converter_clear (&converter);
+	}
+}
+
+static void
+test_newline_converter_perf (void)
+{
+	GString *text;
+	TeplNewlineConverter converter;
+	GTimer *timer;
+	gchar *output;
+	gsize output_length;
+	gdouble elapsed;
+
+	if (!g_test_perf ())
+	{
+		g_test_skip ("Performance test, run it with -m perf.");
+		return;
+	}
+
+	text = g_string_new (NULL);
+	while (text->len < 64 * 1024 * 1024)
+	{
+		g_string_append (text, "\tif (value != NULL) /* Évaluation. */\n");
+	}
+
+	_tepl_newline_converter_init (&converter, TEPL_NEWLINE_TYPE_CR_LF);
+
+	timer = g_timer_new ();
+	g_assert_true (_tepl_newline_converter_convert (&converter, text->str, text->len, &output, &output_length));
+	elapsed = g_timer_elapsed (timer, NULL);
+
+	g_assert_cmpuint (output_length, >, text->len);
+	g_test_minimized_result (elapsed, "LF to CR-LF, 64 MiB: %.3f s", elapsed);
+
+	g_free (output);
+	g_timer_destroy (timer);
+	g_string_free (text, TRUE);
+}
+
+static void
+check_charset (const gchar     *content,
+	       const gchar     *charset,
+	       TeplNewlineType  newline_type,
+	       const gchar     *expected_file_content)
+{
+	TeplBuffer *buffer;
+	TeplFile *file;
+	GFile *location;
+	TeplFileSaver *saver;
+
+	buffer = tepl_buffer_new ();
+	gtk_text_buffer_set_text (GTK_TEXT_BUFFER (buffer), content, -1);
+
+	file = tepl_file_new ();
+	location = get_tmp_location ();
+	saver = tepl_file_saver_new_with_target (buffer, file, location);
+	g_assert_cmpstr (tepl_file_saver_get_charset (saver), ==, "UTF-8");
+	tepl_file_saver_set_charset (saver, charset);
+	tepl_file_saver_set_newline_type (saver, newline_type);
+
+	save_sync (saver);
+	_tepl_test_utils_check_file_content (location, expected_file_content);
+	g_assert_cmpstr (tepl_file_get_charset (file), ==, charset);
+	g_assert_cmpuint (tepl_file_saver_get_n_unconvertible_chars (saver), ==, 0);
+	g_object_unref (saver);
+
+	/* The charset is taken from the TeplFile. */
+	saver = tepl_file_saver_new_with_target (buffer, file, location);
+	g_assert_cmpstr (tepl_file_saver_get_charset (saver), ==, charset);
+
+	g_object_unref (buffer);
+	g_object_unref (file);
+	g_object_unref (location);
+	g_object_unref (saver);
+}
+
+static void
+test_charset (void)
+{
+	GString *content;
+	GString *expected;
+	gint i;
+
+	check_charset ("", "ISO-8859-15", TEPL_NEWLINE_TYPE_LF, "");
+	check_charset ("Évo 5 €\nend", "ISO-8859-15", TEPL_NEWLINE_TYPE_LF, "\xC9vo 5 \xA4\nend");
+	check_charset ("Évo\n", "ISO-8859-15", TEPL_NEWLINE_TYPE_CR_LF, "\xC9vo\r\n");
+
+	/* Several chunks. */
+	content = g_string_new (NULL);
+	expected = g_string_new (NULL);
+	for (i = 0; i < 20000; i++)
+	{
+		g_string_append_printf (content, "line %d Évo €\n", i);
+		g_string_append_printf (expected, "line %d \xC9vo \xA4\n", i);
+	}
+	check_charset (content->str, "ISO-8859-15", TEPL_NEWLINE_TYPE_LF, expected->str);
+	g_string_free (content, TRUE);
+	g_string_free (expected, TRUE);
+}
+
+static void
+save_with_error_cb (GObject      *source_object,
+		    GAsyncResult *result,
+		    gpointer      user_data)
+{
+	TeplFileSaver *saver = TEPL_FILE_SAVER (source_object);
+	GError **error = user_data;
+
+	g_assert_false (tepl_file_saver_save_finish (saver, result, error));
+	gtk_main_quit ();
+}
+
+static void
+check_unconvertible_char_offsets (TeplFileSaver *saver,
+				  const gint    *expected_offsets,
+				  guint          n_expected_offsets)
+{
+	guint i;
+
+	g_assert_cmpuint (tepl_file_saver_get_n_unconvertible_chars (saver), ==, n_expected_offsets);
+
+	for (i = 0; i < n_expected_offsets; i++)
+	{
+		g_assert_cmpint (tepl_file_saver_get_unconvertible_char_offset (saver, i), ==, expected_offsets[i]);
+	}
+}
+
+static void
+test_unconvertible_chars (void)
+{
+	/* The "€" doesn't exist in ISO-8859-1, and the "中" neither. */
+	const gchar *content = "a€b\r\n\n中 very long line";
+	const gint expected_offsets[] = { 1, 6 };
+	TeplBuffer *buffer;
+	TeplFile *file;
+	GFile *location;
+	TeplFileSaver *saver;
+	GError *error = NULL;
+
+	buffer = tepl_buffer_new ();
+	gtk_text_buffer_set_text (GTK_TEXT_BUFFER (buffer), content, -1);
+	file = tepl_file_new ();
+	location = get_tmp_location ();
+	_tepl_test_utils_set_file_content (location, "original");
+
+	/* The file is not modified, also in the fast mode. */
+	saver = tepl_file_saver_new_with_target (buffer, file, location);
+	tepl_file_saver_set_charset (saver, "ISO-8859-1");
+	tepl_file_saver_set_newline_type (saver, TEPL_NEWLINE_TYPE_CR_LF);
+	tepl_file_saver_set_durability (saver, TEPL_FILE_SAVER_DURABILITY_FAST);
+
+	tepl_file_saver_save_async (saver, G_PRIORITY_DEFAULT, NULL, save_with_error_cb, &error);
+	gtk_main ();
+	g_assert_error (error, TEPL_FILE_SAVER_ERROR, TEPL_FILE_SAVER_ERROR_UNCONVERTIBLE_CHARS);
+	g_clear_error (&error);
+
+	_tepl_test_utils_check_file_content (location, "original");
+	check_no_tmp_file ();
+	check_unconvertible_char_offsets (saver, expected_offsets, G_N_ELEMENTS (expected_offsets));
+	g_assert_cmpstr (tepl_file_get_charset (file), ==, "UTF-8");
+
+	/* Saved with the substitution character. */
+	tepl_file_saver_set_flags (saver, TEPL_FILE_SAVER_FLAGS_IGNORE_UNCONVERTIBLE_CHARS);
+	save_sync (saver);
+	_tepl_test_utils_check_file_content (location, "a\x1A" "b\r\n\r\n\x1A very long line");
+	check_unconvertible_char_offsets (saver, expected_offsets, G_N_ELEMENTS (expected_offsets));
+	g_assert_cmpstr (tepl_file_get_charset (file), ==, "ISO-8859-1");
+
+	g_file_delete (location, NULL, NULL);
+	g_object_unref (buffer);
+	g_object_unref (file);
+	g_object_unref (location);
+	g_object_unref (saver);
+}
+
+static void
+test_invalid_chars (void)
+{
+	TeplBuffer *buffer;
+	TeplFile *file;
+	GFile *location;
+	TeplFileSaver *saver;
+	GArray *offsets;
+	gint offset;
+	GError *error = NULL;
+
+	buffer = tepl_buffer_new ();
+	gtk_text_buffer_set_text (GTK_TEXT_BUFFER (buffer), "a\\FFb", -1);
+
+	/* The escaped invalid byte, like TeplFileLoader does. */
+	offsets = g_array_new (FALSE, FALSE, sizeof (gint));
+	offset = 1;
+	g_array_append_val (offsets, offset);
+	offset = 4;
+	g_array_append_val (offsets, offset);
+	_tepl_buffer_set_as_invalid_chars (buffer, offsets);
+	g_array_unref (offsets);
+
+	file = tepl_file_new ();
+	location = get_tmp_location ();
+	_tepl_test_utils_set_file_content (location, "original");
+
+	saver = tepl_file_saver_new_with_target (buffer, file, location);
+	tepl_file_saver_save_async (saver, G_PRIORITY_DEFAULT, NULL, save_with_error_cb, &error);
+	gtk_main ();
+	g_assert_error (error, TEPL_FILE_SAVER_ERROR, TEPL_FILE_SAVER_ERROR_INVALID_CHARS);
+	g_clear_error (&error);
+	_tepl_test_utils_check_file_content (location, "original");
+
+	tepl_file_saver_set_flags (saver, TEPL_FILE_SAVER_FLAGS_IGNORE_INVALID_CHARS);
+	save_sync (saver);
+	_tepl_test_utils_check_file_content (location, "a\\FFb");
+
+	g_file_delete (location, NULL, NULL);
+	g_object_unref (buffer);
+	g_object_unref (file);
+	g_object_unref (location);
+	g_object_unref (saver);
+}
+
+/* Compares the charset conversion with the UTF-8 save. */
+static void
+test_charset_perf (void)
+{
+	const gchar *charsets[] = { "UTF-8", "ISO-8859-15", "UTF-16" };
+	TeplBuffer *buffer;
+	TeplFile *file;
+	GFile *location;
+	GString *text;
+	GTimer *timer;
+	guint i;
+
+	if (!g_test_perf ())
+	{
+		g_test_skip ("Performance test, run it with -m perf.");
+		return;
+	}
+
+	text = g_string_new (NULL);
+	while (text->len < 32 * 1024 * 1024)
+	{
+		g_string_append (text, "\tif (value != NULL) /* Évaluation. */\n");
+	}
+
+	buffer = tepl_buffer_new ();
+	gtk_text_buffer_set_text (GTK_TEXT_BUFFER (buffer), text->str, text->len);
+	file = tepl_file_new ();
+	location = get_tmp_location ();
+	timer = g_timer_new ();
+
+	for (i = 0; i < G_N_ELEMENTS (charsets); i++)
+	{
+		TeplFileSaver *saver;
+		gdouble elapsed;
+
+		saver = tepl_file_saver_new_with_target (buffer, file, location);
+		tepl_file_saver_set_charset (saver, charsets[i]);
+
+		g_timer_start (timer);
+		save_sync (saver);
+		elapsed = g_timer_elapsed (timer, NULL);
+
+		g_test_minimized_result (elapsed,
+					 "Save of 32 MiB in %s: %.3f s",
+					 charsets[i],
+					 elapsed);
+
+		g_object_unref (saver);
+	}
+
+	g_file_delete (location, NULL, NULL);
+	g_string_free (text, TRUE);
+	g_timer_destroy (timer);
+	g_object_unref (location);
+	g_object_unref (file);
+	g_object_unref (buffer);
+}
+
+static void
+check_strip_trailing_whitespace (const gchar        *content,
+				 TeplFileSaverFlags  flags,
+				 const gchar        *expected_file_content)
+{
+	TeplBuffer *buffer;
+	GtkTextBuffer *text_buffer;
+	TeplFile *file;
+	GFile *location;
+	TeplFileSaver *saver;
+	GtkTextIter start;
+	GtkTextIter end;
+	gchar *buffer_content;
+
+	buffer = tepl_buffer_new ();
+	text_buffer = GTK_TEXT_BUFFER (buffer);
+	gtk_text_buffer_set_text (text_buffer, content, -1);
+
+	file = tepl_file_new ();
+	location = get_tmp_location ();
+	saver = tepl_file_saver_new_with_target (buffer, file, location);
+	tepl_file_saver_set_flags (saver, flags);
+
+	save_sync (saver);
+	_tepl_test_utils_check_file_content (location, expected_file_content);
+
+	/* The buffer is not modified. */
+	gtk_text_buffer_get_bounds (text_buffer, &start, &end);
+	buffer_content = gtk_text_buffer_get_text (text_buffer, &start, &end, TRUE);
+	g_assert_cmpstr (buffer_content, ==, content);
+	g_assert_false (gtk_text_buffer_get_modified (text_buffer));
+	g_free (buffer_content);
+	g_object_unref (saver);
+
+	/* Saved again without the flags, the file must be rewritten. */
+	type_and_delete_a_char (text_buffer);
+	saver = tepl_file_saver_new (buffer, file);
+	save_sync (saver);
+	_tepl_test_utils_check_file_content (location, content);
+
+	g_file_delete (location, NULL, NULL);
+	g_object_unref (buffer);
+	g_object_unref (file);
+	g_object_unref (location);
+	g_object_unref (saver);
+}
+
+static void
+test_strip_trailing_whitespace (void)
+{
+	const TeplFileSaverFlags both_flags = (TEPL_FILE_SAVER_FLAGS_STRIP_TRAILING_WHITESPACE |
+					       TEPL_FILE_SAVER_FLAGS_ENSURE_TRAILING_NEWLINE);
+	GString *content;
+	GString *expected;
+	gint i;
+
+	check_strip_trailing_whitespace ("a  \nb\t\n  \n  c  ",
+					 TEPL_FILE_SAVER_FLAGS_STRIP_TRAILING_WHITESPACE,
+					 "a\nb\n\n  c");
+	check_strip_trailing_whitespace ("a  \nb\t\n  \n  c  ", both_flags, "a\nb\n\n  c\n");
+	check_strip_trailing_whitespace ("a  \nb", TEPL_FILE_SAVER_FLAGS_ENSURE_TRAILING_NEWLINE, "a  \nb\n");
+
+	/* Several chunks. */
+	content = g_string_new (NULL);
+	expected = g_string_new (NULL);
+	for (i = 0; i < 20000; i++)
+	{
+		g_string_append_printf (content, "line %d Évo \t\n", i);
+		g_string_append_printf (expected, "line %d Évo\n", i);
+	}
+	check_strip_trailing_whitespace (content->str, both_flags, expected->str);
+	g_string_free (content, TRUE);
+	g_string_free (expected, TRUE);
+}
+
+/* Compares a plain save and a save with the trailing whitespace stripped. */
+static void
+test_strip_trailing_whitespace_perf (void)
+{
+	const TeplFileSaverFlags flags[] =
+	{
+		TEPL_FILE_SAVER_FLAGS_NONE,
+		TEPL_FILE_SAVER_FLAGS_STRIP_TRAILING_WHITESPACE | TEPL_FILE_SAVER_FLAGS_ENSURE_TRAILING_NEWLINE
+	};
+	const gchar *flags_names[] = { "plain save", "stripping the trailing whitespace" };
+	TeplBuffer *buffer;
+	TeplFile *file;
+	GFile *location;
+	GString *text;
+	GTimer *timer;
+	gint line_num;
+	guint i;
+
+	if (!g_test_perf ())
+	{
+		g_test_skip ("Performance test, run it with -m perf.");
+		return;
+	}
+
+	/* One line out of ten with trailing whitespace. */
+	text = g_string_new (NULL);
+	for (line_num = 0; line_num < 500000; line_num++)
+	{
+		g_string_append (text, "\tif (value != NULL) /* Évaluation. */");
+		g_string_append (text, line_num % 10 == 0 ? "  \n" : "\n");
+	}
+
+	buffer = tepl_buffer_new ();
+	gtk_text_buffer_set_text (GTK_TEXT_BUFFER (buffer), text->str, text->len);
+	file = tepl_file_new ();
+	location = get_tmp_location ();
+	timer = g_timer_new ();
+
+	for (i = 0; i < G_N_ELEMENTS (flags); i++)
+	{
+		TeplFileSaver *saver;
+		gdouble elapsed;
+
+		saver = tepl_file_saver_new_with_target (buffer, file, location);
+		tepl_file_saver_set_flags (saver, flags[i]);
+
+		g_timer_start (timer);
+		save_sync (saver);
+		elapsed = g_timer_elapsed (timer, NULL);
+
+		g_test_minimized_result (elapsed,
+					 "Save of 500k lines, %s: %.3f s",
+					 flags_names[i],
+					 elapsed);
+
+		g_object_unref (saver);
+	}
+
+	g_file_delete (location, NULL, NULL);
+	g_string_free (text, TRUE);
+	g_timer_destroy (timer);
+	g_object_unref (location);
+	g_object_unref (file);
+	g_object_unref (buffer);
+}
+
 int
 main (int    argc,
       char **argv)
@@ -172,7 +1441,25 @@ main (int    argc,
 
 	g_test_add_func ("/file_saver/basic", test_basic);
 	g_test_add_func ("/file_saver/backup", test_backup);
+	g_test_add_func ("/file_saver/backup_perf", test_backup_perf);
 	g_test_add_func ("/file_saver/properties", test_properties);
+	g_test_add_func ("/file_saver/several_chunks", test_several_chunks);
+	g_test_add_func ("/file_saver/newline_type", test_newline_type);
+	g_test_add_func ("/file_saver/rope_random_edits", test_rope_random_edits);
+	g_test_add_func ("/file_saver/edit_during_save", test_edit_during_save);
+	g_test_add_func ("/file_saver/unchanged_content", test_unchanged_content);
+	g_test_add_func ("/file_saver/unchanged_content_mixed_newlines", test_unchanged_content_mixed_newlines);
+	g_test_add_func ("/file_saver/durability", test_durability);
+	g_test_add_func ("/file_saver/durability_perf", test_durability_perf);
+	g_test_add_func ("/file_saver/newline_converter_parts", test_newline_converter_parts);
+	g_test_add_func ("/file_saver/newline_converter_strip_parts", test_newline_converter_strip_parts);
+	g_test_add_func ("/file_saver/newline_converter_perf", test_newline_converter_perf);
+	g_test_add_func ("/file_saver/charset", test_charset);
+	g_test_add_func ("/file_saver/unconvertible_chars", test_unconvertible_chars);
+	g_test_add_func ("/file_saver/invalid_chars", test_invalid_chars);
+	g_test_add_func ("/file_saver/charset_perf", test_charset_perf);
+	g_test_add_func ("/file_saver/strip_trailing_whitespace", test_strip_trailing_whitespace);
+	g_test_add_func ("/file_saver/strip_trailing_whitespace_perf", test_strip_trailing_whitespace_perf);
 
 	return g_test_run ();
 }
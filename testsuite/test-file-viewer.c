@@ -0,0 +1,292 @@
+/* SPDX-FileCopyrightText: 2020 - Sébastien Wilmet <swilmet@gnome.org>
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <tepl/tepl.h>
+#include <string.h>
+#include "tepl-test-utils.h"
+
+#define N_LINES (10000)
+
+/* Longer than the maximum size of a window. */
+#define LONG_LINE_SIZE (10 * 1024 * 1024)
+
+static GFile *
+create_file (void)
+{
+	GFile *location;
+	GString *content;
+	gint i;
+
+	content = g_string_new (NULL);
+	for (i = 0; i < N_LINES; i++)
+	{
+		g_string_append_printf (content, "line %d\n", i);
+	}
+
+	location = g_file_new_build_filename (g_get_tmp_dir (), "tepl-file-viewer-test", NULL);
+	_tepl_test_utils_set_file_content (location, content->str);
+
+	g_string_free (content, TRUE);
+	return location;
+}
+
+static void
+open_sync_cb (GObject      *source_object,
+	      GAsyncResult *result,
+	      gpointer      user_data)
+{
+	TeplFileViewer *viewer = TEPL_FILE_VIEWER (source_object);
+	GError *error = NULL;
+
+	tepl_file_viewer_open_finish (viewer, result, &error);
+	g_assert_no_error (error);
+
+	gtk_main_quit ();
+}
+
+static void
+save_sync_cb (GObject      *source_object,
+	      GAsyncResult *result,
+	      gpointer      user_data)
+{
+	TeplFileSaver *saver = TEPL_FILE_SAVER (source_object);
+	GError *error = NULL;
+
+	g_assert_false (tepl_file_saver_save_finish (saver, result, &error));
+	g_assert_error (error, TEPL_FILE_SAVER_ERROR, TEPL_FILE_SAVER_ERROR_PARTIAL_CONTENT);
+	g_clear_error (&error);
+
+	gtk_main_quit ();
+}
+
+static gchar *
+get_cursor_line_text (GtkTextBuffer *buffer)
+{
+	GtkTextIter start;
+	GtkTextIter end;
+
+	gtk_text_buffer_get_iter_at_mark (buffer, &start, gtk_text_buffer_get_insert (buffer));
+	gtk_text_iter_set_line_offset (&start, 0);
+	end = start;
+	gtk_text_iter_forward_to_line_end (&end);
+
+	return gtk_text_iter_get_text (&start, &end);
+}
+
+static void
+test_open (void)
+{
+	TeplView *view;
+	GtkTextBuffer *buffer;
+	GFile *location;
+	TeplFileViewer *viewer;
+	TeplFileSaver *saver;
+	gchar *text;
+
+	view = TEPL_VIEW (tepl_view_new ());
+	g_object_ref_sink (view);
+	buffer = gtk_text_view_get_buffer (GTK_TEXT_VIEW (view));
+
+	location = create_file ();
+	viewer = tepl_file_viewer_new (view);
+	g_assert_false (gtk_text_view_get_editable (GTK_TEXT_VIEW (view)));
+
+	tepl_file_viewer_open_async (viewer, location, G_PRIORITY_DEFAULT, NULL, open_sync_cb, NULL);
+	gtk_main ();
+
+	/* Only a window of the file is in the buffer. */
+	g_assert_cmpint (tepl_file_viewer_get_window_first_line (viewer), ==, 0);
+	g_assert_cmpint (gtk_text_buffer_get_line_count (buffer), <, N_LINES);
+	text = get_cursor_line_text (buffer);
+	g_assert_cmpstr (text, ==, "line 0");
+	g_free (text);
+
+	while (!tepl_file_viewer_is_index_complete (viewer))
+	{
+		gtk_main_iteration ();
+	}
+
+	/* With the last empty line. */
+	g_assert_cmpint (tepl_file_viewer_get_n_indexed_lines (viewer), ==, N_LINES + 1);
+
+	/* The window is moved. */
+	g_assert_true (tepl_view_goto_line (view, 8000));
+	while (tepl_file_viewer_get_window_first_line (viewer) == 0)
+	{
+		gtk_main_iteration ();
+	}
+
+	g_assert_cmpint (tepl_file_viewer_get_window_first_line (viewer), >, 0);
+	text = get_cursor_line_text (buffer);
+	g_assert_cmpstr (text, ==, "line 8000");
+	g_free (text);
+
+	/* Inside the window. */
+	g_assert_true (tepl_view_goto_line (view, 8001));
+	text = get_cursor_line_text (buffer);
+	g_assert_cmpstr (text, ==, "line 8001");
+	g_free (text);
+
+	g_assert_false (tepl_view_goto_line (view, N_LINES + 1));
+
+	/* The buffer contains only a part of the file. */
+	saver = tepl_file_saver_new (TEPL_BUFFER (buffer), tepl_buffer_get_file (TEPL_BUFFER (buffer)));
+	tepl_file_saver_save_async (saver, G_PRIORITY_DEFAULT, NULL, save_sync_cb, NULL);
+	gtk_main ();
+	g_object_unref (saver);
+
+	g_object_unref (viewer);
+	g_assert_true (gtk_text_view_get_editable (GTK_TEXT_VIEW (view)));
+
+	g_file_delete (location, NULL, NULL);
+	g_object_unref (location);
+	g_object_unref (view);
+}
+
+static void
+buffer_changed_cb (GtkTextBuffer *buffer,
+		   gboolean      *changed)
+{
+	*changed = TRUE;
+}
+
+static gboolean
+buffer_starts_with (GtkTextBuffer *buffer,
+		    const gchar   *str)
+{
+	GtkTextIter start;
+	GtkTextIter end;
+	gchar *text;
+	gboolean ret;
+
+	gtk_text_buffer_get_start_iter (buffer, &start);
+	end = start;
+	gtk_text_iter_forward_chars (&end, strlen (str));
+	text = gtk_text_iter_get_text (&start, &end);
+	ret = g_str_equal (text, str);
+	g_free (text);
+
+	return ret;
+}
+
+/* Moves the window as if the view was scrolled to @iter, and waits for the new
+ * window to be shown.
+ */
+static void
+scroll_to_iter (TeplFileViewer *viewer,
+		GtkTextBuffer  *buffer,
+		GtkTextIter    *iter)
+{
+	gboolean changed = FALSE;
+	gulong handler_id;
+
+	handler_id = g_signal_connect (buffer, "changed", G_CALLBACK (buffer_changed_cb), &changed);
+	g_assert_true (_tepl_file_viewer_update_window (viewer, iter, iter));
+
+	while (!changed)
+	{
+		gtk_main_iteration ();
+	}
+
+	g_signal_handler_disconnect (buffer, handler_id);
+}
+
+static void
+test_long_line (void)
+{
+	TeplView *view;
+	GtkTextBuffer *buffer;
+	GFile *location;
+	GString *content;
+	TeplFileViewer *viewer;
+	GtkTextIter iter;
+	GtkTextIter end;
+	gchar *text;
+	gint i;
+
+	view = TEPL_VIEW (tepl_view_new ());
+	g_object_ref_sink (view);
+	buffer = gtk_text_view_get_buffer (GTK_TEXT_VIEW (view));
+
+	/* With multi-byte characters, to check that they are not cut at the
+	 * edges of the windows.
+	 */
+	content = g_string_new ("start");
+	while (content->len < LONG_LINE_SIZE)
+	{
+		g_string_append (content, "abcdé");
+	}
+	g_string_append (content, "end\nlast line\n");
+
+	location = g_file_new_build_filename (g_get_tmp_dir (), "tepl-file-viewer-test", NULL);
+	_tepl_test_utils_set_file_content (location, content->str);
+	g_string_free (content, TRUE);
+
+	viewer = tepl_file_viewer_new (view);
+	tepl_file_viewer_open_async (viewer, location, G_PRIORITY_DEFAULT, NULL, open_sync_cb, NULL);
+	gtk_main ();
+
+	/* Only a part of the long line. */
+	g_assert_cmpint (gtk_text_buffer_get_line_count (buffer), ==, 1);
+	g_assert_true (buffer_starts_with (buffer, "start"));
+
+	/* Scroll until the end of the long line. */
+	for (i = 0; gtk_text_buffer_get_line_count (buffer) == 1; i++)
+	{
+		g_assert_cmpint (i, <, 20);
+
+		gtk_text_buffer_get_end_iter (buffer, &iter);
+		scroll_to_iter (viewer, buffer, &iter);
+
+		g_assert_cmpint (tepl_file_viewer_get_window_first_line (viewer), ==, 0);
+		g_assert_false (buffer_starts_with (buffer, "start"));
+	}
+
+	gtk_text_buffer_get_iter_at_line (buffer, &end, 0);
+	gtk_text_iter_forward_to_line_end (&end);
+	iter = end;
+	g_assert_true (gtk_text_iter_backward_chars (&iter, 8));
+	text = gtk_text_iter_get_text (&iter, &end);
+	g_assert_cmpstr (text, ==, "abcdéend");
+	g_free (text);
+
+	gtk_text_buffer_get_iter_at_line (buffer, &iter, 1);
+	end = iter;
+	gtk_text_iter_forward_to_line_end (&end);
+	text = gtk_text_iter_get_text (&iter, &end);
+	g_assert_cmpstr (text, ==, "last line");
+	g_free (text);
+
+	/* No character has been cut into invalid bytes. */
+	gtk_text_buffer_get_start_iter (buffer, &iter);
+	g_assert_false (gtk_text_iter_forward_search (&iter, "\xEF\xBF\xBD", 0, NULL, NULL, NULL));
+
+	/* Scroll back to the start of the long line. */
+	for (i = 0; !buffer_starts_with (buffer, "start"); i++)
+	{
+		g_assert_cmpint (i, <, 20);
+
+		gtk_text_buffer_get_start_iter (buffer, &iter);
+		scroll_to_iter (viewer, buffer, &iter);
+
+		g_assert_cmpint (tepl_file_viewer_get_window_first_line (viewer), ==, 0);
+	}
+
+	g_object_unref (viewer);
+	g_file_delete (location, NULL, NULL);
+	g_object_unref (location);
+	g_object_unref (view);
+}
+
+gint
+main (gint    argc,
+      gchar **argv)
+{
+	gtk_test_init (&argc, &argv);
+
+	g_test_add_func ("/file_viewer/open", test_open);
+	g_test_add_func ("/file_viewer/long_line", test_long_line);
+
+	return g_test_run ();
+}
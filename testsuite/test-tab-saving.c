@@ -0,0 +1,426 @@
+/* SPDX-FileCopyrightText: 2020 - Sébastien Wilmet <swilmet@gnome.org>
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <tepl/tepl.h>
+#include <string.h>
+#include "tepl-test-utils.h"
+
+/* There is no GApplication in these tests, the saves must work without it. */
+
+typedef struct _SaveAllResult SaveAllResult;
+struct _SaveAllResult
+{
+	gboolean finished;
+	gboolean ok;
+	GList *failed_tabs;
+	GError *error;
+
+	guint n_devices;
+	guint max_running_saves;
+	guint max_running_saves_per_device;
+};
+
+static void
+save_all_cb (GObject      *source_object,
+	     GAsyncResult *result,
+	     gpointer      user_data)
+{
+	TeplTabGroup *tab_group = TEPL_TAB_GROUP (source_object);
+	SaveAllResult *save_all_result = user_data;
+
+	_tepl_tab_group_save_all_get_stats (result,
+					    &save_all_result->n_devices,
+					    &save_all_result->max_running_saves,
+					    &save_all_result->max_running_saves_per_device);
+
+	save_all_result->ok = tepl_tab_group_save_all_finish (tab_group,
+							      result,
+							      &save_all_result->failed_tabs,
+							      &save_all_result->error);
+	save_all_result->finished = TRUE;
+}
+
+static void
+save_all_result_clear (SaveAllResult *save_all_result)
+{
+	g_list_free_full (save_all_result->failed_tabs, g_object_unref);
+	g_clear_error (&save_all_result->error);
+}
+
+static void
+save_all_sync (TeplTabGroup  *tab_group,
+	       guint          max_concurrent_saves,
+	       SaveAllResult *save_all_result)
+{
+	save_all_result->finished = FALSE;
+
+	tepl_tab_group_save_all_async (tab_group,
+				       max_concurrent_saves,
+				       NULL,
+				       save_all_cb,
+				       save_all_result);
+
+	while (!save_all_result->finished)
+	{
+		g_main_context_iteration (NULL, TRUE);
+	}
+}
+
+static TeplTabGroup *
+create_tab_group (void)
+{
+	GtkWidget *notebook;
+
+	notebook = tepl_notebook_new ();
+	g_object_ref_sink (notebook);
+
+	return TEPL_TAB_GROUP (notebook);
+}
+
+/* @location can be %NULL, for an untitled document. */
+static TeplTab *
+add_tab (TeplTabGroup *tab_group,
+	 GFile        *location,
+	 const gchar  *content)
+{
+	TeplTab *tab;
+	TeplBuffer *buffer;
+
+	tab = tepl_tab_new ();
+	gtk_widget_show (GTK_WIDGET (tab));
+	tepl_tab_group_append_tab (tab_group, tab, FALSE);
+
+	buffer = tepl_tab_get_buffer (tab);
+	tepl_file_set_location (tepl_buffer_get_file (buffer), location);
+	gtk_text_buffer_set_text (GTK_TEXT_BUFFER (buffer), content, -1);
+
+	return tab;
+}
+
+static GFile *
+get_tmp_location (gint num)
+{
+	GFile *location;
+	gchar *basename;
+
+	basename = g_strdup_printf ("tepl-tab-saving-test-%d", num);
+	location = g_file_new_build_filename (g_get_tmp_dir (), basename, NULL);
+	g_free (basename);
+
+	return location;
+}
+
+/* All the tabs are on the same device, the queue is drained one save at a
+ * time.
+ */
+static void
+test_save_all_queue (void)
+{
+	TeplTabGroup *tab_group;
+	TeplTab *not_modified_tab;
+	TeplTab *untitled_tab;
+	SaveAllResult result = { 0 };
+	GFile *locations[5];
+	GFile *not_modified_location;
+	gint i;
+
+	tab_group = create_tab_group ();
+
+	for (i = 0; i < (gint) G_N_ELEMENTS (locations); i++)
+	{
+		gchar *content;
+
+		locations[i] = get_tmp_location (i);
+		g_file_delete (locations[i], NULL, NULL);
+
+		content = g_strdup_printf ("content %d", i);
+		add_tab (tab_group, locations[i], content);
+		g_free (content);
+	}
+
+	not_modified_location = get_tmp_location (G_N_ELEMENTS (locations));
+	g_file_delete (not_modified_location, NULL, NULL);
+	not_modified_tab = add_tab (tab_group, not_modified_location, "not modified");
+	gtk_text_buffer_set_modified (GTK_TEXT_BUFFER (tepl_tab_get_buffer (not_modified_tab)), FALSE);
+	untitled_tab = add_tab (tab_group, NULL, "untitled");
+
+	save_all_sync (tab_group, 1, &result);
+	g_assert_true (result.ok);
+	g_assert_no_error (result.error);
+	g_assert_null (result.failed_tabs);
+	g_assert_cmpuint (result.n_devices, ==, 1);
+	g_assert_cmpuint (result.max_running_saves, ==, 1);
+	g_assert_cmpuint (result.max_running_saves_per_device, ==, 1);
+
+	for (i = 0; i < (gint) G_N_ELEMENTS (locations); i++)
+	{
+		gchar *content;
+
+		content = g_strdup_printf ("content %d", i);
+		_tepl_test_utils_check_file_content (locations[i], content);
+		g_free (content);
+
+		g_file_delete (locations[i], NULL, NULL);
+		g_object_unref (locations[i]);
+	}
+
+	g_assert_false (g_file_query_exists (not_modified_location, NULL));
+	g_assert_true (gtk_text_buffer_get_modified (GTK_TEXT_BUFFER (tepl_tab_get_buffer (untitled_tab))));
+	g_object_unref (not_modified_location);
+
+	/* Nothing to save. */
+	save_all_sync (tab_group, 0, &result);
+	g_assert_true (result.ok);
+	g_assert_cmpuint (result.n_devices, ==, 0);
+	g_assert_cmpuint (result.max_running_saves, ==, 0);
+
+	save_all_result_clear (&result);
+	g_object_unref (tab_group);
+}
+
+/* The fake locations are grouped by URI scheme, and their saves fail. */
+static void
+test_save_all_devices (void)
+{
+	TeplTabGroup *tab_group;
+	SaveAllResult result = { 0 };
+	const guint n_devices = 5;
+	const guint n_tabs_per_device = 3;
+	guint device_num;
+	guint tab_num;
+
+	tab_group = create_tab_group ();
+
+	for (tab_num = 0; tab_num < n_tabs_per_device; tab_num++)
+	{
+		for (device_num = 0; device_num < n_devices; device_num++)
+		{
+			gchar *uri;
+			GFile *location;
+
+			uri = g_strdup_printf ("tepl-test-fake-%u:///document-%u", device_num, tab_num);
+			location = g_file_new_for_uri (uri);
+			add_tab (tab_group, location, "content");
+
+			g_free (uri);
+			g_object_unref (location);
+		}
+	}
+
+	save_all_sync (tab_group, 2, &result);
+	g_assert_false (result.ok);
+	g_assert_cmpuint (result.n_devices, ==, n_devices);
+	g_assert_cmpuint (result.max_running_saves_per_device, ==, 2);
+
+	/* The global limit. */
+	g_assert_cmpuint (result.max_running_saves, ==, 8);
+
+	/* The error summary. */
+	g_assert_error (result.error, G_IO_ERROR, G_IO_ERROR_FAILED);
+	g_assert_true (g_str_has_prefix (result.error->message, "15 documents could not be saved:\n"));
+	g_assert_nonnull (strstr (result.error->message, "document-2"));
+	g_assert_cmpuint (g_list_length (result.failed_tabs), ==, n_devices * n_tabs_per_device);
+
+	save_all_result_clear (&result);
+	g_object_unref (tab_group);
+}
+
+static GtkInfoBar *
+get_info_bar (TeplTab *tab)
+{
+	GList *children;
+	GList *l;
+	GtkInfoBar *info_bar = NULL;
+
+	children = gtk_container_get_children (GTK_CONTAINER (tab));
+
+	for (l = children; l != NULL; l = l->next)
+	{
+		if (GTK_IS_INFO_BAR (l->data))
+		{
+			info_bar = l->data;
+			break;
+		}
+	}
+
+	g_list_free (children);
+	return info_bar;
+}
+
+/* The info bar asking to save anyway is destroyed without a response. */
+static void
+test_save_all_info_bar_destroyed (void)
+{
+	TeplTabGroup *tab_group;
+	TeplTab *tab;
+	SaveAllResult result = { 0 };
+	GFile *location;
+	GtkInfoBar *info_bar;
+
+	tab_group = create_tab_group ();
+
+	location = get_tmp_location (0);
+	tab = add_tab (tab_group, location, "日本語");
+	_tepl_file_set_charset (tepl_buffer_get_file (tepl_tab_get_buffer (tab)), "ISO-8859-1");
+
+	tepl_tab_group_save_all_async (tab_group, 0, NULL, save_all_cb, &result);
+
+	while ((info_bar = get_info_bar (tab)) == NULL)
+	{
+		g_main_context_iteration (NULL, TRUE);
+	}
+
+	g_assert_false (result.finished);
+	gtk_widget_destroy (GTK_WIDGET (info_bar));
+
+	while (!result.finished)
+	{
+		g_main_context_iteration (NULL, TRUE);
+	}
+
+	g_assert_false (result.ok);
+	g_assert_error (result.error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+	g_assert_cmpuint (g_list_length (result.failed_tabs), ==, 1);
+	g_assert_true (result.failed_tabs->data == tab);
+
+	g_file_delete (location, NULL, NULL);
+	g_object_unref (location);
+	save_all_result_clear (&result);
+	g_object_unref (tab_group);
+}
+
+/* A tab waiting for the user doesn't keep its slot, and is saved when the user
+ * chooses to save anyway.
+ */
+static void
+test_save_all_save_anyway (void)
+{
+	TeplTabGroup *tab_group;
+	TeplTab *unconvertible_tab;
+	TeplTab *other_tab;
+	SaveAllResult result = { 0 };
+	GFile *unconvertible_location;
+	GFile *other_location;
+	GtkInfoBar *info_bar;
+
+	tab_group = create_tab_group ();
+
+	unconvertible_location = get_tmp_location (0);
+	g_file_delete (unconvertible_location, NULL, NULL);
+	unconvertible_tab = add_tab (tab_group, unconvertible_location, "日本語");
+	_tepl_file_set_charset (tepl_buffer_get_file (tepl_tab_get_buffer (unconvertible_tab)), "ISO-8859-1");
+
+	other_location = get_tmp_location (1);
+	g_file_delete (other_location, NULL, NULL);
+	other_tab = add_tab (tab_group, other_location, "other");
+
+	/* One slot, the same device. */
+	tepl_tab_group_save_all_async (tab_group, 1, NULL, save_all_cb, &result);
+
+	while ((info_bar = get_info_bar (unconvertible_tab)) == NULL)
+	{
+		g_main_context_iteration (NULL, TRUE);
+	}
+
+	while (gtk_text_buffer_get_modified (GTK_TEXT_BUFFER (tepl_tab_get_buffer (other_tab))))
+	{
+		g_main_context_iteration (NULL, TRUE);
+	}
+
+	_tepl_test_utils_check_file_content (other_location, "other");
+	g_assert_false (result.finished);
+
+	gtk_info_bar_response (info_bar, GTK_RESPONSE_YES);
+
+	while (!result.finished)
+	{
+		g_main_context_iteration (NULL, TRUE);
+	}
+
+	g_assert_true (result.ok);
+	g_assert_no_error (result.error);
+	g_assert_null (result.failed_tabs);
+	g_assert_cmpuint (result.max_running_saves, ==, 1);
+	g_assert_true (g_file_query_exists (unconvertible_location, NULL));
+
+	g_file_delete (unconvertible_location, NULL, NULL);
+	g_file_delete (other_location, NULL, NULL);
+	g_object_unref (unconvertible_location);
+	g_object_unref (other_location);
+	save_all_result_clear (&result);
+	g_object_unref (tab_group);
+}
+
+/* Cancelled while the user is asked to save anyway. */
+static void
+test_save_all_cancel (void)
+{
+	TeplTabGroup *tab_group;
+	TeplTab *tab;
+	SaveAllResult result = { 0 };
+	GCancellable *cancellable;
+	GFile *location;
+
+	tab_group = create_tab_group ();
+
+	location = get_tmp_location (0);
+	g_file_delete (location, NULL, NULL);
+	tab = add_tab (tab_group, location, "日本語");
+	_tepl_file_set_charset (tepl_buffer_get_file (tepl_tab_get_buffer (tab)), "ISO-8859-1");
+
+	cancellable = g_cancellable_new ();
+	tepl_tab_group_save_all_async (tab_group, 0, cancellable, save_all_cb, &result);
+
+	while (get_info_bar (tab) == NULL)
+	{
+		g_main_context_iteration (NULL, TRUE);
+	}
+
+	g_cancellable_cancel (cancellable);
+
+	while (!result.finished)
+	{
+		g_main_context_iteration (NULL, TRUE);
+	}
+
+	g_assert_false (result.ok);
+	g_assert_error (result.error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+	g_assert_cmpuint (g_list_length (result.failed_tabs), ==, 1);
+	g_assert_null (get_info_bar (tab));
+	g_assert_false (g_file_query_exists (location, NULL));
+	save_all_result_clear (&result);
+
+	/* Already cancelled: nothing is saved. */
+	result.finished = FALSE;
+	tepl_tab_group_save_all_async (tab_group, 0, cancellable, save_all_cb, &result);
+
+	while (!result.finished)
+	{
+		g_main_context_iteration (NULL, TRUE);
+	}
+
+	g_assert_error (result.error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+	g_assert_cmpuint (g_list_length (result.failed_tabs), ==, 1);
+	g_assert_false (g_file_query_exists (location, NULL));
+
+	g_object_unref (cancellable);
+	g_object_unref (location);
+	save_all_result_clear (&result);
+	g_object_unref (tab_group);
+}
+
+gint
+main (gint    argc,
+      gchar **argv)
+{
+	gtk_test_init (&argc, &argv);
+
+	g_test_add_func ("/tab-saving/save_all_queue", test_save_all_queue);
+	g_test_add_func ("/tab-saving/save_all_devices", test_save_all_devices);
+	g_test_add_func ("/tab-saving/save_all_info_bar_destroyed", test_save_all_info_bar_destroyed);
+	g_test_add_func ("/tab-saving/save_all_save_anyway", test_save_all_save_anyway);
+	g_test_add_func ("/tab-saving/save_all_cancel", test_save_all_cancel);
+
+	return g_test_run ();
+}
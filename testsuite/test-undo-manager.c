@@ -0,0 +1,272 @@
+/* SPDX-FileCopyrightText: 2020 - Sébastien Wilmet <swilmet@gnome.org>
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <tepl/tepl.h>
+#include <string.h>
+
+static TeplUndoManager *
+get_undo_manager (TeplBuffer *buffer)
+{
+	GtkSourceUndoManager *undo_manager;
+
+	undo_manager = gtk_source_buffer_get_undo_manager (GTK_SOURCE_BUFFER (buffer));
+	g_assert_true (TEPL_IS_UNDO_MANAGER (undo_manager));
+
+	return TEPL_UNDO_MANAGER (undo_manager);
+}
+
+static void
+check_text (TeplBuffer  *buffer,
+	    const gchar *expected_text)
+{
+	GtkTextIter start;
+	GtkTextIter end;
+	gchar *text;
+
+	gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (buffer), &start, &end);
+	text = gtk_text_buffer_get_text (GTK_TEXT_BUFFER (buffer), &start, &end, TRUE);
+	g_assert_cmpstr (text, ==, expected_text);
+	g_free (text);
+}
+
+static void
+type_text (TeplBuffer  *buffer,
+	   const gchar *text)
+{
+	const gchar *p;
+
+	for (p = text; *p != '\0'; p = g_utf8_next_char (p))
+	{
+		gtk_text_buffer_insert_interactive_at_cursor (GTK_TEXT_BUFFER (buffer),
+							      p,
+							      g_utf8_next_char (p) - p,
+							      TRUE);
+	}
+}
+
+static void
+delete_range (TeplBuffer *buffer,
+	      gint        start_offset,
+	      gint        end_offset)
+{
+	GtkTextIter start;
+	GtkTextIter end;
+
+	gtk_text_buffer_get_iter_at_offset (GTK_TEXT_BUFFER (buffer), &start, start_offset);
+	gtk_text_buffer_get_iter_at_offset (GTK_TEXT_BUFFER (buffer), &end, end_offset);
+	gtk_text_buffer_delete_interactive (GTK_TEXT_BUFFER (buffer), &start, &end, TRUE);
+}
+
+static void
+test_undo_redo (void)
+{
+	TeplBuffer *buffer;
+	GtkSourceBuffer *gsv_buffer;
+	GtkTextBuffer *text_buffer;
+	GtkTextIter iter;
+
+	buffer = tepl_buffer_new ();
+	gsv_buffer = GTK_SOURCE_BUFFER (buffer);
+	text_buffer = GTK_TEXT_BUFFER (buffer);
+
+	gtk_source_buffer_begin_not_undoable_action (gsv_buffer);
+	gtk_text_buffer_set_text (text_buffer, "Hello world", -1);
+	gtk_source_buffer_end_not_undoable_action (gsv_buffer);
+	gtk_text_buffer_set_modified (text_buffer, FALSE);
+	g_assert_false (gtk_source_buffer_can_undo (gsv_buffer));
+
+	/* One step. */
+	gtk_text_buffer_begin_user_action (text_buffer);
+	gtk_text_buffer_get_iter_at_offset (text_buffer, &iter, 5);
+	gtk_text_buffer_insert (text_buffer, &iter, ", big", -1);
+	gtk_text_buffer_get_start_iter (text_buffer, &iter);
+	gtk_text_buffer_insert (text_buffer, &iter, "«", -1);
+	gtk_text_buffer_end_user_action (text_buffer);
+	check_text (buffer, "«Hello, big world");
+
+	delete_range (buffer, 7, 11);
+	check_text (buffer, "«Hello, world");
+	g_assert_true (gtk_source_buffer_can_undo (gsv_buffer));
+	g_assert_false (gtk_source_buffer_can_redo (gsv_buffer));
+
+	gtk_source_buffer_undo (gsv_buffer);
+	check_text (buffer, "«Hello, big world");
+	g_assert_true (gtk_source_buffer_can_redo (gsv_buffer));
+
+	gtk_source_buffer_undo (gsv_buffer);
+	check_text (buffer, "Hello world");
+	g_assert_false (gtk_source_buffer_can_undo (gsv_buffer));
+	g_assert_false (gtk_text_buffer_get_modified (text_buffer));
+
+	gtk_source_buffer_redo (gsv_buffer);
+	check_text (buffer, "«Hello, big world");
+	g_assert_true (gtk_text_buffer_get_modified (text_buffer));
+
+	/* Saved state. */
+	gtk_text_buffer_set_modified (text_buffer, FALSE);
+
+	gtk_source_buffer_redo (gsv_buffer);
+	check_text (buffer, "«Hello, world");
+	g_assert_true (gtk_text_buffer_get_modified (text_buffer));
+
+	gtk_source_buffer_undo (gsv_buffer);
+	g_assert_false (gtk_text_buffer_get_modified (text_buffer));
+
+	/* A new edit discards the redo steps. */
+	gtk_text_buffer_get_end_iter (text_buffer, &iter);
+	gtk_text_buffer_insert (text_buffer, &iter, "!", -1);
+	g_assert_false (gtk_source_buffer_can_redo (gsv_buffer));
+
+	gtk_source_buffer_undo (gsv_buffer);
+	check_text (buffer, "«Hello, big world");
+	g_assert_false (gtk_text_buffer_get_modified (text_buffer));
+
+	g_object_unref (buffer);
+}
+
+static void
+test_typing (void)
+{
+	TeplBuffer *buffer;
+	GtkSourceBuffer *gsv_buffer;
+
+	buffer = tepl_buffer_new ();
+	gsv_buffer = GTK_SOURCE_BUFFER (buffer);
+
+	type_text (buffer, "été fini");
+	check_text (buffer, "été fini");
+
+	gtk_source_buffer_undo (gsv_buffer);
+	check_text (buffer, "été ");
+
+	gtk_source_buffer_undo (gsv_buffer);
+	check_text (buffer, "");
+	g_assert_false (gtk_source_buffer_can_undo (gsv_buffer));
+
+	gtk_source_buffer_redo (gsv_buffer);
+	gtk_source_buffer_redo (gsv_buffer);
+	check_text (buffer, "été fini");
+
+	/* Backspace. */
+	delete_range (buffer, 7, 8);
+	delete_range (buffer, 6, 7);
+	delete_range (buffer, 5, 6);
+	check_text (buffer, "été f");
+
+	/* Delete key. */
+	delete_range (buffer, 0, 1);
+	delete_range (buffer, 0, 1);
+	check_text (buffer, "é f");
+
+	gtk_source_buffer_undo (gsv_buffer);
+	check_text (buffer, "été f");
+
+	gtk_source_buffer_undo (gsv_buffer);
+	check_text (buffer, "été fini");
+
+	/* A newline is a separate step. */
+	type_text (buffer, "\nab");
+	gtk_source_buffer_undo (gsv_buffer);
+	check_text (buffer, "été fini\n");
+	gtk_source_buffer_undo (gsv_buffer);
+	check_text (buffer, "été fini");
+
+	g_object_unref (buffer);
+}
+
+static gchar *
+create_big_text (gsize size)
+{
+	GString *text;
+
+	text = g_string_sized_new (size);
+
+	while (text->len < size)
+	{
+		g_string_append (text, "A compressible line of text.\n");
+	}
+
+	return g_string_free (text, FALSE);
+}
+
+static void
+test_memory_budget (void)
+{
+	TeplBuffer *buffer;
+	GtkSourceBuffer *gsv_buffer;
+	GtkTextBuffer *text_buffer;
+	TeplUndoManager *undo_manager;
+	GtkTextIter iter;
+	gchar *big_text;
+	gsize big_text_size;
+	gint big_text_n_chars;
+	gint i;
+
+	buffer = tepl_buffer_new ();
+	gsv_buffer = GTK_SOURCE_BUFFER (buffer);
+	text_buffer = GTK_TEXT_BUFFER (buffer);
+	undo_manager = get_undo_manager (buffer);
+
+	big_text = create_big_text (1024 * 1024);
+	big_text_size = strlen (big_text);
+	big_text_n_chars = g_utf8_strlen (big_text, -1);
+
+	/* The inserted text is in the buffer, it is not kept. */
+	gtk_text_buffer_get_start_iter (text_buffer, &iter);
+	gtk_text_buffer_insert_interactive (text_buffer, &iter, big_text, -1, TRUE);
+	g_assert_cmpuint (tepl_undo_manager_get_memory_usage (undo_manager), <, 1024);
+
+	/* The deleted text is kept once, and then compressed. */
+	delete_range (buffer, 0, big_text_n_chars);
+	g_assert_cmpuint (tepl_undo_manager_get_memory_usage (undo_manager), >=, big_text_size);
+
+	while (tepl_undo_manager_get_memory_usage (undo_manager) >= big_text_size / 2)
+	{
+		g_main_context_iteration (NULL, TRUE);
+	}
+
+	gtk_source_buffer_undo (gsv_buffer);
+	check_text (buffer, big_text);
+
+	gtk_source_buffer_undo (gsv_buffer);
+	check_text (buffer, "");
+
+	/* Eviction of the oldest steps. */
+	tepl_undo_manager_set_memory_budget (undo_manager, 4 * 1024);
+
+	for (i = 0; i < 100; i++)
+	{
+		gtk_text_buffer_get_start_iter (text_buffer, &iter);
+		gtk_text_buffer_insert_interactive (text_buffer, &iter, "0123456789", -1, TRUE);
+		delete_range (buffer, 0, 10);
+	}
+
+	g_assert_cmpuint (tepl_undo_manager_get_memory_usage (undo_manager), <=, 4 * 1024);
+
+	/* The last step is kept even if it exceeds the budget. */
+	gtk_text_buffer_get_start_iter (text_buffer, &iter);
+	gtk_text_buffer_insert_interactive (text_buffer, &iter, big_text, -1, TRUE);
+	delete_range (buffer, 0, big_text_n_chars);
+	g_assert_cmpuint (tepl_undo_manager_get_memory_usage (undo_manager), >, 4 * 1024);
+
+	gtk_source_buffer_undo (gsv_buffer);
+	check_text (buffer, big_text);
+	g_assert_false (gtk_source_buffer_can_undo (gsv_buffer));
+
+	g_free (big_text);
+	g_object_unref (buffer);
+}
+
+gint
+main (gint    argc,
+      gchar **argv)
+{
+	gtk_test_init (&argc, &argv);
+
+	g_test_add_func ("/undo-manager/undo_redo", test_undo_redo);
+	g_test_add_func ("/undo-manager/typing", test_typing);
+	g_test_add_func ("/undo-manager/memory_budget", test_memory_budget);
+
+	return g_test_run ();
+}